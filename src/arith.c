@@ -350,6 +350,18 @@ doubleToTimeInternal(const double d)
 
 }
 
+/* qsort() comparator for doubles, ascending */
+int
+cmpDouble(const void *vA, const void *vB)
+{
+
+	double a = *(double*)vA;
+	double b = *(double*)vB;
+
+	return ((a < b) ? -1 : (a > b) ? 1 : 0);
+
+}
+
 /* FNV-1 hash, 32-bit, optional modulo limiter */
 uint32_t
 fnvHash(void *input, size_t len, int modulo)
@@ -0,0 +1,295 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   bench.c
+ * @date   Mon Apr 4 10:12:40 2016
+ *
+ * @brief  Micro-benchmark harness and main() of ptpd2-bench
+ *
+ * ptpd2-bench links against the same objects as ptpd2, minus ptpd.c,
+ * so it provides the globals ptpd.c would. Heap allocations are counted
+ * by wrapping malloc(), calloc() and realloc() at link time where the
+ * linker supports it - otherwise allocs/op is reported as "-".
+ */
+
+#include "bench.h"
+
+#include <getopt.h>
+
+/* normally provided by ptpd.c */
+RunTimeOpts rtOpts;
+Boolean startupInProgress;
+PTPD_THREAD_LOCAL PtpClock *G_ptpClock = NULL;
+TimingDomain timingDomain;
+
+volatile double benchSink;
+
+/* minimum duration of a measured run, seconds */
+static double benchTime = 0.5;
+static char **benchPatterns = NULL;
+static int benchPatternCount = 0;
+static Boolean benchListOnly = FALSE;
+
+static unsigned long allocCount = 0;
+
+/*
+ * Linked with -Wl,--wrap=malloc (BENCH_LDFLAGS, when configure found the
+ * linker supports it), every malloc() call from the objects under test
+ * lands in __wrap_malloc(), and __real_malloc is malloc() itself. Without
+ * it, the weak __real_ references stay NULL and the wrappers are unused.
+ */
+extern void *__real_malloc(size_t size) __attribute__((weak));
+extern void *__real_calloc(size_t nmemb, size_t size) __attribute__((weak));
+extern void *__real_realloc(void *ptr, size_t size) __attribute__((weak));
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+	allocCount++;
+	return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+	allocCount++;
+	return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+	allocCount++;
+	return __real_realloc(ptr, size);
+}
+
+static Boolean
+allocCounting(void)
+{
+	return __real_malloc != NULL;
+}
+
+static double
+benchNow(struct timespec *ts)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	return ts->tv_sec + ts->tv_nsec / 1E9;
+}
+
+void
+benchStart(BenchRun *b)
+{
+	b->allocsStarted = allocCount;
+	benchNow(&b->started);
+}
+
+void
+benchStop(BenchRun *b)
+{
+	struct timespec now;
+
+	benchNow(&now);
+	b->elapsed = (now.tv_sec - b->started.tv_sec) +
+		     (now.tv_nsec - b->started.tv_nsec) / 1E9;
+	b->allocs = allocCount - b->allocsStarted;
+}
+
+void
+benchFail(BenchRun *b, const char *reason)
+{
+	b->failed = TRUE;
+	fprintf(stderr, "benchmark failed: %s\n", reason);
+}
+
+static Boolean
+benchSelected(const char *name)
+{
+	int i;
+
+	if(benchPatternCount == 0) {
+		return TRUE;
+	}
+
+	for(i = 0; i < benchPatternCount; i++) {
+		if(strstr(name, benchPatterns[i]) != NULL) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void
+benchRun(const char *name, BenchFunc func, const void *arg)
+{
+	BenchRun b;
+	long n = 1;
+
+	if(!benchSelected(name)) {
+		return;
+	}
+
+	if(benchListOnly) {
+		printf("%s\n", name);
+		return;
+	}
+
+	for(;;) {
+		memset(&b, 0, sizeof(b));
+		b.iterations = n;
+		func(&b, arg);
+		if(b.failed) {
+			printf("%-44s FAILED\n", name);
+			return;
+		}
+		if(b.elapsed >= benchTime || n >= 1000000000L) {
+			break;
+		}
+		/* aim for 1.2 x the minimum time, but grow at most 100 times per round */
+		if(b.elapsed <= 0) {
+			n *= 100;
+		} else {
+			long next = (long)(n * 1.2 * benchTime / b.elapsed);
+			n = (next > n * 100) ? n * 100 : ((next <= n) ? n + 1 : next);
+		}
+	}
+
+	printf("%-44s %11ld %12.1f ns/op", name, b.iterations,
+	    b.elapsed * 1E9 / b.iterations);
+	if(allocCounting()) {
+		printf(" %10.2f allocs/op\n", (double)b.allocs / b.iterations);
+	} else {
+		printf(" %10s allocs/op\n", "-");
+	}
+	fflush(stdout);
+}
+
+PtpClock*
+benchCreateClock(void)
+{
+	PtpClock *ptpClock;
+	int i;
+
+	if((ptpClock = (PtpClock*)calloc(1, sizeof(PtpClock))) == NULL) {
+		return NULL;
+	}
+
+	if((ptpClock->foreign = (ForeignMasterRecord*)calloc(rtOpts.max_foreign_records,
+	    sizeof(ForeignMasterRecord))) == NULL ||
+	    !allocUnicastGrantTable(ptpClock, rtOpts.unicastGrantTableSize)) {
+		free(ptpClock->foreign);
+		free(ptpClock);
+		return NULL;
+	}
+
+	ptpClock->rtOpts = &rtOpts;
+	ptpClock->msgIbuf = ptpClock->msgIbufStorage;
+
+	/* a made up MAC address */
+	for(i = 0; i < sizeof(ptpClock->netPath.interfaceID) && i < 6; i++) {
+		ptpClock->netPath.interfaceID[i] = 0x02 + i * 0x11;
+	}
+
+	initData(&rtOpts, ptpClock);
+	G_ptpClock = ptpClock;
+
+	return ptpClock;
+}
+
+void
+benchFreeClock(PtpClock *ptpClock)
+{
+	if(ptpClock == NULL) {
+		return;
+	}
+
+	if(G_ptpClock == ptpClock) {
+		G_ptpClock = NULL;
+	}
+
+	freeUnicastGrantTable(ptpClock);
+	free(ptpClock->foreign);
+	free(ptpClock);
+}
+
+static void
+usage(const char *name)
+{
+	printf("usage: %s [-t seconds] [-l] [pattern ...]\n"
+	       "\n"
+	       "  -t seconds  minimum duration of a measured run (default %.1f)\n"
+	       "  -l          list benchmarks instead of running them\n"
+	       "  pattern     only run benchmarks whose name contains one of the patterns\n"
+	       "\n"
+	       "Output: name, iterations, time per operation, heap allocations per operation\n",
+	       name, benchTime);
+}
+
+int
+main(int argc, char **argv)
+{
+	int c;
+
+	while((c = getopt(argc, argv, "t:lh")) != -1) {
+		switch(c) {
+		case 't':
+			benchTime = strtod(optarg, NULL);
+			if(benchTime <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'l':
+			benchListOnly = TRUE;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return (c == 'h') ? 0 : 1;
+		}
+	}
+
+	benchPatterns = argv + optind;
+	benchPatternCount = argc - optind;
+
+	loadDefaultSettings(&rtOpts);
+	/* keep the code under test quiet */
+	rtOpts.logLevel = LOG_ERR;
+	rtOpts.nonDaemon = TRUE;
+
+	benchMsg();
+	benchStats();
+	benchBmc();
+	benchLookup();
+
+	return 0;
+}
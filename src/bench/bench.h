@@ -0,0 +1,80 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   bench.h
+ * @date   Mon Apr 4 10:12:40 2016
+ *
+ * @brief  Micro-benchmark harness definitions
+ *
+ * A benchmark is a function which does its setup, calls benchStart(),
+ * runs the operation under test b->iterations times, calls benchStop()
+ * and cleans up. The harness keeps calling it with a growing iteration
+ * count until one run takes at least the minimum benchmark time, and
+ * reports time and heap allocations per operation for that run.
+ */
+
+#ifndef PTPD_BENCH_H_
+#define PTPD_BENCH_H_
+
+#include "../ptpd.h"
+
+typedef struct {
+	long iterations;
+	struct timespec started;
+	double elapsed;		/* seconds between benchStart() and benchStop() */
+	unsigned long allocs;	/* allocations between benchStart() and benchStop() */
+	unsigned long allocsStarted;
+	Boolean failed;
+} BenchRun;
+
+typedef void (*BenchFunc)(BenchRun *b, const void *arg);
+
+/* run a benchmark unless its name is filtered out */
+void benchRun(const char *name, BenchFunc func, const void *arg);
+void benchStart(BenchRun *b);
+void benchStop(BenchRun *b);
+/* abort the current benchmark: the result is not reported */
+void benchFail(BenchRun *b, const char *reason);
+
+/* a fresh port in its initial state, with default settings */
+PtpClock* benchCreateClock(void);
+void benchFreeClock(PtpClock *ptpClock);
+
+/* the run-time options every benchmark uses: defaults, loaded once */
+extern RunTimeOpts rtOpts;
+
+/* defeat dead code elimination of results */
+extern volatile double benchSink;
+
+/* benchmark groups */
+void benchMsg(void);
+void benchStats(void);
+void benchBmc(void);
+void benchLookup(void);
+
+#endif /* PTPD_BENCH_H_ */
@@ -0,0 +1,157 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   bench_bmc.c
+ * @date   Mon Apr 4 10:12:40 2016
+ *
+ * @brief  Best master clock benchmarks
+ *
+ * bmcDataSetComparison() is internal to bmc.c, so it is measured through
+ * bmc(): one run is a full pass over the foreign master table, n - 1
+ * data set comparisons, plus the state decision for the winner.
+ * The ns/op figure is per bmc() call, not per comparison.
+ */
+
+#include "bench.h"
+
+typedef struct {
+	int records;
+	Boolean sameGrandmaster;	/* all records announce one GM over different paths */
+} BmcBenchConfig;
+
+static void
+fillForeignTable(ForeignMasterRecord *foreign, const BmcBenchConfig *config, PtpClock *ptpClock)
+{
+	uint32_t state = 88172645U;
+	int i;
+
+	for(i = 0; i < config->records; i++) {
+
+		ForeignMasterRecord *record = &foreign[i];
+		MsgAnnounce *announce = &record->announce;
+
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		memset(record, 0, sizeof(ForeignMasterRecord));
+
+		record->header.messageType = ANNOUNCE;
+		record->header.versionPTP = ptpClock->portDS.versionNumber;
+		record->header.domainNumber = ptpClock->defaultDS.domainNumber;
+		record->header.logMessageInterval = ptpClock->portDS.logAnnounceInterval;
+		memset(record->header.sourcePortIdentity.clockIdentity, 0x10, CLOCK_IDENTITY_LENGTH);
+		record->header.sourcePortIdentity.clockIdentity[6] = (i >> 8) & 0xFF;
+		record->header.sourcePortIdentity.clockIdentity[7] = i & 0xFF;
+		record->header.sourcePortIdentity.portNumber = 1 + (state & 0x3);
+		copyPortIdentity(&record->foreignMasterPortIdentity, &record->header.sourcePortIdentity);
+		record->foreignMasterAnnounceMessages = DEFAULT_FOREIGN_MASTER_THRESHOLD;
+		record->localPreference = LOWEST_LOCALPREFERENCE;
+		record->sourceAddr = htonl(0x0A000000 + i);
+
+		if(config->sameGrandmaster) {
+			memset(announce->grandmasterIdentity, 0x20, CLOCK_IDENTITY_LENGTH);
+			announce->grandmasterPriority1 = 128;
+			announce->grandmasterPriority2 = 128;
+			announce->grandmasterClockQuality.clockClass = 6;
+			announce->grandmasterClockQuality.clockAccuracy = 0x21;
+			announce->grandmasterClockQuality.offsetScaledLogVariance = 0x4E5D;
+			announce->stepsRemoved = 1 + ((state >> 4) & 0x7);
+		} else {
+			copyClockIdentity(announce->grandmasterIdentity,
+			    record->header.sourcePortIdentity.clockIdentity);
+			/* mostly ties on priority, so the comparison goes deep */
+			announce->grandmasterPriority1 = 127 + ((state >> 4) & 0x1);
+			announce->grandmasterPriority2 = 128;
+			announce->grandmasterClockQuality.clockClass = 6 + ((state >> 8) & 0x1) * 7;
+			announce->grandmasterClockQuality.clockAccuracy = 0x20 + ((state >> 12) & 0x3);
+			announce->grandmasterClockQuality.offsetScaledLogVariance = 0x4E5D;
+			announce->stepsRemoved = 0;
+		}
+
+		announce->currentUtcOffset = 36;
+		announce->timeSource = GPS;
+	}
+}
+
+static void
+benchBmcRun(BenchRun *b, const void *arg)
+{
+	const BmcBenchConfig *config = (const BmcBenchConfig*)arg;
+	ForeignMasterRecord *foreign;
+	PtpClock *ptpClock;
+	long i;
+	long states = 0;
+
+	if((ptpClock = benchCreateClock()) == NULL) {
+		benchFail(b, "could not create clock");
+		return;
+	}
+
+	if((foreign = (ForeignMasterRecord*)calloc(config->records, sizeof(ForeignMasterRecord))) == NULL) {
+		benchFreeClock(ptpClock);
+		benchFail(b, "could not allocate foreign master table");
+		return;
+	}
+
+	fillForeignTable(foreign, config, ptpClock);
+	ptpClock->number_foreign_records = config->records;
+	ptpClock->max_foreign_records = config->records;
+	ptpClock->portDS.portState = PTP_LISTENING;
+
+	/* first decision off the clock, so the measured ones do not report a master change */
+	bmc(foreign, &rtOpts, ptpClock);
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		states += bmc(foreign, &rtOpts, ptpClock);
+	}
+	benchStop(b);
+
+	benchSink = states + ptpClock->foreign_record_best;
+
+	free(foreign);
+	benchFreeClock(ptpClock);
+}
+
+void
+benchBmc(void)
+{
+	static BmcBenchConfig configs[] = {
+		{ 16, FALSE }, { 256, FALSE }, { 4096, FALSE },
+		{ 16, TRUE }, { 256, TRUE }, { 4096, TRUE }
+	};
+	char name[64];
+	int i;
+
+	for(i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+		snprintf(name, sizeof(name), "bmc/%s/%d",
+		    configs[i].sameGrandmaster ? "samegm" : "distinct", configs[i].records);
+		benchRun(name, benchBmcRun, &configs[i]);
+	}
+}
@@ -0,0 +1,194 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   bench_lookup.c
+ * @date   Mon Apr 4 10:12:40 2016
+ *
+ * @brief  Per-packet lookup benchmarks: access lists and unicast grant tables
+ */
+
+#include "bench.h"
+
+/* ACL benchmarks */
+
+static void
+benchAcl(BenchRun *b, const void *arg)
+{
+	int entries = *(const int*)arg;
+	Ipv4AccessList *acl;
+	char *permit, *deny;
+	size_t len = entries * 24 + 1;
+	uint32_t addr;
+	long i, matched = 0;
+	int j;
+
+	permit = calloc(1, len);
+	deny = calloc(1, len);
+
+	if(permit == NULL || deny == NULL) {
+		free(permit);
+		free(deny);
+		benchFail(b, "could not allocate ACL text");
+		return;
+	}
+
+	/* permit 10.x.y.0/24, deny the upper half of every fourth one */
+	for(j = 0; j < entries; j++) {
+		snprintf(permit + strlen(permit), len - strlen(permit), "%s10.%d.%d.0/24",
+		    j ? "," : "", (j >> 8) & 0xFF, j & 0xFF);
+		if(j % 4 == 0) {
+			snprintf(deny + strlen(deny), len - strlen(deny), "%s10.%d.%d.128/25",
+			    strlen(deny) ? "," : "", (j >> 8) & 0xFF, j & 0xFF);
+		}
+	}
+
+	acl = createIpv4AccessList(permit, deny, ACL_DENY_PERMIT);
+	free(permit);
+	free(deny);
+
+	if(acl == NULL) {
+		benchFail(b, "could not create ACL");
+		return;
+	}
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		/* cycle through all networks plus as many that are not listed - host byte order */
+		j = i % (2 * entries);
+		addr = (10U << 24) | ((j & 0xFFFF) << 8) | (i & 0xFF);
+		matched += matchIpv4AccessList(acl, addr);
+	}
+	benchStop(b);
+
+	benchSink = matched;
+	freeIpv4AccessList(&acl);
+}
+
+/* unicast grant table benchmarks */
+
+enum {
+	GRANT_FIND_PORTID = 0,	/* known port identity */
+	GRANT_FIND_ADDRESS,	/* unknown port identity, known transport address */
+	GRANT_FIND_MISS,	/* nothing known, no free entries */
+	GRANT_FIND_LINEAR	/* known port identity, no index (the peer table) */
+};
+
+static const char *grantFindNames[] = { "portid", "address", "miss", "linear" };
+
+typedef struct {
+	int nodes;
+	int mode;
+} GrantBenchConfig;
+
+static void
+benchGrants(BenchRun *b, const void *arg)
+{
+	const GrantBenchConfig *config = (const GrantBenchConfig*)arg;
+	UnicastGrantTable *table;
+	UnicastGrantIndex *index;
+	PortIdentity *queries;
+	PtpClock *ptpClock;
+	long i, found = 0;
+	int j;
+
+	if((ptpClock = benchCreateClock()) == NULL) {
+		benchFail(b, "could not create clock");
+		return;
+	}
+
+	freeUnicastGrantTable(ptpClock);
+
+	if(!allocUnicastGrantTable(ptpClock, config->nodes) ||
+	    (queries = calloc(config->nodes, sizeof(PortIdentity))) == NULL) {
+		benchFreeClock(ptpClock);
+		benchFail(b, "could not allocate grant table");
+		return;
+	}
+
+	table = ptpClock->unicastGrants;
+	index = (config->mode == GRANT_FIND_LINEAR) ? NULL : &ptpClock->grantIndex;
+
+	initUnicastGrantTable(table, E2E, config->nodes, NULL, &rtOpts, ptpClock);
+
+	/* every entry in use: a slave with a live grant */
+	for(j = 0; j < config->nodes; j++) {
+		table[j].transportAddress = htonl(0x0A000000 + j + 1);
+		memset(table[j].portIdentity.clockIdentity, 0x30, CLOCK_IDENTITY_LENGTH);
+		table[j].portIdentity.clockIdentity[5] = (j >> 16) & 0xFF;
+		table[j].portIdentity.clockIdentity[6] = (j >> 8) & 0xFF;
+		table[j].portIdentity.clockIdentity[7] = j & 0xFF;
+		table[j].portIdentity.portNumber = 1;
+		table[j].timeLeft = 300;
+
+		queries[j] = table[j].portIdentity;
+		if(config->mode == GRANT_FIND_ADDRESS || config->mode == GRANT_FIND_MISS) {
+			queries[j].clockIdentity[0] = 0x31;
+		}
+	}
+
+	initUnicastGrantIndex(&ptpClock->grantIndex, table, config->nodes, &rtOpts);
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		j = i % config->nodes;
+		found += findUnicastGrants(&queries[j],
+		    (config->mode == GRANT_FIND_MISS) ? (Integer32)htonl(0x0B000000 + j) : table[j].transportAddress,
+		    table, index, config->nodes, FALSE) != NULL;
+	}
+	benchStop(b);
+
+	benchSink = found;
+
+	free(queries);
+	benchFreeClock(ptpClock);
+}
+
+void
+benchLookup(void)
+{
+	static int aclEntries[] = { 4, 64, 1024 };
+	static GrantBenchConfig grantConfigs[4 * 3];
+	static const int nodes[] = { 16, 256, 4096 };
+	char name[64];
+	int i, j, n = 0;
+
+	for(i = 0; i < sizeof(aclEntries) / sizeof(aclEntries[0]); i++) {
+		snprintf(name, sizeof(name), "acl/match/%d", aclEntries[i]);
+		benchRun(name, benchAcl, &aclEntries[i]);
+	}
+
+	for(i = GRANT_FIND_PORTID; i <= GRANT_FIND_LINEAR; i++) {
+		for(j = 0; j < 3; j++) {
+			GrantBenchConfig *config = &grantConfigs[n++];
+			config->nodes = nodes[j];
+			config->mode = i;
+			snprintf(name, sizeof(name), "unicast/find/%s/%d", grantFindNames[i], nodes[j]);
+			benchRun(name, benchGrants, config);
+		}
+	}
+}
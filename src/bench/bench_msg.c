@@ -0,0 +1,337 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   bench_msg.c
+ * @date   Mon Apr 4 10:12:40 2016
+ *
+ * @brief  Message codec benchmarks: pack and unpack of every message type
+ *
+ * Pack benchmarks go through the same calls as the issueXXX() functions,
+ * unpack benchmarks decode a message packed beforehand, the way the
+ * handlers in protocol.c, management.c and signaling.c do. The header is
+ * also decoded the way unpackMsgHeader() used to, through the header.def
+ * expansion, as the baseline for msgUnpackHeader().
+ */
+
+#include "bench.h"
+
+enum {
+	BENCH_SYNC = 0,
+	BENCH_FOLLOWUP,
+	BENCH_ANNOUNCE,
+	BENCH_DELAYREQ,
+	BENCH_DELAYRESP,
+	BENCH_PDELAYREQ,
+	BENCH_PDELAYRESP,
+	BENCH_PDELAYRESP_FOLLOWUP,
+	BENCH_SIGNALING,
+	BENCH_MANAGEMENT,
+	BENCH_HEADER,
+	BENCH_HEADER_DEF
+};
+
+static const char *msgNames[] = {
+	"sync", "followup", "announce", "delayreq", "delayresp",
+	"pdelayreq", "pdelayresp", "pdelayrespfollowup", "signaling", "management",
+	"header", "header-def"
+};
+
+/* the def-driven primitives: msg.c has them, no header declares them */
+void unpackNibbleUpper(void *from, void *to, PtpClock *ptpClock);
+void unpackEnumeration4Lower(void *from, void *to, PtpClock *ptpClock);
+void unpackUInteger4Lower(void *from, void *to, PtpClock *ptpClock);
+void unpackUInteger8(void *from, void *to, PtpClock *ptpClock);
+void unpackOctet(void *from, void *to, PtpClock *ptpClock);
+void unpackInteger8(void *from, void *to, PtpClock *ptpClock);
+void unpackUInteger16(void *from, void *to, PtpClock *ptpClock);
+void unpackUInteger32(void *from, void *to, PtpClock *ptpClock);
+void unpackInteger64(void *buf, void *i, PtpClock *ptpClock);
+
+/* the header decoder msgUnpackHeader() replaced in unpackMsgHeader() */
+static void
+benchUnpackHeaderDef(Octet *buf, MsgHeader *header, PtpClock *ptpClock)
+{
+	int offset = 0;
+	MsgHeader* data = header;
+	#define OPERATE( name, size, type) \
+		unpack##type (buf + offset, &data->name, ptpClock); \
+		offset = offset + size;
+	#include "../def/message/header.def"
+}
+
+/* a REQUEST_UNICAST_TRANSMISSION signaling message, as prepareSMRequestUnicastTransmission() builds it */
+static void
+benchPackSignaling(Octet *buf, PtpClock *ptpClock)
+{
+	MsgSignaling outgoing;
+	SignalingTLV tlv;
+	SMRequestUnicastTransmission request;
+
+	memset(&outgoing, 0, sizeof(outgoing));
+	memset(&tlv, 0, sizeof(tlv));
+
+	outgoing.header.transportSpecific = ptpClock->portDS.transportSpecific;
+	outgoing.header.messageType = SIGNALING;
+	outgoing.header.versionPTP = ptpClock->portDS.versionNumber;
+	outgoing.header.domainNumber = ptpClock->defaultDS.domainNumber;
+	outgoing.header.flagField0 = PTP_UNICAST;
+	copyPortIdentity(&outgoing.header.sourcePortIdentity, &ptpClock->portDS.portIdentity);
+	outgoing.header.sequenceId = ptpClock->sentSignalingSequenceId++;
+	outgoing.header.controlField = 0x5;
+	outgoing.header.logMessageInterval = 0x7F;
+	copyPortIdentity(&outgoing.targetPortIdentity, &ptpClock->portDS.portIdentity);
+
+	request.messageType = SYNC;
+	request.reserved0 = 0;
+	request.logInterMessagePeriod = 0;
+	request.durationField = 300;
+
+	tlv.tlvType = TLV_REQUEST_UNICAST_TRANSMISSION;
+	tlv.valueField = (Octet*)&request;
+	outgoing.tlv = &tlv;
+
+	msgPackSignalingTLV(buf, &outgoing, ptpClock);
+	outgoing.header.messageLength = SIGNALING_LENGTH + TL_LENGTH + outgoing.tlv->lengthField;
+	msgPackSignaling(buf, &outgoing, ptpClock);
+}
+
+/* a NULL_MANAGEMENT GET, the smallest complete management message */
+static void
+benchPackManagement(Octet *buf, PtpClock *ptpClock)
+{
+	MsgManagement outgoing;
+	ManagementTLV tlv;
+
+	memset(&outgoing, 0, sizeof(outgoing));
+	memset(&tlv, 0, sizeof(tlv));
+
+	outgoing.header.transportSpecific = ptpClock->portDS.transportSpecific;
+	outgoing.header.messageType = MANAGEMENT;
+	outgoing.header.versionPTP = ptpClock->portDS.versionNumber;
+	outgoing.header.domainNumber = ptpClock->defaultDS.domainNumber;
+	copyPortIdentity(&outgoing.header.sourcePortIdentity, &ptpClock->portDS.portIdentity);
+	outgoing.header.sequenceId = 1;
+	outgoing.header.controlField = 0x4;
+	outgoing.header.logMessageInterval = 0x7F;
+	memset(&outgoing.targetPortIdentity.clockIdentity, 0xFF, CLOCK_IDENTITY_LENGTH);
+	outgoing.targetPortIdentity.portNumber = 0xFFFF;
+	outgoing.startingBoundaryHops = 0;
+	outgoing.boundaryHops = 0;
+	outgoing.actionField = GET;
+
+	tlv.tlvType = TLV_MANAGEMENT;
+	tlv.managementId = MM_NULL_MANAGEMENT;
+	outgoing.tlv = &tlv;
+
+	msgPackManagementTLV(buf, &outgoing, ptpClock);
+	outgoing.header.messageLength = MANAGEMENT_LENGTH + TL_LENGTH + outgoing.tlv->lengthField;
+	msgPackManagement(buf, &outgoing, ptpClock);
+}
+
+static void
+benchPackOne(int type, Octet *buf, MsgHeader *peer, Timestamp *ts, UInteger16 seq, PtpClock *ptpClock)
+{
+	switch(type) {
+	case BENCH_SYNC:
+		msgPackSync(buf, seq, ts, ptpClock);
+		break;
+	case BENCH_FOLLOWUP:
+		msgPackFollowUp(buf, ts, ptpClock, seq);
+		break;
+	case BENCH_ANNOUNCE:
+		msgPackAnnounce(buf, seq, ts, ptpClock);
+		break;
+	case BENCH_DELAYREQ:
+	case BENCH_HEADER:
+	case BENCH_HEADER_DEF:
+		msgPackDelayReq(buf, ts, ptpClock);
+		break;
+	case BENCH_DELAYRESP:
+		msgPackDelayResp(buf, peer, ts, ptpClock);
+		break;
+	case BENCH_PDELAYREQ:
+		msgPackPdelayReq(buf, ts, ptpClock);
+		break;
+	case BENCH_PDELAYRESP:
+		msgPackPdelayResp(buf, peer, ts, ptpClock);
+		break;
+	case BENCH_PDELAYRESP_FOLLOWUP:
+		msgPackPdelayRespFollowUp(buf, peer, ts, ptpClock, seq);
+		break;
+	case BENCH_SIGNALING:
+		benchPackSignaling(buf, ptpClock);
+		break;
+	case BENCH_MANAGEMENT:
+		benchPackManagement(buf, ptpClock);
+		break;
+	}
+}
+
+/* a header of a message from someone else, for the responses */
+static void
+benchPeerHeader(MsgHeader *peer)
+{
+	memset(peer, 0, sizeof(MsgHeader));
+	peer->messageType = DELAY_REQ;
+	peer->versionPTP = 2;
+	peer->sequenceId = 4242;
+	peer->correctionField.lsb = 0x1000;
+	memset(peer->sourcePortIdentity.clockIdentity, 0xA5, CLOCK_IDENTITY_LENGTH);
+	peer->sourcePortIdentity.portNumber = 1;
+}
+
+static void
+benchPack(BenchRun *b, const void *arg)
+{
+	int type = *(const int*)arg;
+	PtpClock *ptpClock;
+	MsgHeader peer;
+	Timestamp ts;
+	long i;
+
+	if((ptpClock = benchCreateClock()) == NULL) {
+		benchFail(b, "could not create clock");
+		return;
+	}
+
+	benchPeerHeader(&peer);
+	memset(&ts, 0, sizeof(ts));
+	ts.secondsField.lsb = 1459764760;
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		ts.nanosecondsField = i & 0x3FFFFFFF;
+		benchPackOne(type, ptpClock->msgObuf, &peer, &ts, (UInteger16)i, ptpClock);
+	}
+	benchStop(b);
+
+	benchSink = ptpClock->msgObuf[31];
+	benchFreeClock(ptpClock);
+}
+
+static void
+benchUnpack(BenchRun *b, const void *arg)
+{
+	int type = *(const int*)arg;
+	PtpClock *ptpClock;
+	MsgHeader peer, header;
+	Timestamp ts;
+	Octet *buf;
+	long i;
+
+	if((ptpClock = benchCreateClock()) == NULL) {
+		benchFail(b, "could not create clock");
+		return;
+	}
+
+	buf = ptpClock->msgIbuf;
+
+	benchPeerHeader(&peer);
+	memset(&ts, 0, sizeof(ts));
+	ts.secondsField.lsb = 1459764760;
+	ts.nanosecondsField = 123456789;
+	benchPackOne(type, buf, &peer, &ts, 4242, ptpClock);
+	msgUnpackHeader(buf, &header);
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		switch(type) {
+		case BENCH_HEADER:
+			msgUnpackHeader(buf, &ptpClock->msgTmpHeader);
+			break;
+		case BENCH_HEADER_DEF:
+			benchUnpackHeaderDef(buf, &ptpClock->msgTmpHeader, ptpClock);
+			break;
+		case BENCH_SYNC:
+			msgUnpackSync(buf, &ptpClock->msgTmp.sync);
+			break;
+		case BENCH_FOLLOWUP:
+			msgUnpackFollowUp(buf, &ptpClock->msgTmp.follow);
+			break;
+		case BENCH_ANNOUNCE:
+			msgUnpackAnnounce(buf, &ptpClock->msgTmp.announce);
+			break;
+		case BENCH_DELAYREQ:
+			msgUnpackDelayReq(buf, &ptpClock->msgTmp.req);
+			break;
+		case BENCH_DELAYRESP:
+			msgUnpackDelayResp(buf, &ptpClock->msgTmp.resp);
+			break;
+		case BENCH_PDELAYREQ:
+			msgUnpackPdelayReq(buf, &ptpClock->msgTmp.preq);
+			break;
+		case BENCH_PDELAYRESP:
+			msgUnpackPdelayResp(buf, &ptpClock->msgTmp.presp);
+			break;
+		case BENCH_PDELAYRESP_FOLLOWUP:
+			msgUnpackPdelayRespFollowUp(buf, &ptpClock->msgTmp.prespfollow);
+			break;
+		/* as handleSignaling() and handleManagement() do, TLV included */
+		case BENCH_SIGNALING:
+			if(msgUnpackSignaling(buf, &ptpClock->msgTmp.signaling, &header, ptpClock, 0)) {
+				unpackSMRequestUnicastTransmission(buf, &ptpClock->msgTmp.signaling, ptpClock);
+				freeSignalingTLV(&ptpClock->msgTmp.signaling);
+			}
+			break;
+		case BENCH_MANAGEMENT:
+			if(msgUnpackManagement(buf, &ptpClock->msgTmp.manage, &header, ptpClock, 0)) {
+				freeManagementTLV(&ptpClock->msgTmp.manage);
+			}
+			break;
+		}
+	}
+	benchStop(b);
+
+	benchSink = ptpClock->msgTmpHeader.sequenceId;
+	benchFreeClock(ptpClock);
+}
+
+void
+benchMsg(void)
+{
+	static int types[] = {
+		BENCH_SYNC, BENCH_FOLLOWUP, BENCH_ANNOUNCE, BENCH_DELAYREQ, BENCH_DELAYRESP,
+		BENCH_PDELAYREQ, BENCH_PDELAYRESP, BENCH_PDELAYRESP_FOLLOWUP,
+		BENCH_SIGNALING, BENCH_MANAGEMENT, BENCH_HEADER, BENCH_HEADER_DEF
+	};
+	char name[64];
+	int i;
+
+	for(i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		if(types[i] == BENCH_HEADER || types[i] == BENCH_HEADER_DEF) {
+			continue;
+		}
+		snprintf(name, sizeof(name), "msg/pack/%s", msgNames[types[i]]);
+		benchRun(name, benchPack, &types[i]);
+	}
+
+	for(i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		snprintf(name, sizeof(name), "msg/unpack/%s", msgNames[types[i]]);
+		benchRun(name, benchUnpack, &types[i]);
+	}
+}
@@ -0,0 +1,218 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   bench_stats.c
+ * @date   Mon Apr 4 10:12:40 2016
+ *
+ * @brief  Per-sample path benchmarks: statistical filters, outlier filter, PI servo
+ *
+ * All of them are fed the same sequence of samples: offset-like noise
+ * around zero with an occasional large spike, repeating every
+ * BENCH_SAMPLES samples.
+ */
+
+#include "bench.h"
+
+#define BENCH_SAMPLES 4096
+
+static double samples[BENCH_SAMPLES];
+static Boolean samplesReady = FALSE;
+
+static void
+prepareSamples(void)
+{
+	uint32_t state = 2463534242U;
+	int i;
+
+	if(samplesReady) {
+		return;
+	}
+
+	/* xorshift: cheap, repeatable, and good enough for filter input */
+	for(i = 0; i < BENCH_SAMPLES; i++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		samples[i] = ((double)(state % 20000) - 10000.0);
+		if(i % 97 == 0) {
+			samples[i] *= 50.0;
+		}
+	}
+
+	samplesReady = TRUE;
+}
+
+#ifdef PTPD_STATISTICS
+
+static const char *filterNames[] = {
+	"none", "mean", "min", "max", "absmin", "absmax", "median", "lucky"
+};
+
+static void
+benchStatFilter(BenchRun *b, const void *arg)
+{
+	StatFilterOptions config = *(const StatFilterOptions*)arg;
+	DoubleMovingStatFilter *filter;
+	long i;
+
+	if((filter = createDoubleMovingStatFilter(&config, "bench")) == NULL) {
+		benchFail(b, "could not create filter");
+		return;
+	}
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		feedDoubleMovingStatFilter(filter, samples[i & (BENCH_SAMPLES - 1)]);
+	}
+	benchStop(b);
+
+	benchSink = filter->output;
+	freeDoubleMovingStatFilter(&filter);
+}
+
+static void
+benchOutlierFilter(BenchRun *b, const void *arg)
+{
+	OutlierFilterConfig config = *(const OutlierFilterConfig*)arg;
+	OutlierFilter filter;
+	long i;
+	long accepted = 0;
+
+	outlierFilterSetup(&filter);
+	filter.init(&filter, &config, "bench");
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		accepted += filter.filter(&filter, samples[i & (BENCH_SAMPLES - 1)]);
+	}
+	benchStop(b);
+
+	benchSink = accepted;
+	filter.shutdown(&filter);
+}
+
+#endif /* PTPD_STATISTICS */
+
+typedef struct {
+	int type;
+	int dTmethod;
+} BenchServoConfig;
+
+static void
+benchServo(BenchRun *b, const void *arg)
+{
+	const BenchServoConfig *config = arg;
+	ClockServo servo;
+	double adj = 0;
+	long i;
+
+	memset(&servo, 0, sizeof(servo));
+	servo.type = config->type;
+	servo.maxOutput = rtOpts.servoMaxPpb;
+	servo.kP = rtOpts.servoKP;
+	servo.kI = rtOpts.servoKI;
+	servo.gain = 1.0;
+	servo.kalman.phaseNoise = rtOpts.servoKalmanPhaseNoise * rtOpts.servoKalmanPhaseNoise;
+	servo.kalman.freqNoise = rtOpts.servoKalmanFreqNoise * rtOpts.servoKalmanFreqNoise;
+	servo.linreg.window = rtOpts.servoLinRegWindow;
+	servo.dTmethod = config->dTmethod;
+	servo.dT = 1.0;
+	servo.maxdT = rtOpts.servoMaxdT;
+
+	benchStart(b);
+	for(i = 0; i < b->iterations; i++) {
+		adj += runServo(&servo, (Integer32)samples[i & (BENCH_SAMPLES - 1)],
+		    (Integer32)samples[i & (BENCH_SAMPLES - 1)], 50000);
+	}
+	benchStop(b);
+
+	benchSink = adj;
+}
+
+void
+benchStats(void)
+{
+	char name[64];
+	int i;
+
+	prepareSamples();
+
+#ifdef PTPD_STATISTICS
+	{
+		static const int windows[] = { 8, 64, 1024 };
+		static StatFilterOptions configs[(FILTER_LUCKY - FILTER_MEAN + 1) * 3 * 2];
+		static OutlierFilterConfig oConfigs[2];
+		int type, j, k, n = 0;
+
+		for(type = FILTER_MEAN; type <= FILTER_LUCKY; type++) {
+			for(j = 0; j < 3; j++) {
+				for(k = 0; k < 2; k++) {
+					StatFilterOptions *config = &configs[n++];
+					config->enabled = TRUE;
+					config->filterType = type;
+					config->windowSize = windows[j];
+					config->windowType = k ? WINDOW_INTERVAL : WINDOW_SLIDING;
+					config->percentile = rtOpts.filterMSOpts.percentile;
+					snprintf(name, sizeof(name), "filter/%s/%s/%d", filterNames[type],
+					    k ? "interval" : "sliding", windows[j]);
+					benchRun(name, benchStatFilter, config);
+				}
+			}
+		}
+
+		/* the default configuration, and a long window */
+		for(k = 0; k < 2; k++) {
+			oConfigs[k] = rtOpts.oFilterMSConfig;
+			oConfigs[k].enabled = TRUE;
+			if(k) {
+				oConfigs[k].capacity = 200;
+			}
+			snprintf(name, sizeof(name), "outlier/filter/%d", oConfigs[k].capacity);
+			benchRun(name, benchOutlierFilter, &oConfigs[k]);
+		}
+	}
+#endif /* PTPD_STATISTICS */
+
+	{
+		static const BenchServoConfig configs[] = {
+			{ SERVO_PI, DT_CONSTANT },
+			{ SERVO_PI, DT_MEASURED },
+			{ SERVO_KALMAN, DT_CONSTANT },
+			{ SERVO_KALMAN, DT_MEASURED },
+			{ SERVO_LINREG, DT_MEASURED }
+		};
+		static const char *typeNames[] = { "pi", "kalman", "linreg" };
+		static const char *methodNames[] = { "none", "constant", "measured" };
+
+		for(i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+			snprintf(name, sizeof(name), "servo/%s/%s", typeNames[configs[i].type],
+			    methodNames[configs[i].dTmethod]);
+			benchRun(name, benchServo, &configs[i]);
+		}
+	}
+}
@@ -87,8 +87,18 @@ void initData(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 	    memcpy(ptpClock->defaultDS.clockIdentity + 3, &pid, 2);
 	}
 
+	/* a boundary clock is one clock: all ports take the identity of the first one to start */
+	if(ptpClock->ports != NULL) {
+	    if(ptpClock->ports->haveClockIdentity) {
+		copyClockIdentity(ptpClock->defaultDS.clockIdentity, ptpClock->ports->clockIdentity);
+	    } else {
+		copyClockIdentity(ptpClock->ports->clockIdentity, ptpClock->defaultDS.clockIdentity);
+		ptpClock->ports->haveClockIdentity = TRUE;
+	    }
+	}
+
 	ptpClock->bestMaster = NULL;
-	ptpClock->defaultDS.numberPorts = NUMBER_PORTS;
+	ptpClock->defaultDS.numberPorts = ptpClock->ports ? ptpClock->ports->count : NUMBER_PORTS;
 
 	ptpClock->disabled = rtOpts->portDisabled;
 
@@ -169,6 +179,8 @@ void initData(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 	/*Init other stuff*/
 	ptpClock->number_foreign_records = 0;
   	ptpClock->max_foreign_records = rtOpts->max_foreign_records;
+
+	msgPackTemplates(ptpClock);
 }
 
 /* memcmp behaviour: -1: a<b, 1: a>b, 0: a=b */
@@ -752,6 +764,144 @@ bmcStateDecision(ForeignMasterRecord *foreign, const RunTimeOpts *rtOpts, PtpClo
 }
 
 
+/* port states taking part in the best master decision */
+static Boolean
+bmcStateActive(UInteger8 state)
+{
+
+	switch(state) {
+	case PTP_LISTENING:
+	case PTP_UNCALIBRATED:
+	case PTP_PASSIVE:
+	case PTP_SLAVE:
+	case PTP_MASTER:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+
+}
+
+/*
+ * Boundary clock: find the best master heard on a port (Erbest), NULL if
+ * the port has heard none or takes no part in the decision
+ */
+ForeignMasterRecord*
+bmcPortBest(PtpClock *ptpClock)
+{
+	Integer16 j, best;
+
+	if(!bmcStateActive(ptpClock->portDS.portState) || !ptpClock->number_foreign_records) {
+		return NULL;
+	}
+
+	for (j = 1, best = 0; j < ptpClock->number_foreign_records; j++)
+		if ((bmcDataSetComparison(&ptpClock->foreign[j], &ptpClock->foreign[best],
+					  ptpClock, ptpClock->rtOpts)) < 0)
+			best = j;
+
+	ptpClock->foreign_record_best = best;
+	ptpClock->bestMaster = &ptpClock->foreign[best];
+
+	return ptpClock->bestMaster;
+}
+
+/*
+ * Boundary clock state decision (9.3.3 fig 26) across all ports of the clock.
+ * Erbest is the best master heard on a port and Ebest the best of those.
+ * The port that heard Ebest is the slave, and a port whose best master is
+ * the clock itself, or which is not on the path to Ebest, is a master.
+ * @erbest and @states hold the Erbest (or NULL) and the state of each of the
+ * @count ports. The ports share the default dataset of @ptpClock (port 1),
+ * which is what the comparisons are made with. Fills @decisions, to be put
+ * into effect on each port with bmcApplyDecision().
+ */
+void
+bmcBoundaryClockDecision(ForeignMasterRecord **erbest, const UInteger8 *states, int count,
+			 PtpClock *ptpClock, UInteger8 *decisions)
+{
+	const RunTimeOpts *rtOpts = ptpClock->rtOpts;
+	ForeignMasterRecord *ebest = NULL;
+	ForeignMasterRecord me;
+	int i;
+
+	/* a port that is down may still have a record from before it went down */
+	for(i = 0; i < count; i++) {
+		if(erbest[i] != NULL && bmcStateActive(states[i]) &&
+		    (ebest == NULL || bmcDataSetComparison(erbest[i], ebest, ptpClock, rtOpts) < 0)) {
+			ebest = erbest[i];
+		}
+	}
+
+	DBGV("Boundary clock state decision: %s best master\n", ebest ? "have" : "no");
+
+	memset(&me, 0, sizeof(me));
+	me.localPreference = LOWEST_LOCALPREFERENCE;
+	copyD0(&me.header, &me.announce, ptpClock);
+
+	for(i = 0; i < count; i++) {
+
+		if(!bmcStateActive(states[i])) {
+			decisions[i] = BC_DECISION_NONE;
+			continue;
+		}
+
+		/* M1 / P1, or S1 / M2 on the port that heard Ebest: the same as an ordinary clock */
+		if(erbest[i] != NULL &&
+		    (erbest[i] == ebest || ptpClock->defaultDS.clockQuality.clockClass < 128)) {
+			decisions[i] = BC_DECISION_OWN;
+			continue;
+		}
+
+		if(ebest == NULL || ptpClock->defaultDS.clockQuality.clockClass < 128 ||
+		    bmcDataSetComparison(&me, ebest, ptpClock, rtOpts) < 0) {
+			/* M1 / M2 - but a port that has not heard anything yet keeps listening */
+			if(erbest[i] == NULL && states[i] == PTP_LISTENING) {
+				decisions[i] = BC_DECISION_LISTENING;
+			} else {
+				decisions[i] = BC_DECISION_M1;
+			}
+		} else if(erbest[i] != NULL &&
+		    !memcmp(erbest[i]->announce.grandmasterIdentity, ebest->announce.grandmasterIdentity,
+			CLOCK_IDENTITY_LENGTH) &&
+		    bmcDataSetComparison(ebest, erbest[i], ptpClock, rtOpts) < 0) {
+			/* P2: the same grandmaster, only further away than through the slave port */
+			decisions[i] = BC_DECISION_P2;
+		} else {
+			/* M3: pass the time of Ebest on */
+			decisions[i] = BC_DECISION_M3;
+		}
+	}
+
+}
+
+/* Boundary clock: put the decision made for a port into effect, returning the port's new state */
+UInteger8
+bmcApplyDecision(PtpClock *ptpClock, UInteger8 decision)
+{
+	ForeignMasterRecord *erbest;
+
+	switch(decision) {
+	case BC_DECISION_OWN:
+		/* the foreign master table may have changed since the decision was made */
+		if((erbest = bmcPortBest(ptpClock)) == NULL) {
+			return ptpClock->portDS.portState;
+		}
+		return bmcStateDecision(erbest, ptpClock->rtOpts, ptpClock);
+	case BC_DECISION_LISTENING:
+		return PTP_LISTENING;
+	case BC_DECISION_M1:
+		m1(ptpClock->rtOpts, ptpClock);
+		return PTP_MASTER;
+	case BC_DECISION_M3:
+		return PTP_MASTER;
+	case BC_DECISION_P2:
+		return PTP_PASSIVE;
+	default:
+		return ptpClock->portDS.portState;
+	}
+
+}
 
 UInteger8
 bmc(ForeignMasterRecord *foreignMaster,
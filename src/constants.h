@@ -113,6 +113,17 @@ section 7.6.2.5, page 56:
 
 /* features, only change to refelect changes in implementation */
 #define NUMBER_PORTS      	1
+/* ports of a boundary clock run by one process (ptpengine:boundary_clock_interfaces) */
+#define PTPD_MAX_PORTS		8
+/* boundary clock state decision for one port, made across all ports (bmcBoundaryClockDecision) */
+enum {
+	BC_DECISION_NONE = 0,	/* the port takes no part in the decision */
+	BC_DECISION_OWN,	/* the port heard Ebest, or a class 1..127 clock: the state decision on its own Erbest */
+	BC_DECISION_LISTENING,	/* nothing heard yet - keep listening */
+	BC_DECISION_M1,		/* master with the clock's own datasets */
+	BC_DECISION_M3,		/* master passing on the time of Ebest */
+	BC_DECISION_P2		/* passive: the same grandmaster is closer through the slave port */
+};
 #define VERSION_PTP       	2
 #define TWO_STEP_FLAG    	TRUE
 #define BOUNDARY_CLOCK    	FALSE
@@ -10,6 +10,8 @@
 #include <dep/statistics.h>
 #endif /* PTPD_STATISTICS */
 #include "dep/alarms.h"
+#include "dep/timerwheel.h"
+#include "dep/latency.h"
 
 
 /**
@@ -77,6 +79,7 @@ typedef struct
 	uint32_t sequenceMismatchErrors;  /* mismatched sequence IDs - also increments discarded */
 	uint32_t delayMechanismMismatchErrors; /* P2P received, E2E expected or vice versa - incremets discarded */
 	uint32_t consecutiveSequenceErrors;    /* number of consecutive sequence mismatch errors */
+	uint32_t txTimestampsLost;	  /* keyed TX timestamps that never arrived (batched Sync, Delay_Req, Pdelay_Req) */
 
 	/* unicast sgnaling counters */
 	uint32_t unicastGrantsRequested;  /* slave: how many we requested, master: how many requests we received */
@@ -99,16 +102,64 @@ typedef struct
 } PtpdCounters;
 
 /**
- * \struct PIservo
- * \brief PI controller model structure
+ * \struct KalmanServo
+ * \brief Kalman filter servo state: phase and frequency offset estimates
+ */
+
+typedef struct {
+    double phase;		/* estimated offset from master, ns */
+    double freq;		/* estimated free-running frequency offset, ppb */
+    double p[2][2];		/* estimate covariance */
+    double r;			/* estimated measurement noise variance, ns^2 */
+    double mpdMean;		/* running path delay mean and variance, ns, ns^2 */
+    double mpdVar;
+    double lastOutput;		/* correction in force since the last update, ppb */
+    double prevOutput;		/* and the one before */
+    double lastOffset[2];	/* the last two offsets, ns */
+    double lastDrift;		/* freq as last published in observedDrift */
+    double phaseNoise;		/* process noise spectral densities: ns^2/s, ppb^2/s */
+    double freqNoise;
+    Integer32 lastDelay;
+    int updates;
+    int gated;			/* outliers in a row */
+    Boolean initialised;
+} KalmanServo;
+
+/**
+ * \struct DriftEstimator
+ * \brief Sliding least-squares fit of the free-running phase against local time
+ */
+
+typedef struct {
+    double time[LINREG_MAX_WINDOW];	/* local time of each sample, s */
+    double phase[LINREG_MAX_WINDOW];	/* free-running phase at each sample, ns */
+    double now;			/* local time of the last sample, s */
+    double correction;		/* frequency corrections applied so far, integrated, ns */
+    double lastOutput;		/* correction in force since the last sample, ppb */
+    double lastDrift;		/* observedDrift as the servo left it */
+    double drift;		/* the estimate: free-running frequency offset, ppb */
+    double driftError;		/* and its standard error, ppb */
+    double phaseFit;		/* the fitted phase at the last sample, corrections taken out, ns */
+    int window;			/* samples in the fit */
+    int count;
+    int next;
+    Boolean valid;		/* enough samples for an estimate */
+} DriftEstimator;
+
+/**
+ * \struct ClockServo
+ * \brief Clock servo state: the servo type, the PI controller model,
+ * the Kalman filter, the drift estimator and what they have in common
  */
 
 typedef struct{
+    Enumeration8 type;
     int maxOutput;
     Integer32 input;
     double output;
     double observedDrift;
     double kP, kI;
+    double gain;		/* PI bandwidth scale: kP * gain, kI * gain^2 */
     TimeInternal lastUpdate;
     Boolean runningMaxOutput;
     int dTmethod;
@@ -132,8 +183,73 @@ typedef struct{
     double driftMaxFinal;
     DoublePermanentStdDev driftStats;
     DoublePermanentMedian driftMedianContainer;
+    Boolean adaptive;		/* gain scheduled from the offset statistics */
+    double gainTarget;		/* gain moves towards this a little every update */
+    double gainMin, gainMax;
+    double noise;		/* offset noise over the last statistics period, ns */
+    int excursions;		/* offsets beyond the noise in a row */
+    double rawSum;		/* sums of raw offsets and their squares this period */
+    double rawPower;
+    int rawSamples;
+    double lastRawMean;		/* raw offset mean over the last period */
+    Boolean lastRawMeanValid;
+    uint32_t lastOutliers;	/* outlier filter counts at the last gain update */
 #endif /* PTPD_STATISTICS */
-} PIservo;
+    KalmanServo kalman;
+    DriftEstimator linreg;
+    DriftEstimator acquisition;	/* free-running frequency over the fast acquisition period */
+    TimeInternal lastSample;	/* when acquisition last had a sample */
+    double sampleSpacing;	/* least time between the samples it keeps, s */
+    double phaseSlew;		/* phase fitted by acquisition, being slewed out, ns */
+    double phaseSlewRate;	/* ... at this rate, ppb */
+    TimeInternal slewStart;
+} ClockServo;
+
+/**
+ * \struct HoldoverModel
+ * \brief Free-running frequency history and the model fitted to it:
+ * frequency, aging and optionally temperature, used to steer the clock
+ * when there is no master to follow
+ */
+
+typedef struct {
+    /* the history: mean free-running frequency over each sample interval */
+    double time[HOLDOVER_MAX_SAMPLES];		/* middle of the interval, monotonic s */
+    double frequency[HOLDOVER_MAX_SAMPLES];	/* ppb */
+    double temperature[HOLDOVER_MAX_SAMPLES];	/* mean reading over the interval */
+    Boolean hasTemperature[HOLDOVER_MAX_SAMPLES];
+    Boolean outlier[HOLDOVER_MAX_SAMPLES];	/* left out of the last fit */
+    int count;
+    int next;
+    /* the interval being accumulated */
+    Boolean open;
+    double start;		/* monotonic s */
+    double last;		/* time of the last clock update in it */
+    double startOffset;		/* offset from master at the start, ns */
+    double integral;		/* frequency corrections applied, integrated, ns */
+    double output;		/* correction in force since the last update, ppb */
+    double startTemperature;
+    Boolean startHasTemperature;
+    double lastOffset;		/* the last offset from master seen, ns */
+    /* the model: frequency + aging * (t - reference) + tempCoeff * (T - tempReference) */
+    int state;
+    Boolean aging;		/* terms found significant and used */
+    Boolean temperatureTerm;
+    double reference;		/* time of the newest sample, monotonic s */
+    double coeff[HOLDOVER_TERMS];	/* ppb, ppb/s, ppb per temperature unit */
+    double covariance[HOLDOVER_TERMS][HOLDOVER_TERMS];
+    double tempReference;
+    double residual;		/* std dev of the samples around the model, ppb */
+    /* holdover in progress */
+    double entered;		/* monotonic s */
+    double entryOffset;		/* |offset from master| when the last master went, ns */
+    double modelError;		/* model uncertainty integrated over the holdover, ns */
+    double lastUpdate;
+    double currentTemperature;
+    Boolean hasCurrentTemperature;
+    double predicted;		/* the frequency in force, ppb */
+    double errorEstimate;	/* estimated time error now, ns */
+} HoldoverModel;
 
 typedef struct {
 	Boolean activity; 		/* periodic check, updateClock sets this to let the watchdog know we're holding clock control */
@@ -177,6 +293,8 @@ typedef struct {
 	UInteger16      messageType;		/* message type this grant is for */
 	UnicastGrantTable *parent;		/* parent entry (that has transportAddress and portIdentity */
 	Boolean		receiving;		/* keepalive: used to detect if message of this type is being received */
+	TimerWheelEntry	wheelEntry;		/* next expiry, renewal or keepalive event for this grant */
+	UInteger32	expiryTick;		/* grant wheel tick at which timeLeft reaches the expiry threshold */
 } UnicastGrantData;
 
 struct UnicastGrantTable {
@@ -187,12 +305,18 @@ struct UnicastGrantTable {
 	UnicastGrantData	grantData[PTP_MAX_MESSAGE_INDEXED];/* master: grantee's grants, slave: grantor's grant status */
 	UInteger32		timeLeft;		/* time until expiry of last grant (max[grants.timeLeft]. when runs out and no renewal, entry can be re-used */
 	Boolean			isPeer;			/* this entry is peer only */
+	Boolean			freeListed;		/* entry is on the index's free entry stack */
 	TimeInternal		lastSyncTimestamp;		/* last Sync message timestamp sent */
 };
 
-/* Unicast index holder: data + port mask */
+/* Unicast index holder: open-addressed hash tables over the grant table + port mask */
 typedef struct {
-	UnicastGrantTable* data[UNICAST_MAX_DESTINATIONS];
+	UnicastGrantTable** byPortIdentity;	/* entries hashed by port identity, linear probing */
+	UnicastGrantTable** byAddress;		/* entries hashed by transport address, linear probing */
+	UnicastGrantTable** freeNodes;		/* stack of entries which may be free for re-use */
+	int freeCount;
+	int size;				/* number of hash slots - power of 2, at least 2 x nodeCount */
+	int nodeCount;				/* number of grant table entries covered by the index */
 	UInteger16 portMask;
 } UnicastGrantIndex;
 
@@ -210,6 +334,83 @@ typedef struct {
     Integer32 transportAddress;
 } SyncDestEntry;
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+/* a Delay_Req or Pdelay_Req waiting for its TX timestamp */
+typedef struct {
+    Boolean pending;
+    UInteger32 key;
+    UInteger16 sequenceId;
+} TxTimestampPending;
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
+#ifdef PTPD_SYNC_BATCHING
+/* a batched Sync waiting for its TX timestamp */
+typedef struct {
+    Boolean pending;
+    UInteger32 key;
+    Integer32 transportAddress;
+    UInteger16 sequenceId;
+    int64_t sent;		/* for the latency probes, 0 if not measured */
+} SyncTxPending;
+
+/* unicast Syncs packed for the next sendmmsg() */
+typedef struct {
+    int count;
+    Octet buf[SYNC_BATCH_MAX][PACKET_SIZE];
+    Integer32 destinations[SYNC_BATCH_MAX];
+    UInteger16 *sequenceIds[SYNC_BATCH_MAX];
+} SyncBatch;
+#endif /* PTPD_SYNC_BATCHING */
+
+/**
+ * \struct StatisticsFileHeader
+ * \brief Header of a binary statistics file
+ */
+typedef struct {
+	char magic[8];
+	UInteger32 version;
+	UInteger32 headerSize;
+	UInteger32 recordSize;
+	UInteger32 flags;
+	/* records written so far - the file is preallocated beyond them */
+	uint64_t records;
+	Octet reserved[32];
+} StatisticsFileHeader;
+
+/**
+ * \struct StatisticsRecord
+ * \brief One statistics log entry, unformatted: a binary statistics
+ * file record, or the source of a CSV statistics line
+ */
+typedef struct {
+	TimeInternal timestamp;
+	double observedDrift;
+	double mpdMean;
+	double mpdStdDev;
+	double ofmMean;
+	double ofmStdDev;
+	double driftMean;
+	double driftStdDev;
+	/* linear regression servo drift estimate and its standard error, 0 with other servos */
+	double driftEstimate;
+	double driftEstimateError;
+	/* meanPathDelay and delaySM hold the peer delay values with P2P */
+	TimeInternal meanPathDelay;
+	TimeInternal offsetFromMaster;
+	TimeInternal delaySM;
+	TimeInternal delayMS;
+	TimeInternal rawDelayMS;
+	TimeInternal rawDelaySM;
+	PortIdentity parentPortIdentity;
+	ClockIdentity grandmasterIdentity;
+	UInteger16 sequenceId;
+	Integer32 resetCount;
+	Enumeration8 portState;
+	Enumeration8 timestampFormat;
+	char lastMessage;
+	Octet reserved[5];
+} StatisticsRecord;
+
 
 /**
  * \struct RunTimeOpts
@@ -259,6 +460,16 @@ typedef struct {
 	Octet backupIfaceName[IFACE_NAME_LENGTH];
 	Boolean backupIfaceEnabled;
 
+	/* boundary clock: interfaces of ports 2 and up, as configured and split */
+	char boundaryClockIfaces[PATH_MAX+1];
+	Octet boundaryClockPortIfaces[PTPD_MAX_PORTS - 1][IFACE_NAME_LENGTH];
+	int boundaryClockPorts;
+	/* boundary clock: ports 2 and up on threads of their own, pinned to a core or not (-1) */
+	Boolean portThreads;
+	char portThreadCpuList[PATH_MAX+1];
+	int portThreadCpus[PTPD_MAX_PORTS - 1];
+	int portThreadPriority;
+
 	Boolean	noResetClock; // don't step the clock if offset > 1s
 	Boolean stepForce; // force clock step on first sync after startup
 	Boolean stepOnce; // only step clock on first sync after startup
@@ -293,6 +504,8 @@ typedef struct {
 	Boolean preferUtcValid;
 	Boolean requireUtcValid;
 	Boolean useSysLog;
+	Boolean logAsync; /* hand log output over to the writer thread */
+	int logAsyncQueueSize;
 	Boolean checkConfigOnly;
 	Boolean printLockFile;
 
@@ -311,11 +524,13 @@ typedef struct {
 	Boolean periodicUpdates;
 	Boolean logStatistics;
 	Enumeration8 statisticsTimestamp;
+	Enumeration8 statisticsFormat;
 
 	Enumeration8 logLevel;
 	int statisticsLogInterval;
 
 	int statusFileUpdateInterval;
+	Boolean latencyHistograms;
 
 	Boolean ignore_daemon_lock;
 	Boolean do_IGMP_refresh;
@@ -333,6 +548,7 @@ typedef struct {
 	char lockFile[PATH_MAX+1]; /* lock file location */
 	char driftFile[PATH_MAX+1]; /* drift file location */
 	char leapFile[PATH_MAX+1]; /* leap seconds file location */
+	char phcDevice[PATH_MAX+1]; /* PTP hardware clock to steer instead of the system clock */
 	Enumeration8 drift_recovery_method; /* how the observed drift is managed
 				      between restarts */
 
@@ -352,6 +568,7 @@ typedef struct {
 	Boolean dot1AS; /* 801.2AS support -> transportSpecific field */
 
 	Boolean disableUdpChecksums; /* disable UDP checksum validation where supported */
+	Boolean hwTimestamping; /* use hardware timestamps and steer the interface's PHC */
 
 	/* list of unicast destinations for use with unicast with or without signaling */
 	char unicastDestinations[MAXHOSTNAMELEN * UNICAST_MAX_DESTINATIONS];
@@ -377,6 +594,10 @@ typedef struct {
 	 * transmit signaling using one port ID, and rest of messages with another
 	 */
 	UInteger16  unicastPortMask; /* port mask to apply to portNumber when using negotiation */
+	int unicastGrantTableSize; /* maximum number of unicast slaves (or masters) we keep grants for */
+	Boolean unicastSyncBatching; /* Master: send unicast Syncs in one batch, collect TX timestamps asynchronously */
+	Boolean asyncTxTimestamps; /* do not wait for Delay_Req / Pdelay_Req TX timestamps, collect them from the event loop */
+	int recvBatchSize; /* maximum packets read from a socket with one recvmmsg() */
 
 #ifdef RUNTIME_DEBUG
 	int debug_level;
@@ -400,6 +621,17 @@ typedef struct {
 	double servoKI;
 	Enumeration8 servoDtMethod;
 	double servoMaxdT;
+	Enumeration8 servoType;
+	double servoKalmanPhaseNoise;
+	double servoKalmanFreqNoise;
+	int servoLinRegWindow;
+
+	Boolean holdover;
+	int holdoverInterval;
+	int holdoverWindow;
+	Boolean holdoverAging;
+	char holdoverTemperatureFile[PATH_MAX];
+	double holdoverTemperatureScale;
 
 	/**
 	 *  When enabled, ptpd ensures that Sync message sequence numbers
@@ -429,12 +661,18 @@ typedef struct {
 	int servoStabilityTimeout;
 	int servoStabilityPeriod;
 
+	Boolean servoAdaptiveGain;
+	double servoGainMin;
+	double servoGainMax;
+
 	Boolean maxDelayStableOnly;
 #endif
 	/* also used by the periodic message ticker */
 	int statsUpdateInterval;
 
 	int calibrationDelay;
+	int acquisitionPeriod;
+	Integer8 acquisitionLogInterval;
 	Boolean enablePanicMode;
 	Boolean panicModeReleaseClock;
 	int panicModeDuration;
@@ -469,6 +707,12 @@ typedef struct {
 } RunTimeOpts;
 
 
+/* ports of a boundary clock, NULL for an ordinary clock */
+typedef struct ClockPorts ClockPorts;
+
+/* boundary clock port running on a thread of its own, NULL if it is not */
+typedef struct PortThread PortThread;
+
 /**
  * \struct PtpClock
  * \brief Main program data structure
@@ -503,15 +747,34 @@ typedef struct {
 	Boolean disabled;	/* port is permanently disabled */
 
 	/* unicast grant table - our own grants or our slaves' grants or grants to peers */
-	UnicastGrantTable unicastGrants[UNICAST_MAX_DESTINATIONS];
-	/* our trivial index table to speed up lookups */
+	UnicastGrantTable *unicastGrants;
+	int unicastGrantTableSize;
+	/* hash index over the above table for O(1) lookups */
 	UnicastGrantIndex grantIndex;
+	/* expiry, renewal and keepalive events for unicast and peer grants, one tick per grant refresh */
+	TimerWheel grantWheel;
 	/* current parent from the above table */
 	UnicastGrantTable *parentGrants;
 	/* previous parent's grants when changing parents: if not null, this is what should be canceled */
 	UnicastGrantTable *previousGrants;
 	/* another index to match unicast Sync with FollowUp when we can't capture the destination address of Sync */
-	SyncDestEntry syncDestIndex[UNICAST_MAX_DESTINATIONS];
+	SyncDestEntry *syncDestIndex;
+	int syncDestIndexSize;
+
+#ifdef PTPD_SYNC_BATCHING
+	/* batched unicast Syncs waiting for TX timestamps, indexed by timestamp key */
+	SyncTxPending syncTxPending[SYNC_TX_PENDING_MAX];
+	int syncTxPendingCount;
+	SyncBatch syncBatch;
+#endif /* PTPD_SYNC_BATCHING */
+
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	/* our own delay requests waiting for TX timestamps from the event loop */
+	TxTimestampPending delayReqTxPending;
+	TxTimestampPending pdelayReqTxPending;
+	/* consecutive delay request TX timestamps which never arrived */
+	int txTimestampsMissed;
+#endif /* PTPD_TXTIMESTAMP_KEYED */
 
 	/* unicast destinations parsed from config */
 	UnicastDestination unicastDestinations[UNICAST_MAX_DESTINATIONS];
@@ -545,7 +808,13 @@ typedef struct {
 	MsgSignaling outgoingSignalingTmp;
 
 	Octet msgObuf[PACKET_SIZE];
-	Octet msgIbuf[PACKET_SIZE];
+	/* pre-packed messages, see msgPackTemplates() */
+	Octet syncTemplate[SYNC_LENGTH];
+	Octet announceTemplate[ANNOUNCE_LENGTH];
+	Octet delayRespTemplate[DELAY_RESP_LENGTH];
+	/* message being processed: msgIbufStorage, or a batch receive buffer */
+	Octet *msgIbuf;
+	Octet msgIbufStorage[PACKET_SIZE];
 
 	int followUpGap;
 
@@ -645,7 +914,7 @@ typedef struct {
 	PtpdCounters counters;
 
 	/* PI servo model */
-	PIservo servo;
+	ClockServo servo;
 
 	/* "panic mode" support */
 	Boolean panicMode; /* in panic mode - do not update clock or calculate offsets */
@@ -690,6 +959,11 @@ typedef struct {
 	Integer32 offsetUpdates;
 
 	Boolean isCalibrated;
+	Boolean acquiring;		/* fast initial acquisition in progress */
+	Boolean acquisitionSync;	/* Sync received since the last Delay_Req */
+
+	/* frequency model learnt while slave, steering the clock in holdover */
+	HoldoverModel holdover;
 
 	NTPcontrol ntpControl;
 
@@ -709,7 +983,51 @@ typedef struct {
 
 	RunTimeOpts *rtOpts;
 
+	/* boundary clock: all ports of the clock, this one included */
+	ClockPorts *ports;
+	/* the port's servo steers the clock - see handOverClockControl() */
+	Boolean controllingClock;
+	/* descriptors found ready by the wait the port was last run after */
+	fd_set *readfds;
+	PortThread *thread;
+
+	/* hot path latency histograms, if enabled */
+	LatencyProbe latency;
+
 } PtpClock;
 
+/**
+ * \struct ClockPorts
+ * \brief Ports of a boundary clock driven by one protocol loop
+ */
+struct ClockPorts {
+	PtpClock *port[PTPD_MAX_PORTS];
+	int count;
+	/* port whose servo steers the clock: the slave port, port 1 when there is none */
+	PtpClock *controller;
+	/* descriptors found ready by the wait shared by all ports, read by handle() */
+	fd_set readfds;
+	/* all ports have the clock identity of the first one initialised */
+	ClockIdentity clockIdentity;
+	Boolean haveClockIdentity;
+	/* ports 2 and up run on port threads */
+	Boolean threaded;
+	/* port states as last seen by the main thread, for the status file */
+	UInteger8 portState[PTPD_MAX_PORTS];
+};
+
+/**
+ * \struct ClockDatasets
+ * \brief Boundary clock datasets all ports take from the slave port
+ */
+typedef struct {
+	ParentDS parentDS;
+	UInteger16 stepsRemoved;
+	TimePropertiesDS timePropertiesDS;
+	int utcOffset;
+	Boolean leapInsert;
+	Boolean leapDelete;
+} ClockDatasets;
+
 
 #endif /*DATATYPES_H_*/
@@ -224,7 +224,12 @@ configureAlarms(AlarmEntry *alarms, int count, void * userData)
 #ifdef PTPD_SNMP
 	if(ptpClock->rtOpts->snmpEnabled && ptpClock->rtOpts->snmpTrapsEnabled) {
 	    DBG("SNMP alarm handler attached for %s\n", alarms[i].name);
+#ifdef PTPD_PORT_THREADS
+	    /* port threads hand their alarms to the main thread, which runs the SNMP agent */
+	    alarms[i].handlers[1] = (ptpClock->thread != NULL) ? alarmHandler_portThread : alarmHandler_snmp;
+#else
 	    alarms[i].handlers[1] = alarmHandler_snmp;
+#endif /* PTPD_PORT_THREADS */
 	} else {
 	    alarms[i].handlers[1] = NULL;
 	}
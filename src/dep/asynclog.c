@@ -0,0 +1,469 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   asynclog.c
+ * @date   Mon Mar 14 21:40:12 2016
+ *
+ * @brief  Asynchronous log writer thread
+ *
+ * With global:log_async enabled, logMessage(), logStatistics() and
+ * recordSync() format their output straight into a slot of a
+ * pre-allocated ring and return. A writer thread takes the records off
+ * the ring and does the file writes, log rotation, syslog and console
+ * output. The protocol thread is the only producer and the writer
+ * thread the only consumer, so the ring needs no locks: each side owns
+ * one index and publishes it with release / acquire ordering.
+ *
+ * Other threads producing log output (boundary clock port threads) get
+ * a ring of their own with asyncLogAddQueue() and asyncLogAttach(). Their
+ * rings outlive a stop and restart of the writer thread (SIGHUP), so they
+ * never fall back to writing the files themselves.
+ *
+ * When the ring is full the record is dropped, and above 3/4 full only
+ * messages at LOG_NOTICE or higher priority are accepted - the
+ * protocol thread never waits for the writer. Drops are counted and
+ * reported by the writer thread.
+ */
+
+#include "../ptpd.h"
+
+#ifdef PTPD_ASYNC_LOG
+
+typedef struct {
+	int target;
+	int priority;
+	struct timeval when;
+	const char *state;
+	const char *iface;
+	int length;
+	char text[ASYNCLOG_RECORD_SIZE];
+} AsyncLogRecord;
+
+struct AsyncLogQueue {
+	AsyncLogRecord *ring;
+	uint32_t mask;
+	/* written by the producing thread only */
+	uint32_t head;
+	uint32_t droppedFull;
+	uint32_t droppedThrottled;
+	/* written by the writer thread only */
+	uint32_t tail;
+	/* the producer is gone: free the queue once the writer is stopped */
+	int removed;
+};
+
+/* the queue of the protocol (main) thread, and up to this many more */
+#define ASYNCLOG_QUEUES PTPD_MAX_PORTS
+
+static struct {
+	AsyncLogQueue queue;
+	AsyncLogQueue *queues[ASYNCLOG_QUEUES];
+	int rotated[ASYNCLOG_TARGETS];
+	int stop;
+	Boolean running;
+	pthread_t thread;
+	/* set up once: attached threads may post to it while the writer is stopped */
+	sem_t wakeup;
+	Boolean wakeupReady;
+	/* drops reported so far - the counts run on across restarts */
+	uint32_t reportedFull;
+	uint32_t reportedThrottled;
+} asyncLog;
+
+/* the queue the calling thread produces into, NULL for the protocol thread */
+static PTPD_THREAD_LOCAL AsyncLogQueue *producer;
+
+/* queue of the calling thread */
+static AsyncLogQueue*
+asyncLogQueue(void)
+{
+	return producer != NULL ? producer : &asyncLog.queue;
+}
+
+/* records dropped from all queues so far */
+static void
+asyncLogCountDrops(uint32_t *full, uint32_t *throttled)
+{
+
+	AsyncLogQueue *queue;
+	int i;
+
+	*full = __atomic_load_n(&asyncLog.queue.droppedFull, __ATOMIC_RELAXED);
+	*throttled = __atomic_load_n(&asyncLog.queue.droppedThrottled, __ATOMIC_RELAXED);
+
+	for(i = 0; i < ASYNCLOG_QUEUES; i++) {
+		if((queue = __atomic_load_n(&asyncLog.queues[i], __ATOMIC_ACQUIRE)) != NULL) {
+			*full += __atomic_load_n(&queue->droppedFull, __ATOMIC_RELAXED);
+			*throttled += __atomic_load_n(&queue->droppedThrottled, __ATOMIC_RELAXED);
+		}
+	}
+
+}
+
+/* write out everything in a queue - called by the writer thread */
+static void
+asyncLogDrain(AsyncLogQueue *queue)
+{
+
+	AsyncLogRecord *record;
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	while(queue->tail != head) {
+		record = &queue->ring[queue->tail & queue->mask];
+		if(writeLogRecord(record->target, record->priority, &record->when,
+			    record->state, record->iface, record->text, record->length)) {
+			__atomic_store_n(&asyncLog.rotated[record->target], 1, __ATOMIC_RELEASE);
+		}
+		__atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+	}
+
+}
+
+static AsyncLogRecord*
+asyncLogAllocRing(const RunTimeOpts *rtOpts, uint32_t *mask)
+{
+
+	uint32_t capacity = ASYNCLOG_QUEUE_MIN;
+	AsyncLogRecord *ring;
+
+	while(capacity < rtOpts->logAsyncQueueSize) {
+		capacity <<= 1;
+	}
+
+	if((ring = calloc(capacity, sizeof(AsyncLogRecord))) != NULL) {
+		*mask = capacity - 1;
+	}
+
+	return ring;
+
+}
+
+/* report drops at most this often */
+#define ASYNCLOG_REPORT_INTERVAL 1
+
+static void
+asyncLogReportDrops(uint32_t *lastFull, uint32_t *lastThrottled, time_t *lastReport, Boolean force)
+{
+
+	uint32_t full, throttled;
+	struct timeval now;
+
+	asyncLogCountDrops(&full, &throttled);
+
+	if(full == *lastFull && throttled == *lastThrottled) {
+		return;
+	}
+
+	gettimeofday(&now, 0);
+	if(!force && (now.tv_sec - *lastReport < ASYNCLOG_REPORT_INTERVAL)) {
+		return;
+	}
+
+	/* we are the writer thread, so this is written out directly */
+	WARNING("Asynchronous logging: %u messages dropped (%u queue full, %u above 3/4 full)\n",
+		(full - *lastFull) + (throttled - *lastThrottled),
+		full - *lastFull, throttled - *lastThrottled);
+
+	*lastFull = full;
+	*lastThrottled = throttled;
+	*lastReport = now.tv_sec;
+
+}
+
+static void*
+asyncLogWriter(void *arg)
+{
+
+	AsyncLogQueue *queue;
+	time_t lastReport = 0;
+	Boolean stopping = FALSE;
+	struct timespec deadline;
+	int i;
+
+	for(;;) {
+
+		/* stop was requested before this drain started - no more records will arrive */
+		stopping = __atomic_load_n(&asyncLog.stop, __ATOMIC_ACQUIRE);
+
+		asyncLogDrain(&asyncLog.queue);
+		for(i = 0; i < ASYNCLOG_QUEUES; i++) {
+			if((queue = __atomic_load_n(&asyncLog.queues[i], __ATOMIC_ACQUIRE)) != NULL) {
+				asyncLogDrain(queue);
+			}
+		}
+
+		asyncLogReportDrops(&asyncLog.reportedFull, &asyncLog.reportedThrottled, &lastReport, stopping);
+
+		if(stopping) {
+			break;
+		}
+
+		/* the timeout only matters for reporting drops when nothing else is logged */
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += ASYNCLOG_REPORT_INTERVAL;
+		while(sem_timedwait(&asyncLog.wakeup, &deadline) == -1 && errno == EINTR);
+
+	}
+
+	return NULL;
+
+}
+
+/* Allocate the ring and start the writer thread */
+Boolean
+asyncLogStart(const RunTimeOpts *rtOpts)
+{
+
+	sigset_t all, old;
+	int ret;
+
+	if(asyncLog.running) {
+		return TRUE;
+	}
+
+	/* the queues of other threads stay as they are, and drops keep counting */
+	asyncLog.queue.head = 0;
+	asyncLog.queue.tail = 0;
+	memset(asyncLog.rotated, 0, sizeof(asyncLog.rotated));
+	asyncLog.stop = 0;
+
+	if((asyncLog.queue.ring = asyncLogAllocRing(rtOpts, &asyncLog.queue.mask)) == NULL) {
+		PERROR("Could not allocate asynchronous log queue");
+		return FALSE;
+	}
+
+	if(!asyncLog.wakeupReady) {
+		if(sem_init(&asyncLog.wakeup, 0, 0) == -1) {
+			PERROR("Could not initialise asynchronous log queue");
+			free(asyncLog.queue.ring);
+			asyncLog.queue.ring = NULL;
+			return FALSE;
+		}
+		asyncLog.wakeupReady = TRUE;
+	}
+
+	/* signals are for the protocol thread: the writer starts with all of them blocked */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&asyncLog.thread, NULL, asyncLogWriter, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if(ret != 0) {
+		errno = ret;
+		PERROR("Could not start asynchronous log writer thread");
+		free(asyncLog.queue.ring);
+		asyncLog.queue.ring = NULL;
+		return FALSE;
+	}
+
+	asyncLog.running = TRUE;
+	INFO("Asynchronous logging started, queue size %u\n", asyncLog.queue.mask + 1);
+
+	return TRUE;
+
+}
+
+/* Write out everything queued and stop the writer thread */
+void
+asyncLogStop(void)
+{
+
+	int i;
+
+	if(!asyncLog.running) {
+		return;
+	}
+
+	__atomic_store_n(&asyncLog.stop, 1, __ATOMIC_RELEASE);
+	sem_post(&asyncLog.wakeup);
+	pthread_join(asyncLog.thread, NULL);
+
+	/* from here on, logging is synchronous again */
+	asyncLog.running = FALSE;
+	free(asyncLog.queue.ring);
+	asyncLog.queue.ring = NULL;
+
+	/* the last of what the removed queues held has just been written out */
+	for(i = 0; i < ASYNCLOG_QUEUES; i++) {
+		if(asyncLog.queues[i] != NULL && asyncLog.queues[i]->removed) {
+			free(asyncLog.queues[i]->ring);
+			free(asyncLog.queues[i]);
+			asyncLog.queues[i] = NULL;
+		}
+	}
+
+}
+
+/* TRUE if log output from the calling thread should be queued */
+Boolean
+asyncLogActive(void)
+{
+
+	/* attached threads queue even while the writer is stopped */
+	return producer != NULL ||
+		(asyncLog.running && !pthread_equal(pthread_self(), asyncLog.thread));
+
+}
+
+/*
+ * Create a queue for another thread to log through once attached to it.
+ * Called by the protocol thread; returns NULL if it could not be created.
+ */
+AsyncLogQueue*
+asyncLogAddQueue(const RunTimeOpts *rtOpts)
+{
+
+	AsyncLogQueue *queue;
+	int i;
+
+	for(i = 0; i < ASYNCLOG_QUEUES; i++) {
+		if(asyncLog.queues[i] == NULL) {
+			break;
+		}
+	}
+
+	if(i == ASYNCLOG_QUEUES) {
+		ERROR("No asynchronous log queue left for another thread\n");
+		return NULL;
+	}
+
+	if((queue = calloc(1, sizeof(AsyncLogQueue))) == NULL ||
+	    (queue->ring = asyncLogAllocRing(rtOpts, &queue->mask)) == NULL) {
+		PERROR("Could not allocate asynchronous log queue");
+		free(queue);
+		return NULL;
+	}
+
+	__atomic_store_n(&asyncLog.queues[i], queue, __ATOMIC_RELEASE);
+
+	return queue;
+
+}
+
+/* Log all output of the calling thread through @queue */
+void
+asyncLogAttach(AsyncLogQueue *queue)
+{
+
+	producer = queue;
+
+}
+
+/*
+ * The thread logging through @queue has finished: the queue goes
+ * when the writer thread stops, after writing out what is left in it
+ */
+void
+asyncLogRemoveQueue(AsyncLogQueue *queue)
+{
+
+	if(queue != NULL) {
+		__atomic_store_n(&queue->removed, 1, __ATOMIC_RELEASE);
+	}
+
+}
+
+/*
+ * Claim the next free slot for a record, returning its text buffer and
+ * size, or NULL if the record has to be dropped
+ */
+char*
+asyncLogReserve(int target, int priority, int *size)
+{
+
+	AsyncLogQueue *queue = asyncLogQueue();
+	AsyncLogRecord *record;
+	uint32_t used = queue->head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if(used > queue->mask) {
+		__atomic_store_n(&queue->droppedFull, queue->droppedFull + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	/* shed low priority output first */
+	if((priority > LOG_NOTICE) && (used >= (queue->mask + 1) - ((queue->mask + 1) >> 2))) {
+		__atomic_store_n(&queue->droppedThrottled, queue->droppedThrottled + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	record = &queue->ring[queue->head & queue->mask];
+	record->target = target;
+	record->priority = priority;
+	*size = sizeof(record->text);
+
+	return record->text;
+
+}
+
+/* Publish the record claimed with asyncLogReserve() to the writer thread */
+void
+asyncLogCommit(int length, const struct timeval *when, const char *state, const char *iface)
+{
+
+	AsyncLogQueue *queue = asyncLogQueue();
+	AsyncLogRecord *record = &queue->ring[queue->head & queue->mask];
+
+	if(length >= sizeof(record->text)) {
+		length = sizeof(record->text) - 1;
+	}
+
+	record->length = length;
+	record->state = state;
+	record->iface = iface;
+	if(when != NULL) {
+		record->when = *when;
+	}
+
+	__atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+	sem_post(&asyncLog.wakeup);
+
+}
+
+/* TRUE (once) if the writer thread rotated or truncated the target's file since the last call */
+Boolean
+asyncLogRotated(int target)
+{
+
+	return __atomic_exchange_n(&asyncLog.rotated[target], 0, __ATOMIC_ACQUIRE) != 0;
+
+}
+
+/* Number of records dropped so far */
+uint32_t
+asyncLogDropped(void)
+{
+
+	uint32_t full, throttled;
+
+	asyncLogCountDrops(&full, &throttled);
+
+	return full + throttled;
+
+}
+
+#endif /* PTPD_ASYNC_LOG */
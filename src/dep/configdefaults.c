@@ -159,6 +159,8 @@ void
 loadDefaultSettings( RunTimeOpts* rtOpts )
 {
 
+	int i;
+
 	/* Wipe the memory first to avoid unconsistent behaviour - no need to set Boolean to FALSE, int to 0 etc. */
 	memset(rtOpts, 0, sizeof(RunTimeOpts));
 
@@ -189,6 +191,7 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	rtOpts->dot1AS = FALSE;
 
 	rtOpts->disableUdpChecksums = TRUE;
+	rtOpts->hwTimestamping = FALSE;
 
 	rtOpts->unicastNegotiation = FALSE;
 	rtOpts->unicastNegotiationListening = FALSE;
@@ -196,10 +199,19 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	rtOpts->unicastGrantDuration = 300;
 	rtOpts->unicastAcceptAny = FALSE;
 	rtOpts->unicastPortMask = 0;
+	rtOpts->unicastGrantTableSize = UNICAST_MAX_DESTINATIONS;
+	rtOpts->unicastSyncBatching = FALSE;
+	rtOpts->asyncTxTimestamps = TRUE;
+#ifdef PTPD_RECV_BATCHING
+	rtOpts->recvBatchSize = RECV_BATCH_MAX;
+#else
+	rtOpts->recvBatchSize = 1;
+#endif /* PTPD_RECV_BATCHING */
 
 	rtOpts->noAdjust = NO_ADJUST;  // false
 	rtOpts->logStatistics = TRUE;
 	rtOpts->statisticsTimestamp = TIMESTAMP_DATETIME;
+	rtOpts->statisticsFormat = STATSFILE_CSV;
 
 	rtOpts->periodicUpdates = FALSE; /* periodically log a status update */
 
@@ -218,6 +230,8 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	rtOpts->ignore_delayreq_interval_master = FALSE;
 	rtOpts->do_IGMP_refresh = TRUE;
 	rtOpts->useSysLog       = FALSE;
+	rtOpts->logAsync = FALSE;
+	rtOpts->logAsyncQueueSize = 1024;
 	rtOpts->announceReceiptTimeout  = DEFAULT_ANNOUNCE_RECEIPT_TIMEOUT;
 #ifdef RUNTIME_DEBUG
 	rtOpts->debug_level = LOG_INFO;			/* by default debug messages as disabled, but INFO messages and below are printed */
@@ -281,6 +295,17 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	/* when measuring dT, use a maximum of 5 sync intervals (would correspond to avg 20% discard rate) */
 	rtOpts->servoMaxdT = 5.0;
 
+	rtOpts->servoType = SERVO_PI;
+	rtOpts->servoKalmanPhaseNoise = 10.0;
+	rtOpts->servoKalmanFreqNoise = 1.0;
+	rtOpts->servoLinRegWindow = 16;
+
+	rtOpts->holdover = FALSE;
+	rtOpts->holdoverInterval = 60;
+	rtOpts->holdoverWindow = 3600;
+	rtOpts->holdoverAging = TRUE;
+	rtOpts->holdoverTemperatureScale = 0.001;
+
 	/* disabled by default */
 	rtOpts->announceTimeoutGracePeriod = 0;
 
@@ -296,6 +321,11 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	rtOpts-> cpuNumber = -1;
 #endif /* (linux && HAVE_SCHED_H) || HAVE_SYS_CPUSET_H*/
 
+	/* boundary clock port threads are not pinned unless configured */
+	for(i = 0; i < PTPD_MAX_PORTS - 1; i++) {
+		rtOpts->portThreadCpus[i] = -1;
+	}
+
 #ifdef PTPD_STATISTICS
 
 	rtOpts->oFilterMSConfig.enabled = FALSE;
@@ -340,11 +370,13 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	rtOpts->filterMSOpts.filterType = FILTER_MIN;
 	rtOpts->filterMSOpts.windowSize = 4;
 	rtOpts->filterMSOpts.windowType = WINDOW_SLIDING;
+	rtOpts->filterMSOpts.percentile = 25;
 
 	rtOpts->filterSMOpts.enabled = FALSE;
 	rtOpts->filterSMOpts.filterType = FILTER_MIN;
 	rtOpts->filterSMOpts.windowSize = 4;
 	rtOpts->filterSMOpts.windowType = WINDOW_SLIDING;
+	rtOpts->filterSMOpts.percentile = 25;
 
 	/* How often refresh statistics (seconds) */
 	rtOpts->statsUpdateInterval = 30;
@@ -356,6 +388,10 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	rtOpts->servoStabilityPeriod = 1;
 	/* How many minutes without servo stabilisation means servo has not stabilised */
 	rtOpts->servoStabilityTimeout = 10;
+	/* PI gain scheduling: bandwidth from 4x the configured gains when acquiring to 1/4 when stable */
+	rtOpts->servoAdaptiveGain = FALSE;
+	rtOpts->servoGainMin = 0.25;
+	rtOpts->servoGainMax = 4.0;
 	/* How long to wait for one-way delay prefiltering */
 	rtOpts->calibrationDelay = 0;
 	/* if set to TRUE and maxDelay is defined, only check against threshold if servo is stable */
@@ -366,6 +402,7 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 
 	/* status file options */
 	rtOpts->statusFileUpdateInterval = 1;
+	rtOpts->latencyHistograms = FALSE;
 
 	rtOpts->ofmAlarmThreshold = 0;
 
@@ -374,6 +411,10 @@ loadDefaultSettings( RunTimeOpts* rtOpts )
 	rtOpts->panicModeDuration = 2;
 	rtOpts->panicModeExitThreshold = 0;
 
+	/* fast initial acquisition: off, 16 messages per second when used */
+	rtOpts->acquisitionPeriod = 0;
+	rtOpts->acquisitionLogInterval = -4;
+
 	/* full network reset after 5 times in listening */
 	rtOpts->maxListen = 5;
 
@@ -133,12 +133,16 @@ if it's POSIX compatible, if you succeed, report it to ptpd-devel@sourceforge.ne
 #define PTP_ETHER_TYPE 0x88f7
 #define PTP_ETHER_PEER "01:80:c2:00:00:0E"
 
+/* maximum number of configured unicast destinations, also the minimum and default grant table size */
 #ifdef PTPD_UNICAST_MAX
 #define UNICAST_MAX_DESTINATIONS PTPD_UNICAST_MAX
 #else
 #define UNICAST_MAX_DESTINATIONS 16
 #endif /* PTPD_UNICAST_MAX */
 
+/* upper limit for the runtime-sized unicast grant table */
+#define UNICAST_GRANT_TABLE_MAX 65536
+
 /* dummy clock driver designation in preparation for generic clock driver API */
 #define DEFAULT_CLOCKDRIVER "kernelclock"
 /* default lock file location and mode */
@@ -163,6 +167,83 @@ if it's POSIX compatible, if you succeed, report it to ptpd-devel@sourceforge.ne
 /* wait a maximum of 10 ms for a late TX timestamp */
 #define LATE_TXTIMESTAMP_US 10000
 
+/*
+ * keyed TX timestamps: the kernel numbers each TX timestamp (SOF_TIMESTAMPING_OPT_ID),
+ * so they can be collected from the error queue later and matched to their messages
+ */
+#if defined(SO_TIMESTAMPING) && !defined(PTPD_SIM) && \
+    defined(HAVE_DECL_SOF_TIMESTAMPING_OPT_ID) && HAVE_DECL_SOF_TIMESTAMPING_OPT_ID
+#define PTPD_TXTIMESTAMP_KEYED
+/* keyed TX timestamps set aside while waiting for a different one */
+#define TXTIMESTAMP_BACKLOG_MAX 64
+/* consecutive Delay_Req / Pdelay_Req TX timestamps lost before we warn about it */
+#define TXTIMESTAMP_MAX_LOST 5
+#endif /* SO_TIMESTAMPING && !PTPD_SIM && SOF_TIMESTAMPING_OPT_ID */
+
+/*
+ * batched unicast Sync transmission: one sendmmsg() per batch, TX timestamps
+ * collected from the error queue later, matched by key
+ */
+#if defined(PTPD_TXTIMESTAMP_KEYED) && defined(HAVE_SENDMMSG) && !defined(PTPD_SLAVE_ONLY)
+#define PTPD_SYNC_BATCHING
+/* maximum number of messages passed to the kernel in one sendmmsg() call */
+#define SYNC_BATCH_MAX 64
+/* table of Syncs waiting for their TX timestamps - must be a power of 2 */
+#define SYNC_TX_PENDING_MAX 1024
+#endif /* PTPD_TXTIMESTAMP_KEYED && HAVE_SENDMMSG && !PTPD_SLAVE_ONLY */
+
+/*
+ * batched receive: one recvmmsg() drains several packets per wakeup
+ * into pre-allocated buffers, which are processed in place
+ */
+#if defined(HAVE_RECVMMSG) && !defined(PTPD_SIM)
+#define PTPD_RECV_BATCHING
+/* receive buffers per socket - the most packets one recvmmsg() call can return */
+#define RECV_BATCH_MAX 32
+#endif /* HAVE_RECVMMSG && !PTPD_SIM */
+
+/*
+ * Linux PTP hardware clocks: hardware timestamping on the interface,
+ * with the interface's PHC (/dev/ptpN) steered instead of the system clock.
+ * ptpd2-sim keeps the driver, and gives it a simulated PHC to steer.
+ */
+#if defined(SO_TIMESTAMPING) && defined(HAVE_LINUX_PTP_CLOCK_H) && defined(HAVE_CLOCK_ADJTIME)
+#define PTPD_PHC
+#endif /* SO_TIMESTAMPING && HAVE_LINUX_PTP_CLOCK_H && HAVE_CLOCK_ADJTIME */
+
+/*
+ * Asynchronous logging: log file, syslog and stderr output handed over to
+ * a writer thread through a single producer, single consumer ring
+ */
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SEMAPHORE_H) && defined(HAVE_PTHREAD_CREATE) && defined(HAVE_SEM_TIMEDWAIT)
+#define PTPD_ASYNC_LOG
+/* longest message or statistics line carried by one queue record */
+#define ASYNCLOG_RECORD_SIZE 1024
+#define ASYNCLOG_QUEUE_MIN 16
+#define ASYNCLOG_QUEUE_MAX 65536
+/* destinations of queued log records */
+enum {
+	ASYNCLOG_EVENT = 0,
+	ASYNCLOG_STATISTICS,
+	ASYNCLOG_RECORD,
+	ASYNCLOG_TARGETS
+};
+#endif /* HAVE_PTHREAD_H && HAVE_SEMAPHORE_H && HAVE_PTHREAD_CREATE && HAVE_SEM_TIMEDWAIT */
+
+/*
+ * Boundary clock port threads: ports 2 and up each run on their own thread
+ * and event loop, talking to the main thread through lock-free queues
+ */
+#if defined(PTPD_EPOLL) && defined(PTPD_ASYNC_LOG) && defined(HAVE_SYS_EVENTFD_H) && !defined(PTPD_SLAVE_ONLY)
+#define PTPD_PORT_THREADS
+/* messages a port queue holds - power of 2 */
+#define PORT_QUEUE_SIZE 64
+/* per thread state: the port being run, the event loop and scratch buffers */
+#define PTPD_THREAD_LOCAL __thread
+#else
+#define PTPD_THREAD_LOCAL
+#endif /* PTPD_EPOLL && PTPD_ASYNC_LOG && HAVE_SYS_EVENTFD_H && !PTPD_SLAVE_ONLY */
+
 /* drift recovery metod for use with -F */
 enum {
 	DRIFT_RESET = 0,
@@ -186,6 +267,57 @@ enum {
 	TIMESTAMP_BOTH
 };
 
+/* statistics file format */
+enum {
+	STATSFILE_CSV,
+	STATSFILE_BINARY
+};
+
+/* binary statistics file: convert to CSV with ptpd2 -X */
+#define STATSFILE_MAGIC "PTPDSTAT"
+#define STATSFILE_VERSION 2
+/* file is grown (and preallocated) this much at a time */
+#define STATSFILE_CHUNK (1024 * 1024)
+/* header flags */
+#define STATSFILE_FLAG_STATISTICS	(1 << 0)	/* records carry the PTPD_STATISTICS fields */
+
+#ifdef PTPD_STATISTICS
+#define STATSFILE_FLAGS STATSFILE_FLAG_STATISTICS
+#else
+#define STATSFILE_FLAGS 0
+#endif /* PTPD_STATISTICS */
+
+/* clock servo type */
+enum {
+	SERVO_PI,
+	SERVO_KALMAN,
+	SERVO_LINREG
+};
+
+/* most samples the linear regression drift estimator can fit */
+#define LINREG_MAX_WINDOW	64
+
+/* frequency history the holdover model keeps: samples, model terms */
+#define HOLDOVER_MAX_SAMPLES	512
+#define HOLDOVER_TERMS		3
+/* seconds between frequency updates in holdover */
+#define HOLDOVER_UPDATE_INTERVAL	1
+
+/* holdover model state */
+enum {
+	HOLDOVER_DISABLED,
+	HOLDOVER_LEARNING,	/* too little history for a model yet */
+	HOLDOVER_READY,
+	HOLDOVER_ACTIVE		/* steering the clock from the model */
+};
+
+/* holdover model terms: ppb, ppb/s, ppb/unit of temperature */
+enum {
+	HOLDOVER_TERM_FREQUENCY = 0,
+	HOLDOVER_TERM_AGING,
+	HOLDOVER_TERM_TEMPERATURE
+};
+
 /* servo dT calculation mode */
 enum {
 	DT_NONE,
@@ -202,6 +334,7 @@ enum {
 	FILTER_ABSMIN,
 	FILTER_ABSMAX,
 	FILTER_MEDIAN,
+	FILTER_LUCKY,
 	FILTER_MAXVALUE
 };
 
@@ -79,6 +79,13 @@ static void parseUserVariables(dictionary *dict, dictionary *target);
 
 static void findUnknownSettings(int opCode, dictionary* source, dictionary* dict);
 
+#ifndef PTPD_SLAVE_ONLY
+static Boolean parseBoundaryClockInterfaces(RunTimeOpts *rtOpts, char *error, int errorLen);
+#ifdef PTPD_PORT_THREADS
+static Boolean parsePortThreadCpus(RunTimeOpts *rtOpts, char *error, int errorLen);
+#endif /* PTPD_PORT_THREADS */
+#endif /* PTPD_SLAVE_ONLY */
+
 
 /* Basic helper macros */
 
@@ -811,11 +818,142 @@ findUnknownSettings(int opCode, dictionary* source, dictionary* dict)
 	/* skip if the key is null or is a section */
         if(source->key[i] == NULL || strstr(source->key[i],":") == NULL)
             continue;
+#ifdef PTPD_SIM
+	/* ptpd2-sim scenario settings share the file */
+	if(simConfigKey(source->key[i]))
+	    continue;
+#endif /* PTPD_SIM */
 		    if ( !iniparser_find_entry(dict, source->key[i]) && !(opCode & CFGOP_PARSE_QUIET) )
 			WARNING("Unknown configuration entry: %s - setting will be ignored\n", source->key[i]);
     }
 }
 
+#ifndef PTPD_SLAVE_ONLY
+/*
+ * Split ptpengine:boundary_clock_interfaces into the interfaces of ports 2 and up.
+ * Returns FALSE with the reason in @error if the list cannot be used.
+ */
+static Boolean
+parseBoundaryClockInterfaces(RunTimeOpts *rtOpts, char *error, int errorLen)
+{
+
+    char* token;
+    char* stash;
+    char* text_;
+    char* text__;
+    int i;
+    Boolean ret = TRUE;
+
+    rtOpts->boundaryClockPorts = 0;
+
+    if((text_ = strdup(rtOpts->boundaryClockIfaces)) == NULL) {
+	snprintf(error, errorLen, "Could not allocate memory to parse ptpengine:boundary_clock_interfaces");
+	return FALSE;
+    }
+
+    for(text__ = text_; ret; text__ = NULL) {
+
+	token = strtok_r(text__, ", ;\t", &stash);
+	if(token == NULL)
+	    break;
+
+	if(strlen(token) >= IFACE_NAME_LENGTH) {
+	    snprintf(error, errorLen, "Configuration error: ptpengine:boundary_clock_interfaces: "
+		"interface name %s is too long", token);
+	    ret = FALSE;
+	    break;
+	}
+
+	if(rtOpts->boundaryClockPorts == PTPD_MAX_PORTS - 1) {
+	    snprintf(error, errorLen, "Configuration error: ptpengine:boundary_clock_interfaces: "
+		"a boundary clock can have at most %d ports", PTPD_MAX_PORTS);
+	    ret = FALSE;
+	    break;
+	}
+
+	if(!strcmp(token, rtOpts->primaryIfaceName)) {
+	    ret = FALSE;
+	}
+	for(i = 0; i < rtOpts->boundaryClockPorts; i++) {
+	    if(!strcmp(token, rtOpts->boundaryClockPortIfaces[i])) {
+		ret = FALSE;
+	    }
+	}
+	if(!ret) {
+	    snprintf(error, errorLen, "Configuration error: ptpengine:boundary_clock_interfaces: "
+		"interface %s is used by more than one port", token);
+	    break;
+	}
+
+	strncpy(rtOpts->boundaryClockPortIfaces[rtOpts->boundaryClockPorts++], token, IFACE_NAME_LENGTH);
+
+    }
+
+    free(text_);
+
+    return ret;
+
+}
+
+#ifdef PTPD_PORT_THREADS
+/*
+ * Split ptpengine:port_thread_cpus into the CPU core of each port thread.
+ * Returns FALSE with the reason in @error if the list cannot be used.
+ */
+static Boolean
+parsePortThreadCpus(RunTimeOpts *rtOpts, char *error, int errorLen)
+{
+
+    char* token;
+    char* stash;
+    char* text_;
+    char* text__;
+    char* end;
+    long cpu;
+    int i = 0;
+    Boolean ret = TRUE;
+
+    for(i = 0; i < PTPD_MAX_PORTS - 1; i++) {
+	rtOpts->portThreadCpus[i] = -1;
+    }
+
+    if((text_ = strdup(rtOpts->portThreadCpuList)) == NULL) {
+	snprintf(error, errorLen, "Could not allocate memory to parse ptpengine:port_thread_cpus");
+	return FALSE;
+    }
+
+    for(text__ = text_, i = 0; ret; text__ = NULL, i++) {
+
+	token = strtok_r(text__, ", ;\t", &stash);
+	if(token == NULL)
+	    break;
+
+	if(i == PTPD_MAX_PORTS - 1) {
+	    snprintf(error, errorLen, "Configuration error: ptpengine:port_thread_cpus: "
+		"more CPU cores listed than a boundary clock can have port threads (%d)", PTPD_MAX_PORTS - 1);
+	    ret = FALSE;
+	    break;
+	}
+
+	cpu = strtol(token, &end, 10);
+	if(*end != '\0' || cpu < -1 || cpu > 255) {
+	    snprintf(error, errorLen, "Configuration error: ptpengine:port_thread_cpus: "
+		"%s is not a CPU core number (0..255, -1 = not bound)", token);
+	    ret = FALSE;
+	    break;
+	}
+
+	rtOpts->portThreadCpus[i] = cpu;
+    }
+
+    free(text_);
+
+    return ret;
+
+}
+#endif /* PTPD_PORT_THREADS */
+#endif /* PTPD_SLAVE_ONLY */
+
 /*
  * IT HAPPENS HERE
  *
@@ -861,6 +999,10 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 
 	PtpEnginePreset ptpPreset;
 
+#ifndef PTPD_SLAVE_ONLY
+	char bcError[200];
+#endif /* PTPD_SLAVE_ONLY */
+
 	if(!(opCode & CFGOP_PARSE_QUIET)) {
 		INFO("Checking configuration\n");
 	}
@@ -920,6 +1062,52 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 
 	CONFIG_KEY_TRIGGER("ptpengine:backup_interface", rtOpts->backupIfaceEnabled,TRUE,FALSE);
 
+#ifndef PTPD_SLAVE_ONLY
+	parseResult &= configMapString(opCode, opArg, dict, target, "ptpengine:boundary_clock_interfaces",
+		PTPD_RESTART_DAEMON, rtOpts->boundaryClockIfaces, sizeof(rtOpts->boundaryClockIfaces), rtOpts->boundaryClockIfaces,
+		"Run a boundary clock: additional network interfaces, separated by commas,\n"
+	"	 spaces or tabs. ptpengine:interface is port 1 and every interface listed\n"
+	"	 adds a port, numbered on from ptpengine:port_number. All ports share the\n"
+	"	 clock and one best master decision: at most one port is slave and steers\n"
+	"	 the clock, the others are masters or passive. The ports use the same\n"
+	"	 settings as port 1. Up to 7 interfaces can be listed.");
+
+	CONFIG_KEY_CONFLICT("ptpengine:boundary_clock_interfaces", "ptpengine:backup_interface");
+
+	CONFIG_CONDITIONAL_ASSERTION(!parseBoundaryClockInterfaces(rtOpts, bcError, sizeof(bcError)), bcError);
+
+#ifdef PTPD_PORT_THREADS
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "ptpengine:port_threads",
+		PTPD_RESTART_DAEMON, &rtOpts->portThreads, rtOpts->portThreads,
+		"Boundary clock: run ports 2 and up on threads of their own, each with its\n"
+	"	 own event loop, so that traffic on one port does not delay another. Port 1\n"
+	"	 stays on the main thread with the clock-wide work: signals, SNMP, the status\n"
+	"	 file and the best master decision across ports. Requires global:log_async.");
+
+	CONFIG_CONDITIONAL_ASSERTION(rtOpts->portThreads && rtOpts->boundaryClockPorts == 0,
+		"Configuration error: ptpengine:port_threads requires ptpengine:boundary_clock_interfaces");
+
+	parseResult &= configMapString(opCode, opArg, dict, target, "ptpengine:port_thread_cpus",
+		PTPD_RESTART_DAEMON, rtOpts->portThreadCpuList, sizeof(rtOpts->portThreadCpuList), rtOpts->portThreadCpuList,
+		"CPU cores to bind the boundary clock port threads to, separated by commas,\n"
+	"	 spaces or tabs: the first for port 2, the next for port 3 and so on.\n"
+	"	 -1 or a missing entry = thread not bound, running on the cores of the\n"
+	"	 process (see global:cpuaffinity_cpucore).");
+
+	CONFIG_CONDITIONAL_ASSERTION(!parsePortThreadCpus(rtOpts, bcError, sizeof(bcError)), bcError);
+
+	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:port_thread_priority",
+		PTPD_RESTART_DAEMON, INTTYPE_INT, &rtOpts->portThreadPriority, rtOpts->portThreadPriority,
+		"Real-time (SCHED_FIFO) priority of the boundary clock port threads.\n"
+	"	 0 = normal scheduling. Setting a priority needs root or CAP_SYS_NICE.", RANGECHECK_RANGE,
+	0, 99);
+#else
+	rtOpts->portThreads = FALSE;
+#endif /* PTPD_PORT_THREADS */
+#else
+	rtOpts->boundaryClockPorts = 0;
+#endif /* PTPD_SLAVE_ONLY */
+
 	/* Preset option names have to be mapped to defined presets - no free strings here */
 	parseResult &= configMapSelectValue(opCode, opArg, dict, target, "ptpengine:preset",
 		PTPD_RESTART_PROTOCOL, &rtOpts->selectedPreset, rtOpts->selectedPreset,
@@ -999,6 +1187,45 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 	"	 This option can be used as a workaround where a node sends signaling messages and\n"
 	"	 timing messages with different port identities", RANGECHECK_RANGE, 0,65535);
 
+	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:unicast_grant_table_size",
+		PTPD_RESTART_DAEMON, INTTYPE_INT, &rtOpts->unicastGrantTableSize, rtOpts->unicastGrantTableSize,
+		"Size of the unicast grant table: the maximum number of unicast slaves served\n"
+	"        (master) when using unicast negotiation. The table and its hash index\n"
+	"        are allocated on startup.", RANGECHECK_RANGE, UNICAST_MAX_DESTINATIONS, UNICAST_GRANT_TABLE_MAX);
+
+#ifdef PTPD_SYNC_BATCHING
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "ptpengine:unicast_sync_batching",
+		PTPD_RESTART_NETWORK, &rtOpts->unicastSyncBatching, rtOpts->unicastSyncBatching,
+		"Master: send Sync messages to all unicast slaves in a single batch (sendmmsg)\n"
+	"        and collect their transmit timestamps asynchronously, sending each FollowUp\n"
+	"        as soon as its timestamp arrives. Requires SO_TIMESTAMPING with\n"
+	"        SOF_TIMESTAMPING_OPT_ID support.");
+
+	CONFIG_KEY_CONDITIONAL_WARNING_ISSET((rtOpts->ipMode != IPMODE_UNICAST) && rtOpts->unicastSyncBatching,
+	 			    "ptpengine:unicast_sync_batching",
+				"Sync batching can only be used with unicast transmission\n");
+
+	CONFIG_KEY_CONDITIONAL_TRIGGER(rtOpts->ipMode != IPMODE_UNICAST, rtOpts->unicastSyncBatching,FALSE, rtOpts->unicastSyncBatching);
+#endif /* PTPD_SYNC_BATCHING */
+
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "ptpengine:async_tx_timestamps",
+		PTPD_RESTART_NETWORK, &rtOpts->asyncTxTimestamps, rtOpts->asyncTxTimestamps,
+		"Do not wait for the transmit timestamps of Delay Request and Peer Delay Request\n"
+	"        messages: collect them from the main event loop as they arrive, matched by\n"
+	"        SOF_TIMESTAMPING_OPT_ID key. A late timestamp only costs that one measurement,\n"
+	"        SO_TIMESTAMPING stays in use. Set to N to wait for each timestamp, and fall\n"
+	"        back to looped packets for good on the first one missed, as before.");
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
+#ifdef PTPD_RECV_BATCHING
+	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:receive_batch_size",
+		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->recvBatchSize, rtOpts->recvBatchSize,
+		"Maximum number of packets read from the event or general socket with one\n"
+	"        recvmmsg() call and processed before polling the sockets again.\n"
+	"        1 reads a single packet per wakeup. Not used with libpcap.", RANGECHECK_RANGE, 1, RECV_BATCH_MAX);
+#endif /* PTPD_RECV_BATCHING */
+
 	CONFIG_KEY_CONDITIONAL_WARNING_ISSET((rtOpts->transport == IEEE_802_3) && rtOpts->unicastNegotiation,
 	 			    "ptpengine:unicast_negotiation",
 				"Unicast negotiation cannot be used with Ethernet transport\n");
@@ -1073,6 +1300,27 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 	"        Workaround for situations where a node (like Transparent Clock).\n"
 	"        does not rewrite checksums\n");
 
+#ifdef PTPD_PHC
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "ptpengine:hardware_timestamping",
+		PTPD_RESTART_NETWORK, &rtOpts->hwTimestamping, rtOpts->hwTimestamping,
+		"Use hardware timestamps (SIOCSHWTSTAMP, SOF_TIMESTAMPING_RAW_HARDWARE)\n"
+	"        and steer the PTP hardware clock (PHC) of the interface instead of\n"
+	"        the system clock (see clock:phc_device). Linux only, UDP transport only.\n"
+	"        The system clock can then be synchronised to the PHC by other means.\n"
+	"        Without a NIC, ptpd2-sim test/sim-phc.conf runs the PHC code against\n"
+	"        a simulated PHC.");
+
+	CONFIG_KEY_CONDITIONAL_WARNING_ISSET((rtOpts->transport == IEEE_802_3 || rtOpts->pcap) && rtOpts->hwTimestamping,
+	 			    "ptpengine:hardware_timestamping",
+				"Hardware timestamping cannot be used with Ethernet transport or libpcap\n");
+
+	CONFIG_KEY_CONDITIONAL_TRIGGER(rtOpts->transport == IEEE_802_3 || rtOpts->pcap, rtOpts->hwTimestamping,FALSE, rtOpts->hwTimestamping);
+
+	/* one PHC per interface, but a single clock to steer */
+	CONFIG_KEY_CONDITIONAL_ASSERTION("ptpengine:boundary_clock_interfaces", rtOpts->hwTimestamping,
+		"Configuration error: ptpengine:boundary_clock_interfaces cannot be used with ptpengine:hardware_timestamping");
+#endif /* PTPD_PHC */
+
 	parseResult &= configMapSelectValue(opCode, opArg, dict, target, "ptpengine:delay_mechanism",
 		PTPD_RESTART_PROTOCOL, &rtOpts->delayMechanism, rtOpts->delayMechanism,
 		 "Delay detection mode used - use DELAY_DISABLED for syntonisation only\n"
@@ -1090,7 +1338,11 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 			    "PTP port number (part of PTP Port Identity - not UDP port).\n"
 		    "        For ordinary clocks (single port), the default should be used, \n"
 		    "        but when running multiple instances to simulate a boundary clock, \n"
-		    "        The port number can be changed.",RANGECHECK_RANGE,1,65534);
+		    "        The port number can be changed. With ptpengine:boundary_clock_interfaces,\n"
+		    "        this is the number of port 1 and the other ports follow on from it.",RANGECHECK_RANGE,1,65534);
+
+	CONFIG_CONDITIONAL_ASSERTION(rtOpts->portNumber + rtOpts->boundaryClockPorts > 65534,
+		"Configuration error: ptpengine:port_number too high for the number of boundary clock ports");
 
 	parseResult &= configMapString(opCode, opArg, dict, target, "ptpengine:port_description",
 		PTPD_UPDATE_DATASETS, rtOpts->portDescription, sizeof(rtOpts->portDescription), rtOpts->portDescription,
@@ -1111,6 +1363,9 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 		PTPD_RESTART_NONE, &rtOpts->slaveOnly, ptpPreset.slaveOnly,
 		 "Slave only mode (sets clock class to 255, overriding value from preset).");
 
+	CONFIG_KEY_CONDITIONAL_ASSERTION("ptpengine:boundary_clock_interfaces", rtOpts->slaveOnly,
+		"Configuration error: ptpengine:boundary_clock_interfaces cannot be used with slave only operation");
+
 	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:inbound_latency",
 		PTPD_RESTART_NONE, INTTYPE_I32, &rtOpts->inboundLatency.nanoseconds, rtOpts->inboundLatency.nanoseconds,
 	"Specify latency correction (nanoseconds) for incoming packets.", RANGECHECK_NONE, 0,0);
@@ -1506,11 +1761,12 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 	"max", FILTER_MAX,
 	"absmin", FILTER_ABSMIN,
 	"absmax", FILTER_ABSMAX,
-	"median", FILTER_MEDIAN, NULL);
+	"median", FILTER_MEDIAN,
+	"lucky", FILTER_LUCKY, NULL);
 
 	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:sync_stat_filter_window",
 		PTPD_RESTART_FILTERS, INTTYPE_INT, &rtOpts->filterMSOpts.windowSize, rtOpts->filterMSOpts.windowSize,
-		"Number of samples used for the Sync statistical filter",RANGECHECK_RANGE,3,128);
+		"Number of samples used for the Sync statistical filter",RANGECHECK_RANGE,3,STATFILTER_MAX_SAMPLES);
 
 	parseResult &= configMapSelectValue(opCode, opArg, dict, target, "ptpengine:sync_stat_filter_window_type",
 		PTPD_RESTART_FILTERS, &rtOpts->filterMSOpts.windowType, rtOpts->filterMSOpts.windowType,
@@ -1519,6 +1775,12 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 	"sliding", WINDOW_SLIDING,
 	"interval", WINDOW_INTERVAL, NULL);
 
+	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:sync_stat_filter_percentile",
+		PTPD_RESTART_FILTERS, INTTYPE_INT, &rtOpts->filterMSOpts.percentile, rtOpts->filterMSOpts.percentile,
+		"Lucky packet Sync filter: percentage of the window with the lowest delay passed on.\n"
+	"	 Sliding window: a Sync is used only if it is in this lowest part of the window.\n"
+	"	 Interval window: the mean of this lowest part of each window is used.",RANGECHECK_RANGE,1,100);
+
 	parseResult &= configMapBoolean(opCode, opArg, dict, target, "ptpengine:delay_stat_filter_enable",
 		PTPD_RESTART_FILTERS, &rtOpts->filterSMOpts.enabled, rtOpts->filterSMOpts.enabled,
 		 "Enable statistical filter for Delay messages.");
@@ -1532,11 +1794,12 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 	"max", FILTER_MAX,
 	"absmin", FILTER_ABSMIN,
 	"absmax", FILTER_ABSMAX,
-	"median", FILTER_MEDIAN, NULL);
+	"median", FILTER_MEDIAN,
+	"lucky", FILTER_LUCKY, NULL);
 
 	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:delay_stat_filter_window",
 		PTPD_RESTART_FILTERS, INTTYPE_INT, &rtOpts->filterSMOpts.windowSize, rtOpts->filterSMOpts.windowSize,
-		"Number of samples used for the Delay statistical filter",RANGECHECK_RANGE,3,128);
+		"Number of samples used for the Delay statistical filter",RANGECHECK_RANGE,3,STATFILTER_MAX_SAMPLES);
 
 	parseResult &= configMapSelectValue(opCode, opArg, dict, target, "ptpengine:delay_stat_filter_window_type",
 		PTPD_RESTART_FILTERS, &rtOpts->filterSMOpts.windowType, rtOpts->filterSMOpts.windowType,
@@ -1545,6 +1808,12 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 	"sliding", WINDOW_SLIDING,
 	"interval", WINDOW_INTERVAL, NULL);
 
+	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:delay_stat_filter_percentile",
+		PTPD_RESTART_FILTERS, INTTYPE_INT, &rtOpts->filterSMOpts.percentile, rtOpts->filterSMOpts.percentile,
+		"Lucky packet Delay filter: percentage of the window with the lowest delay passed on.\n"
+	"	 Sliding window: a Delay Response is used only if it is in this lowest part of the window.\n"
+	"	 Interval window: the mean of this lowest part of each window is used.",RANGECHECK_RANGE,1,100);
+
 
 	parseResult &= configMapBoolean(opCode, opArg, dict, target, "ptpengine:delay_outlier_filter_enable",
 		PTPD_RESTART_FILTERS, &rtOpts->oFilterSMConfig.enabled, rtOpts->oFilterSMConfig.enabled,
@@ -1744,6 +2013,20 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 
 #endif /* PTPD_STATISTICS */
 
+	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:acquisition_period",
+		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->acquisitionPeriod, rtOpts->acquisitionPeriod,
+		"Fast initial acquisition: for this many seconds after moving to slave state,\n"
+	"	 exchange Sync and Delay Request messages at ptpengine:acquisition_log_interval\n"
+	"	 (requested from the master when using unicast negotiation, Delay Requests\n"
+	"	 only otherwise), then start the servo from the frequency offset measured\n"
+	"	 over the burst, slew out the phase offset fitted with it (step it if over\n"
+	"	 1 second) and go back to the configured intervals. Also ends\n"
+	"	 ptpengine:calibration_delay. 0 - not used.",RANGECHECK_RANGE,0,300);
+
+	parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:acquisition_log_interval",
+		PTPD_RESTART_NONE, INTTYPE_I8, &rtOpts->acquisitionLogInterval, rtOpts->acquisitionLogInterval,
+		"Sync and Delay Request interval (log 2) used during fast initial acquisition.\n"
+	"	 Never slower than the configured intervals.",RANGECHECK_RANGE,-7,0);
 
         parseResult &= configMapInt(opCode, opArg, dict, target, "ptpengine:idle_timeout",
 		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->idleTimeout, rtOpts->idleTimeout,
@@ -1919,6 +2202,20 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 		PTPD_RESTART_NONE, rtOpts->driftFile, sizeof(rtOpts->driftFile), rtOpts->driftFile,
 	"Specify drift file");
 
+#ifdef PTPD_PHC
+	parseResult &= configMapString(opCode, opArg, dict, target, "clock:phc_device",
+		PTPD_RESTART_PROTOCOL, rtOpts->phcDevice, sizeof(rtOpts->phcDevice), rtOpts->phcDevice,
+	"PTP hardware clock device (/dev/ptpN) to steer instead of the system clock.\n"
+	"        Requires ptpengine:hardware_timestamping. When empty, the PHC of the\n"
+	"        PTP interface is used. Set it when the timestamping PHC is exposed\n"
+	"        through another device.");
+
+	CONFIG_KEY_CONDITIONAL_ASSERTION("clock:phc_device",
+				    !rtOpts->hwTimestamping && strlen(rtOpts->phcDevice),
+	"Configuration error: clock:phc_device requires ptpengine:hardware_timestamping -\n"
+	"        with software timestamps, offsets are measured against the system clock");
+#endif /* PTPD_PHC */
+
 	parseResult &= configMapInt(opCode, opArg, dict, target, "clock:leap_second_pause_period",
 		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->leapSecondPausePeriod,
 		rtOpts->leapSecondPausePeriod,
@@ -1951,6 +2248,18 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 				"smear",	LEAP_SMEAR, NULL
 				);
 
+#ifdef PTPD_PHC
+	/* the kernel leap second flags only apply to the system clock */
+	CONFIG_KEY_CONDITIONAL_WARNING_ISSET((rtOpts->hwTimestamping || strlen(rtOpts->phcDevice)) &&
+				    rtOpts->leapSecondHandling == LEAP_ACCEPT,
+	 			    "clock:leap_second_handling",
+				"leap_second_handling=accept cannot be used with a PTP hardware clock - using step\n");
+
+	CONFIG_KEY_CONDITIONAL_TRIGGER((rtOpts->hwTimestamping || strlen(rtOpts->phcDevice)) &&
+				    rtOpts->leapSecondHandling == LEAP_ACCEPT,
+				    rtOpts->leapSecondHandling, LEAP_STEP, rtOpts->leapSecondHandling);
+#endif /* PTPD_PHC */
+
 	parseResult &= configMapInt(opCode, opArg, dict, target, "clock:leap_second_smear_period",
 		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->leapSecondSmearPeriod,
 		rtOpts->leapSecondSmearPeriod,
@@ -2007,6 +2316,78 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 		"Maximum servo update interval (delta t) when using measured servo update interval\n"
 	"	 (servo:dt_method = measured), specified as sync interval multiplier.", RANGECHECK_RANGE, 1.5,100.0);
 
+	parseResult &= configMapSelectValue(opCode, opArg, dict, target, "servo:type",
+		PTPD_RESTART_NONE, &rtOpts->servoType, rtOpts->servoType,
+		"Clock servo type:\n"
+	"	 pi:     PI controller (servo:kp, servo:ki),\n"
+	"	 kalman: Kalman filter estimating phase and frequency offset and measurement\n"
+	"	         noise - locks faster and holds tighter with noisy path delays.\n"
+	"	 linreg: PI controller with its frequency seeded and bounded by a least squares\n"
+	"	         fit of the last servo:linreg_window offsets - converges in a few\n"
+	"	         intervals with slow (1 per second and slower) sync rates.\n"
+	"	 The servo can be changed at run time without disturbing the clock.\n"
+	"	 The Kalman and linreg servos always use the measured update interval.",
+			"pi", SERVO_PI,
+			"kalman", SERVO_KALMAN,
+			"linreg", SERVO_LINREG, NULL
+	);
+
+	parseResult &= configMapDouble(opCode, opArg, dict, target, "servo:kalman_phase_noise",
+		PTPD_RESTART_NONE, &rtOpts->servoKalmanPhaseNoise, rtOpts->servoKalmanPhaseNoise,
+		"Kalman servo: white frequency noise of the clock (ns per square root of a second).\n"
+	"	 Higher values follow the measured offset more closely, lower values smooth it more.",
+	RANGECHECK_RANGE, 0.001, 1000000.0);
+
+	parseResult &= configMapDouble(opCode, opArg, dict, target, "servo:kalman_freq_noise",
+		PTPD_RESTART_NONE, &rtOpts->servoKalmanFreqNoise, rtOpts->servoKalmanFreqNoise,
+		"Kalman servo: frequency random walk of the clock (ppb per square root of a second).\n"
+	"	 Higher values follow frequency changes (temperature) faster, lower values\n"
+	"	 give a steadier frequency estimate.",
+	RANGECHECK_RANGE, 0.0001, 10000.0);
+
+	parseResult &= configMapInt(opCode, opArg, dict, target, "servo:linreg_window",
+		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->servoLinRegWindow, rtOpts->servoLinRegWindow,
+		"Linear regression servo: number of offset samples the frequency is estimated from.\n"
+	"	 Longer windows give a steadier estimate, shorter ones follow frequency changes faster.",
+	RANGECHECK_RANGE, 4, LINREG_MAX_WINDOW);
+
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "servo:holdover",
+		PTPD_RESTART_NONE, &rtOpts->holdover, rtOpts->holdover,
+		"Holdover: while slave, learn a model of the clock's free-running frequency\n"
+	"	 (frequency, aging and optionally temperature) and when the last master is gone,\n"
+	"	 steer the clock from it instead of leaving the last correction applied.\n"
+	"	 The estimated time error in holdover is shown in the status file and SNMP.");
+
+	parseResult &= configMapInt(opCode, opArg, dict, target, "servo:holdover_interval",
+		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->holdoverInterval, rtOpts->holdoverInterval,
+		"Holdover: the frequency is measured over intervals of this many seconds,\n"
+	"	 each one a sample of the history the model is fitted to.",
+	RANGECHECK_RANGE, 1, 3600);
+
+	parseResult &= configMapInt(opCode, opArg, dict, target, "servo:holdover_window",
+		PTPD_RESTART_NONE, INTTYPE_INT, &rtOpts->holdoverWindow, rtOpts->holdoverWindow,
+		"Holdover: time constant (seconds) of the weighting of the history - older samples\n"
+	"	 count less, and those over 8 times as old are left out. 0 - all samples count\n"
+	"	 the same, up to the last 512.",
+	RANGECHECK_RANGE, 0, 604800);
+
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "servo:holdover_aging",
+		PTPD_RESTART_NONE, &rtOpts->holdoverAging, rtOpts->holdoverAging,
+		"Holdover: model a linear frequency drift (aging) as well, where the history shows one.");
+
+	parseResult &= configMapString(opCode, opArg, dict, target, "servo:holdover_temperature_file",
+		PTPD_RESTART_NONE, rtOpts->holdoverTemperatureFile, sizeof(rtOpts->holdoverTemperatureFile),
+		rtOpts->holdoverTemperatureFile,
+		"Holdover: file holding a temperature reading (or any other proxy for it), such as\n"
+	"	 /sys/class/thermal/thermal_zone0/temp. When set, the model includes the frequency's\n"
+	"	 dependency on it, where the history shows one. Empty - not used.");
+
+	parseResult &= configMapDouble(opCode, opArg, dict, target, "servo:holdover_temperature_scale",
+		PTPD_RESTART_NONE, &rtOpts->holdoverTemperatureScale, rtOpts->holdoverTemperatureScale,
+		"Holdover: the temperature file reading is multiplied by this - 0.001 for the millidegrees\n"
+	"	 of the Linux thermal zones.",
+	RANGECHECK_NONE, 0, 0);
+
 #ifdef PTPD_STATISTICS
 	parseResult &= configMapBoolean(opCode, opArg, dict, target, "servo:stability_detection",
 		PTPD_RESTART_NONE, &rtOpts->servoStabilityDetection,
@@ -2038,6 +2419,24 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 	"	 allows to preserve observed drift if servo cannot stabilise.\n", RANGECHECK_RANGE,
 	1,60);
 
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "servo:adaptive_gain",
+		PTPD_RESTART_NONE, &rtOpts->servoAdaptiveGain, rtOpts->servoAdaptiveGain,
+		"Schedule the PI servo gains from the offset and path delay statistics:\n"
+	"	 bandwidth at servo:adaptive_gain_max while acquiring and after a step,\n"
+	"	 moving down towards servo:adaptive_gain_min while the offset mean stays\n"
+	"	 within the noise (checked every global:statistics_update_interval).\n"
+	"	 kP is scaled by the bandwidth and kI by its square. Gain changes are bumpless.");
+
+	parseResult &= configMapDouble(opCode, opArg, dict, target, "servo:adaptive_gain_max",
+		PTPD_RESTART_NONE, &rtOpts->servoGainMax, rtOpts->servoGainMax,
+		"Adaptive servo gain: PI bandwidth while acquiring, as a multiple of the configured gains.",
+	RANGECHECK_RANGE, 1.0, 100.0);
+
+	parseResult &= configMapDouble(opCode, opArg, dict, target, "servo:adaptive_gain_min",
+		PTPD_RESTART_NONE, &rtOpts->servoGainMin, rtOpts->servoGainMin,
+		"Adaptive servo gain: lowest PI bandwidth once stable, as a multiple of the configured gains.",
+	RANGECHECK_RANGE, 0.01, 1.0);
+
 #endif
 
 	parseResult &= configMapInt(opCode, opArg, dict, target, "servo:max_delay",
@@ -2167,6 +2566,13 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 		"Status file update interval in seconds.", RANGECHECK_RANGE,
 	1,30);
 
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "global:latency_histograms",
+		PTPD_RESTART_PROTOCOL, &rtOpts->latencyHistograms, rtOpts->latencyHistograms,
+		"Measure how long each stage of the Sync receive path (socket read to clock\n"
+	"	 adjustment) and of the Sync transmit path (packing to Follow_Up) takes, and\n"
+	"	 keep latency histograms of them, shown in the status file and over SNMP.\n"
+	"	 Costs one clock read per stage of every Sync and Follow_Up handled.");
+
 #ifdef RUNTIME_DEBUG
 	parseResult &= configMapSelectValue(opCode, opArg, dict, target, "global:debug_level",
 		PTPD_RESTART_NONE, (uint8_t*)&rtOpts->debug_level, rtOpts->debug_level,
@@ -2219,6 +2625,26 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 				"LOG_ALL",	LOG_ALL, NULL
 				);
 
+#ifdef PTPD_ASYNC_LOG
+	parseResult &= configMapBoolean(opCode, opArg, dict, target, "global:log_async",
+		PTPD_RESTART_LOGGING, &rtOpts->logAsync, rtOpts->logAsync,
+		"Hand log file, statistics file, syslog and console output over to a writer\n"
+	"	 thread, so the protocol engine never blocks on log I/O. Messages which do not\n"
+	"	 fit in the queue are dropped and counted.");
+
+	parseResult &= configMapInt(opCode, opArg, dict, target, "global:log_async_queue_size",
+		PTPD_RESTART_LOGGING, INTTYPE_INT, &rtOpts->logAsyncQueueSize, rtOpts->logAsyncQueueSize,
+		"Number of messages the asynchronous log queue can hold (rounded up to a power of 2).\n"
+	"	 Above 3/4 full, only messages at LOG_NOTICE or higher priority are queued.",
+	RANGECHECK_RANGE, ASYNCLOG_QUEUE_MIN, ASYNCLOG_QUEUE_MAX);
+
+#ifdef PTPD_PORT_THREADS
+	/* port threads can only log through a queue of their own */
+	CONFIG_CONDITIONAL_ASSERTION(rtOpts->portThreads && !rtOpts->logAsync,
+		"Configuration error: ptpengine:port_threads requires global:log_async");
+#endif /* PTPD_PORT_THREADS */
+#endif /* PTPD_ASYNC_LOG */
+
 	/* if statistics file specified, enable statistics logging - otherwise disable  - log_statistics also controlled further below*/
 	CONFIG_KEY_TRIGGER("global:statistics_file", rtOpts->statisticsLog.logEnabled,TRUE,FALSE);
 	CONFIG_KEY_TRIGGER("global:statistics_file", rtOpts->logStatistics,TRUE,FALSE);
@@ -2295,6 +2721,23 @@ parseConfig ( int opCode, void *opArg, dictionary* dict, RunTimeOpts *rtOpts )
 		"both",		TIMESTAMP_BOTH, NULL
 		);
 
+	parseResult &= configMapSelectValue(opCode, opArg, dict, target, "global:statistics_file_format",
+		PTPD_RESTART_LOGGING, &rtOpts->statisticsFormat, rtOpts->statisticsFormat,
+		"Format of the statistics file (global:statistics_file):\n"
+	"        csv - one comma-separated text line per entry\n"
+	"        binary - fixed size binary records written through a memory mapped,\n"
+	"                 preallocated file. Convert to CSV with "PTPD_PROGNAME" -X <file>.\n"
+	"                 Statistics printed to the console are always CSV.\n",
+		"csv",		STATSFILE_CSV,
+		"binary",	STATSFILE_BINARY, NULL
+		);
+
+#ifdef PTPD_PORT_THREADS
+	/* binary records are written by the protocol thread itself, so only by one */
+	CONFIG_CONDITIONAL_ASSERTION(rtOpts->portThreads && rtOpts->statisticsFormat == STATSFILE_BINARY,
+		"Configuration error: ptpengine:port_threads cannot be used with global:statistics_file_format=binary");
+#endif /* PTPD_PORT_THREADS */
+
 	/* If statistics file is enabled but logStatistics isn't, disable logging to file */
 	CONFIG_KEY_CONDITIONAL_TRIGGER(rtOpts->statisticsLog.logEnabled && !rtOpts->logStatistics,
 					rtOpts->statisticsLog.logEnabled, FALSE, rtOpts->statisticsLog.logEnabled);
@@ -2722,12 +3165,13 @@ Boolean loadCommandLineOptions(RunTimeOpts* rtOpts, dictionary* dict, int argc,
 	    {"unicast",		optional_argument, 0, 'U'},
 	    {"unicast-negotiation",		optional_argument, 0, 'g'},
 	    {"unicast-destinations",		required_argument, 0, 'u'},
+	    {"convert-statistics",	required_argument, 0, 'X'},
 	    {0,			0		 , 0, 0}
 	};
 
-	while ((c = getopt_long(argc, argv, "?c:kb:i:d:sgmGMWyUu:nf:S:r:DvCVHTt:he:Y:tOLEPAaR:l:p", long_options, &opt_index)) != -1) {
+	while ((c = getopt_long(argc, argv, "?c:kb:i:d:sgmGMWyUu:nf:S:r:DvCVHTt:he:Y:tOLEPAaR:l:pX:", long_options, &opt_index)) != -1) {
 #else
-	while ((c = getopt(argc, argv, "?c:kb:i:d:sgmGMWyUu:nf:S:r:DvCVHTt:he:Y:tOLEPAaR:l:p")) != -1) {
+	while ((c = getopt(argc, argv, "?c:kb:i:d:sgmGMWyUu:nf:S:r:DvCVHTt:he:Y:tOLEPAaR:l:pX:")) != -1) {
 #endif
 	    switch(c) {
 /* non-config options first */
@@ -2756,6 +3200,10 @@ short_help:
 		case 'T':
 			dumpConfigTemplates();
 			return FALSE;
+		case 'X':
+			if(statsFileConvert(optarg, stdout) < 0)
+			    *ret = 1;
+			return FALSE;
 /* regular ptpd options */
 
 		/* config file path */
@@ -2970,6 +3418,7 @@ printShortHelp()
 			"-R --lock-directory [path]	Directory to store lock files\n"
 			"-f --log-file [path]		global:log_file=[path]		Log file\n"
 			"-S --statistics-file [path]	global:statistics_file=[path]	Statistics file\n"
+			"-X --convert-statistics [path]	Print a binary statistics file as CSV and exit\n"
 			"-T --show-templates		display available configuration templates\n"
 			"-t --templates [name],[name],[...]\n"
 			"                               apply configuration template(s) - see man(5) ptpd2.conf\n"
@@ -43,6 +43,35 @@ typedef struct {
 	int ifIndex;
 } InterfaceInfo;
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+/**
+* \brief A keyed TX timestamp collected from the socket error queue
+ */
+typedef struct {
+	uint32_t key;
+	struct timespec timestamp;
+} TxTimestampEntry;
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
+#ifdef PTPD_RECV_BATCHING
+/**
+* \brief Packets drained from a socket by one recvmmsg() call
+ */
+typedef struct {
+	struct mmsghdr msgs[RECV_BATCH_MAX];
+	struct iovec iov[RECV_BATCH_MAX];
+	struct sockaddr_in from[RECV_BATCH_MAX];
+	union {
+		struct cmsghdr cm;
+		char	control[256];
+	} cmsg[RECV_BATCH_MAX];
+	Octet buf[RECV_BATCH_MAX][PACKET_SIZE];
+	/* packets received by the last recvmmsg(), next one to be processed */
+	int count;
+	int next;
+} RecvBatch;
+#endif /* PTPD_RECV_BATCHING */
+
 /**
 * \brief Struct describing network transport data
  */
@@ -84,6 +113,25 @@ typedef struct {
 	struct ether_addr etherDest;
 	struct ether_addr peerEtherDest;
 	Boolean txTimestampFailure;
+#ifdef PTPD_PHC
+	/* SOF_TIMESTAMPING_RAW_HARDWARE timestamps are used */
+	Boolean hwTimestamping;
+	/* PTP hardware clock of the interface (/dev/ptpN), -1 if none */
+	int phcIndex;
+#endif /* PTPD_PHC */
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	/* TX timestamps are keyed with SOF_TIMESTAMPING_OPT_ID */
+	Boolean txTimestampKeyed;
+	/* key the kernel will assign to the next message sent on the event socket */
+	uint32_t txTimestampKey;
+	/* keyed timestamps read while waiting for a different one */
+	TxTimestampEntry txTimestampBacklog[TXTIMESTAMP_BACKLOG_MAX];
+	int txTimestampBacklogCount;
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+#ifdef PTPD_RECV_BATCHING
+	RecvBatch eventBatch;
+	RecvBatch generalBatch;
+#endif /* PTPD_RECV_BATCHING */
 
 	Ipv4AccessList* timingAcl;
 	Ipv4AccessList* managementAcl;
@@ -103,9 +151,18 @@ typedef struct {
 
 	uint32_t lastHash;
 	UInteger32 maxSize;
+	/* bytes written since the file was opened or truncated, checked with fstat() before rotating */
 	UInteger32 fileSize;
 	int maxFiles;
 
+	/* message being logged, formatted once for all destinations */
+	char lineBuf[PATH_MAX+1];
+
+	/* binary statistics file written through a shared mapping, see statsfile.c */
+	Boolean binary;
+	Octet *map;
+	size_t mapSize;
+
 } LogFileHandler;
 
 
@@ -33,6 +33,11 @@
 #define EVENTTIMER_MAX_DESC		20
 #define EVENTTIMER_MIN_INTERVAL_US	250 /* 4000/sec */
 
+#ifdef PTPD_EPOLL
+/* maximum number of non-timer descriptors watched by the event loop: up to 4 per port */
+#define EVENTLOOP_MAX_FDS		(4 * PTPD_MAX_PORTS)
+#endif /* PTPD_EPOLL */
+
 typedef struct EventTimer EventTimer;
 
 struct EventTimer {
@@ -51,12 +56,18 @@ struct EventTimer {
 	Boolean (*isRunning) (EventTimer* timer);	
 
 	/* implementation data */
-#ifdef PTPD_PTIMERS
+#if defined(PTPD_SIM)
+	/* simulated time of the next expiry, and the period - ns */
+	int64_t simDeadline;
+	int64_t simInterval;
+#elif defined(PTPD_EPOLL)
+	int timerFd;
+#elif defined(PTPD_PTIMERS)
 	timer_t timerId;
 #else
 	int32_t itimerInterval;
 	int32_t itimerLeft;
-#endif /* PTPD_PTIMERS */
+#endif /* PTPD_EPOLL */
 
 	/* linked list */
 	EventTimer *_first;
@@ -0,0 +1,392 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ * Copyright (c) 2015      Wojciech Owczarek,
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   eventtimer_epoll.c
+ * @date   Mon Feb 1 12:10:05 2016
+ *
+ * @brief  EventTimer implementation using timerfd and epoll
+ *
+ * Every timer owns a timerfd, and all of them are registered with a
+ * single epoll instance, together with any descriptors the network
+ * code asks us to watch. The main loop sleeps in epoll_wait() until
+ * either a timer fires or a packet arrives - no signals involved.
+ */
+
+#include "../ptpd.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+/* timers should be based on CLOCK_MONOTONIC */
+#define CLK_TYPE CLOCK_MONOTONIC
+
+/* how many events we collect in one epoll_wait() call */
+#define EVENTLOOP_MAX_EVENTS (PTP_MAX_TIMER + EVENTLOOP_MAX_FDS)
+
+static void eventTimerStart_epoll(EventTimer *timer, double interval);
+static void eventTimerStop_epoll(EventTimer *timer);
+static void eventTimerReset_epoll(EventTimer *timer);
+static void eventTimerShutdown_epoll(EventTimer *timer);
+static Boolean eventTimerIsRunning_epoll(EventTimer *timer);
+static Boolean eventTimerIsExpired_epoll(EventTimer *timer);
+
+/* the epoll instance shared by all timers and registered descriptors - one per thread */
+static PTPD_THREAD_LOCAL int loopFd = -1;
+
+/*
+ * registered (non-timer) descriptors: epoll hands us back a pointer
+ * into this table, which is how we tell them apart from timers
+ */
+static PTPD_THREAD_LOCAL int loopFds[EVENTLOOP_MAX_FDS];
+static PTPD_THREAD_LOCAL Boolean loopFdsInitialised = FALSE;
+
+static int
+getLoopFd(void)
+{
+
+	int i;
+
+	if(!loopFdsInitialised) {
+	    for(i = 0; i < EVENTLOOP_MAX_FDS; i++) {
+		loopFds[i] = -1;
+	    }
+	    loopFdsInitialised = TRUE;
+	}
+
+	if(loopFd < 0) {
+	    if((loopFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		PERROR("Could not create epoll instance");
+	    } else {
+		DBGV("Created event loop epoll instance %d\n", loopFd);
+	    }
+	}
+
+	return loopFd;
+
+}
+
+void
+setupEventTimer(EventTimer *timer)
+{
+
+	struct epoll_event ev;
+
+	if(timer == NULL) {
+	    return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	memset(timer, 0, sizeof(EventTimer));
+
+	timer->start = eventTimerStart_epoll;
+	timer->stop = eventTimerStop_epoll;
+	timer->reset = eventTimerReset_epoll;
+	timer->shutdown = eventTimerShutdown_epoll;
+	timer->isExpired = eventTimerIsExpired_epoll;
+	timer->isRunning = eventTimerIsRunning_epoll;
+
+	if((timer->timerFd = timerfd_create(CLK_TYPE, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+	    PERROR("Could not create timerfd for timer %s", timer->id);
+	    return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = timer;
+
+	if(epoll_ctl(getLoopFd(), EPOLL_CTL_ADD, timer->timerFd, &ev) < 0) {
+	    PERROR("Could not register timerfd for timer %s", timer->id);
+	    close(timer->timerFd);
+	    timer->timerFd = -1;
+	} else {
+	    DBGV("Created timerfd timer %s\n", timer->id);
+	}
+
+}
+
+static void
+eventTimerStart_epoll(EventTimer *timer, double interval)
+{
+
+	struct timespec ts;
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+
+	ts.tv_sec = interval;
+	ts.tv_nsec = (interval - ts.tv_sec) * 1E9;
+
+	if(!ts.tv_sec && ts.tv_nsec < EVENTTIMER_MIN_INTERVAL_US * 1000) {
+	    ts.tv_nsec = EVENTTIMER_MIN_INTERVAL_US * 1000;
+	}
+
+	DBGV("Timer %s start requested at %d.%4d sec interval\n", timer->id, ts.tv_sec, ts.tv_nsec);
+
+	its.it_interval = ts;
+	its.it_value = ts;
+
+	if (timerfd_settime(timer->timerFd, 0, &its, NULL) < 0) {
+		PERROR("could not arm timerfd timer %s", timer->id);
+		return;
+	}
+
+	DBG2("timerStart:     Set timer %s to %f\n", timer->id, interval);
+
+	timer->expired = FALSE;
+	timer->running = TRUE;
+
+}
+
+static void
+eventTimerStop_epoll(EventTimer *timer)
+{
+
+	struct itimerspec its;
+
+	DBGV("Timer %s stop requested\n", timer->id);
+
+	memset(&its, 0, sizeof(its));
+
+	if (timerfd_settime(timer->timerFd, 0, &its, NULL) < 0) {
+		PERROR("could not stop timerfd timer %s", timer->id);
+		return;
+	}
+
+	timer->running = FALSE;
+
+	DBG2("timerStop: stopped timer %s\n", timer->id);
+
+}
+
+static void
+eventTimerReset_epoll(EventTimer *timer)
+{
+}
+
+static void
+eventTimerShutdown_epoll(EventTimer *timer)
+{
+
+	if(timer->timerFd < 0) {
+	    return;
+	}
+
+	/* closing the fd also removes it from the epoll set */
+	if(close(timer->timerFd) == -1) {
+	    PERROR("Could not close timerfd for timer %s!", timer->id);
+	}
+
+	timer->timerFd = -1;
+
+}
+
+static Boolean
+eventTimerIsRunning_epoll(EventTimer *timer)
+{
+
+	DBG2("timerIsRunning:   Timer %s %s running\n", timer->id,
+		timer->running ? "is" : "is not");
+
+	return timer->running;
+}
+
+static Boolean
+eventTimerIsExpired_epoll(EventTimer *timer)
+{
+
+	Boolean ret;
+
+	ret = timer->expired;
+
+	DBG2("timerIsExpired:   Timer %s %s expired\n", timer->id,
+		timer->expired ? "is" : "is not");
+
+	/* the five monkeys experiment */
+	if(ret) {
+	    timer->expired = FALSE;
+	}
+
+	return ret;
+
+}
+
+void
+startEventTimers(void)
+{
+
+	DBG("initTimer\n");
+
+	getLoopFd();
+
+}
+
+void
+shutdownEventTimers(void)
+{
+
+	if(loopFd >= 0) {
+	    close(loopFd);
+	    loopFd = -1;
+	}
+
+}
+
+/* register a descriptor with the event loop */
+Boolean
+eventLoopAddFd(int fd)
+{
+
+	struct epoll_event ev;
+	int i;
+
+	if(fd < 0 || getLoopFd() < 0) {
+	    return FALSE;
+	}
+
+	for(i = 0; i < EVENTLOOP_MAX_FDS; i++) {
+	    if(loopFds[i] == -1) {
+		break;
+	    }
+	}
+
+	if(i == EVENTLOOP_MAX_FDS) {
+	    ERROR("Event loop descriptor table full - cannot register fd %d\n", fd);
+	    return FALSE;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &loopFds[i];
+
+	if(epoll_ctl(loopFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	    PERROR("Could not add fd %d to event loop", fd);
+	    return FALSE;
+	}
+
+	loopFds[i] = fd;
+
+	DBGV("Registered fd %d with event loop\n", fd);
+
+	return TRUE;
+
+}
+
+/* remove a descriptor from the event loop - call before closing it */
+void
+eventLoopRemoveFd(int fd)
+{
+
+	int i;
+
+	if(fd < 0 || loopFd < 0) {
+	    return;
+	}
+
+	for(i = 0; i < EVENTLOOP_MAX_FDS; i++) {
+	    if(loopFds[i] == fd) {
+		epoll_ctl(loopFd, EPOLL_CTL_DEL, fd, NULL);
+		loopFds[i] = -1;
+		DBGV("Removed fd %d from event loop\n", fd);
+		return;
+	    }
+	}
+
+}
+
+/* the epoll descriptor itself, so it can be nested in someone else's select() */
+int
+eventLoopFd(void)
+{
+	return getLoopFd();
+}
+
+/*
+ * Sleep until the next timer expiry or until a registered descriptor
+ * becomes readable, or until timeout passes (NULL = no timeout).
+ * Expired timers are latched, readable descriptors are returned in readfds.
+ * Returns the number of readable descriptors, 0 if only timers fired
+ * or the wait was interrupted, -1 on error.
+ */
+int
+eventLoopWait(TimeInternal *timeout, fd_set *readfds)
+{
+
+	struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+	EventTimer *timer;
+	uint64_t expirations;
+	int timeoutMs = -1;
+	int ret, i;
+	int ready = 0;
+
+	if(getLoopFd() < 0) {
+	    return -1;
+	}
+
+	/*
+	 * round up: a sub-millisecond remainder truncated to 0 would
+	 * turn the wait into a poll and spin until the deadline
+	 */
+	if(timeout != NULL) {
+	    timeoutMs = timeout->seconds * 1000 + (timeout->nanoseconds + 999999) / 1000000;
+	}
+
+	ret = epoll_wait(loopFd, events, EVENTLOOP_MAX_EVENTS, timeoutMs);
+
+	if(ret < 0) {
+	    if(errno == EINTR) {
+		return 0;
+	    }
+	    return -1;
+	}
+
+	for(i = 0; i < ret; i++) {
+
+	    /* a registered descriptor */
+	    if((int*)events[i].data.ptr >= loopFds &&
+		(int*)events[i].data.ptr < loopFds + EVENTLOOP_MAX_FDS) {
+		int fd = *(int*)events[i].data.ptr;
+		if(fd >= 0 && readfds != NULL) {
+		    FD_SET(fd, readfds);
+		    ready++;
+		}
+		continue;
+	    }
+
+	    /* a timer: drain the expiration count and latch the expiry */
+	    timer = (EventTimer*)events[i].data.ptr;
+	    if(read(timer->timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+		timer->expired = TRUE;
+		DBG2("Timer %s expired (%llu expirations)\n", timer->id,
+		    (unsigned long long)expirations);
+	    }
+
+	}
+
+	return ready;
+
+}
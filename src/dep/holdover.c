@@ -0,0 +1,607 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   holdover.c
+ * @date   Mon May 30 14:02:51 2016
+ *
+ * @brief  Holdover: a model of the free-running clock frequency, learnt
+ *         while slave, steering the clock when there is no master
+ *
+ * While the servo runs, the frequency the clock would have run at on its
+ * own is measured over every servo:holdover_interval: the corrections
+ * applied over the interval, integrated, plus what the offset from master
+ * moved by. That is exact whatever the servo does, so the history does
+ * not depend on the servo having settled. A weighted least squares fit
+ * over the history, newer samples counting more, gives the frequency
+ * and, where they stand out from the noise, its aging and its dependency
+ * on a temperature reading.
+ *
+ * When the last master goes, the clock is steered from the model, and
+ * the time error is estimated from the offset at the time, the model's
+ * own uncertainty integrated over the holdover and the scatter of the
+ * history around the model.
+ */
+
+#include "../ptpd.h"
+
+/* fewest samples the model is fitted to */
+#define HOLDOVER_MIN_SAMPLES	5
+
+/* a term is kept if its coefficient is this many standard errors from zero */
+#define HOLDOVER_SIGNIFICANCE	2.0
+
+/* a sample further than this many (robust) standard deviations from the model is left out */
+#define HOLDOVER_OUTLIER	5.0
+
+/* an interval with a longer gap between clock updates is abandoned, in intervals */
+#define HOLDOVER_MAX_GAP	0.5
+
+/* samples older than this many windows are left out of the fit */
+#define HOLDOVER_HORIZON	8.0
+
+static const char* stateNames[] = {
+	[HOLDOVER_DISABLED] = "disabled",
+	[HOLDOVER_LEARNING] = "learning",
+	[HOLDOVER_READY] = "ready",
+	[HOLDOVER_ACTIVE] = "active"
+};
+
+const char*
+holdoverStateName(int state)
+{
+	if(state < HOLDOVER_DISABLED || state > HOLDOVER_ACTIVE) {
+		return "unknown";
+	}
+
+	return stateNames[state];
+}
+
+static double
+monotonicNow(void)
+{
+	TimeInternal now;
+
+	getTimeMonotonic(&now);
+	return now.seconds + now.nanoseconds / 1E9;
+}
+
+/* one reading of the temperature file, scaled; FALSE if none */
+static Boolean
+readTemperature(const RunTimeOpts *rtOpts, double *value)
+{
+	FILE *fp;
+	Boolean ret;
+
+	if(!strlen(rtOpts->holdoverTemperatureFile)) {
+		return FALSE;
+	}
+
+	if((fp = fopen(rtOpts->holdoverTemperatureFile, "r")) == NULL) {
+		DBG("holdover: could not open temperature file %s: %s\n",
+		    rtOpts->holdoverTemperatureFile, strerror(errno));
+		return FALSE;
+	}
+
+	ret = (fscanf(fp, "%lf", value) == 1);
+	fclose(fp);
+
+	if(!ret) {
+		DBG("holdover: no reading in temperature file %s\n", rtOpts->holdoverTemperatureFile);
+		return FALSE;
+	}
+
+	*value *= rtOpts->holdoverTemperatureScale;
+	return TRUE;
+}
+
+void
+holdoverReset(HoldoverModel *model, const RunTimeOpts *rtOpts)
+{
+	memset(model, 0, sizeof(HoldoverModel));
+	model->state = rtOpts->holdover ? HOLDOVER_LEARNING : HOLDOVER_DISABLED;
+}
+
+/* the interval in progress can not be used: a clock step, or the servo not running */
+void
+holdoverBreak(HoldoverModel *model)
+{
+	model->open = FALSE;
+}
+
+/* invert a small symmetric matrix in place, Gauss-Jordan; FALSE if singular */
+static Boolean
+invert(double m[HOLDOVER_TERMS][HOLDOVER_TERMS], int n)
+{
+	double inv[HOLDOVER_TERMS][HOLDOVER_TERMS];
+	double pivot, factor;
+	int i, j, k, best;
+
+	for(i = 0; i < n; i++) {
+		for(j = 0; j < n; j++) {
+			inv[i][j] = (i == j);
+		}
+	}
+
+	for(i = 0; i < n; i++) {
+		best = i;
+		for(k = i + 1; k < n; k++) {
+			if(fabs(m[k][i]) > fabs(m[best][i])) {
+				best = k;
+			}
+		}
+		if(fabs(m[best][i]) < 1E-300) {
+			return FALSE;
+		}
+		for(j = 0; j < n; j++) {
+			factor = m[i][j]; m[i][j] = m[best][j]; m[best][j] = factor;
+			factor = inv[i][j]; inv[i][j] = inv[best][j]; inv[best][j] = factor;
+		}
+		pivot = m[i][i];
+		for(j = 0; j < n; j++) {
+			m[i][j] /= pivot;
+			inv[i][j] /= pivot;
+		}
+		for(k = 0; k < n; k++) {
+			if(k == i) {
+				continue;
+			}
+			factor = m[k][i];
+			for(j = 0; j < n; j++) {
+				m[k][j] -= factor * m[i][j];
+				inv[k][j] -= factor * inv[i][j];
+			}
+		}
+	}
+
+	memcpy(m, inv, sizeof(inv));
+	return TRUE;
+}
+
+/*
+ * Weighted least squares fit of the terms asked for. The weights are not
+ * inverse variances, so the covariance is the sandwich estimate, with the
+ * residual variance corrected for the effective number of samples.
+ */
+static Boolean
+fitModel(HoldoverModel *model, const RunTimeOpts *rtOpts, Boolean aging, Boolean temperature)
+{
+	int terms[HOLDOVER_TERMS];
+	double a[HOLDOVER_TERMS][HOLDOVER_TERMS], b[HOLDOVER_TERMS][HOLDOVER_TERMS];
+	double rhs[HOLDOVER_TERMS], beta[HOLDOVER_TERMS], x[HOLDOVER_TERMS];
+	double w, r, sw = 0.0, sw2 = 0.0, swr2 = 0.0, swt = 0.0, neff, variance;
+	double reference, tempReference = 0.0;
+	int i, j, k, l, n = 0;
+
+	terms[n++] = HOLDOVER_TERM_FREQUENCY;
+	if(aging) {
+		terms[n++] = HOLDOVER_TERM_AGING;
+	}
+	if(temperature) {
+		terms[n++] = HOLDOVER_TERM_TEMPERATURE;
+	}
+
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+	memset(rhs, 0, sizeof(rhs));
+
+	reference = model->time[(model->next + HOLDOVER_MAX_SAMPLES - 1) % HOLDOVER_MAX_SAMPLES];
+
+/* the history is a ring, but the fit does not care about the order */
+#define HOLDOVER_WEIGHT(i) (rtOpts->holdoverWindow > 0 ? \
+	exp(-(reference - model->time[i]) / rtOpts->holdoverWindow) : 1.0)
+#define HOLDOVER_EXPIRED(i) (model->outlier[i] || (rtOpts->holdoverWindow > 0 && \
+	reference - model->time[i] > HOLDOVER_HORIZON * rtOpts->holdoverWindow))
+
+	/* temperature is taken from its weighted mean, which keeps the fit well conditioned */
+	if(temperature) {
+		for(i = 0; i < model->count; i++) {
+			if(HOLDOVER_EXPIRED(i)) {
+				continue;
+			}
+			w = HOLDOVER_WEIGHT(i);
+			swt += w * model->temperature[i];
+			sw += w;
+		}
+		tempReference = swt / sw;
+		sw = 0.0;
+	}
+
+	for(i = 0; i < model->count; i++) {
+		if(HOLDOVER_EXPIRED(i)) {
+			continue;
+		}
+		if(temperature && !model->hasTemperature[i]) {
+			return FALSE;
+		}
+		w = HOLDOVER_WEIGHT(i);
+		x[0] = 1.0;
+		x[1] = model->time[i] - reference;
+		x[2] = model->temperature[i] - tempReference;
+		for(k = 0; k < n; k++) {
+			for(l = 0; l < n; l++) {
+				a[k][l] += w * x[terms[k]] * x[terms[l]];
+				b[k][l] += w * w * x[terms[k]] * x[terms[l]];
+			}
+			rhs[k] += w * x[terms[k]] * model->frequency[i];
+		}
+		sw += w;
+		sw2 += w * w;
+	}
+
+	neff = sw * sw / sw2;
+	if(neff < n + 2.0 || !invert(a, n)) {
+		return FALSE;
+	}
+
+	for(k = 0; k < n; k++) {
+		beta[k] = 0.0;
+		for(l = 0; l < n; l++) {
+			beta[k] += a[k][l] * rhs[l];
+		}
+	}
+
+	for(i = 0; i < model->count; i++) {
+		if(HOLDOVER_EXPIRED(i)) {
+			continue;
+		}
+		w = HOLDOVER_WEIGHT(i);
+		x[0] = 1.0;
+		x[1] = model->time[i] - reference;
+		x[2] = model->temperature[i] - tempReference;
+		r = model->frequency[i];
+		for(k = 0; k < n; k++) {
+			r -= beta[k] * x[terms[k]];
+		}
+		swr2 += w * r * r;
+	}
+
+#undef HOLDOVER_WEIGHT
+#undef HOLDOVER_EXPIRED
+
+	variance = swr2 / sw * neff / (neff - n);
+	model->residual = sqrt(variance);
+	model->reference = reference;
+	model->tempReference = tempReference;
+
+	memset(model->coeff, 0, sizeof(model->coeff));
+	memset(model->covariance, 0, sizeof(model->covariance));
+
+	for(k = 0; k < n; k++) {
+		model->coeff[terms[k]] = beta[k];
+		for(l = 0; l < n; l++) {
+			/* (A^-1 B A^-1)[k][l] */
+			double c = 0.0;
+			for(i = 0; i < n; i++) {
+				for(j = 0; j < n; j++) {
+					c += a[k][i] * b[i][j] * a[j][l];
+				}
+			}
+			model->covariance[terms[k]][terms[l]] = variance * c;
+		}
+	}
+
+	model->aging = aging;
+	model->temperatureTerm = temperature;
+
+	return TRUE;
+}
+
+static double predictFrequency(const HoldoverModel *model, double t, Boolean hasTemperature,
+    double temperature, double *error);
+
+/*
+ * Flag the samples too far from the model just fitted - an interval spanning
+ * a path delay change, or before the delay was measured. The scale is the
+ * median absolute residual, which the outliers themselves do not inflate.
+ * Returns the number of samples newly flagged.
+ */
+static int
+flagOutliers(HoldoverModel *model, const RunTimeOpts *rtOpts)
+{
+	double residuals[HOLDOVER_MAX_SAMPLES], sorted[HOLDOVER_MAX_SAMPLES];
+	double error, limit;
+	double horizon = HOLDOVER_HORIZON * rtOpts->holdoverWindow;
+	int i, n = 0, flagged = 0;
+
+	for(i = 0; i < model->count; i++) {
+		residuals[i] = fabs(model->frequency[i] - predictFrequency(model, model->time[i],
+		    model->hasTemperature[i], model->temperature[i], &error));
+		if(!model->outlier[i] && (horizon <= 0.0 || model->reference - model->time[i] <= horizon)) {
+			sorted[n++] = residuals[i];
+		}
+	}
+
+	if(n < HOLDOVER_MIN_SAMPLES) {
+		return 0;
+	}
+
+	qsort(sorted, n, sizeof(double), cmpDouble);
+	/* 1.4826 MAD estimates the standard deviation of normal noise */
+	limit = HOLDOVER_OUTLIER * 1.4826 * sorted[n / 2];
+
+	for(i = 0; i < model->count; i++) {
+		if(!model->outlier[i] && residuals[i] > limit) {
+			model->outlier[i] = TRUE;
+			flagged++;
+		}
+	}
+
+	return flagged;
+}
+
+/* fit every term there is data for, then again without those lost in the noise */
+static void
+updateModel(HoldoverModel *model, const RunTimeOpts *rtOpts)
+{
+	Boolean aging = rtOpts->holdoverAging;
+	Boolean temperature = strlen(rtOpts->holdoverTemperatureFile) > 0;
+	Boolean keepAging, keepTemperature;
+
+	if(model->count < HOLDOVER_MIN_SAMPLES) {
+		return;
+	}
+
+	/* outliers are found again every time, against the model as it is now */
+	memset(model->outlier, 0, sizeof(model->outlier));
+
+	/* the full model may be more than the history supports */
+	if(!fitModel(model, rtOpts, aging, temperature) &&
+	    !fitModel(model, rtOpts, aging, FALSE) &&
+	    !fitModel(model, rtOpts, FALSE, FALSE)) {
+		return;
+	}
+
+	if(flagOutliers(model, rtOpts) &&
+	    !fitModel(model, rtOpts, model->aging, model->temperatureTerm)) {
+		return;
+	}
+
+	keepAging = model->aging &&
+	    fabs(model->coeff[HOLDOVER_TERM_AGING]) > HOLDOVER_SIGNIFICANCE * sqrt(model->covariance[HOLDOVER_TERM_AGING][HOLDOVER_TERM_AGING]);
+	keepTemperature = model->temperatureTerm &&
+	    fabs(model->coeff[HOLDOVER_TERM_TEMPERATURE]) > HOLDOVER_SIGNIFICANCE *
+		sqrt(model->covariance[HOLDOVER_TERM_TEMPERATURE][HOLDOVER_TERM_TEMPERATURE]);
+
+	if(keepAging != model->aging || keepTemperature != model->temperatureTerm) {
+		fitModel(model, rtOpts, keepAging, keepTemperature);
+	}
+
+	if(model->state == HOLDOVER_LEARNING) {
+		INFO("Holdover model ready: %.03f ppb after %d samples\n",
+		    model->coeff[HOLDOVER_TERM_FREQUENCY], model->count);
+		model->state = HOLDOVER_READY;
+	}
+
+	DBG("holdover model: %.03f ppb, aging %.06f ppb/s, temperature %.03f ppb/unit, residual %.03f ppb, %d samples\n",
+	    model->coeff[HOLDOVER_TERM_FREQUENCY], model->coeff[HOLDOVER_TERM_AGING], model->coeff[HOLDOVER_TERM_TEMPERATURE],
+	    model->residual, model->count);
+}
+
+/* the model's frequency at time t, and its standard error */
+static double
+predictFrequency(const HoldoverModel *model, double t, Boolean hasTemperature, double temperature, double *error)
+{
+	double g[HOLDOVER_TERMS];
+	double f = 0.0, variance = 0.0;
+	int i, j;
+
+	g[HOLDOVER_TERM_FREQUENCY] = 1.0;
+	g[HOLDOVER_TERM_AGING] = model->aging ? t - model->reference : 0.0;
+	g[HOLDOVER_TERM_TEMPERATURE] = (model->temperatureTerm && hasTemperature) ? temperature - model->tempReference : 0.0;
+
+	for(i = 0; i < HOLDOVER_TERMS; i++) {
+		f += model->coeff[i] * g[i];
+		for(j = 0; j < HOLDOVER_TERMS; j++) {
+			variance += g[i] * model->covariance[i][j] * g[j];
+		}
+	}
+
+	*error = sqrt(max(variance, 0.0));
+	return f;
+}
+
+/*
+ * Called on every clock update once the servo has run, with the frequency
+ * correction it applied (the negated adjustment, ppb). Closes an interval
+ * and refits the model every servo:holdover_interval.
+ */
+void
+holdoverSample(HoldoverModel *model, const RunTimeOpts *rtOpts, const double offset, const double output)
+{
+	double now, length, temperature = 0.0;
+	Boolean hasTemperature;
+	int i;
+
+	if(!rtOpts->holdover) {
+		if(model->state != HOLDOVER_DISABLED) {
+			holdoverReset(model, rtOpts);
+		}
+		return;
+	}
+
+	if(model->state == HOLDOVER_DISABLED) {
+		holdoverReset(model, rtOpts);
+	}
+
+	now = monotonicNow();
+	model->lastOffset = offset;
+
+	if(model->open && now - model->last > HOLDOVER_MAX_GAP * rtOpts->holdoverInterval) {
+		DBG("holdover: %.0f s without clock updates - sample interval restarted\n", now - model->last);
+		model->open = FALSE;
+	}
+
+	if(!model->open) {
+		model->open = TRUE;
+		model->start = now;
+		model->last = now;
+		model->startOffset = offset;
+		model->integral = 0.0;
+		model->output = output;
+		model->startHasTemperature = readTemperature(rtOpts, &model->startTemperature);
+		return;
+	}
+
+	model->integral += model->output * (now - model->last);
+	model->last = now;
+	model->output = output;
+
+	length = now - model->start;
+	if(length < rtOpts->holdoverInterval) {
+		return;
+	}
+
+	hasTemperature = readTemperature(rtOpts, &temperature);
+
+	/* the offset moves at the free-running frequency less the correction */
+	i = model->next;
+	model->time[i] = model->start + length / 2.0;
+	model->frequency[i] = (model->integral + offset - model->startOffset) / length;
+	model->hasTemperature[i] = hasTemperature && model->startHasTemperature;
+	model->temperature[i] = model->hasTemperature[i] ? (temperature + model->startTemperature) / 2.0 : 0.0;
+	model->next = (i + 1) % HOLDOVER_MAX_SAMPLES;
+	if(model->count < HOLDOVER_MAX_SAMPLES) {
+		model->count++;
+	}
+
+	DBGV("holdover: sample %d: %.03f ppb over %.03f s\n", model->count, model->frequency[i], length);
+
+	/* the next interval starts where this one ended */
+	model->start = now;
+	model->startOffset = offset;
+	model->integral = 0.0;
+	model->startTemperature = temperature;
+	model->startHasTemperature = hasTemperature;
+
+	updateModel(model, rtOpts);
+}
+
+/*
+ * The last master is gone: steer the clock from the model, if there is one.
+ * Returns TRUE if holdover has started.
+ */
+Boolean
+startHoldover(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	HoldoverModel *model = &ptpClock->holdover;
+
+	if(!rtOpts->holdover || rtOpts->noAdjust || model->state == HOLDOVER_ACTIVE) {
+		return FALSE;
+	}
+
+	if(model->state != HOLDOVER_READY) {
+		NOTICE("No master - holdover model not ready (%d samples), clock left at %.03f ppb\n",
+		    model->count, ptpClock->servo.observedDrift);
+		return FALSE;
+	}
+
+	model->open = FALSE;
+	model->state = HOLDOVER_ACTIVE;
+	model->entered = monotonicNow();
+	model->lastUpdate = model->entered;
+	model->entryOffset = fabs(model->lastOffset);
+	model->modelError = 0.0;
+	model->hasCurrentTemperature = FALSE;
+
+	NOTICE("No master - holdover: clock steered from the model, %.03f ppb, aging %.03f ppb/h%s, "
+	    "residual %.03f ppb over %d samples\n",
+	    model->coeff[HOLDOVER_TERM_FREQUENCY], model->coeff[HOLDOVER_TERM_AGING] * 3600.0,
+	    model->temperatureTerm ? ", temperature compensated" : "",
+	    model->residual, model->count);
+
+	updateHoldover(rtOpts, ptpClock);
+
+	return TRUE;
+}
+
+/*
+ * Every HOLDOVER_UPDATE_INTERVAL in holdover: the frequency the model
+ * gives for now, and the time error it is likely to have let in so far.
+ * The clock is only adjusted while no other timing service has it.
+ */
+void
+updateHoldover(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	HoldoverModel *model = &ptpClock->holdover;
+	double now, error, elapsed, temperature;
+
+	if(model->state != HOLDOVER_ACTIVE) {
+		return;
+	}
+
+	if(!rtOpts->holdover) {
+		stopHoldover(rtOpts, ptpClock, FALSE);
+		return;
+	}
+
+	now = monotonicNow();
+
+	if(readTemperature(rtOpts, &temperature)) {
+		model->currentTemperature = temperature;
+		model->hasCurrentTemperature = TRUE;
+	}
+
+	model->predicted = predictFrequency(model, now, model->hasCurrentTemperature,
+	    model->currentTemperature, &error);
+
+	/* the model's error is a frequency error for the whole holdover, not noise averaging out */
+	model->modelError += error * (now - model->lastUpdate);
+	model->lastUpdate = now;
+	elapsed = now - model->entered;
+	model->errorEstimate = model->entryOffset + model->modelError +
+	    model->residual * sqrt(rtOpts->holdoverInterval * elapsed);
+
+	DBGV("holdover: %.0f s, %.03f ppb +/- %.03f, estimated error %.0f ns\n",
+	    elapsed, model->predicted, error, model->errorEstimate);
+
+	if(ptpClock->clockControl.granted || timingDomain.current == NULL) {
+		ptpClock->servo.observedDrift = model->predicted;
+		adjFreq_wrapper(rtOpts, ptpClock, -model->predicted);
+	}
+}
+
+/* a master is back, or holdover is no longer wanted; the servo starts from the model if resuming */
+void
+stopHoldover(const RunTimeOpts *rtOpts, PtpClock *ptpClock, Boolean resume)
+{
+	HoldoverModel *model = &ptpClock->holdover;
+
+	if(model->state != HOLDOVER_ACTIVE) {
+		return;
+	}
+
+	NOTICE("Holdover ended after %.0f s, estimated time error %.0f ns\n",
+	    model->lastUpdate - model->entered, model->errorEstimate);
+
+	model->state = rtOpts->holdover ? HOLDOVER_READY : HOLDOVER_DISABLED;
+
+	if(resume && !rtOpts->noAdjust) {
+		ptpClock->servo.observedDrift = model->predicted;
+		adjFreq_wrapper(rtOpts, ptpClock, -model->predicted);
+	}
+}
@@ -0,0 +1,191 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   latency.c
+ * @date   Tue May 3 10:41:18 2016
+ *
+ * @brief  Hot path latency probes and log-linear latency histograms
+ *
+ * A histogram has fixed buckets, so recording a value is a count of the
+ * leading zeros and an increment: nothing is allocated or sorted on the
+ * paths being measured, and percentiles are only worked out when asked.
+ */
+
+#include "../ptpd.h"
+
+static const char* stageNames[LATENCY_STAGES] = {
+	[LATENCY_RX_RECV] = "RX recv",
+	[LATENCY_RX_PROCESS] = "RX process",
+	[LATENCY_RX_HANDLE] = "RX handle",
+	[LATENCY_RX_OFFSET] = "RX offset",
+	[LATENCY_RX_SERVO] = "RX servo",
+	[LATENCY_RX_ADJFREQ] = "RX adjFreq",
+	[LATENCY_RX_TOTAL] = "RX total",
+	[LATENCY_TX_PACK] = "TX pack",
+	[LATENCY_TX_SEND] = "TX send",
+	[LATENCY_TX_TIMESTAMP] = "TX TS wait",
+	[LATENCY_TX_FOLLOWUP] = "TX followup",
+	[LATENCY_TX_TOTAL] = "TX total"
+};
+
+/*
+ * Allocate the histograms if enabled and not done yet, free them if disabled.
+ * Histograms survive protocol restarts; chains in progress do not.
+ */
+void
+latencyProbeInit(LatencyProbe *probe, int enabled)
+{
+	memset(probe->chains, 0, sizeof(probe->chains));
+
+	if(!enabled) {
+		latencyProbeFree(probe);
+		return;
+	}
+
+	if(probe->stages != NULL) {
+		return;
+	}
+
+	probe->stages = (LatencyHistogram*)calloc(LATENCY_STAGES, sizeof(LatencyHistogram));
+
+	if(probe->stages == NULL) {
+		PERROR("Could not allocate latency histograms - latency measurement disabled");
+		return;
+	}
+
+	DBG("allocated %d bytes for latency histograms\n", (int)(LATENCY_STAGES * sizeof(LatencyHistogram)));
+}
+
+void
+latencyProbeFree(LatencyProbe *probe)
+{
+	free(probe->stages);
+	probe->stages = NULL;
+	memset(probe->chains, 0, sizeof(probe->chains));
+}
+
+const char*
+latencyStageName(int stage)
+{
+	if(stage < 0 || stage >= LATENCY_STAGES) {
+		return "unknown";
+	}
+
+	return stageNames[stage];
+}
+
+/* exact below 64 ns, then 64 buckets per power of two */
+static int
+histogramBucket(int64_t value)
+{
+	int msb, octave;
+
+	if(value < LATENCY_HIST_SUBBUCKETS) {
+		return value < 0 ? 0 : value;
+	}
+
+#if defined(__GNUC__)
+	msb = 63 - __builtin_clzll((unsigned long long)value);
+#else
+	for(msb = 6; msb < 62 && (value >> (msb + 1)); msb++);
+#endif /* __GNUC__ */
+	octave = msb - 5;
+	if(octave >= LATENCY_HIST_OCTAVES) {
+		return LATENCY_HIST_BUCKETS - 1;
+	}
+
+	return octave * LATENCY_HIST_SUBBUCKETS + ((value >> (msb - 6)) & (LATENCY_HIST_SUBBUCKETS - 1));
+}
+
+/* the smallest value in a bucket */
+static int64_t
+histogramValue(int bucket)
+{
+	int octave = bucket / LATENCY_HIST_SUBBUCKETS;
+	int64_t sub = bucket % LATENCY_HIST_SUBBUCKETS;
+
+	if(octave == 0) {
+		return sub;
+	}
+
+	return (LATENCY_HIST_SUBBUCKETS + sub) << (octave - 1);
+}
+
+void
+latencyHistogramAdd(LatencyHistogram *histogram, int64_t value)
+{
+	if(value < 0) {
+		value = 0;
+	}
+
+	if(!histogram->count || value < histogram->min) {
+		histogram->min = value;
+	}
+	if(value > histogram->max) {
+		histogram->max = value;
+	}
+
+	histogram->count++;
+	histogram->sum += value;
+	histogram->buckets[histogramBucket(value)]++;
+}
+
+/* the middle of the bucket holding the given percentile */
+int64_t
+latencyHistogramPercentile(const LatencyHistogram *histogram, double percentile)
+{
+	uint64_t rank, seen = 0;
+	int64_t low, high;
+	int i;
+
+	if(!histogram->count) {
+		return 0;
+	}
+
+	rank = ceil(histogram->count * percentile / 100.0);
+	if(rank < 1) {
+		rank = 1;
+	}
+
+	for(i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if(seen >= rank) {
+			break;
+		}
+	}
+
+	low = histogramValue(i);
+	high = (i + 1 < LATENCY_HIST_BUCKETS) ? histogramValue(i + 1) : histogram->max;
+	low += (high - low) / 2;
+
+	if(low < histogram->min) {
+		return histogram->min;
+	}
+
+	return low < histogram->max ? low : histogram->max;
+}
@@ -0,0 +1,184 @@
+#ifndef PTPDLATENCY_H_
+#define PTPDLATENCY_H_
+
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file    latency.h
+ * @date    Tue May 3 10:41:18 2016
+ * Hot path latency probes: where the time goes between a Sync arriving
+ * and the clock being adjusted, and between a Sync being packed and its
+ * Follow_Up going out.
+ *
+ * A chain is started when a message is read or a Sync is packed, and each
+ * mark records the time since the previous one in the histogram of the
+ * stage just finished. Times are CLOCK_MONOTONIC_RAW nanoseconds. With
+ * the probes disabled, every mark is a test of one pointer.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+/* exact below 64 ns, then 64 buckets per power of two (within 1.6%) up to about 9 minutes */
+#define LATENCY_HIST_SUBBUCKETS		64
+#define LATENCY_HIST_OCTAVES		34
+#define LATENCY_HIST_BUCKETS		(LATENCY_HIST_SUBBUCKETS * LATENCY_HIST_OCTAVES)
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	int64_t min;
+	int64_t max;
+	uint64_t buckets[LATENCY_HIST_BUCKETS];
+} LatencyHistogram;
+
+/* the stages measured, in the order they happen */
+enum {
+	/* slave: Sync or Follow_Up to frequency adjustment */
+	LATENCY_RX_RECV = 0,	/* reading the message off the socket */
+	LATENCY_RX_PROCESS,	/* header decode, checks and dispatch */
+	LATENCY_RX_HANDLE,	/* Sync / Follow_Up handling */
+	LATENCY_RX_OFFSET,	/* updateOffset() */
+	LATENCY_RX_SERVO,	/* offset checks and the servo */
+	LATENCY_RX_ADJFREQ,	/* the frequency adjustment */
+	LATENCY_RX_TOTAL,
+	/* master: Sync to Follow_Up */
+	LATENCY_TX_PACK,	/* origin timestamp and packing */
+	LATENCY_TX_SEND,	/* sendto() */
+	LATENCY_TX_TIMESTAMP,	/* waiting for the TX timestamp */
+	LATENCY_TX_FOLLOWUP,	/* packing and sending the Follow_Up */
+	LATENCY_TX_TOTAL,
+	LATENCY_STAGES
+};
+
+enum {
+	LATENCY_RX = 0,
+	LATENCY_TX,
+	LATENCY_CHAINS
+};
+
+typedef struct {
+	int64_t start;		/* 0 when not running */
+	int64_t last;		/* time of the last mark */
+} LatencyChain;
+
+typedef struct {
+	/* NULL when disabled */
+	LatencyHistogram *stages;
+	LatencyChain chains[LATENCY_CHAINS];
+} LatencyProbe;
+
+void latencyProbeInit(LatencyProbe *probe, int enabled);
+void latencyProbeFree(LatencyProbe *probe);
+const char* latencyStageName(int stage);
+
+void latencyHistogramAdd(LatencyHistogram *histogram, int64_t value);
+int64_t latencyHistogramPercentile(const LatencyHistogram *histogram, double percentile);
+
+static inline int64_t
+latencyNow(void)
+{
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif /* CLOCK_MONOTONIC_RAW */
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* start a chain at @start, the first stage counting from it */
+static inline void
+latencyStartAt(LatencyProbe *probe, int chain, int64_t start)
+{
+	if(probe->stages != NULL) {
+		probe->chains[chain].start = start;
+		probe->chains[chain].last = start;
+	}
+}
+
+/* start a chain now, returning the time it started, 0 if disabled */
+static inline int64_t
+latencyStart(LatencyProbe *probe, int chain)
+{
+	if(probe->stages == NULL) {
+		return 0;
+	}
+
+	latencyStartAt(probe, chain, latencyNow());
+	return probe->chains[chain].start;
+}
+
+/* start a chain which began at @start, the first stage counting from now */
+static inline void
+latencyResume(LatencyProbe *probe, int chain, int64_t start)
+{
+	if(probe->stages != NULL && start) {
+		probe->chains[chain].start = start;
+		probe->chains[chain].last = latencyNow();
+	}
+}
+
+/* the stage in progress on a running chain has finished */
+static inline void
+latencyMark(LatencyProbe *probe, int chain, int stage)
+{
+	int64_t now;
+
+	if(probe->stages != NULL && probe->chains[chain].start) {
+		now = latencyNow();
+		latencyHistogramAdd(&probe->stages[stage], now - probe->chains[chain].last);
+		probe->chains[chain].last = now;
+	}
+}
+
+/* the chain has finished: all of it goes to @stage */
+static inline void
+latencyEnd(LatencyProbe *probe, int chain, int stage)
+{
+	if(probe->stages != NULL && probe->chains[chain].start) {
+		latencyHistogramAdd(&probe->stages[stage], latencyNow() - probe->chains[chain].start);
+		probe->chains[chain].start = 0;
+	}
+}
+
+/* time of the last mark on a running chain, 0 if not running */
+static inline int64_t
+latencyLastMark(const LatencyProbe *probe, int chain)
+{
+	return probe->chains[chain].start ? probe->chains[chain].last : 0;
+}
+
+/* the message went somewhere other than the stages measured */
+static inline void
+latencyAbandon(LatencyProbe *probe, int chain)
+{
+	probe->chains[chain].start = 0;
+}
+
+#endif /* PTPDLATENCY_H_ */
@@ -1499,15 +1499,11 @@ copyPortIdentity( PortIdentity *dest, PortIdentity *src)
 	dest->portNumber = src->portNumber;
 }
 
+/* header of a management or signaling message: the same decoder as for all others */
 void
 unpackMsgHeader(Octet *buf, MsgHeader *header, PtpClock *ptpClock)
 {
-	int offset = 0;
-	MsgHeader* data = header;
-	#define OPERATE( name, size, type) \
-		unpack##type (buf + offset, &data->name, ptpClock); \
-		offset = offset + size;
-	#include "../def/message/header.def"
+	msgUnpackHeader(buf, header);
 }
 
 void
@@ -1662,28 +1658,41 @@ unpackMsgSignaling(Octet *buf, MsgSignaling *m, PtpClock *ptpClock)
 	#endif /* PTPD_DBG */
 }
 
-/*Unpack Header from IN buffer to msgTmpHeader field */
+/* Timestamp at the start of the body of Sync, Announce, Follow_Up, Delay_Req and Delay_Resp */
+static inline void
+unpackBodyTimestamp(const Octet *buf, Timestamp *ts)
+{
+	ts->secondsField.msb = getBE16(buf + 34);
+	ts->secondsField.lsb = getBE32(buf + 36);
+	ts->nanosecondsField = getBE32(buf + 40);
+}
+
+/*
+ * Unpack Header from IN buffer to msgTmpHeader field. The header is
+ * decoded once per message in processMessage(): handlers get the result.
+ */
 void
 msgUnpackHeader(Octet * buf, MsgHeader * header)
 {
-	header->transportSpecific = (*(Nibble *) (buf + 0)) >> 4;
-	header->messageType = (*(Enumeration4 *) (buf + 0)) & 0x0F;
-	header->versionPTP = (*(UInteger4 *) (buf + 1)) & 0x0F;
-	/* force reserved bit to zero if not */
-	header->messageLength = flip16(*(UInteger16 *) (buf + 2));
-	header->domainNumber = (*(UInteger8 *) (buf + 4));
-	header->flagField0 = (*(Octet *) (buf + 6));
-	header->flagField1 = (*(Octet *) (buf + 7));
-	memcpy(&header->correctionField.msb, (buf + 8), 4);
-	memcpy(&header->correctionField.lsb, (buf + 12), 4);
-	header->correctionField.msb = flip32(header->correctionField.msb);
-	header->correctionField.lsb = flip32(header->correctionField.lsb);
+	const UInteger8 *b = (const UInteger8 *)buf;
+
+	header->transportSpecific = b[0] >> 4;
+	header->messageType = b[0] & 0x0F;
+	header->reserved0 = b[1] >> 4;
+	header->versionPTP = b[1] & 0x0F;
+	header->messageLength = getBE16(buf + 2);
+	header->domainNumber = b[4];
+	header->reserved1 = b[5];
+	header->flagField0 = b[6];
+	header->flagField1 = b[7];
+	header->correctionField.msb = getBE32(buf + 8);
+	header->correctionField.lsb = getBE32(buf + 12);
+	header->reserved2 = getBE32(buf + 16);
 	copyClockIdentity(header->sourcePortIdentity.clockIdentity, (buf + 20));
-	header->sourcePortIdentity.portNumber =
-		flip16(*(UInteger16 *) (buf + 28));
-	header->sequenceId = flip16(*(UInteger16 *) (buf + 30));
-	header->controlField = (*(UInteger8 *) (buf + 32));
-	header->logMessageInterval = (*(Integer8 *) (buf + 33));
+	header->sourcePortIdentity.portNumber = getBE16(buf + 28);
+	header->sequenceId = getBE16(buf + 30);
+	header->controlField = b[32];
+	header->logMessageInterval = (Integer8)b[33];
 
 #ifdef PTPD_DBG
 	msgHeader_display(header);
@@ -1710,11 +1719,28 @@ msgPackHeader(Octet * buf, PtpClock * ptpClock)
 }
 
 
+/*
+ * Pre-pack the messages sent most: the packing functions below copy the
+ * template and patch in the few fields that change between sends.
+ */
+void
+msgPackTemplates(PtpClock * ptpClock)
+{
+#ifndef PTPD_SLAVE_ONLY
+	msgPackSyncTemplate(ptpClock);
+	msgPackAnnounceTemplate(ptpClock);
+#endif /* PTPD_SLAVE_ONLY */
+	msgPackDelayRespTemplate(ptpClock);
+}
+
 #ifndef PTPD_SLAVE_ONLY
-/*Pack SYNC message into OUT buffer of ptpClock*/
+/*Pack the SYNC template: everything but the sequence ID and origin timestamp*/
 void
-msgPackSync(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp, PtpClock * ptpClock)
+msgPackSyncTemplate(PtpClock * ptpClock)
 {
+	Octet *buf = ptpClock->syncTemplate;
+
+	memset(buf, 0, SYNC_LENGTH);
 	msgPackHeader(buf, ptpClock);
 
 	/* changes in header */
@@ -1726,13 +1752,20 @@ msgPackSync(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp, Ptp
 		*(UInteger8 *) (buf + 6) |= PTP_TWO_STEP;
 	/* Table 19 */
 	*(UInteger16 *) (buf + 2) = flip16(SYNC_LENGTH);
-	*(UInteger16 *) (buf + 30) = flip16(sequenceId);
 	*(UInteger8 *) (buf + 32) = 0x00;
 
 	 /* Table 24 - unless it's multicast, logMessageInterval remains    0x7F */
 	 if(rtOpts.transport == IEEE_802_3 || rtOpts.ipMode != IPMODE_UNICAST )
 		*(Integer8 *) (buf + 33) = ptpClock->portDS.logSyncInterval;
-	memset((buf + 8), 0, 8);
+}
+
+/*Pack SYNC message into OUT buffer of ptpClock*/
+void
+msgPackSync(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp, PtpClock * ptpClock)
+{
+	memcpy(buf, ptpClock->syncTemplate, SYNC_LENGTH);
+
+	*(UInteger16 *) (buf + 30) = flip16(sequenceId);
 
 	/* Sync message */
 	*(UInteger16 *) (buf + 34) = flip16(originTimestamp->secondsField.msb);
@@ -1745,12 +1778,7 @@ msgPackSync(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp, Ptp
 void
 msgUnpackSync(Octet * buf, MsgSync * sync)
 {
-	sync->originTimestamp.secondsField.msb =
-		flip16(*(UInteger16 *) (buf + 34));
-	sync->originTimestamp.secondsField.lsb =
-		flip32(*(UInteger32 *) (buf + 36));
-	sync->originTimestamp.nanosecondsField =
-		flip32(*(UInteger32 *) (buf + 40));
+	unpackBodyTimestamp(buf, &sync->originTimestamp);
 
 #ifdef PTPD_DBG
 	msgSync_display(sync);
@@ -1760,12 +1788,14 @@ msgUnpackSync(Octet * buf, MsgSync * sync)
 
 /* When building slave only, this code does not get compiled */
 #ifndef PTPD_SLAVE_ONLY
-/*Pack Announce message into OUT buffer of ptpClock*/
+/*Pack the Announce template: everything but the sequence ID and origin timestamp*/
 void
-msgPackAnnounce(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp, PtpClock * ptpClock)
+msgPackAnnounceTemplate(PtpClock * ptpClock)
 {
+	Octet *buf = ptpClock->announceTemplate;
 	UInteger16 stepsRemoved;
-	
+
+	memset(buf, 0, ANNOUNCE_LENGTH);
 	msgPackHeader(buf, ptpClock);
 
 	/* changes in header */
@@ -1774,16 +1804,11 @@ msgPackAnnounce(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp,
 	*(char *)(buf + 0) = *(char *)(buf + 0) | 0x0B;
 	/* Table 19 */
 	*(UInteger16 *) (buf + 2) = flip16(ANNOUNCE_LENGTH);
-	*(UInteger16 *) (buf + 30) = flip16(sequenceId);
 	*(UInteger8 *) (buf + 32) = 0x05;
 	/* Table 24: for Announce, logMessageInterval is never 0x7F */
 	*(Integer8 *) (buf + 33) = ptpClock->portDS.logAnnounceInterval;
 
 	/* Announce message */
-	*(UInteger16 *) (buf + 34) = flip16(originTimestamp->secondsField.msb);
-	*(UInteger32 *) (buf + 36) = flip32(originTimestamp->secondsField.lsb);
-	*(UInteger32 *) (buf + 40) = flip32(originTimestamp->nanosecondsField);
-
 	*(Integer16 *) (buf + 44) = flip16(ptpClock->timePropertiesDS.currentUtcOffset);
 	*(UInteger8 *) (buf + 47) = ptpClock->parentDS.grandmasterPriority1;
 	*(UInteger8 *) (buf + 48) = ptpClock->defaultDS.clockQuality.clockClass;
@@ -1808,33 +1833,39 @@ msgPackAnnounce(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp,
 	*(UInteger8*) (buf + 7) |= (ptpClock->timePropertiesDS.timeTraceable)		<< 4;
 	*(UInteger8*) (buf + 7) |= (ptpClock->timePropertiesDS.frequencyTraceable)	<< 5;
 }
+
+/*Pack Announce message into OUT buffer of ptpClock*/
+void
+msgPackAnnounce(Octet * buf, UInteger16 sequenceId, Timestamp * originTimestamp, PtpClock * ptpClock)
+{
+	memcpy(buf, ptpClock->announceTemplate, ANNOUNCE_LENGTH);
+
+	*(UInteger16 *) (buf + 30) = flip16(sequenceId);
+
+	/* Announce message */
+	*(UInteger16 *) (buf + 34) = flip16(originTimestamp->secondsField.msb);
+	*(UInteger32 *) (buf + 36) = flip32(originTimestamp->secondsField.lsb);
+	*(UInteger32 *) (buf + 40) = flip32(originTimestamp->nanosecondsField);
+}
 #endif /* PTPD_SLAVE_ONLY */
 
 /*Unpack Announce message from IN buffer of ptpClock to msgtmp.Announce*/
 void
 msgUnpackAnnounce(Octet * buf, MsgAnnounce * announce)
 {
-	UInteger16 stepsRemoved;
-	
-	announce->originTimestamp.secondsField.msb =
-		flip16(*(UInteger16 *) (buf + 34));
-	announce->originTimestamp.secondsField.lsb =
-		flip32(*(UInteger32 *) (buf + 36));
-	announce->originTimestamp.nanosecondsField =
-		flip32(*(UInteger32 *) (buf + 40));
-	announce->currentUtcOffset = flip16(*(UInteger16 *) (buf + 44));
+	unpackBodyTimestamp(buf, &announce->originTimestamp);
+	announce->currentUtcOffset = getBE16(buf + 44);
 	announce->grandmasterPriority1 = *(UInteger8 *) (buf + 47);
 	announce->grandmasterClockQuality.clockClass =
 		*(UInteger8 *) (buf + 48);
 	announce->grandmasterClockQuality.clockAccuracy =
 		*(Enumeration8 *) (buf + 49);
 	announce->grandmasterClockQuality.offsetScaledLogVariance =
-		flip16(*(UInteger16 *) (buf + 50));
+		getBE16(buf + 50);
 	announce->grandmasterPriority2 = *(UInteger8 *) (buf + 52);
 	copyClockIdentity(announce->grandmasterIdentity, (buf + 53));
-	/* resolve bugs #37 and #40 - alignment errors on ARMv5 */
-	memcpy(&stepsRemoved, buf + 61, sizeof(UInteger16));
-	announce->stepsRemoved = flip16(stepsRemoved);
+	/* byte loads: no alignment errors on ARMv5 (bugs #37 and #40) */
+	announce->stepsRemoved = getBE16(buf + 61);
 	announce->timeSource = *(Enumeration8 *) (buf + 63);
 
 	#ifdef PTPD_DBG
@@ -1876,12 +1907,7 @@ msgPackFollowUp(Octet * buf, Timestamp * preciseOriginTimestamp, PtpClock * ptpC
 void
 msgUnpackFollowUp(Octet * buf, MsgFollowUp * follow)
 {
-	follow->preciseOriginTimestamp.secondsField.msb =
-		flip16(*(UInteger16 *) (buf + 34));
-	follow->preciseOriginTimestamp.secondsField.lsb =
-		flip32(*(UInteger32 *) (buf + 36));
-	follow->preciseOriginTimestamp.nanosecondsField =
-		flip32(*(UInteger32 *) (buf + 40));
+	unpackBodyTimestamp(buf, &follow->preciseOriginTimestamp);
 
 	#ifdef PTPD_DBG
 	msgFollowUp_display(follow);
@@ -1945,23 +1971,34 @@ msgPackDelayReq(Octet * buf, Timestamp * originTimestamp, PtpClock * ptpClock)
 	*(UInteger32 *) (buf + 40) = flip32(originTimestamp->nanosecondsField);
 }
 
-/*pack delayResp message into OUT buffer of ptpClock*/
+/*Pack the delayResp template: the fields not taken from the delayReq being answered*/
 void
-msgPackDelayResp(Octet * buf, MsgHeader * header, Timestamp * receiveTimestamp, PtpClock * ptpClock)
+msgPackDelayRespTemplate(PtpClock * ptpClock)
 {
+	Octet *buf = ptpClock->delayRespTemplate;
+
+	memset(buf, 0, DELAY_RESP_LENGTH);
 	msgPackHeader(buf, ptpClock);
-	
+
 	/* changes in header */
 	*(char *)(buf + 0) = *(char *)(buf + 0) & 0xF0;
 	/* RAZ messageType */
 	*(char *)(buf + 0) = *(char *)(buf + 0) | 0x09;
 	/* Table 19 */
 	*(UInteger16 *) (buf + 2) = flip16(DELAY_RESP_LENGTH);
-	*(UInteger8 *) (buf + 4) = header->domainNumber;
 
 	/* -- PTP_UNICAST flag will be set in netsend* if needed */
 
-	memset((buf + 8), 0, 8);
+	*(UInteger8 *) (buf + 32) = 0x03;
+}
+
+/*pack delayResp message into OUT buffer of ptpClock*/
+void
+msgPackDelayResp(Octet * buf, MsgHeader * header, Timestamp * receiveTimestamp, PtpClock * ptpClock)
+{
+	memcpy(buf, ptpClock->delayRespTemplate, DELAY_RESP_LENGTH);
+
+	*(UInteger8 *) (buf + 4) = header->domainNumber;
 
 	/* Copy correctionField of PdelayReqMessage */
 	*(Integer32 *) (buf + 8) = flip32(header->correctionField.msb);
@@ -1969,8 +2006,6 @@ msgPackDelayResp(Octet * buf, MsgHeader * header, Timestamp * receiveTimestamp,
 
 	*(UInteger16 *) (buf + 30) = flip16(header->sequenceId);
 
-	*(UInteger8 *) (buf + 32) = 0x03;
-
 	 /* Table 24 - unless it's multicast, logMessageInterval remains    0x7F */
 	 /* really tempting to cheat here, at least for hybrid, but standard is a standard */
 	if ((header->flagField0 & PTP_UNICAST) != PTP_UNICAST) {
@@ -2027,12 +2062,7 @@ msgPackPdelayResp(Octet * buf, MsgHeader * header, Timestamp * requestReceiptTim
 void
 msgUnpackDelayReq(Octet * buf, MsgDelayReq * delayreq)
 {
-	delayreq->originTimestamp.secondsField.msb =
-		flip16(*(UInteger16 *) (buf + 34));
-	delayreq->originTimestamp.secondsField.lsb =
-		flip32(*(UInteger32 *) (buf + 36));
-	delayreq->originTimestamp.nanosecondsField =
-		flip32(*(UInteger32 *) (buf + 40));
+	unpackBodyTimestamp(buf, &delayreq->originTimestamp);
 
 	#ifdef PTPD_DBG
 	msgDelayReq_display(delayreq);
@@ -2045,12 +2075,7 @@ msgUnpackDelayReq(Octet * buf, MsgDelayReq * delayreq)
 void
 msgUnpackPdelayReq(Octet * buf, MsgPdelayReq * pdelayreq)
 {
-	pdelayreq->originTimestamp.secondsField.msb =
-		flip16(*(UInteger16 *) (buf + 34));
-	pdelayreq->originTimestamp.secondsField.lsb =
-		flip32(*(UInteger32 *) (buf + 36));
-	pdelayreq->originTimestamp.nanosecondsField =
-		flip32(*(UInteger32 *) (buf + 40));
+	unpackBodyTimestamp(buf, &pdelayreq->originTimestamp);
 
 	#ifdef PTPD_DBG
 	msgPdelayReq_display(pdelayreq);
@@ -2063,16 +2088,10 @@ msgUnpackPdelayReq(Octet * buf, MsgPdelayReq * pdelayreq)
 void
 msgUnpackDelayResp(Octet * buf, MsgDelayResp * resp)
 {
-	resp->receiveTimestamp.secondsField.msb =
-		flip16(*(UInteger16 *) (buf + 34));
-	resp->receiveTimestamp.secondsField.lsb =
-		flip32(*(UInteger32 *) (buf + 36));
-	resp->receiveTimestamp.nanosecondsField =
-		flip32(*(UInteger32 *) (buf + 40));
+	unpackBodyTimestamp(buf, &resp->receiveTimestamp);
 	copyClockIdentity(resp->requestingPortIdentity.clockIdentity,
 	       (buf + 44));
-	resp->requestingPortIdentity.portNumber =
-		flip16(*(UInteger16 *) (buf + 52));
+	resp->requestingPortIdentity.portNumber = getBE16(buf + 52);
 
 	#ifdef PTPD_DBG
 	msgDelayResp_display(resp);
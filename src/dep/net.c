@@ -85,6 +85,10 @@
 #include <linux/ethtool.h>
 #endif /* SO_TIMESTAMPING */
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+#include <linux/errqueue.h>
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 /**
  * shutdown the IPv4 multicast for specific address
  *
@@ -155,6 +159,16 @@ netShutdown(NetPath * netPath)
 {
 	netShutdownMulticast(netPath);
 
+#ifdef PTPD_EPOLL
+	/* stop watching our descriptors before they are closed */
+	eventLoopRemoveFd(netPath->eventSock);
+	eventLoopRemoveFd(netPath->generalSock);
+#ifdef PTPD_PCAP
+	eventLoopRemoveFd(netPath->pcapEventSock);
+	eventLoopRemoveFd(netPath->pcapGeneralSock);
+#endif /* PTPD_PCAP */
+#endif /* PTPD_EPOLL */
+
 	/* Close sockets */
 	if (netPath->eventSock >= 0)
 		close(netPath->eventSock);
@@ -164,6 +178,12 @@ netShutdown(NetPath * netPath)
 		close(netPath->generalSock);
 	netPath->generalSock = -1;
 
+#ifdef PTPD_RECV_BATCHING
+	/* whatever was left in the batches came from the sockets just closed */
+	netPath->eventBatch.count = netPath->eventBatch.next = 0;
+	netPath->generalBatch.count = netPath->generalBatch.next = 0;
+#endif /* PTPD_RECV_BATCHING */
+
 #ifdef PTPD_PCAP
 	if (netPath->pcapEvent != NULL) {
 		pcap_close(netPath->pcapEvent);
@@ -686,26 +706,217 @@ netSetMulticastLoopback(NetPath * netPath, Boolean value) {
 	return TRUE;
 }
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+/*
+ * Read one keyed TX timestamp from the socket error queue.
+ * Returns 1 if a timestamp was read, 0 if the queue is empty, -1 on error.
+ */
+static int
+netReadTxTimestamp(NetPath *netPath, struct timespec *timestamp, uint32_t *key)
+{
+	ssize_t ret;
+	struct msghdr msg;
+	struct iovec vec[1];
+	struct cmsghdr *cmsg;
+	struct sock_extended_err *serr;
+	Octet buf[PACKET_SIZE];
+	Boolean haveTimestamp, haveKey;
+
+	union {
+		struct cmsghdr cm;
+		char	control[256];
+	}     cmsg_un;
+
+	for(;;) {
+
+		vec[0].iov_base = buf;
+		vec[0].iov_len = PACKET_SIZE;
+
+		memset(&msg, 0, sizeof(msg));
+		memset(&cmsg_un, 0, sizeof(cmsg_un));
+
+		msg.msg_iov = vec;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsg_un.control;
+		msg.msg_controllen = sizeof(cmsg_un.control);
+
+		ret = recvmsg(netPath->eventSock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return 0;
+			return -1;
+		}
+
+		haveTimestamp = FALSE;
+		haveKey = FALSE;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET &&
+			    cmsg->cmsg_type == SO_TIMESTAMPING) {
+				/* software timestamp is the first of the three */
+				*timestamp = *(struct timespec *)CMSG_DATA(cmsg);
+#ifdef PTPD_PHC
+				/* raw hardware timestamp is the third */
+				if(netPath->hwTimestamping)
+					*timestamp = ((struct timespec *)CMSG_DATA(cmsg))[2];
+#endif /* PTPD_PHC */
+				haveTimestamp = TRUE;
+			}
+			if (cmsg->cmsg_level == IPPROTO_IP &&
+			    cmsg->cmsg_type == IP_RECVERR) {
+				serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+				if (serr->ee_errno == ENOMSG &&
+				    serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+					*key = serr->ee_data;
+					haveKey = TRUE;
+				}
+			}
+		}
+
+		if (haveTimestamp && haveKey) {
+			DBG("netReadTxTimestamp: TX timestamp key %u: %ld.%09ld\n", *key,
+			    (long)timestamp->tv_sec, (long)timestamp->tv_nsec);
+			return 1;
+		}
+
+		DBG("netReadTxTimestamp: discarded error queue message without keyed TX timestamp\n");
+
+	}
+
+}
+
+/*
+ * Get the next keyed TX timestamp: those set aside while
+ * waiting for another one come first, then the error queue.
+ */
+ssize_t
+netRecvTxTimestamp(NetPath *netPath, TimeInternal *timeStamp, UInteger32 *key)
+{
+	struct timespec ts;
+	uint32_t tsKey;
+	int ret;
+
+	if (netPath->txTimestampBacklogCount > 0) {
+		netPath->txTimestampBacklogCount--;
+		ts = netPath->txTimestampBacklog[netPath->txTimestampBacklogCount].timestamp;
+		tsKey = netPath->txTimestampBacklog[netPath->txTimestampBacklogCount].key;
+	} else if ((ret = netReadTxTimestamp(netPath, &ts, &tsKey)) <= 0) {
+		return ret;
+	}
+
+	timeStamp->seconds = ts.tv_sec;
+	timeStamp->nanoseconds = ts.tv_nsec;
+	*key = tsKey;
+
+	return 1;
+}
+
+/* key of the TX timestamp of the last message sent on the event socket */
+UInteger32
+netLastTxTimestampKey(NetPath *netPath)
+{
+	return netPath->txTimestampKey - 1;
+}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 #if defined(SO_TIMESTAMPING) && defined(SO_TIMESTAMPNS)
+/* stop using SO_TIMESTAMPING for TX timestamps, fall back to SO_TIMESTAMPNS */
+static void
+netRevertTimestamping(NetPath *netPath)
+{
+	int val;
+
+	DBG("net.c: SO_TIMESTAMPING TX software timestamp failure - reverting to SO_TIMESTAMPNS\n");
+	/* unset SO_TIMESTAMPING first! otherwise we get an always-exiting select! */
+	val = 0;
+	if(setsockopt(netPath->eventSock, SOL_SOCKET, SO_TIMESTAMPING, &val, sizeof(int)) < 0) {
+		DBG("netRevertTimestamping: failed to unset SO_TIMESTAMPING");
+	}
+	val = 1;
+	if(setsockopt(netPath->eventSock, SOL_SOCKET, SO_TIMESTAMPNS, &val, sizeof(int)) < 0) {
+		DBG("netRevertTimestamping: failed to revert to SO_TIMESTAMPNS");
+	}
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	netPath->txTimestampKeyed = FALSE;
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+}
+
+/*
+ * Read the TX timestamp of the message just sent. With keyed timestamps,
+ * any others found on the way (batched Syncs) are set aside for later.
+ */
+static ssize_t
+netRecvOwnTxTimestamp(NetPath *netPath, TimeInternal *timeStamp)
+{
+	extern PTPD_THREAD_LOCAL PtpClock *G_ptpClock;
+
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	struct timespec ts;
+	uint32_t key;
+	int ret;
+
+	if (netPath->txTimestampKeyed) {
+		while ((ret = netReadTxTimestamp(netPath, &ts, &key)) > 0) {
+			if (key == netPath->txTimestampKey - 1) {
+				timeStamp->seconds = ts.tv_sec;
+				timeStamp->nanoseconds = ts.tv_nsec;
+				return 1;
+			}
+			if (netPath->txTimestampBacklogCount < TXTIMESTAMP_BACKLOG_MAX) {
+				netPath->txTimestampBacklog[netPath->txTimestampBacklogCount].key = key;
+				netPath->txTimestampBacklog[netPath->txTimestampBacklogCount].timestamp = ts;
+				netPath->txTimestampBacklogCount++;
+			} else {
+				DBG("netRecvOwnTxTimestamp: TX timestamp backlog full - dropped key %u\n", key);
+			}
+		}
+		return ret;
+	}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
+	return netRecvEvent(G_ptpClock->msgIbuf, timeStamp, netPath, MSG_ERRQUEUE);
+}
+
+/* latency probes: a stage of the Sync being sent has finished, if one is being timed */
+static void
+txLatencyMark(int stage)
+{
+	extern PTPD_THREAD_LOCAL PtpClock *G_ptpClock;
+
+	if(G_ptpClock != NULL) {
+		latencyMark(&G_ptpClock->latency, LATENCY_TX, stage);
+	}
+}
+
 static Boolean
 getTxTimestamp(NetPath* netPath,TimeInternal* timeStamp) {
-	extern PtpClock *G_ptpClock;
+	extern PTPD_THREAD_LOCAL PtpClock *G_ptpClock;
 	ssize_t length;
 	fd_set tmpSet;
 	struct timeval timeOut = {0,0};
-	int val = 1;
 	int i = 0;
 	if(netPath->txTimestampFailure)
 		goto failure;
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	/*
+	 * the message we are waiting for consumed the next key - only
+	 * called after a successful send: a failed one consumes none
+	 */
+	netPath->txTimestampKey++;
+	/* no timestamp wanted: the caller collects it later by key */
+	if(timeStamp == NULL && netPath->txTimestampKeyed)
+		return TRUE;
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 	FD_ZERO(&tmpSet);
 	FD_SET(netPath->eventSock, &tmpSet);
 
 	if(select(netPath->eventSock + 1, &tmpSet, NULL, NULL, &timeOut) > 0) {
 		if (FD_ISSET(netPath->eventSock, &tmpSet)) {
 
-			length = netRecvEvent(G_ptpClock->msgIbuf, timeStamp,
-			    netPath, MSG_ERRQUEUE);
+			length = netRecvOwnTxTimestamp(netPath, timeStamp);
 			if (length > 0) {
 				DBG("getTxTimestamp: Grabbed sent msg via errqueue: %d bytes, at %d.%d\n", length, timeStamp->seconds, timeStamp->nanoseconds);
 				return TRUE;
@@ -720,7 +931,7 @@ getTxTimestamp(NetPath* netPath,TimeInternal* timeStamp) {
 
 	/* we're desperate here, aren't we... */
 	for(i = 0; i < 3; i++) {
-	    length = netRecvEvent(G_ptpClock->msgIbuf, timeStamp, netPath, MSG_ERRQUEUE);
+	    length = netRecvOwnTxTimestamp(netPath, timeStamp);
 	    if(length > 0) {
 		DBG("getTxTimestamp: SO_TIMESTAMPING - delayed TX timestamp caught\n");
 		return TRUE;
@@ -731,7 +942,7 @@ getTxTimestamp(NetPath* netPath,TimeInternal* timeStamp) {
 	/* try for the last time: sleep and poll the error queue, if nothing, consider SO_TIMESTAMPING inoperable */
 	usleep(LATE_TXTIMESTAMP_US);
 
-	length = netRecvEvent(G_ptpClock->msgIbuf, timeStamp, netPath, MSG_ERRQUEUE);
+	length = netRecvOwnTxTimestamp(netPath, timeStamp);
 
 	if(length > 0) {
 		DBG("getTxTimestamp: SO_TIMESTAMPING - even more delayed TX timestamp caught\n");
@@ -740,23 +951,95 @@ getTxTimestamp(NetPath* netPath,TimeInternal* timeStamp) {
 		DBG("getTxTimestamp: SO_TIMESTAMPING - TX timestamp retry failed - will use loop from now on\n");
 	}
 
-failure:
-	DBG("net.c: SO_TIMESTAMPING TX software timestamp failure - reverting to SO_TIMESTAMPNS\n");
-	/* unset SO_TIMESTAMPING first! otherwise we get an always-exiting select! */
-	val = 0;
-	if(setsockopt(netPath->eventSock, SOL_SOCKET, SO_TIMESTAMPING, &val, sizeof(int)) < 0) {
-		DBG("getTxTimestamp: failed to unset SO_TIMESTAMPING");
-	}
-	val = 1;
-	if(setsockopt(netPath->eventSock, SOL_SOCKET, SO_TIMESTAMPNS, &val, sizeof(int)) < 0) {
-		DBG("getTxTimestamp: failed to revert to SO_TIMESTAMPNS");
+#ifdef PTPD_PHC
+	/*
+	 * looped back messages carry no hardware timestamps, so there is
+	 * nothing to fall back to: lose this one and keep going
+	 */
+	if(netPath->hwTimestamping) {
+		DBG("getTxTimestamp: hardware TX timestamp lost\n");
+		G_ptpClock->counters.txTimestampsLost++;
+		if(timeStamp != NULL)
+			clearTime(timeStamp);
+		return TRUE;
 	}
+#endif /* PTPD_PHC */
+
+failure:
+	netRevertTimestamping(netPath);
 
 	return FALSE;
 }
+
 #endif /* SO_TIMESTAMPING */
 
 
+#ifdef PTPD_PHC
+/*
+ * Switch the NIC to hardware timestamping of PTP event messages and find
+ * its PTP hardware clock - phcInit() opens it later.
+ */
+static Boolean
+netInitHwTimestamping(NetPath * netPath, const RunTimeOpts * rtOpts)
+{
+
+	struct ethtool_ts_info tsInfo;
+	struct hwtstamp_config hwConfig;
+	struct ifreq ifRequest;
+	int required = SOF_TIMESTAMPING_TX_HARDWARE |
+	    SOF_TIMESTAMPING_RX_HARDWARE |
+	    SOF_TIMESTAMPING_RAW_HARDWARE;
+
+	memset(&tsInfo, 0, sizeof(tsInfo));
+	memset(&ifRequest, 0, sizeof(ifRequest));
+	tsInfo.cmd = ETHTOOL_GET_TS_INFO;
+	strncpy(ifRequest.ifr_name, rtOpts->ifaceName, IFNAMSIZ - 1);
+	ifRequest.ifr_data = (char *) &tsInfo;
+
+	if (ioctl(netPath->eventSock, SIOCETHTOOL, &ifRequest) < 0) {
+		PERROR("Could not retrieve ethtool timestamping capabilities for %s",
+			    rtOpts->ifaceName);
+		return FALSE;
+	}
+
+	if ((tsInfo.so_timestamping & required) != required) {
+		ERROR("Interface %s does not support hardware timestamping\n",
+			    rtOpts->ifaceName);
+		return FALSE;
+	}
+
+	netPath->phcIndex = tsInfo.phc_index;
+
+	memset(&hwConfig, 0, sizeof(hwConfig));
+	memset(&ifRequest, 0, sizeof(ifRequest));
+	strncpy(ifRequest.ifr_name, rtOpts->ifaceName, IFNAMSIZ - 1);
+	ifRequest.ifr_data = (char *) &hwConfig;
+	hwConfig.tx_type = HWTSTAMP_TX_ON;
+	hwConfig.rx_filter = HWTSTAMP_FILTER_PTP_V2_L4_EVENT;
+
+	if (ioctl(netPath->eventSock, SIOCSHWTSTAMP, &ifRequest) < 0) {
+		/* some NICs can only timestamp everything */
+		DBG("netInitHwTimestamping: PTPv2 event filter not accepted by %s, trying to timestamp all packets\n",
+			    rtOpts->ifaceName);
+		hwConfig.tx_type = HWTSTAMP_TX_ON;
+		hwConfig.rx_filter = HWTSTAMP_FILTER_ALL;
+		if (ioctl(netPath->eventSock, SIOCSHWTSTAMP, &ifRequest) < 0) {
+			PERROR("Could not enable hardware timestamping on %s",
+				    rtOpts->ifaceName);
+			return FALSE;
+		}
+	}
+
+	netPath->hwTimestamping = TRUE;
+
+	INFO("Hardware timestamping enabled on %s, PTP hardware clock index %d\n",
+		    rtOpts->ifaceName, netPath->phcIndex);
+
+	return TRUE;
+
+}
+#endif /* PTPD_PHC */
+
 /**
  * Initialize timestamping of packets
  *
@@ -776,6 +1059,21 @@ netInitTimestamping(NetPath * netPath, const RunTimeOpts * rtOpts)
 	    SOF_TIMESTAMPING_RX_SOFTWARE |
 	    SOF_TIMESTAMPING_SOFTWARE;
 
+#ifdef PTPD_PHC
+	netPath->hwTimestamping = FALSE;
+	netPath->phcIndex = -1;
+
+	if(rtOpts->hwTimestamping) {
+	    if(!netInitHwTimestamping(netPath, rtOpts)) {
+		return FALSE;
+	    }
+	    netPath->txTimestampFailure = FALSE;
+	    val = SOF_TIMESTAMPING_TX_HARDWARE |
+		SOF_TIMESTAMPING_RX_HARDWARE |
+		SOF_TIMESTAMPING_RAW_HARDWARE;
+	} else {
+#endif /* PTPD_PHC */
+
 /* unless compiled with PTPD_EXPERIMENTAL, check if we support the desired tstamp capabilities */
 #ifndef PTPD_EXPERIMENTAL
 #ifdef ETHTOOL_GET_TS_INFO
@@ -807,12 +1105,32 @@ netInitTimestamping(NetPath * netPath, const RunTimeOpts * rtOpts)
 #endif /* ETHTOOL_GET_TS_INFO */
 #endif /* PTPD_EXPERIMENTAL */
 
+#ifdef PTPD_PHC
+	}
+#endif /* PTPD_PHC */
+
 	if(val == 1) {
 	    if (setsockopt(netPath->eventSock, SOL_SOCKET, SO_TIMESTAMPNS, &val, sizeof(int)) < 0) {
 		    PERROR("netInitTimestamping: failed to enable SO_TIMESTAMPNS");
 		    result = FALSE;
 	    }
 	} else {
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	    netPath->txTimestampKeyed = FALSE;
+	    netPath->txTimestampKey = 0;
+	    netPath->txTimestampBacklogCount = 0;
+	    /* have the kernel number our TX timestamps, so they can be collected out of order */
+	    if(rtOpts->unicastSyncBatching || rtOpts->asyncTxTimestamps) {
+		int keyedVal = val | SOF_TIMESTAMPING_OPT_ID;
+		if (setsockopt(netPath->eventSock, SOL_SOCKET, SO_TIMESTAMPING, &keyedVal, sizeof(int)) < 0) {
+		    WARNING("netInitTimestamping: TX timestamp keys (SOF_TIMESTAMPING_OPT_ID) not supported - TX timestamps will be collected synchronously\n");
+		} else {
+		    DBG("netInitTimestamping: SO_TIMESTAMPING TX timestamp keys enabled\n");
+		    netPath->txTimestampKeyed = TRUE;
+		}
+	    }
+	    if (!netPath->txTimestampKeyed)
+#endif /* PTPD_TXTIMESTAMP_KEYED */
 	    if (setsockopt(netPath->eventSock, SOL_SOCKET, SO_TIMESTAMPING, &val, sizeof(int)) < 0) {
 		    PERROR("netInitTimestamping: failed to enable SO_TIMESTAMPING");
 		    result = FALSE;
@@ -1240,8 +1558,8 @@ netInit(NetPath * netPath, RunTimeOpts * rtOpts, PtpClock * ptpClock)
 
                     DBG("eventSock rcvbuff : %d\n", n);
 
-                    if(n < (UNICAST_MAX_DESTINATIONS * 1024)) {
-                        n = UNICAST_MAX_DESTINATIONS * 1024;
+                    if(n < (rtOpts->unicastGrantTableSize * 1024)) {
+                        n = rtOpts->unicastGrantTableSize * 1024;
                         if (setsockopt(netPath->eventSock, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n)) < 0) {
                             DBG("Failed to increase event socket receive buffer\n");
                         }
@@ -1253,8 +1571,8 @@ netInit(NetPath * netPath, RunTimeOpts * rtOpts, PtpClock * ptpClock)
 
                     DBG("genetalSock rcvbuff : %d\n", n);
 
-                    if(n < (UNICAST_MAX_DESTINATIONS * 1024)) {
-                        n = UNICAST_MAX_DESTINATIONS * 1024;
+                    if(n < (rtOpts->unicastGrantTableSize * 1024)) {
+                        n = rtOpts->unicastGrantTableSize * 1024;
                         if (setsockopt(netPath->generalSock, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n)) < 0) {
                             DBG("Failed to increase general socket receive buffer\n");
                         }
@@ -1280,8 +1598,14 @@ netInit(NetPath * netPath, RunTimeOpts * rtOpts, PtpClock * ptpClock)
 		 * wowczarek: 2.3.1-rc4@jun0215: this breaks the manual packet looping,
 		 * so may only be used for multicast-only
 		 */
-		
-		if ( rtOpts->ipMode == IPMODE_MULTICAST ) {
+
+		/*
+		 * Boundary clock ports all bind to the PTP ports on INADDR_ANY, so
+		 * without this every port would see the traffic of the others,
+		 * and unicast would only reach one of them - those need it in
+		 * any IP mode.
+		 */
+		if ( rtOpts->ipMode == IPMODE_MULTICAST || rtOpts->boundaryClockPorts > 0 ) {
 		    if (setsockopt(netPath->eventSock, SOL_SOCKET, SO_BINDTODEVICE,
 				rtOpts->ifaceName, strlen(rtOpts->ifaceName)) < 0
 			|| setsockopt(netPath->generalSock, SOL_SOCKET, SO_BINDTODEVICE,
@@ -1392,6 +1716,22 @@ netInit(NetPath * netPath, RunTimeOpts * rtOpts, PtpClock * ptpClock)
 	}
 #endif
 
+#ifdef PTPD_EPOLL
+	/* hand our descriptors over to the event loop */
+#ifdef PTPD_PCAP
+	if (netPath->pcapEventSock >= 0) {
+		if(!eventLoopAddFd(netPath->pcapEventSock) ||
+		    (netPath->pcapGeneralSock >= 0 && !eventLoopAddFd(netPath->pcapGeneralSock))) {
+			return FALSE;
+		}
+	} else
+#endif /* PTPD_PCAP */
+	if(!eventLoopAddFd(netPath->eventSock) ||
+	    (netPath->generalSock >= 0 && !eventLoopAddFd(netPath->generalSock))) {
+		return FALSE;
+	}
+#endif /* PTPD_EPOLL */
+
 	/* Compile ACLs */
 	if(rtOpts->timingAclEnabled) {
     		freeIpv4AccessList(&netPath->timingAcl);
@@ -1408,12 +1748,96 @@ netInit(NetPath * netPath, RunTimeOpts * rtOpts, PtpClock * ptpClock)
 	return TRUE;
 }
 
-/*Check if data has been received*/
-int
-netSelect(TimeInternal * timeout, NetPath * netPath, fd_set *readfds)
+#ifdef PTPD_EPOLL
+/*
+ * Our sockets and all timers live in the event loop's epoll set,
+ * so we sleep exactly until the next packet or timer expiry.
+ */
+static int
+netSelectEventLoop(TimeInternal * timeout, fd_set *readfds)
 {
+
+#if defined PTPD_SNMP
+	extern const RunTimeOpts rtOpts;
+	struct timeval tv, *tv_ptr = NULL;
+	struct timeval snmp_timer_wait = { 0, 0};
+	int snmpblock = 0;
 	int ret, nfds;
+#endif
+
+	if (timeout && isTimeInternalNegative(timeout)) {
+		ERROR("Negative timeout attempted for select()\n");
+		return -1;
+	}
+
+	FD_ZERO(readfds);
+
+#if defined PTPD_SNMP
+if (rtOpts.snmpEnabled) {
+	/* SNMP wants select(): nest the event loop descriptor in the SNMP fd set */
+	int loopFd = eventLoopFd();
+	TimeInternal noWait = {0, 0};
+
+	if (timeout) {
+		tv.tv_sec = timeout->seconds;
+		tv.tv_usec = timeout->nanoseconds / 1000;
+		tv_ptr = &tv;
+	}
+
+	FD_SET(loopFd, readfds);
+	nfds = loopFd + 1;
+	snmpblock = 1;
+	if (tv_ptr) {
+		snmpblock = 0;
+		memcpy(&snmp_timer_wait, tv_ptr, sizeof(struct timeval));
+	}
+	snmp_select_info(&nfds, readfds, &snmp_timer_wait, &snmpblock);
+	if (snmpblock == 0)
+		tv_ptr = &snmp_timer_wait;
+
+	ret = select(nfds, readfds, 0, 0, tv_ptr);
+
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		return ret;
+	}
+
+	if (ret > 0) {
+		snmp_read(readfds);
+	} else {
+		snmp_timeout();
+		run_alarms();
+	}
+	netsnmp_check_outstanding_agent_requests();
+
+	if (ret == 0 || !FD_ISSET(loopFd, readfds)) {
+		FD_ZERO(readfds);
+		return 0;
+	}
+
+	/* the event loop has something for us - collect it without blocking */
+	FD_ZERO(readfds);
+	return eventLoopWait(&noWait, readfds);
+}
+#endif /* PTPD_SNMP */
+
+	return eventLoopWait(timeout, readfds);
+
+}
+#endif /* PTPD_EPOLL */
+
+/*Check if data has been received on any of the @count ports in @netPaths*/
+int
+netSelect(TimeInternal * timeout, NetPath **netPaths, int count, fd_set *readfds)
+{
+#ifdef PTPD_EPOLL
+	/* the sockets of all ports are in the event loop already */
+	return netSelectEventLoop(timeout, readfds);
+#else
+	int ret, nfds, i;
 	struct timeval tv, *tv_ptr;
+	NetPath *netPath;
 
 
 #if defined PTPD_SNMP
@@ -1436,28 +1860,34 @@ netSelect(TimeInternal * timeout, NetPath * netPath, fd_set *readfds)
 
 	FD_ZERO(readfds);
 	nfds = 0;
+
+	for (i = 0; i < count; i++) {
+	netPath = netPaths[i];
 #ifdef PTPD_PCAP
 	if (netPath->pcapEventSock >= 0) {
 		FD_SET(netPath->pcapEventSock, readfds);
 		if (netPath->pcapGeneralSock >= 0)
 			FD_SET(netPath->pcapGeneralSock, readfds);
 
-		nfds = netPath->pcapEventSock;
-		if (netPath->pcapEventSock < netPath->pcapGeneralSock)
+		if (nfds < netPath->pcapEventSock)
+			nfds = netPath->pcapEventSock;
+		if (nfds < netPath->pcapGeneralSock)
 			nfds = netPath->pcapGeneralSock;
 
 	} else if (netPath->eventSock >= 0) {
+#else
+	if (netPath->eventSock >= 0) {
 #endif
 		FD_SET(netPath->eventSock, readfds);
 		if (netPath->generalSock >= 0)
 			FD_SET(netPath->generalSock, readfds);
 
-		nfds = netPath->eventSock;
-		if (netPath->eventSock < netPath->generalSock)
+		if (nfds < netPath->eventSock)
+			nfds = netPath->eventSock;
+		if (nfds < netPath->generalSock)
 			nfds = netPath->generalSock;
-#ifdef PTPD_PCAP
 	}
-#endif
+	}
 	nfds++;
 
 #if defined PTPD_SNMP
@@ -1492,6 +1922,159 @@ if (rtOpts.snmpEnabled) {
 }
 #endif
 	return ret;
+#endif /* PTPD_EPOLL */
+}
+
+/*
+ * Validate an event message read from the socket and pick up its source and
+ * destination address and its receive timestamp from the ancillary data.
+ * Returns the message length, or 0 if the message cannot be used.
+ */
+static ssize_t
+netReadEvent(struct msghdr *msg, ssize_t length, TimeInternal *time, NetPath *netPath, int flags)
+{
+
+	struct cmsghdr *cmsg;
+
+#if defined(SO_TIMESTAMPNS) || defined(SO_TIMESTAMPING)
+	struct timespec * ts;
+#elif defined(SO_BINTIME)
+	struct bintime * bt;
+	struct timespec ts;
+#endif
+
+#if defined(SO_TIMESTAMP)
+	struct timeval * tv;
+#endif
+	Boolean timestampValid = FALSE;
+
+	netPath->lastDestAddr = 0;
+
+	if (msg->msg_flags & MSG_TRUNC) {
+		ERROR("received truncated message\n");
+		return 0;
+	}
+	/* get time stamp of packet */
+	if (!time) {
+		ERROR("null receive time stamp argument\n");
+		return 0;
+	}
+	if (msg->msg_flags & MSG_CTRUNC) {
+		ERROR("received truncated ancillary data\n");
+		return 0;
+	}
+
+#if defined(HAVE_DECL_MSG_ERRQUEUE) && HAVE_DECL_MSG_ERRQUEUE
+	if(!(flags & MSG_ERRQUEUE))
+#endif
+	netPath->lastSourceAddr = ((struct sockaddr_in *)msg->msg_name)->sin_addr.s_addr;
+
+	netPath->receivedPacketsTotal++;
+
+	/* do not report "from self" */
+	if(!netPath->lastSourceAddr || (netPath->lastSourceAddr != netPath->interfaceAddr.s_addr)) {
+	    netPath->receivedPackets++;
+	}
+
+	if (msg->msg_controllen <= 0) {
+		ERROR("received short ancillary data (%ld)\n",
+		      (long)msg->msg_controllen);
+
+		return 0;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(msg, cmsg)) {
+
+#ifdef IP_PKTINFO
+		if ((cmsg->cmsg_level == IPPROTO_IP) &&
+		    (cmsg->cmsg_type == IP_PKTINFO)) {
+			struct in_pktinfo *pi =
+			(struct in_pktinfo *) CMSG_DATA(cmsg);
+			netPath->lastDestAddr = pi->ipi_addr.s_addr;
+			DBG("IP_PKTINFO Dst: %s\n", inet_ntoa(pi->ipi_addr));
+		}
+#endif
+
+#ifdef IP_RECVDSTADDR
+		if ((cmsg->cmsg_level == IPPROTO_IP) &&
+		    (cmsg->cmsg_type == IP_RECVDSTADDR)) {
+			struct in_addr *pa = (struct in_addr *) CMSG_DATA(cmsg);
+			netPath->lastDestAddr = pa->s_addr;
+			DBG("IP_RECVDSTADDR Dst: %s\n", inet_ntoa(*pa));
+		}
+#endif
+
+
+		if (cmsg->cmsg_level == SOL_SOCKET) {
+#if defined(SO_TIMESTAMPING) && defined(SO_TIMESTAMPNS)
+			if(cmsg->cmsg_type == SO_TIMESTAMPING ||
+			    cmsg->cmsg_type == SO_TIMESTAMPNS) {
+				ts = (struct timespec *)CMSG_DATA(cmsg);
+#ifdef PTPD_PHC
+				/* raw hardware timestamp is the third of the three */
+				if(netPath->hwTimestamping && cmsg->cmsg_type == SO_TIMESTAMPING)
+					ts += 2;
+#endif /* PTPD_PHC */
+				time->seconds = ts->tv_sec;
+				time->nanoseconds = ts->tv_nsec;
+				timestampValid = TRUE;
+				DBG("rcvevent: SO_TIMESTAMP%s %s time stamp: %us %dns\n", netPath->txTimestampFailure ?
+				    "NS" : "ING",
+				    (flags & MSG_ERRQUEUE) ? "(TX)" : "(RX)" , time->seconds, time->nanoseconds);
+				break;
+			}
+#elif defined(SO_TIMESTAMPNS)
+			if(cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+				ts = (struct timespec *)CMSG_DATA(cmsg);
+				time->seconds = ts->tv_sec;
+				time->nanoseconds = ts->tv_nsec;
+				timestampValid = TRUE;
+				DBGV("kernel NANO recv time stamp %us %dns\n",
+				     time->seconds, time->nanoseconds);
+				break;
+			}
+#elif defined(SO_BINTIME)
+			if(cmsg->cmsg_type == SCM_BINTIME) {
+				bt = (struct bintime *)CMSG_DATA(cmsg);
+				bintime2timespec(bt, &ts);
+				time->seconds = ts.tv_sec;
+				time->nanoseconds = ts.tv_nsec;
+				timestampValid = TRUE;
+				DBGV("kernel NANO recv time stamp %us %dns\n",
+				     time->seconds, time->nanoseconds);
+				break;
+			}
+#endif
+		
+#if defined(SO_TIMESTAMP)
+			if(cmsg->cmsg_type == SCM_TIMESTAMP) {
+				tv = (struct timeval *)CMSG_DATA(cmsg);
+				time->seconds = tv->tv_sec;
+				time->nanoseconds = tv->tv_usec * 1000;
+				timestampValid = TRUE;
+				DBGV("kernel MICRO recv time stamp %us %dns\n",
+				     time->seconds, time->nanoseconds);
+			}
+#endif
+		 }
+
+	}
+
+
+	if (!timestampValid) {
+		/*
+		 * do not try to get by with recording the time here, better
+		 * to fail because the time recorded could be well after the
+		 * message receive, which would put a big spike in the
+		 * offset signal sent to the clock servo
+		 */
+		DBG("netReadEvent: no receive time stamp\n");
+		return 0;
+	}
+
+	return length;
+
 }
 
 /**
@@ -1535,19 +2118,6 @@ netRecvEvent(Octet * buf, TimeInternal * time, NetPath * netPath, int flags)
 		char	control[256];
 	}     cmsg_un;
 
-	struct cmsghdr *cmsg;
-
-#if defined(SO_TIMESTAMPNS) || defined(SO_TIMESTAMPING)
-	struct timespec * ts;
-#elif defined(SO_BINTIME)
-	struct bintime * bt;
-	struct timespec ts;
-#endif
-	
-#if defined(SO_TIMESTAMP)
-	struct timeval * tv;
-#endif
-	Boolean timestampValid = FALSE;
 	netPath->lastDestAddr = 0;
 #ifdef PTPD_PCAP
 	if (netPath->pcapEvent == NULL) { /* Using sockets */
@@ -1575,121 +2145,8 @@ netRecvEvent(Octet * buf, TimeInternal * time, NetPath * netPath, int flags)
 
 			return ret;
 		};
-		if (msg.msg_flags & MSG_TRUNC) {
-			ERROR("received truncated message\n");
-			return 0;
-		}
-		/* get time stamp of packet */
-		if (!time) {
-			ERROR("null receive time stamp argument\n");
-			return 0;
-		}
-		if (msg.msg_flags & MSG_CTRUNC) {
-			ERROR("received truncated ancillary data\n");
-			return 0;
-		}
-
-#if defined(HAVE_DECL_MSG_ERRQUEUE) && HAVE_DECL_MSG_ERRQUEUE
-		if(!(flags & MSG_ERRQUEUE))
-#endif
-		netPath->lastSourceAddr = from_addr.sin_addr.s_addr;
-
-		netPath->receivedPacketsTotal++;
-
-		/* do not report "from self" */
-		if(!netPath->lastSourceAddr || (netPath->lastSourceAddr != netPath->interfaceAddr.s_addr)) {
-		    netPath->receivedPackets++;
-		}
-
-		if (msg.msg_controllen <= 0) {
-			ERROR("received short ancillary data (%ld/%ld)\n",
-			      (long)msg.msg_controllen, (long)sizeof(cmsg_un.control));
-
-			return 0;
-		}
-
-		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
-		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-
-#ifdef IP_PKTINFO
-			if ((cmsg->cmsg_level == IPPROTO_IP) &&
-			    (cmsg->cmsg_type == IP_PKTINFO)) {
-				struct in_pktinfo *pi =
-				(struct in_pktinfo *) CMSG_DATA(cmsg);
-				netPath->lastDestAddr = pi->ipi_addr.s_addr;
-				DBG("IP_PKTINFO Dst: %s\n", inet_ntoa(pi->ipi_addr));
-			}
-#endif
-
-#ifdef IP_RECVDSTADDR
-			if ((cmsg->cmsg_level == IPPROTO_IP) &&
-			    (cmsg->cmsg_type == IP_RECVDSTADDR)) {
-				struct in_addr *pa = (struct in_addr *) CMSG_DATA(cmsg);
-				netPath->lastDestAddr = pa->s_addr;
-				DBG("IP_RECVDSTADDR Dst: %s\n", inet_ntoa(*pa));
-			}
-#endif
-
-
-			if (cmsg->cmsg_level == SOL_SOCKET) {
-#if defined(SO_TIMESTAMPING) && defined(SO_TIMESTAMPNS)
-				if(cmsg->cmsg_type == SO_TIMESTAMPING ||
-				    cmsg->cmsg_type == SO_TIMESTAMPNS) {
-					ts = (struct timespec *)CMSG_DATA(cmsg);
-					time->seconds = ts->tv_sec;
-					time->nanoseconds = ts->tv_nsec;
-					timestampValid = TRUE;
-					DBG("rcvevent: SO_TIMESTAMP%s %s time stamp: %us %dns\n", netPath->txTimestampFailure ?
-					    "NS" : "ING",
-					    (flags & MSG_ERRQUEUE) ? "(TX)" : "(RX)" , time->seconds, time->nanoseconds);
-					break;
-				}
-#elif defined(SO_TIMESTAMPNS)
-				if(cmsg->cmsg_type == SCM_TIMESTAMPNS) {
-					ts = (struct timespec *)CMSG_DATA(cmsg);
-					time->seconds = ts->tv_sec;
-					time->nanoseconds = ts->tv_nsec;
-					timestampValid = TRUE;
-					DBGV("kernel NANO recv time stamp %us %dns\n",
-					     time->seconds, time->nanoseconds);
-					break;
-				}
-#elif defined(SO_BINTIME)
-				if(cmsg->cmsg_type == SCM_BINTIME) {
-					bt = (struct bintime *)CMSG_DATA(cmsg);
-					bintime2timespec(bt, &ts);
-					time->seconds = ts.tv_sec;
-					time->nanoseconds = ts.tv_nsec;
-					timestampValid = TRUE;
-					DBGV("kernel NANO recv time stamp %us %dns\n",
-					     time->seconds, time->nanoseconds);
-					break;
-				}
-#endif
-			
-#if defined(SO_TIMESTAMP)
-				if(cmsg->cmsg_type == SCM_TIMESTAMP) {
-					tv = (struct timeval *)CMSG_DATA(cmsg);
-					time->seconds = tv->tv_sec;
-					time->nanoseconds = tv->tv_usec * 1000;
-					timestampValid = TRUE;
-					DBGV("kernel MICRO recv time stamp %us %dns\n",
-					     time->seconds, time->nanoseconds);
-				}
-#endif
-			 }
-
-		}
-
-
-		if (!timestampValid) {
-			/*
-			 * do not try to get by with recording the time here, better
-			 * to fail because the time recorded could be well after the
-			 * message receive, which would put a big spike in the
-			 * offset signal sent to the clock servo
-			 */
-			DBG("netRecvEvent: no receive time stamp\n");
+		ret = netReadEvent(&msg, ret, time, netPath, flags);
+		if (ret == 0) {
 			return 0;
 		}
 #ifdef PTPD_PCAP
@@ -1738,7 +2195,6 @@ netRecvEvent(Octet * buf, TimeInternal * time, NetPath * netPath, int flags)
 		       pkt_header->caplen - netPath->headerOffset);
 		time->seconds = pkt_header->ts.tv_sec;
 		time->nanoseconds = pkt_header->ts.tv_usec * 1000;
-		timestampValid = TRUE;
 		DBGV("netRecvEvent: kernel PCAP recv time stamp %us %dns\n",
 		     time->seconds, time->nanoseconds);
 		fflush(NULL);
@@ -1844,6 +2300,96 @@ netRecvGeneral(Octet * buf, NetPath * netPath)
 	return ret;
 }
 
+#ifdef PTPD_RECV_BATCHING
+/*
+ * Drain up to size packets from the event socket (with their ancillary data)
+ * or the general socket with a single recvmmsg() into the batch buffers.
+ * Returns the number of packets received, 0 if there were none, -1 on error.
+ */
+int
+netRecvBatch(NetPath * netPath, Boolean event, int size)
+{
+	RecvBatch *batch = event ? &netPath->eventBatch : &netPath->generalBatch;
+	struct msghdr *msg;
+	int i, ret;
+
+	if (size > RECV_BATCH_MAX)
+		size = RECV_BATCH_MAX;
+
+	batch->count = 0;
+	batch->next = 0;
+
+	for (i = 0; i < size; i++) {
+		batch->iov[i].iov_base = batch->buf[i];
+		batch->iov[i].iov_len = PACKET_SIZE;
+
+		msg = &batch->msgs[i].msg_hdr;
+		memset(msg, 0, sizeof(struct msghdr));
+		msg->msg_name = &batch->from[i];
+		msg->msg_namelen = sizeof(struct sockaddr_in);
+		msg->msg_iov = &batch->iov[i];
+		msg->msg_iovlen = 1;
+		if (event) {
+			msg->msg_control = batch->cmsg[i].control;
+			msg->msg_controllen = sizeof(batch->cmsg[i].control);
+		}
+	}
+
+	ret = recvmmsg(event ? netPath->eventSock : netPath->generalSock,
+		    batch->msgs, size, MSG_DONTWAIT, NULL);
+
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		return -1;
+	}
+
+	DBGV("netRecvBatch: %d packets from the %s socket\n", ret, event ? "event" : "general");
+
+	batch->count = ret;
+	return ret;
+}
+
+/*
+ * Hand out the next packet of the last batch received: *buf points into the
+ * batch, so the message is processed in place. The source and destination
+ * address and (event messages) the receive timestamp are picked up as in
+ * netRecvEvent() and netRecvGeneral(). Returns FALSE when the batch is
+ * exhausted; *length is 0 for a packet that cannot be used.
+ */
+Boolean
+netNextBatchPacket(NetPath * netPath, Boolean event, Octet ** buf, ssize_t * length, TimeInternal * time)
+{
+	RecvBatch *batch = event ? &netPath->eventBatch : &netPath->generalBatch;
+	int i = batch->next;
+
+	if (i >= batch->count) {
+		batch->count = 0;
+		batch->next = 0;
+		return FALSE;
+	}
+
+	batch->next++;
+	*buf = batch->buf[i];
+
+	if (event) {
+		*length = netReadEvent(&batch->msgs[i].msg_hdr, batch->msgs[i].msg_len,
+			    time, netPath, 0);
+		return TRUE;
+	}
+
+	netPath->lastSourceAddr = batch->from[i].sin_addr.s_addr;
+
+	/* do not report "from self" */
+	if(!netPath->lastSourceAddr || (netPath->lastSourceAddr != netPath->interfaceAddr.s_addr)) {
+	    netPath->receivedPackets++;
+	}
+	netPath->receivedPacketsTotal++;
+
+	*length = batch->msgs[i].msg_len;
+	return TRUE;
+}
+#endif /* PTPD_RECV_BATCHING */
 
 #ifdef PTPD_PCAP
 ssize_t
@@ -1869,6 +2415,8 @@ netSendPcapEther(Octet * buf,  UInteger16 length,
 // destinationAddress: destination:
 //   if filled, send to this unicast dest;
 //   if zero, sending to multicast.
+// tim: receives the TX timestamp; with keyed TX timestamps it may be NULL,
+//   the caller then collects the timestamp later by netLastTxTimestampKey().
 //
 ///
 /// TODO: merge these 2 functions into one
@@ -1946,16 +2494,18 @@ netSendEvent(Octet * buf, UInteger16 length, NetPath * netPath,
 #else
 
 #ifdef PTPD_PCAP
-			if((netPath->pcapEvent == NULL) && !netPath->txTimestampFailure) {
+			if(ret > 0 && (netPath->pcapEvent == NULL) && !netPath->txTimestampFailure) {
 #else
-			if(!netPath->txTimestampFailure) {
+			if(ret > 0 && !netPath->txTimestampFailure) {
 #endif /* PTPD_PCAP */
+				txLatencyMark(LATENCY_TX_SEND);
 				if(!getTxTimestamp(netPath, tim)) {
 					netPath->txTimestampFailure = TRUE;
 					if (tim) {
 						clearTime(tim);
 					}
 				}
+				txLatencyMark(LATENCY_TX_TIMESTAMP);
 			}
 
 			if(netPath->txTimestampFailure)
@@ -1991,10 +2541,11 @@ netSendEvent(Octet * buf, UInteger16 length, NetPath * netPath,
 #ifdef SO_TIMESTAMPING
 
 #ifdef PTPD_PCAP
-			if((netPath->pcapEvent == NULL) && !netPath->txTimestampFailure) {
+			if(ret > 0 && (netPath->pcapEvent == NULL) && !netPath->txTimestampFailure) {
 #else
-			if(!netPath->txTimestampFailure) {
+			if(ret > 0 && !netPath->txTimestampFailure) {
 #endif /* PTPD_PCAP */
+				txLatencyMark(LATENCY_TX_SEND);
 				if(!getTxTimestamp(netPath, tim)) {
 					if (tim) {
 						clearTime(tim);
@@ -2005,6 +2556,7 @@ netSendEvent(Octet * buf, UInteger16 length, NetPath * netPath,
 					/* Try re-enabling MULTICAST_LOOP */
 					netSetMulticastLoopback(netPath, TRUE);
 				}
+				txLatencyMark(LATENCY_TX_TIMESTAMP);
 			}
 #endif /* SO_TIMESTAMPING */
 		}
@@ -2015,6 +2567,76 @@ netSendEvent(Octet * buf, UInteger16 length, NetPath * netPath,
 	return ret;
 }
 
+#ifdef PTPD_SYNC_BATCHING
+/*
+ * Send a batch of unicast event messages with one sendmmsg() call.
+ * Message i is length bytes at buf + i * PACKET_SIZE, sent to destinations[i].
+ * No TX timestamps are collected here: firstKey receives the timestamp key
+ * of the first message, message i gets firstKey + i.
+ * Returns the number of messages sent, or -1 if none could be sent.
+ */
+int
+netSendEventBatch(Octet * buf, UInteger16 length, int count, const Integer32 * destinations,
+		  NetPath * netPath, UInteger32 * firstKey)
+{
+	struct mmsghdr msgs[SYNC_BATCH_MAX];
+	struct iovec vecs[SYNC_BATCH_MAX];
+	struct sockaddr_in addrs[SYNC_BATCH_MAX];
+	int i, ret = 0, sent = 0;
+
+	if (count > SYNC_BATCH_MAX) {
+		count = SYNC_BATCH_MAX;
+	}
+
+	memset(msgs, 0, count * sizeof(struct mmsghdr));
+	memset(addrs, 0, count * sizeof(struct sockaddr_in));
+
+	for (i = 0; i < count; i++) {
+		Octet *msgBuf = buf + i * PACKET_SIZE;
+
+		addrs[i].sin_family = AF_INET;
+		addrs[i].sin_port = htons(PTP_EVENT_PORT);
+		addrs[i].sin_addr.s_addr = destinations[i];
+
+		/* unicast destinations only, see netSendEvent() */
+		*(char *)(msgBuf + 6) |= PTP_UNICAST;
+
+		vecs[i].iov_base = msgBuf;
+		vecs[i].iov_len = length;
+
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msgs[i].msg_hdr.msg_iov = &vecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	*firstKey = netPath->txTimestampKey;
+
+	/* sendmmsg() may stop short - carry on from where it stopped */
+	while (sent < count) {
+		ret = sendmmsg(netPath->eventSock, msgs + sent, count - sent, 0);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			DBG("Error sending unicast event message batch (%d of %d sent)\n", sent, count);
+			break;
+		}
+		sent += ret;
+	}
+
+	netPath->txTimestampKey += sent;
+	netPath->sentPackets += sent;
+	netPath->sentPacketsTotal += sent;
+
+	if (!sent && ret < 0) {
+		return -1;
+	}
+
+	return sent;
+}
+#endif /* PTPD_SYNC_BATCHING */
+
 ssize_t
 netSendGeneral(Octet * buf, UInteger16 length, NetPath * netPath,
 	       const const RunTimeOpts *rtOpts, Integer32 destinationAddress)
@@ -2204,9 +2826,9 @@ netSendPeerEvent(Octet * buf, UInteger16 length, NetPath * netPath, const RunTim
 #else
 
 #ifdef PTPD_PCAP
-		if((netPath->pcapEvent == NULL) && !netPath->txTimestampFailure) {
+		if(ret > 0 && (netPath->pcapEvent == NULL) && !netPath->txTimestampFailure) {
 #else
-		if(!netPath->txTimestampFailure) {
+		if(ret > 0 && !netPath->txTimestampFailure) {
 #endif /* PTPD_PCAP */
 			if(!getTxTimestamp(netPath, tim)) {
 				netPath->txTimestampFailure = TRUE;
@@ -2243,7 +2865,7 @@ netSendPeerEvent(Octet * buf, UInteger16 length, NetPath * netPath, const RunTim
 		if (ret <= 0)
 			DBG("Error sending multicast peer event message\n");
 #ifdef SO_TIMESTAMPING
-		if(!netPath->txTimestampFailure) {
+		if(ret > 0 && !netPath->txTimestampFailure) {
 			if(!getTxTimestamp(netPath, tim)) {
 				if (tim) {
 					clearTime(tim);
@@ -0,0 +1,254 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   phc.c
+ * @date   Wed Feb 24 19:12:50 2016
+ *
+ * @brief  Linux PTP hardware clock (PHC) driver
+ *
+ * While a PHC is open, getTime(), setTime(), adjFreq() and getAdjFreq()
+ * operate on it instead of the system clock, so the servo steers the
+ * clock which produced the hardware timestamps. Without hardware
+ * timestamps the offsets are measured against the system clock, so the
+ * system clock is what gets steered.
+ *
+ * The device is only reached through phcDevice*(). ptpd2-sim replaces
+ * those with a simulated PHC, so the driver runs unchanged in make sim
+ * (test/sim-phc.conf) without PTP hardware.
+ */
+
+#include "../ptpd.h"
+
+#ifdef PTPD_PHC
+
+#ifndef PTPD_SIM
+#include <linux/ptp_clock.h>
+#endif /* PTPD_SIM */
+
+/* dynamic POSIX clock ID of an open /dev/ptpN */
+#define FD_TO_CLOCKID(fd)	((~(clockid_t) (fd) << 3) | 3)
+
+static int phcFd = -1;
+static clockid_t phcClock = CLOCK_REALTIME;
+static char phcPath[PATH_MAX+1];
+static Integer32 phcMaxAdj = 0;
+
+/*
+ * Open the PHC to be steered when hardware timestamping is used: the
+ * configured device, or else the PHC of the interface. Otherwise the
+ * system clock stays in charge. Called on every protocol (re)initialisation.
+ */
+Boolean
+phcInit(const RunTimeOpts *rtOpts, const NetPath *netPath)
+{
+
+	char path[PATH_MAX+1];
+	Integer32 maxAdj = 0;
+	int fd;
+
+	phcShutdown();
+
+	memset(path, 0, sizeof(path));
+
+	/* steering the PHC against software timestamps would leave the servo loop open */
+	if(!netPath->hwTimestamping) {
+		if(strlen(rtOpts->phcDevice)) {
+			WARNING("Not using PTP hardware clock %s without hardware timestamps - steering the system clock\n",
+			    rtOpts->phcDevice);
+		}
+		return TRUE;
+	}
+
+	if(strlen(rtOpts->phcDevice)) {
+		snprintf(path, sizeof(path), "%s", rtOpts->phcDevice);
+	} else {
+		if(netPath->phcIndex < 0) {
+			ERROR("Interface %s has no PTP hardware clock - cannot use hardware timestamps\n",
+			    rtOpts->ifaceName);
+			return FALSE;
+		}
+		snprintf(path, sizeof(path), "/dev/ptp%d", netPath->phcIndex);
+	}
+
+	if((fd = phcDeviceOpen(path)) < 0) {
+		PERROR("Could not open PTP hardware clock %s", path);
+		return FALSE;
+	}
+
+	if(phcDeviceCaps(fd, &maxAdj) < 0) {
+		PERROR("Could not read capabilities of PTP hardware clock %s", path);
+		phcDeviceClose(fd);
+		return FALSE;
+	}
+
+	phcFd = fd;
+	phcClock = FD_TO_CLOCKID(fd);
+	phcMaxAdj = maxAdj;
+	snprintf(phcPath, sizeof(phcPath), "%s", path);
+
+	if(netPath->phcIndex >= 0 && strlen(rtOpts->phcDevice)) {
+		snprintf(path, sizeof(path), "/dev/ptp%d", netPath->phcIndex);
+		if(strcmp(path, phcPath)) {
+			WARNING("Steering %s, but hardware timestamps on %s come from %s\n",
+			    phcPath, rtOpts->ifaceName, path);
+		}
+	}
+
+	if(phcMaxAdj <= 0) {
+		WARNING("PTP hardware clock %s cannot be frequency adjusted - use clock:no_adjust\n",
+		    phcPath);
+	}
+
+	INFO("Using PTP hardware clock %s, maximum frequency adjustment %d ppb\n",
+	    phcPath, phcMaxAdj);
+
+	return TRUE;
+
+}
+
+void
+phcShutdown(void)
+{
+
+	if(phcFd >= 0) {
+		DBG("Closing PTP hardware clock %s\n", phcPath);
+		phcDeviceClose(phcFd);
+	}
+
+	phcFd = -1;
+	phcClock = CLOCK_REALTIME;
+	phcMaxAdj = 0;
+	memset(phcPath, 0, sizeof(phcPath));
+
+}
+
+Boolean
+phcActive(void)
+{
+	return (phcFd >= 0);
+}
+
+/* the clock getTime() and setTime() use: the PHC, or CLOCK_REALTIME */
+clockid_t
+phcClockId(void)
+{
+	return phcClock;
+}
+
+const char*
+phcName(void)
+{
+	return phcFd >= 0 ? phcPath : "system clock";
+}
+
+/* frequency adjustment in ppb, clamped to what the PHC supports */
+Boolean
+phcAdjFreq(double adj)
+{
+
+	struct timex t;
+
+	if(adj > phcMaxAdj) {
+		adj = phcMaxAdj;
+	} else if(adj < -phcMaxAdj) {
+		adj = -phcMaxAdj;
+	}
+
+	memset(&t, 0, sizeof(t));
+	t.modes = ADJ_FREQUENCY;
+	/* scaled ppm: ppm with a 16-bit fractional part */
+	t.freq = (long) round(adj * ((1 << 16) / 1000.0));
+
+	DBG2("phcAdjFreq: %s adj is %.09f, freq is %ld\n", phcPath, adj, t.freq);
+
+	if(phcDeviceAdjtime(phcClock, &t) < 0) {
+		DBG("phcAdjFreq: clock_adjtime() failed on %s: %s\n", phcPath, strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+
+}
+
+double
+phcGetAdjFreq(void)
+{
+
+	struct timex t;
+
+	memset(&t, 0, sizeof(t));
+
+	if(phcDeviceAdjtime(phcClock, &t) < 0) {
+		DBG("phcGetAdjFreq: clock_adjtime() failed on %s: %s\n", phcPath, strerror(errno));
+		return 0;
+	}
+
+	return (t.freq + 0.0) / ((1 << 16) / 1000.0);
+
+}
+
+#ifndef PTPD_SIM
+/* the device: ptpd2-sim brings its own, see src/sim/simclock.c */
+
+int
+phcDeviceOpen(const char *path)
+{
+	return open(path, O_RDWR);
+}
+
+/* maximum frequency adjustment, ppb */
+int
+phcDeviceCaps(int fd, Integer32 *maxAdj)
+{
+
+	struct ptp_clock_caps caps;
+
+	memset(&caps, 0, sizeof(caps));
+	if(ioctl(fd, PTP_CLOCK_GETCAPS, &caps) < 0) {
+		return -1;
+	}
+
+	*maxAdj = caps.max_adj;
+	return 0;
+
+}
+
+void
+phcDeviceClose(int fd)
+{
+	close(fd);
+}
+
+int
+phcDeviceAdjtime(clockid_t clock, struct timex *t)
+{
+	return clock_adjtime(clock, t);
+}
+#endif /* PTPD_SIM */
+
+#endif /* PTPD_PHC */
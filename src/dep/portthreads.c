@@ -0,0 +1,1054 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   portthreads.c
+ * @date   Sat Apr 2 14:05:51 2016
+ *
+ * @brief  Boundary clock port threads
+ *
+ * With ptpengine:port_threads enabled, ports 2 and up of a boundary clock
+ * each run on a thread of their own, with their own event loop, optionally
+ * bound to a CPU core and scheduled SCHED_FIFO. Port 1 stays on the main
+ * thread, which also makes the decisions taken for the whole clock: the
+ * state decision across ports, which port steers the clock, the datasets
+ * all ports share, signals, SNMP and the status file.
+ *
+ * A port thread shares no data with the main thread. Each direction has a
+ * single producer, single consumer queue of fixed size messages, with an
+ * eventfd in the consumer's event loop to wake it up. Posting a message
+ * never waits: when a queue is full the message is dropped and reported.
+ *
+ * Handing the clock over to another port takes two steps: the port
+ * steering the clock is asked to let go (RELEASE), answers with the state
+ * of the clock control (RELEASED), and only then is the next port told to
+ * take over (ACQUIRE).
+ *
+ * The timing domain only ever runs on the main thread. While a port thread
+ * steers the clock, the PTP timing service runs on a stand-in for it: the
+ * port reports its clock control state once per timing domain update
+ * (CLOCK), and is told what the timing domain made of it (CLOCKCONTROL).
+ */
+
+#include "../ptpd.h"
+
+#ifdef PTPD_PORT_THREADS
+
+/* messages between the main thread and the port threads */
+enum {
+	PORTMSG_STATE = 0,	/* port: the port changed state */
+	PORTMSG_ERBEST,		/* port: the best master heard on the port */
+	PORTMSG_DATASETS,	/* both: the clock datasets, from the slave port */
+	PORTMSG_RELEASED,	/* port: the port no longer steers the clock */
+	PORTMSG_ALARM,		/* port: an alarm event for SNMP */
+	PORTMSG_CLOCK,		/* port: clock control state, from the port steering the clock */
+	PORTMSG_DECISION,	/* main: the state decision for the port */
+	PORTMSG_RELEASE,	/* main: stop steering the clock */
+	PORTMSG_ACQUIRE,	/* main: start steering the clock */
+	PORTMSG_CONFIG,		/* main: the configuration was reloaded */
+	PORTMSG_STEP,		/* main: step the clock (SIGUSR1) */
+	PORTMSG_CLOCKCONTROL	/* main: the timing domain's decision on the clock control */
+};
+
+typedef struct {
+	Boolean granted;
+	double observedDrift;
+	uint32_t seq;		/* ACQUIRE: the clock control decision the port starts from */
+} ClockHandover;
+
+/* what the PTP timing service needs to know of the port steering the clock */
+typedef struct {
+	uint32_t seq;		/* the last clock control decision the port took in */
+	UInteger8 portState;
+	Boolean available;
+	Boolean activity;	/* since the last report, as are the packet counts */
+	Boolean ptpTimescale;
+	Boolean leapSecondInProgress;
+	ClockStatusInfo clockStatus;
+	TimeInternal offsetFromMaster;
+	uint64_t sentPackets;
+	uint64_t receivedPackets;
+} ClockReport;
+
+/* what the timing domain changed in the clock control of the port */
+typedef struct {
+	uint32_t seq;
+	Boolean granted;
+	Boolean available;
+	Boolean leapInsert;
+	Boolean leapDelete;
+	Boolean override;
+	int utcOffset;
+} ClockDecision;
+
+typedef struct {
+	int type;
+	union {
+		UInteger8 state;
+		UInteger8 decision;
+		struct {
+			Boolean heard;
+			ForeignMasterRecord record;
+		} erbest;
+		ClockDatasets datasets;
+		ClockHandover handover;
+		ClockReport clock;
+		ClockDecision clockControl;
+		RunTimeOpts *config;
+#ifdef PTPD_SNMP
+		AlarmEntry alarm;
+#endif /* PTPD_SNMP */
+	} data;
+} PortMessage;
+
+typedef struct {
+	PortMessage ring[PORT_QUEUE_SIZE];
+	/* written by the producer only */
+	uint32_t head;
+	uint32_t dropped;
+	Boolean full;
+	/* written by the consumer only */
+	uint32_t tail;
+	/* the consumer waits for this one */
+	int eventFd;
+} PortQueue;
+
+struct PortThread {
+	PtpClock *port;
+	int index;
+	int cpu;
+	pthread_t thread;
+	Boolean running;
+	int stop;
+	PortQueue toPort;
+	PortQueue toMain;
+	AsyncLogQueue *logQueue;
+	/* the rest belongs to the port thread */
+	fd_set readfds;
+	UInteger8 lastState;
+	Boolean releasing;
+	ClockHandover released;
+	Boolean datasetsSent;
+	ClockDatasets datasets;
+	uint32_t clockSeq;
+};
+
+/* the main thread's view of the clock */
+static struct {
+	int eventFd;
+	/* Erbest of each port thread, as last reported */
+	ForeignMasterRecord erbest[PTPD_MAX_PORTS];
+	Boolean heard[PTPD_MAX_PORTS];
+	Boolean decide;
+	/* port synchronised to the best master, -1 if none */
+	int slave;
+	/* port the clock is being handed over to, -1 if none */
+	int handover;
+	Boolean releasing;
+	/* datasets last shared from port 1 */
+	Boolean datasetsShared;
+	ClockDatasets datasets;
+	/* the PTP timing service's view of a port thread steering the clock */
+	PtpClock *proxy;
+	/* clock control decisions sent, reports from before the last one are stale */
+	uint32_t clockSeq;
+} coordinator;
+
+/* Claim the next free message slot, NULL if the queue is full */
+static PortMessage*
+portMessage(PortQueue *queue, int type)
+{
+
+	PortMessage *message;
+
+	if(queue->head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) >= PORT_QUEUE_SIZE) {
+		queue->dropped++;
+		/* once per run of drops - the queue is only full if the other side is stuck */
+		if(!queue->full) {
+			ERROR("Boundary clock port queue full - messages are being dropped (%u so far)\n",
+				queue->dropped);
+			queue->full = TRUE;
+		}
+		return NULL;
+	}
+
+	queue->full = FALSE;
+	message = &queue->ring[queue->head & (PORT_QUEUE_SIZE - 1)];
+	message->type = type;
+
+	return message;
+
+}
+
+/* Publish the message claimed with portMessage() and wake up the consumer */
+static void
+portMessagePost(PortQueue *queue)
+{
+
+	uint64_t one = 1;
+
+	__atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+
+	if(write(queue->eventFd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+		DBG("Could not wake up port queue consumer: %s\n", strerror(errno));
+	}
+
+}
+
+/* Post a message without data, returning FALSE if it was dropped */
+static Boolean
+portMessageSimple(PortQueue *queue, int type)
+{
+
+	if(portMessage(queue, type) == NULL) {
+		return FALSE;
+	}
+
+	portMessagePost(queue);
+	return TRUE;
+
+}
+
+/* The next message to consume, NULL if none */
+static PortMessage*
+portMessageNext(PortQueue *queue)
+{
+
+	if(queue->tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	return &queue->ring[queue->tail & (PORT_QUEUE_SIZE - 1)];
+
+}
+
+/* Hand the slot of the message just consumed back to the producer */
+static void
+portMessageDone(PortQueue *queue)
+{
+
+	__atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+
+}
+
+/* Reset a wakeup eventfd found readable */
+static void
+clearWakeup(int eventFd, fd_set *readfds)
+{
+
+	uint64_t count;
+
+	if(eventFd >= 0 && FD_ISSET(eventFd, readfds) &&
+	    read(eventFd, &count, sizeof(count)) != sizeof(count) && errno != EAGAIN) {
+		DBG("Could not read port queue wakeup: %s\n", strerror(errno));
+	}
+
+}
+
+static void*
+portThreadMain(void *arg)
+{
+
+	extern PTPD_THREAD_LOCAL PtpClock *G_ptpClock;
+	PortThread *thread = (PortThread*)arg;
+	PtpClock *ptpClock = thread->port;
+	RunTimeOpts *rtOpts = ptpClock->rtOpts;
+	struct sched_param param;
+	int ret;
+
+	G_ptpClock = ptpClock;
+	asyncLogAttach(thread->logQueue);
+
+	if(thread->cpu >= 0) {
+		if(setCpuAffinity(thread->cpu) < 0) {
+			ERROR("Could not bind port %d thread to CPU core %d\n",
+				rtOpts->portNumber, thread->cpu);
+		} else {
+			INFO("Port %d thread bound to CPU core %d\n",
+				rtOpts->portNumber, thread->cpu);
+		}
+	}
+
+	if(rtOpts->portThreadPriority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = rtOpts->portThreadPriority;
+		if((ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0) {
+			errno = ret;
+			PERROR("Could not set port %d thread to SCHED_FIFO priority %d",
+				rtOpts->portNumber, rtOpts->portThreadPriority);
+		}
+	}
+
+	/* the timers and sockets of the port go into this thread's event loop */
+	if(!timerSetup(ptpClock->timers) || !eventLoopAddFd(thread->toPort.eventFd)) {
+		CRITICAL("Could not set up the event loop of port %d - port not started\n",
+			rtOpts->portNumber);
+	} else {
+		protocolPortThread(rtOpts, ptpClock);
+		shutdownBoundaryClockPort(ptpClock);
+	}
+
+	shutdownEventTimers();
+
+	return NULL;
+
+}
+
+/*
+ * Prepare ports 2 and up to run on threads, before their alarms are
+ * configured. The threads are started by startPortThreads().
+ */
+Boolean
+setupPortThreads(ClockPorts *ports)
+{
+
+	const RunTimeOpts *rtOpts = ports->port[0]->rtOpts;
+	PortThread *thread;
+	int i;
+
+	memset(&coordinator, 0, sizeof(coordinator));
+	coordinator.slave = -1;
+	coordinator.handover = -1;
+
+	if((coordinator.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		PERROR("Could not create boundary clock port queue wakeup");
+		return FALSE;
+	}
+
+	if((coordinator.proxy = (PtpClock*)calloc(1, sizeof(PtpClock))) == NULL) {
+		PERROR("Error: Failed to allocate memory for boundary clock port threads");
+		return FALSE;
+	}
+	/* should the timing service shut down through it, port 1 takes the clock down */
+	coordinator.proxy->ports = ports;
+	coordinator.proxy->rtOpts = ports->port[0]->rtOpts;
+
+	for(i = 1; i < ports->count; i++) {
+		if((thread = (PortThread*)calloc(1, sizeof(PortThread))) == NULL) {
+			PERROR("Error: Failed to allocate memory for boundary clock port %d thread", i + 1);
+			return FALSE;
+		}
+		thread->port = ports->port[i];
+		thread->index = i;
+		thread->cpu = rtOpts->portThreadCpus[i - 1];
+		thread->toMain.eventFd = coordinator.eventFd;
+		ports->port[i]->thread = thread;
+		ports->port[i]->readfds = &thread->readfds;
+		if((thread->toPort.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+			PERROR("Could not create boundary clock port queue wakeup");
+			return FALSE;
+		}
+	}
+
+	ports->threaded = TRUE;
+
+	return TRUE;
+
+}
+
+/* Start the port threads. Ports already started are stopped by stopPortThreads() */
+Boolean
+startPortThreads(ClockPorts *ports)
+{
+
+	PortThread *thread;
+	sigset_t all, old;
+	int i, ret;
+
+	if(!eventLoopAddFd(coordinator.eventFd)) {
+		return FALSE;
+	}
+
+	for(i = 1; i < ports->count; i++) {
+
+		thread = ports->port[i]->thread;
+
+		if((thread->logQueue = asyncLogAddQueue(ports->port[0]->rtOpts)) == NULL) {
+			return FALSE;
+		}
+
+		/* signals are for the main thread */
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		ret = pthread_create(&thread->thread, NULL, portThreadMain, thread);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+		if(ret != 0) {
+			errno = ret;
+			PERROR("Could not start boundary clock port %d thread", i + 1);
+			asyncLogRemoveQueue(thread->logQueue);
+			thread->logQueue = NULL;
+			return FALSE;
+		}
+
+		thread->running = TRUE;
+		INFO("Boundary clock port %d (%s) running on its own thread\n",
+			i + 1, thread->port->rtOpts->primaryIfaceName);
+	}
+
+	return TRUE;
+
+}
+
+/* Shut the ports down and wait for their threads to finish */
+void
+stopPortThreads(ClockPorts *ports)
+{
+
+	PortThread *thread;
+	uint64_t one = 1;
+	int i;
+
+	for(i = 1; i < ports->count; i++) {
+		thread = ports->port[i]->thread;
+		if(thread == NULL || !thread->running) {
+			continue;
+		}
+		/* not a message: stopping must work with the queue full */
+		__atomic_store_n(&thread->stop, 1, __ATOMIC_RELEASE);
+		if(write(thread->toPort.eventFd, &one, sizeof(one)) != sizeof(one)) {
+			DBG("Could not wake up port %d thread: %s\n", i + 1, strerror(errno));
+		}
+	}
+
+	for(i = 1; i < ports->count; i++) {
+		thread = ports->port[i]->thread;
+		if(thread == NULL || !thread->running) {
+			continue;
+		}
+		pthread_join(thread->thread, NULL);
+		thread->running = FALSE;
+		asyncLogRemoveQueue(thread->logQueue);
+		thread->logQueue = NULL;
+	}
+
+}
+
+/* Free what setupPortThreads() allocated, once the threads are stopped */
+void
+freePortThreads(ClockPorts *ports)
+{
+
+	PortThread *thread;
+	int i;
+
+	for(i = 1; i < ports->count; i++) {
+		if((thread = ports->port[i]->thread) == NULL) {
+			continue;
+		}
+		if(thread->toPort.eventFd >= 0) {
+			close(thread->toPort.eventFd);
+		}
+		free(thread);
+		ports->port[i]->thread = NULL;
+	}
+
+	if(coordinator.eventFd >= 0) {
+		eventLoopRemoveFd(coordinator.eventFd);
+		close(coordinator.eventFd);
+		coordinator.eventFd = -1;
+	}
+
+	if(coordinator.proxy != NULL) {
+		if(timingDomain.services[0]->controller == coordinator.proxy) {
+			timingDomain.services[0]->controller = ports->port[0];
+		}
+		free(coordinator.proxy);
+		coordinator.proxy = NULL;
+	}
+
+}
+
+/* Tell the port threads about a reloaded configuration */
+void
+portThreadsReload(const RunTimeOpts *rtOpts, ClockPorts *ports)
+{
+
+	PortMessage *message;
+	RunTimeOpts *config;
+	int i;
+
+	for(i = 1; i < ports->count; i++) {
+		/* each port gets a copy of its own, which it frees */
+		if((config = (RunTimeOpts*)malloc(sizeof(RunTimeOpts))) == NULL) {
+			PERROR("Could not pass configuration on to port %d", i + 1);
+			continue;
+		}
+		if((message = portMessage(&ports->port[i]->thread->toPort, PORTMSG_CONFIG)) == NULL) {
+			ERROR("Could not pass configuration on to port %d\n", i + 1);
+			free(config);
+			continue;
+		}
+		memcpy(config, rtOpts, sizeof(RunTimeOpts));
+		message->data.config = config;
+		portMessagePost(&ports->port[i]->thread->toPort);
+	}
+
+}
+
+/* Have the port thread step the clock (SIGUSR1) */
+void
+portThreadStep(PtpClock *ptpClock)
+{
+
+	if(!portMessageSimple(&ptpClock->thread->toPort, PORTMSG_STEP)) {
+		ERROR("SIGUSR1 received - could not pass it on to port %d\n",
+			ptpClock->thread->index + 1);
+	}
+
+}
+
+/* Boundary clock: from now on port @next steers the clock */
+static void
+completeHandover(ClockPorts *ports, const ClockHandover *handover)
+{
+
+	TimingService *service = timingDomain.services[0];
+	PtpClock *proxy = coordinator.proxy;
+	PortMessage *message = NULL;
+	ClockHandover acquire = *handover;
+	PtpClock *next;
+	int index;
+
+	/* the timing domain's decision stands, whatever the port had taken in */
+	if(ports->controller->thread != NULL) {
+		acquire.granted = proxy->clockControl.granted;
+	}
+
+	coordinator.releasing = FALSE;
+	index = coordinator.handover < 0 ? 0 : coordinator.handover;
+	coordinator.handover = -1;
+	next = ports->port[index];
+
+	if(next->thread != NULL &&
+	    (message = portMessage(&next->thread->toPort, PORTMSG_ACQUIRE)) == NULL) {
+		/* the clock must not be left without a port steering it */
+		ERROR("Could not hand the clock over to port %d - port 1 keeps it\n", index + 1);
+		next = ports->port[0];
+	}
+
+	/* before the port hears of it: posting the message publishes these too */
+	ports->controller = next;
+	service->config = ports->port[0]->rtOpts;
+
+	if(message != NULL) {
+		/* the stand-in starts from what the port is told, until it reports */
+		memset(&proxy->clockControl, 0, sizeof(proxy->clockControl));
+		memset(&proxy->clockStatus, 0, sizeof(proxy->clockStatus));
+		proxy->clockControl.granted = acquire.granted;
+		proxy->portDS.portState = ports->portState[index];
+		proxy->netPath.sentPackets = 0;
+		proxy->netPath.receivedPackets = 0;
+		acquire.seq = ++coordinator.clockSeq;
+		service->controller = proxy;
+		message->data.handover = acquire;
+		portMessagePost(&next->thread->toPort);
+	} else {
+		service->controller = next;
+		next->clockControl.granted = acquire.granted;
+		next->servo.observedDrift = acquire.observedDrift;
+		next->controllingClock = TRUE;
+	}
+
+	INFO("Clock now controlled by port %d (%s)\n",
+		next->rtOpts->portNumber, next->rtOpts->primaryIfaceName);
+
+}
+
+/* Main thread: take in the report of the port thread steering the clock */
+static void
+takeClockReport(const ClockReport *report)
+{
+
+	PtpClock *proxy = coordinator.proxy;
+	Boolean update = proxy->clockStatus.update || report->clockStatus.update;
+	Boolean majorChange = proxy->clockStatus.majorChange || report->clockStatus.majorChange;
+
+	proxy->portDS.portState = report->portState;
+	proxy->timePropertiesDS.ptpTimescale = report->ptpTimescale;
+	proxy->leapSecondInProgress = report->leapSecondInProgress;
+	proxy->currentDS.offsetFromMaster = report->offsetFromMaster;
+	proxy->clockControl.activity |= report->activity;
+	proxy->netPath.sentPackets += report->sentPackets;
+	proxy->netPath.receivedPackets += report->receivedPackets;
+
+	/* what the timing domain decides, the port only has once it has taken it in */
+	if(report->seq == coordinator.clockSeq) {
+		proxy->clockControl.available = report->available;
+		proxy->clockStatus = report->clockStatus;
+	} else {
+		proxy->clockStatus.inSync = report->clockStatus.inSync;
+		proxy->clockStatus.clockOffset = report->clockStatus.clockOffset;
+	}
+
+	proxy->clockStatus.update = update;
+	proxy->clockStatus.majorChange = majorChange;
+
+}
+
+/*
+ * Main thread: the timing domain update. With a port thread steering the
+ * clock, the PTP timing service runs on its stand-in, and the port is
+ * told about whatever the update changed.
+ */
+void
+portThreadsTimingDomainUpdate(ClockPorts *ports)
+{
+
+	PtpClock *proxy = coordinator.proxy;
+	PtpClock *controller = ports->controller;
+	ClockControlInfo clockControl = proxy->clockControl;
+	ClockStatusInfo clockStatus = proxy->clockStatus;
+	PortMessage *message;
+	ClockDecision *decision;
+
+	timingDomain.update(&timingDomain);
+
+	if(controller->thread == NULL || coordinator.handover >= 0 ||
+	    timingDomain.services[0]->controller != proxy) {
+		return;
+	}
+
+	if(clockControl.granted == proxy->clockControl.granted &&
+	    clockControl.available == proxy->clockControl.available &&
+	    clockStatus.leapInsert == proxy->clockStatus.leapInsert &&
+	    clockStatus.leapDelete == proxy->clockStatus.leapDelete &&
+	    clockStatus.override == proxy->clockStatus.override &&
+	    clockStatus.utcOffset == proxy->clockStatus.utcOffset) {
+		return;
+	}
+
+	if((message = portMessage(&controller->thread->toPort, PORTMSG_CLOCKCONTROL)) == NULL) {
+		/* the port keeps what it had: the stand-in has to agree with it */
+		proxy->clockControl.granted = clockControl.granted;
+		proxy->clockControl.available = clockControl.available;
+		return;
+	}
+
+	decision = &message->data.clockControl;
+	decision->seq = ++coordinator.clockSeq;
+	decision->granted = proxy->clockControl.granted;
+	decision->available = proxy->clockControl.available;
+	decision->leapInsert = proxy->clockStatus.leapInsert;
+	decision->leapDelete = proxy->clockStatus.leapDelete;
+	decision->override = proxy->clockStatus.override;
+	decision->utcOffset = proxy->clockStatus.utcOffset;
+	portMessagePost(&controller->thread->toPort);
+
+}
+
+/* Boundary clock: start handing the clock over to port @next */
+static void
+handOverClockControl(ClockPorts *ports, int next)
+{
+
+	PtpClock *previous = ports->controller;
+	ClockHandover handover;
+
+	coordinator.handover = next;
+
+	/* the port letting go will answer, and the latest choice gets the clock */
+	if(coordinator.releasing) {
+		return;
+	}
+
+	if(ports->port[next] == previous) {
+		coordinator.handover = -1;
+		return;
+	}
+
+	if(previous->thread != NULL) {
+		/* if this fails, we try again next time round */
+		coordinator.releasing = portMessageSimple(&previous->thread->toPort, PORTMSG_RELEASE);
+		return;
+	}
+
+	handover.granted = previous->clockControl.granted;
+	handover.observedDrift = previous->servo.observedDrift;
+	previous->clockControl.granted = FALSE;
+	previous->controllingClock = FALSE;
+
+	completeHandover(ports, &handover);
+
+}
+
+/* Boundary clock: pass the datasets of the slave port @source on to the other ports */
+static void
+shareClockDatasets(ClockPorts *ports, int source, const ClockDatasets *datasets)
+{
+
+	PortMessage *message;
+	int i;
+
+	for(i = 0; i < ports->count; i++) {
+		if(i == source) {
+			continue;
+		}
+		if(i == 0) {
+			setClockDatasets(ports->port[0], datasets);
+		} else if((message = portMessage(&ports->port[i]->thread->toPort, PORTMSG_DATASETS)) != NULL) {
+			message->data.datasets = *datasets;
+			portMessagePost(&ports->port[i]->thread->toPort);
+		}
+	}
+
+	if(source == 0) {
+		coordinator.datasets = *datasets;
+		coordinator.datasetsShared = TRUE;
+	}
+
+}
+
+/* Boundary clock: the state decision across all ports, from what the ports reported */
+static void
+portThreadsStateDecision(ClockPorts *ports)
+{
+
+	PtpClock *ptpClock = ports->port[0];
+	ForeignMasterRecord *erbest[PTPD_MAX_PORTS];
+	UInteger8 decisions[PTPD_MAX_PORTS];
+	UInteger8 state;
+	PortMessage *message;
+	int i;
+
+	DBG2("event STATE_DECISION_EVENT (boundary clock)\n");
+
+	coordinator.decide = FALSE;
+
+	ports->portState[0] = ptpClock->portDS.portState;
+	erbest[0] = bmcPortBest(ptpClock);
+	for(i = 1; i < ports->count; i++) {
+		erbest[i] = coordinator.heard[i] ? &coordinator.erbest[i] : NULL;
+	}
+
+	bmcBoundaryClockDecision(erbest, ports->portState, ports->count, ptpClock, decisions);
+
+	state = bmcApplyDecision(ptpClock, decisions[0]);
+	if(state != ptpClock->portDS.portState)
+		toState(state, ptpClock->rtOpts, ptpClock);
+
+	for(i = 1; i < ports->count; i++) {
+		if(decisions[i] == BC_DECISION_NONE) {
+			continue;
+		}
+		if((message = portMessage(&ports->port[i]->thread->toPort, PORTMSG_DECISION)) == NULL) {
+			coordinator.decide = TRUE;
+			continue;
+		}
+		message->data.decision = decisions[i];
+		portMessagePost(&ports->port[i]->thread->toPort);
+	}
+
+}
+
+/*
+ * Main thread: take in what the port threads reported, and make the
+ * decisions for the whole clock. Called once per pass of the main loop.
+ */
+void
+portThreadsPoll(ClockPorts *ports)
+{
+
+	PtpClock *ptpClock = ports->port[0];
+	PortThread *thread;
+	PortMessage *message;
+	ClockDatasets datasets;
+	int i, slave;
+
+	clearWakeup(coordinator.eventFd, &ports->readfds);
+
+	ports->portState[0] = ptpClock->portDS.portState;
+
+	for(i = 1; i < ports->count; i++) {
+		thread = ports->port[i]->thread;
+		while((message = portMessageNext(&thread->toMain)) != NULL) {
+			switch(message->type) {
+			case PORTMSG_STATE:
+				ports->portState[i] = message->data.state;
+				break;
+			case PORTMSG_ERBEST:
+				coordinator.heard[i] = message->data.erbest.heard;
+				coordinator.erbest[i] = message->data.erbest.record;
+				coordinator.decide = TRUE;
+				break;
+			case PORTMSG_DATASETS:
+				shareClockDatasets(ports, i, &message->data.datasets);
+				break;
+			case PORTMSG_RELEASED:
+				completeHandover(ports, &message->data.handover);
+				break;
+			case PORTMSG_CLOCK:
+				/* reports queued before a handover are of no use */
+				if(ports->controller == ports->port[i]) {
+					takeClockReport(&message->data.clock);
+				}
+				break;
+#ifdef PTPD_SNMP
+			case PORTMSG_ALARM:
+				alarmHandler_snmp(&message->data.alarm);
+				break;
+#endif /* PTPD_SNMP */
+			default:
+				break;
+			}
+			portMessageDone(&thread->toMain);
+		}
+	}
+
+	/* the clock follows the port synchronised to the best master */
+	slave = -1;
+	for(i = 0; i < ports->count; i++) {
+		if(ports->portState[i] == PTP_SLAVE ||
+		    ports->portState[i] == PTP_UNCALIBRATED) {
+			slave = i;
+		}
+	}
+
+	if(slave != coordinator.slave) {
+		coordinator.slave = slave;
+		handOverClockControl(ports, slave >= 0 ? slave : 0);
+		/* the other ports were decided on the old best master */
+		coordinator.decide = TRUE;
+		coordinator.datasetsShared = FALSE;
+	} else if(coordinator.handover >= 0 && !coordinator.releasing) {
+		handOverClockControl(ports, coordinator.handover);
+	}
+
+	if(slave == 0) {
+		getClockDatasets(ptpClock, &datasets);
+		if(!coordinator.datasetsShared ||
+		    memcmp(&datasets, &coordinator.datasets, sizeof(datasets))) {
+			shareClockDatasets(ports, 0, &datasets);
+		}
+	}
+
+	if(coordinator.decide) {
+		portThreadsStateDecision(ports);
+	}
+
+}
+
+/* Boundary clock: the port has a new best master decision to make */
+void
+portThreadsBmcUpdate(PtpClock *ptpClock)
+{
+
+	PortThread *thread = ptpClock->thread;
+	ForeignMasterRecord *erbest;
+	PortMessage *message;
+
+	ptpClock->record_update = FALSE;
+
+	/* port 1: the main thread decides right after this pass */
+	if(thread == NULL) {
+		coordinator.decide = TRUE;
+		return;
+	}
+
+	if((message = portMessage(&thread->toMain, PORTMSG_ERBEST)) == NULL) {
+		/* try again next time round */
+		ptpClock->record_update = TRUE;
+		return;
+	}
+
+	erbest = bmcPortBest(ptpClock);
+	message->data.erbest.heard = (erbest != NULL);
+	if(erbest != NULL) {
+		message->data.erbest.record = *erbest;
+	}
+	portMessagePost(&thread->toMain);
+
+}
+
+/*
+ * Port thread: act on the messages from the main thread. Returns FALSE
+ * once the port has to shut down.
+ */
+Boolean
+portThreadReceive(PtpClock *ptpClock)
+{
+
+	PortThread *thread = ptpClock->thread;
+	PortMessage *message;
+	UInteger8 state;
+
+	if(__atomic_load_n(&thread->stop, __ATOMIC_ACQUIRE)) {
+		return FALSE;
+	}
+
+	clearWakeup(thread->toPort.eventFd, ptpClock->readfds);
+
+	while((message = portMessageNext(&thread->toPort)) != NULL) {
+		switch(message->type) {
+		case PORTMSG_DECISION:
+			state = bmcApplyDecision(ptpClock, message->data.decision);
+			if(state != ptpClock->portDS.portState)
+				toState(state, ptpClock->rtOpts, ptpClock);
+			break;
+		case PORTMSG_DATASETS:
+			setClockDatasets(ptpClock, &message->data.datasets);
+			break;
+		case PORTMSG_RELEASE:
+			thread->released.granted = ptpClock->clockControl.granted;
+			thread->released.observedDrift = ptpClock->servo.observedDrift;
+			ptpClock->clockControl.granted = FALSE;
+			ptpClock->controllingClock = FALSE;
+			/* answered by portThreadSend() */
+			thread->releasing = TRUE;
+			break;
+		case PORTMSG_ACQUIRE:
+			ptpClock->clockControl.granted = message->data.handover.granted;
+			ptpClock->servo.observedDrift = message->data.handover.observedDrift;
+			ptpClock->controllingClock = TRUE;
+			thread->clockSeq = message->data.handover.seq;
+			break;
+		case PORTMSG_CLOCKCONTROL:
+			if(ptpClock->controllingClock) {
+				ptpClock->clockControl.granted = message->data.clockControl.granted;
+				ptpClock->clockControl.available = message->data.clockControl.available;
+				ptpClock->clockStatus.leapInsert = message->data.clockControl.leapInsert;
+				ptpClock->clockStatus.leapDelete = message->data.clockControl.leapDelete;
+				ptpClock->clockStatus.override = message->data.clockControl.override;
+				ptpClock->clockStatus.utcOffset = message->data.clockControl.utcOffset;
+				thread->clockSeq = message->data.clockControl.seq;
+			}
+			break;
+		case PORTMSG_CONFIG:
+			setBoundaryClockPortConfig(message->data.config, ptpClock->rtOpts, thread->index);
+			free(message->data.config);
+			break;
+		case PORTMSG_STEP:
+			do_signal_sigusr1(ptpClock);
+			break;
+		default:
+			break;
+		}
+		portMessageDone(&thread->toPort);
+	}
+
+	return TRUE;
+
+}
+
+/* Port thread: report what changed in this pass to the main thread */
+void
+portThreadSend(PtpClock *ptpClock)
+{
+
+	PortThread *thread = ptpClock->thread;
+	UInteger8 state = ptpClock->portDS.portState;
+	PortMessage *message;
+	ClockDatasets datasets;
+
+	if(thread->releasing &&
+	    (message = portMessage(&thread->toMain, PORTMSG_RELEASED)) != NULL) {
+		message->data.handover = thread->released;
+		portMessagePost(&thread->toMain);
+		thread->releasing = FALSE;
+	}
+
+	if(state != thread->lastState &&
+	    (message = portMessage(&thread->toMain, PORTMSG_STATE)) != NULL) {
+		message->data.state = state;
+		portMessagePost(&thread->toMain);
+		thread->lastState = state;
+		/* a port becoming slave again has to share its datasets again */
+		thread->datasetsSent = FALSE;
+	}
+
+	if(state != PTP_SLAVE && state != PTP_UNCALIBRATED) {
+		return;
+	}
+
+	getClockDatasets(ptpClock, &datasets);
+	if((!thread->datasetsSent || memcmp(&datasets, &thread->datasets, sizeof(datasets))) &&
+	    (message = portMessage(&thread->toMain, PORTMSG_DATASETS)) != NULL) {
+		message->data.datasets = datasets;
+		portMessagePost(&thread->toMain);
+		thread->datasets = datasets;
+		thread->datasetsSent = TRUE;
+	}
+
+}
+
+/*
+ * Port thread steering the clock: report the clock control state to the
+ * main thread, which runs the timing domain. Once per timing domain update.
+ */
+void
+portThreadReportClock(PtpClock *ptpClock)
+{
+
+	PortThread *thread = ptpClock->thread;
+	PortMessage *message;
+	ClockReport *report;
+
+	/* if this fails, the events are reported next time */
+	if((message = portMessage(&thread->toMain, PORTMSG_CLOCK)) == NULL) {
+		return;
+	}
+
+	report = &message->data.clock;
+	report->seq = thread->clockSeq;
+	report->portState = ptpClock->portDS.portState;
+	report->available = ptpClock->clockControl.available;
+	report->activity = ptpClock->clockControl.activity;
+	report->ptpTimescale = ptpClock->timePropertiesDS.ptpTimescale;
+	report->leapSecondInProgress = ptpClock->leapSecondInProgress;
+	report->clockStatus = ptpClock->clockStatus;
+	report->offsetFromMaster = ptpClock->currentDS.offsetFromMaster;
+	report->sentPackets = ptpClock->netPath.sentPackets;
+	report->receivedPackets = ptpClock->netPath.receivedPackets;
+	portMessagePost(&thread->toMain);
+
+	/* events: handed over to the timing service now */
+	ptpClock->clockControl.activity = FALSE;
+	ptpClock->clockStatus.update = FALSE;
+	ptpClock->clockStatus.majorChange = FALSE;
+	ptpClock->netPath.sentPackets = 0;
+	ptpClock->netPath.receivedPackets = 0;
+
+}
+
+#ifdef PTPD_SNMP
+/* Port threads leave SNMP traps to the main thread, which runs the agent */
+void
+alarmHandler_portThread(AlarmEntry *alarm)
+{
+
+	PtpClock *ptpClock = (PtpClock*)alarm->userData;
+	PortMessage *message;
+
+	if((message = portMessage(&ptpClock->thread->toMain, PORTMSG_ALARM)) != NULL) {
+		message->data.alarm = *alarm;
+		portMessagePost(&ptpClock->thread->toMain);
+	}
+
+}
+#endif /* PTPD_SNMP */
+
+#endif /* PTPD_PORT_THREADS */
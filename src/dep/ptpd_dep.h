@@ -177,6 +177,22 @@ static inline Integer32 flip32(x)
 #endif
 */
 
+/* big-endian loads from a packet buffer, at any alignment */
+static inline UInteger16
+getBE16(const Octet *buf)
+{
+	const UInteger8 *b = (const UInteger8 *)buf;
+	return (UInteger16)((b[0] << 8) | b[1]);
+}
+
+static inline UInteger32
+getBE32(const Octet *buf)
+{
+	const UInteger8 *b = (const UInteger8 *)buf;
+	return ((UInteger32)b[0] << 24) | ((UInteger32)b[1] << 16) |
+		((UInteger32)b[2] << 8) | (UInteger32)b[3];
+}
+
 /** \}*/
 
 
@@ -227,10 +243,14 @@ void msgUnpackPdelayRespFollowUp(Octet * buf,MsgPdelayRespFollowUp*);
 Boolean msgUnpackManagement(Octet * buf,MsgManagement*, MsgHeader*, PtpClock *ptpClock, const int tlvOffset);
 Boolean msgUnpackSignaling(Octet * buf,MsgSignaling*, MsgHeader*, PtpClock *ptpClock, const int tlvOffset);
 void msgPackHeader(Octet * buf,PtpClock*);
+void msgPackTemplates(PtpClock*);
 #ifndef PTPD_SLAVE_ONLY
+void msgPackAnnounceTemplate(PtpClock*);
 void msgPackAnnounce(Octet * buf, UInteger16, Timestamp*, PtpClock*);
+void msgPackSyncTemplate(PtpClock*);
 void msgPackSync(Octet * buf, UInteger16, Timestamp*, PtpClock*);
 #endif /* PTPD_SLAVE_ONLY */
+void msgPackDelayRespTemplate(PtpClock*);
 void msgPackFollowUp(Octet * buf,Timestamp*,PtpClock*, const UInteger16);
 void msgPackDelayReq(Octet * buf,Timestamp *,PtpClock *);
 void msgPackDelayResp(Octet * buf,MsgHeader *,Timestamp *,PtpClock *);
@@ -369,7 +389,7 @@ UInteger16 msgPackManagementResponse(Octet * buf,MsgHeader*,MsgManagement*,PtpCl
 Boolean testInterface(char* ifaceName, const RunTimeOpts* rtOpts);
 Boolean netInit(NetPath*,RunTimeOpts*,PtpClock*);
 Boolean netShutdown(NetPath*);
-int netSelect(TimeInternal*,NetPath*,fd_set*);
+int netSelect(TimeInternal*,NetPath**,int,fd_set*);
 ssize_t netRecvEvent(Octet*,TimeInternal*,NetPath*,int);
 ssize_t netRecvGeneral(Octet*,NetPath*);
 ssize_t netSendEvent(Octet*,UInteger16,NetPath*,const RunTimeOpts*,Integer32,TimeInternal*);
@@ -378,9 +398,110 @@ ssize_t netSendPeerGeneral(Octet*,UInteger16,NetPath*,const RunTimeOpts*, Intege
 ssize_t netSendPeerEvent(Octet*,UInteger16,NetPath*,const RunTimeOpts*,Integer32,TimeInternal*);
 Boolean netRefreshIGMP(NetPath *, const RunTimeOpts *, PtpClock *);
 Boolean hostLookup(const char* hostname, Integer32* addr);
+#ifdef PTPD_SYNC_BATCHING
+int netSendEventBatch(Octet*,UInteger16,int,const Integer32*,NetPath*,UInteger32*);
+#endif /* PTPD_SYNC_BATCHING */
+#ifdef PTPD_RECV_BATCHING
+int netRecvBatch(NetPath*,Boolean,int);
+Boolean netNextBatchPacket(NetPath*,Boolean,Octet**,ssize_t*,TimeInternal*);
+#endif /* PTPD_RECV_BATCHING */
+#ifdef PTPD_TXTIMESTAMP_KEYED
+ssize_t netRecvTxTimestamp(NetPath*,TimeInternal*,UInteger32*);
+UInteger32 netLastTxTimestampKey(NetPath*);
+#endif /* PTPD_TXTIMESTAMP_KEYED */
 
 /** \}*/
 
+#ifdef PTPD_EPOLL
+/** \name eventtimer_epoll.c (Linux event loop driver)
+ * -timers and registered descriptors share one epoll set */
+ /**\{*/
+
+Boolean eventLoopAddFd(int fd);
+void eventLoopRemoveFd(int fd);
+int eventLoopFd(void);
+int eventLoopWait(TimeInternal *timeout, fd_set *readfds);
+
+/** \}*/
+#endif /* PTPD_EPOLL */
+
+/** \name statsfile.c (binary statistics file)
+ * -write statistics records through a mapped file, convert them to CSV */
+ /**\{*/
+
+Boolean statsFileOpen(LogFileHandler *handler);
+void statsFileClose(LogFileHandler *handler);
+Boolean statsFileWrite(LogFileHandler *handler, const StatisticsRecord *record);
+int statsFileConvert(const char *path, FILE *out);
+
+/** \}*/
+
+#ifdef PTPD_ASYNC_LOG
+/** \name asynclog.c (asynchronous log writer)
+ * -queue log output for a writer thread */
+ /**\{*/
+
+typedef struct AsyncLogQueue AsyncLogQueue;
+
+Boolean asyncLogStart(const RunTimeOpts*);
+void asyncLogStop(void);
+Boolean asyncLogActive(void);
+AsyncLogQueue* asyncLogAddQueue(const RunTimeOpts*);
+void asyncLogAttach(AsyncLogQueue *queue);
+void asyncLogRemoveQueue(AsyncLogQueue *queue);
+char* asyncLogReserve(int target, int priority, int *size);
+void asyncLogCommit(int length, const struct timeval *when, const char *state, const char *iface);
+Boolean asyncLogRotated(int target);
+uint32_t asyncLogDropped(void);
+
+/** \}*/
+#endif /* PTPD_ASYNC_LOG */
+
+#ifdef PTPD_PORT_THREADS
+/** \name portthreads.c (boundary clock port threads)
+ * -run ports 2 and up on threads of their own */
+ /**\{*/
+
+Boolean setupPortThreads(ClockPorts *ports);
+Boolean startPortThreads(ClockPorts *ports);
+void stopPortThreads(ClockPorts *ports);
+void freePortThreads(ClockPorts *ports);
+void portThreadsPoll(ClockPorts *ports);
+void portThreadsBmcUpdate(PtpClock *ptpClock);
+void portThreadsReload(const RunTimeOpts *rtOpts, ClockPorts *ports);
+void portThreadStep(PtpClock *ptpClock);
+Boolean portThreadReceive(PtpClock *ptpClock);
+void portThreadSend(PtpClock *ptpClock);
+void portThreadsTimingDomainUpdate(ClockPorts *ports);
+void portThreadReportClock(PtpClock *ptpClock);
+#ifdef PTPD_SNMP
+void alarmHandler_portThread(AlarmEntry *alarm);
+#endif /* PTPD_SNMP */
+
+/** \}*/
+#endif /* PTPD_PORT_THREADS */
+
+#ifdef PTPD_PHC
+/** \name phc.c (Linux PTP hardware clock driver)
+ * -steer a /dev/ptpN clock instead of the system clock */
+ /**\{*/
+
+Boolean phcInit(const RunTimeOpts*, const NetPath*);
+void phcShutdown(void);
+Boolean phcActive(void);
+clockid_t phcClockId(void);
+const char* phcName(void);
+Boolean phcAdjFreq(double);
+double phcGetAdjFreq(void);
+/* the device itself - ptpd2-sim supplies a simulated one (sim/simclock.c) */
+int phcDeviceOpen(const char*);
+int phcDeviceCaps(int, Integer32*);
+void phcDeviceClose(int);
+int phcDeviceAdjtime(clockid_t, struct timex*);
+
+/** \}*/
+#endif /* PTPD_PHC */
+
 #if defined PTPD_SNMP
 /** \name snmp.c (SNMP subsystem)
  * -Handle SNMP subsystem*/
@@ -424,6 +545,10 @@ void ptpdShutdown(PtpClock * ptpClock);
 void checkSignals(RunTimeOpts * rtOpts, PtpClock * ptpClock);
 void restartSubsystems(RunTimeOpts *rtOpts, PtpClock *ptpClock);
 void applyConfig(dictionary *baseConfig, RunTimeOpts *rtOpts, PtpClock *ptpClock);
+void setBoundaryClockConfig(const RunTimeOpts *rtOpts, ClockPorts *ports);
+void setBoundaryClockPortConfig(const RunTimeOpts *rtOpts, RunTimeOpts *portOpts, int index);
+void shutdownBoundaryClockPort(PtpClock *port);
+void do_signal_sigusr1(PtpClock *ptpClock);
 
 void enable_runtime_debug(void );
 void disable_runtime_debug(void );
@@ -446,12 +571,17 @@ void DBG_time(const char *name, const TimeInternal  p);
 
 
 void logMessage(int priority, const char *format, ...);
+#ifdef PTPD_ASYNC_LOG
+Boolean writeLogRecord(int target, int priority, const struct timeval *when, const char *state, const char *iface, const char *text, int length);
+#endif /* PTPD_ASYNC_LOG */
 void updateLogSize(LogFileHandler* handler);
 Boolean maintainLogSize(LogFileHandler* handler);
 int restartLog(LogFileHandler* handler, Boolean quiet);
 void restartLogging(RunTimeOpts* rtOpts);
 void stopLogging(RunTimeOpts* rtOpts);
 void logStatistics(PtpClock *ptpClock);
+int snprint_StatisticsHeader(char *s, int max_len, int timestampFormat, UInteger32 flags);
+int snprint_StatisticsRecord(char *s, int max_len, const StatisticsRecord *record, UInteger32 flags);
 void periodicUpdate(const RunTimeOpts *rtOpts, PtpClock *ptpClock);
 void displayStatus(PtpClock *ptpClock, const char *prefixMessage);
 void displayPortIdentity(PortIdentity *port, const char *prefixMessage);
@@ -501,9 +631,23 @@ int parseLeapFile(char * path, LeapSecondInfo *info);
 void
 resetWarnings(const RunTimeOpts * rtOpts, PtpClock * ptpClock);
 
-void setupPIservo(PIservo* servo, const RunTimeOpts* rtOpts);
-void resetPIservo(PIservo* servo);
-double runPIservo(PIservo* servo, const Integer32 input);
+void setupServo(ClockServo* servo, const RunTimeOpts* rtOpts);
+void resetServo(ClockServo* servo);
+double runServo(ClockServo* servo, const Integer32 offset, const Integer32 rawOffset, const Integer32 delay);
+const char* servoName(const ClockServo* servo);
+void startAcquisition(ClockServo* servo, const int period);
+void acquisitionSample(ClockServo* servo, const Integer32 rawOffset, const Integer32 delay);
+Boolean endAcquisition(ClockServo* servo, const Integer32 delay);
+double endPhaseSlew(ClockServo* servo);
+
+/* holdover.c */
+void holdoverReset(HoldoverModel *model, const RunTimeOpts *rtOpts);
+void holdoverBreak(HoldoverModel *model);
+void holdoverSample(HoldoverModel *model, const RunTimeOpts *rtOpts, const double offset, const double output);
+Boolean startHoldover(const RunTimeOpts *rtOpts, PtpClock *ptpClock);
+void updateHoldover(const RunTimeOpts *rtOpts, PtpClock *ptpClock);
+void stopHoldover(const RunTimeOpts *rtOpts, PtpClock *ptpClock, Boolean resume);
+const char* holdoverStateName(int state);
 
 #ifdef PTPD_STATISTICS
 void updatePtpEngineStats (PtpClock* ptpClock, const RunTimeOpts* rtOpts);
@@ -512,5 +656,10 @@ void updatePtpEngineStats (PtpClock* ptpClock, const RunTimeOpts* rtOpts);
 void writeStatusFile(PtpClock *ptpClock, const RunTimeOpts *rtOpts, Boolean quiet);
 void updateXtmp (TimeInternal oldTime, TimeInternal newTime);
 
+#ifdef PTPD_SIM
+/* sim/sim.c: ptpd2-sim scenario settings, skipped by the configuration parser */
+Boolean simConfigKey(const char *key);
+#endif /* PTPD_SIM */
+
 
 #endif /*PTPD_DEP_H_*/
@@ -64,6 +64,9 @@
 
 #ifdef PTPD_STATISTICS
 static void checkServoStable(PtpClock *ptpClock, const RunTimeOpts *rtOpts);
+static void setServoGain(ClockServo *servo, double gain);
+static void trackServoGain(ClockServo *servo, const Integer32 offset, const Integer32 rawOffset);
+static void updateServoGain(PtpClock *ptpClock);
 #endif
 
 void
@@ -91,6 +94,8 @@ initClock(const RunTimeOpts * rtOpts, PtpClock * ptpClock)
 #endif
 	/* clear vars */
 
+	resetServo(&ptpClock->servo);
+
 	/* clean more original filter variables */
 	clearTime(&ptpClock->currentDS.offsetFromMaster);
 	clearTime(&ptpClock->currentDS.meanPathDelay);
@@ -466,6 +471,9 @@ updateOffset(TimeInternal * send_time, TimeInternal * recv_time,
 	/* multiply interval if interval filter used on delayMS */
 	if(rtOpts->filterMSOpts.enabled && rtOpts->filterMSOpts.windowType != WINDOW_SLIDING) {
 	    ptpClock->servo.dT *= rtOpts->filterMSOpts.windowSize;
+	/* a sliding lucky packet filter passes this share of the samples */
+	} else if(rtOpts->filterMSOpts.enabled && rtOpts->filterMSOpts.filterType == FILTER_LUCKY) {
+	    ptpClock->servo.dT *= 100.0 / rtOpts->filterMSOpts.percentile;
 	}
 #endif
         /* updates paused, leap second pending - do nothing */
@@ -957,6 +965,11 @@ void
 updateClock(const RunTimeOpts * rtOpts, PtpClock * ptpClock)
 {
 
+	double adj;
+	/* the same before the two-sample mean in updateOffset() */
+	Integer32 rawOffset = ptpClock->currentDS.offsetFromMaster.nanoseconds +
+			    ptpClock->ofm_filt.nsec_prev - ptpClock->ofm_filt.y;
+
 	if(rtOpts->noAdjust) {
 		ptpClock->clockControl.available = FALSE;
 		DBGV("updateClock: noAdjust - skipped clock update\n");
@@ -971,6 +984,8 @@ updateClock(const RunTimeOpts * rtOpts, PtpClock * ptpClock)
 	DBGV("==> updateClock\n");
 
 	if(ptpClock->clockControl.stepRequired) {
+		/* the offset no longer follows the frequency */
+		holdoverBreak(&ptpClock->holdover);
 		if (!rtOpts->noResetClock) {
 			stepClock(rtOpts, ptpClock);
 			ptpClock->clockControl.stepRequired = FALSE;
@@ -991,10 +1006,29 @@ updateClock(const RunTimeOpts * rtOpts, PtpClock * ptpClock)
 
 	/* only run the servo if we are calibrted - if calibration delay configured */
 
+	if(ptpClock->acquiring) {
+		acquisitionSample(&ptpClock->servo, rawOffset, ptpClock->currentDS.meanPathDelay.nanoseconds);
+	}
+
 	if((!rtOpts->calibrationDelay) || ptpClock->isCalibrated) {
 
-		/* Adjust the clock first -> the PI controller runs here */
-		adjFreq_wrapper(rtOpts, ptpClock, runPIservo(&ptpClock->servo, ptpClock->currentDS.offsetFromMaster.nanoseconds));
+#ifdef PTPD_STATISTICS
+		trackServoGain(&ptpClock->servo, ptpClock->currentDS.offsetFromMaster.nanoseconds, rawOffset);
+#endif /* PTPD_STATISTICS */
+		/* Adjust the clock first -> the servo runs here */
+		adj = runServo(&ptpClock->servo, ptpClock->currentDS.offsetFromMaster.nanoseconds,
+			rawOffset, ptpClock->currentDS.meanPathDelay.nanoseconds);
+		latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_SERVO);
+		adjFreq_wrapper(rtOpts, ptpClock, adj);
+		latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_ADJFREQ);
+		/* what the acquisition fit takes as applied until the next sample */
+		ptpClock->servo.acquisition.lastOutput = -adj;
+		CLAMP(ptpClock->servo.acquisition.lastOutput, ptpClock->servo.maxOutput);
+		holdoverSample(&ptpClock->holdover, rtOpts,
+		    ptpClock->currentDS.offsetFromMaster.seconds * 1E9 + ptpClock->currentDS.offsetFromMaster.nanoseconds,
+		    ptpClock->servo.acquisition.lastOutput);
+	} else {
+		holdoverBreak(&ptpClock->holdover);
 	}
 		warn_operator_fast_slewing(rtOpts, ptpClock, ptpClock->servo.observedDrift);
 		/* let the clock source know it's being synced */
@@ -1034,40 +1068,186 @@ updateClock(const RunTimeOpts * rtOpts, PtpClock * ptpClock)
 
 }
 
+/*
+ * Servo types. Each one gets the offset from master, with and without the
+ * two-sample mean, the mean path delay and the time since its last update,
+ * keeps observedDrift as its estimate of the frequency offset (saved,
+ * restored and handed over between ports by the rest of the engine), and
+ * returns the frequency adjustment.
+ */
+typedef struct {
+	const char *name;
+	/* a model of the clock, which needs the real update interval */
+	Boolean model;
+	void (*reset)(ClockServo *servo);
+	double (*run)(ClockServo *servo, const Integer32 offset, const Integer32 rawOffset,
+			const Integer32 delay, const double dt);
+} ServoType;
+
+static void resetPIservo(ClockServo *servo);
+static double runPIservo(ClockServo *servo, const Integer32 offset, const Integer32 rawOffset,
+			const Integer32 delay, const double dt);
+static void resetKalmanServo(ClockServo *servo);
+static double runKalmanServo(ClockServo *servo, const Integer32 offset, const Integer32 rawOffset,
+			const Integer32 delay, const double dt);
+static void resetLinRegServo(ClockServo *servo);
+static double runLinRegServo(ClockServo *servo, const Integer32 offset, const Integer32 rawOffset,
+			const Integer32 delay, const double dt);
+static double runPhaseSlew(ClockServo *servo, const Integer32 offset, const Integer32 rawOffset,
+			const Integer32 delay, const double dt);
+
+static const ServoType servoTypes[] = {
+	[SERVO_PI] = { "PI", FALSE, resetPIservo, runPIservo },
+	[SERVO_KALMAN] = { "Kalman", TRUE, resetKalmanServo, runKalmanServo },
+	[SERVO_LINREG] = { "linreg", TRUE, resetLinRegServo, runLinRegServo }
+};
+
+#define SERVO_TYPES (sizeof(servoTypes) / sizeof(servoTypes[0]))
+
+/* Kalman servo: phase error removed over this many update intervals */
+#define KALMAN_PHASE_INTERVALS	4.0
+/* samples averaged into the measurement and path delay noise estimates */
+#define KALMAN_NOISE_WINDOW	32
+/* innovations beyond this many std devs are de-weighted ... */
+#define KALMAN_GATE		3.0
+/* ... unless this many in a row, when the filter starts over */
+#define KALMAN_GATE_MAX		8
+/* measurement noise before there is an estimate, ns^2 */
+#define KALMAN_INITIAL_NOISE	1E6
+
+/* linear regression servo: samples needed before there is an estimate */
+#define LINREG_MIN_SAMPLES	4
+/* the PI drift kept within this many standard errors of the estimate ... */
+#define LINREG_BOUND		3.0
+/* ... but never closer than this, ppb */
+#define LINREG_MIN_BOUND	1.0
+/* most of the offset taken out in one update interval */
+#define LINREG_PHASE_GAIN	0.25
+
+/* fast acquisition: the servo's drift is replaced if this many std errors off the burst estimate */
+#define ACQUISITION_BOUND	3.0
+/* the fitted phase is slewed out over this many seconds ... */
+#define ACQUISITION_SLEW_TIME	4.0
+/* ... unless it is this far off, ns: then the clock is stepped, as for any offset over 1 second */
+#define ACQUISITION_STEP	1E9
+
+/* PI gain scheduling: bandwidth steps per statistics period, up and down */
+#define GAIN_RAISE		2.0
+#define GAIN_LOWER		1.4142136
+/* change in the raw offset mean between periods, squared, over what noise alone would give:
+ * above this the servo is not keeping up with the clock ... */
+#define GAIN_WANDER_HIGH	4.0
+/* ... below this it is following the noise */
+#define GAIN_WANDER_LOW		1.0
+/* raw offsets needed in a period for a gain change */
+#define GAIN_MIN_SAMPLES	8
+/* outliers per offset update above which the bandwidth only goes down */
+#define GAIN_OUTLIER_SHARE	0.2
+/* offsets beyond this many noise std devs ... */
+#define GAIN_STEP_SIGMA		8.0
+/* ... this many times in a row are a step: back to the acquisition bandwidth */
+#define GAIN_STEP_SAMPLES	4
+/* most the gain changes by in one update */
+#define GAIN_SLEW		1.1
+/* most of the offset a raised bandwidth takes out in one update interval */
+#define GAIN_MAX_PHASE		0.5
+
+const char*
+servoName(const ClockServo* servo)
+{
+	if(servo->type >= SERVO_TYPES) {
+		return "unknown";
+	}
+
+	return servoTypes[servo->type].name;
+}
+
 void
-setupPIservo(PIservo* servo, const const RunTimeOpts* rtOpts)
+setupServo(ClockServo* servo, const RunTimeOpts* rtOpts)
 {
+    if(servo->type != rtOpts->servoType) {
+	servo->type = rtOpts->servoType;
+	if(servo->type >= SERVO_TYPES) {
+		servo->type = SERVO_PI;
+	}
+	/* both start from the current observed drift, so switching is bumpless */
+	servoTypes[servo->type].reset(servo);
+	INFO("Clock servo: %s\n", servoName(servo));
+    }
     servo->maxOutput = rtOpts->servoMaxPpb;
     servo->kP = rtOpts->servoKP;
     servo->kI = rtOpts->servoKI;
     servo->dTmethod = rtOpts->servoDtMethod;
+    servo->kalman.phaseNoise = rtOpts->servoKalmanPhaseNoise * rtOpts->servoKalmanPhaseNoise;
+    servo->kalman.freqNoise = rtOpts->servoKalmanFreqNoise * rtOpts->servoKalmanFreqNoise;
+    if(servo->linreg.window != rtOpts->servoLinRegWindow) {
+	servo->linreg.window = rtOpts->servoLinRegWindow;
+	resetLinRegServo(servo);
+    }
 #ifdef PTPD_STATISTICS
     servo->stabilityThreshold = rtOpts->servoStabilityThreshold;
     servo->stabilityPeriod = rtOpts->servoStabilityPeriod;
     servo->stabilityTimeout = (60 / rtOpts->statsUpdateInterval) * rtOpts->servoStabilityTimeout;
+    servo->gainMin = rtOpts->servoGainMin;
+    servo->gainMax = rtOpts->servoGainMax;
+    if(!rtOpts->servoAdaptiveGain || servo->type != SERVO_PI) {
+	servo->adaptive = FALSE;
+	servo->gain = 1.0;
+    /* just enabled: start out acquiring */
+    } else if(!servo->adaptive) {
+	servo->adaptive = TRUE;
+	setServoGain(servo, servo->gainMax);
+    } else {
+	setServoGain(servo, max(servo->gainMin, min(servo->gainMax, servo->gainTarget)));
+    }
+#else
+    servo->gain = 1.0;
 #endif
 }
 
 void
-resetPIservo(PIservo* servo)
+resetServo(ClockServo* servo)
 {
-/* not needed: restoreDrift handles this */
-/*   servo->observedDrift = 0; */
     servo->input = 0;
     servo->output = 0;
     servo->lastUpdate.seconds = 0;
     servo->lastUpdate.nanoseconds = 0;
+    servo->phaseSlew = 0.0;
+
+#ifdef PTPD_STATISTICS
+    if(servo->adaptive) {
+	servo->gain = servo->gainMax;
+	servo->gainTarget = servo->gainMax;
+	servo->excursions = 0;
+	servo->rawSum = 0.0;
+	servo->rawPower = 0.0;
+	servo->rawSamples = 0;
+	servo->lastRawMeanValid = FALSE;
+    }
+#endif /* PTPD_STATISTICS */
+
+    if(servo->type < SERVO_TYPES) {
+	servoTypes[servo->type].reset(servo);
+    }
 }
 
 double
-runPIservo(PIservo* servo, const Integer32 input)
+runServo(ClockServo* servo, const Integer32 offset, const Integer32 rawOffset, const Integer32 delay)
 {
 
         double dt;
+        int dTmethod;
 
         TimeInternal now, delta;
 
-        switch (servo->dTmethod) {
+	if(servo->type >= SERVO_TYPES) {
+		servo->type = SERVO_PI;
+	}
+
+	/* a model of the clock needs the real update interval */
+	dTmethod = servoTypes[servo->type].model ? DT_MEASURED : servo->dTmethod;
+
+        switch (dTmethod) {
 
         case DT_MEASURED:
 
@@ -1081,7 +1261,7 @@ runPIservo(PIservo* servo, const Integer32 input)
                 }
 
                 /* Don't use dT longer then max update interval multiplier */
-                if(dt > (servo->maxdT * servo->dT))
+                if(!servoTypes[servo->type].model && dt > (servo->maxdT * servo->dT))
                         dt = (servo->maxdT + 0.0) * servo->dT;
 
                 break;
@@ -1101,46 +1281,499 @@ runPIservo(PIservo* servo, const Integer32 input)
         if(dt <= 0.0)
             dt = 1.0;
 
-	servo->input = input;
+	servo->input = offset;
+
+	if(servo->phaseSlew != 0.0) {
+		servo->output = runPhaseSlew(servo, offset, rawOffset, delay, dt);
+	} else {
+		servo->output = servoTypes[servo->type].run(servo, offset, rawOffset, delay, dt);
+	}
+
+	if(dTmethod == DT_MEASURED)
+		servo->lastUpdate = now;
+
+	DBGV("%s servo dt: %.09f, input (ofm): %d, output(adj): %.09f, observed drift: %.09f\n",
+		servoName(servo), dt, offset, servo->output, servo->observedDrift);
+
+	return -servo->output;
+
+}
+
+/* the servo output or its drift estimate is at the limit: the servo is not in control */
+static void
+servoAtLimit(ClockServo* servo, const Boolean atLimit)
+{
+	servo->runningMaxOutput = atLimit;
+#ifdef PTPD_STATISTICS
+	if(atLimit) {
+		servo->stableCount = 0;
+		servo->updateCount = 0;
+		servo->isStable = FALSE;
+	}
+#endif /* PTPD_STATISTICS */
+}
+
+static void
+resetPIservo(ClockServo* servo)
+{
+/* not needed: restoreDrift handles this */
+/*   servo->observedDrift = 0; */
+}
+
+static double
+runPIservo(ClockServo* servo, const Integer32 input, const Integer32 rawOffset,
+		const Integer32 delay, const double dt)
+{
+
+	double gain = servo->gain;
 
 	if (servo->kP < 0.000001)
 		servo->kP = 0.000001;
 	if (servo->kI < 0.000001)
 		servo->kI = 0.000001;
 
+	/* scaled down with kI to keep the damping if the interval is too long for it */
+	if (gain > 1.0 && servo->kP * gain * dt > GAIN_MAX_PHASE)
+		gain = max(1.0, GAIN_MAX_PHASE / (servo->kP * dt));
+
 	servo->observedDrift +=
-		dt * ((input + 0.0 ) * servo->kI);
+		dt * ((input + 0.0 ) * servo->kI * gain * gain);
 
 	if(servo->observedDrift >= servo->maxOutput) {
 		servo->observedDrift = servo->maxOutput;
-		servo->runningMaxOutput = TRUE;
-#ifdef PTPD_STATISTICS
-		servo->stableCount = 0;
-		servo->updateCount = 0;
-		servo->isStable = FALSE;
-#endif /* PTPD_STATISTICS */
+		servoAtLimit(servo, TRUE);
 	}
 	else if(servo->observedDrift <= -servo->maxOutput) {
 		servo->observedDrift = -servo->maxOutput;
-		servo->runningMaxOutput = TRUE;
-#ifdef PTPD_STATISTICS
-		servo->stableCount = 0;
-		servo->updateCount = 0;
-		servo->isStable = FALSE;
-#endif /* PTPD_STATISTICS */
+		servoAtLimit(servo, TRUE);
 	} else {
-		servo->runningMaxOutput = FALSE;
+		servoAtLimit(servo, FALSE);
 	}
 
-	servo->output = (servo->kP * (input + 0.0) ) + servo->observedDrift;
+	return (servo->kP * gain * (input + 0.0) ) + servo->observedDrift;
 
-	if(servo->dTmethod == DT_MEASURED)
-		servo->lastUpdate = now;
+}
+
+static void
+kalmanStart(ClockServo* servo, const double offset, const Integer32 delay)
+{
+	KalmanServo *k = &servo->kalman;
+
+	k->phase = offset;
+	k->freq = servo->observedDrift;
+	k->lastOutput = k->prevOutput = servo->observedDrift;
+	k->lastOffset[0] = k->lastOffset[1] = offset;
+	if(k->r <= 0) {
+		k->r = KALMAN_INITIAL_NOISE;
+	}
+	k->p[0][0] = max(k->r, offset * offset);
+	k->p[0][1] = k->p[1][0] = 0;
+	/* the saved drift may well be wrong - let the first few samples decide */
+	k->p[1][1] = (servo->maxOutput + 0.0) * servo->maxOutput;
+	k->mpdMean = delay;
+	k->mpdVar = 0;
+	k->lastDelay = delay;
+	k->updates = 0;
+	k->gated = 0;
+	k->initialised = TRUE;
+}
+
+static void
+resetKalmanServo(ClockServo* servo)
+{
+	servo->kalman.initialised = FALSE;
+	servo->kalman.r = 0;
+}
+
+/*
+ * Kalman filter on the state [phase offset (ns), frequency offset (ppb)]
+ * of the free-running clock, with the frequency correction applied since
+ * the last update as the control input. The process noise is white
+ * frequency noise plus a frequency random walk. The filter takes the raw
+ * offset, not the two-sample mean, and works out the measurement noise
+ * from the second differences of the offset with the corrections taken
+ * out: those do not depend on how good its own estimates are. A change in
+ * the mean path delay moves the offset the other way without the clock
+ * moving, so the estimates move with it, and the noise is never taken to
+ * be below the variance of the path delay. The output is the estimated
+ * frequency offset plus what removes the estimated phase offset in a few
+ * update intervals.
+ */
+static double
+runKalmanServo(ClockServo* servo, const Integer32 offset, const Integer32 rawOffset,
+		const Integer32 delay, const double dt)
+{
 
-	DBGV("Servo dt: %.09f, input (ofm): %d, output(adj): %.09f, accumulator (observed drift): %.09f\n", dt, input, servo->output, servo->observedDrift);
+	KalmanServo *k = &servo->kalman;
+	double (*p)[2] = k->p;
+	double z = rawOffset;
+	double innovation, d2, s, r, g, k0, k1, a, output;
+
+	/* someone else set the drift: a saved one, a handover or a leap second smear */
+	if(k->initialised && servo->observedDrift != k->lastDrift) {
+		k->freq += servo->observedDrift - k->lastDrift;
+		k->lastOutput += servo->observedDrift - k->lastDrift;
+	}
+
+	if(!k->initialised) {
+		kalmanStart(servo, z, delay);
+		goto output;
+	}
+
+	k->updates++;
+	a = 1.0 / min(k->updates, KALMAN_NOISE_WINDOW);
+
+	/* the path delay moved: so does the offset, but not the clock */
+	if(delay != k->lastDelay) {
+		double d = delay - k->mpdMean;
+		k->mpdMean += a * d;
+		k->mpdVar += a * ((1.0 - a) * d * d - k->mpdVar);
+		k->phase -= delay - k->lastDelay;
+		k->lastOffset[0] -= delay - k->lastDelay;
+		k->lastOffset[1] -= delay - k->lastDelay;
+		k->lastDelay = delay;
+	}
+
+	/* measurement noise: phase and frequency cancel out of the second difference */
+	if(k->updates >= 2) {
+		d2 = z - 2.0 * k->lastOffset[0] + k->lastOffset[1] +
+			(k->lastOutput - k->prevOutput) * dt;
+		d2 = min(d2 * d2, KALMAN_GATE * KALMAN_GATE * 6.0 * k->r);
+		k->r += a * (max(d2 / 6.0, 1.0) - k->r);
+	}
+	k->lastOffset[1] = k->lastOffset[0];
+	k->lastOffset[0] = z;
+
+	/* predict */
+	k->phase += (k->freq - k->lastOutput) * dt;
+	p[0][0] += dt * (2.0 * p[0][1] + dt * p[1][1]) +
+		    k->phaseNoise * dt + k->freqNoise * dt * dt * dt / 3.0;
+	p[0][1] += dt * p[1][1] + k->freqNoise * dt * dt / 2.0;
+	p[1][0] = p[0][1];
+	p[1][1] += k->freqNoise * dt;
+
+	innovation = z - k->phase;
+	r = max(k->r, k->mpdVar);
+	s = p[0][0] + r;
+
+	/* de-weight outliers once the noise estimate has settled */
+	g = innovation * innovation / (KALMAN_GATE * KALMAN_GATE * s);
+	if(k->updates > KALMAN_NOISE_WINDOW && g > 1.0) {
+		if(++k->gated > KALMAN_GATE_MAX) {
+			DBG("Kalman servo: %d outliers in a row - starting over\n", k->gated);
+			kalmanStart(servo, z, delay);
+			goto output;
+		}
+		r *= g;
+		s = p[0][0] + r;
+	} else {
+		k->gated = 0;
+	}
+
+	/* update */
+	k0 = p[0][0] / s;
+	k1 = p[0][1] / s;
+	k->phase += k0 * innovation;
+	k->freq += k1 * innovation;
+	p[1][1] -= k1 * p[0][1];
+	p[0][1] *= 1.0 - k0;
+	p[1][0] = p[0][1];
+	p[0][0] *= 1.0 - k0;
+
+output:
+
+	CLAMP(k->freq, servo->maxOutput);
+
+	output = k->freq + k->phase / (KALMAN_PHASE_INTERVALS * dt);
+	servoAtLimit(servo, output >= servo->maxOutput || output <= -servo->maxOutput);
+	CLAMP(output, servo->maxOutput);
+
+	k->prevOutput = k->lastOutput;
+	k->lastOutput = output;
+	servo->observedDrift = k->freq;
+	k->lastDrift = k->freq;
+
+	DBGV("Kalman servo: phase %.03f ns, freq %.03f ppb, noise %.03f ns, path delay noise %.03f ns\n",
+		k->phase, k->freq, sqrt(k->r), sqrt(k->mpdVar));
+
+	return output;
+
+}
+
+static void
+driftEstimatorReset(DriftEstimator* e)
+{
+	e->count = 0;
+	e->next = 0;
+	e->now = 0;
+	e->correction = 0;
+	e->drift = 0;
+	e->driftError = 0;
+	e->phaseFit = 0;
+	e->valid = FALSE;
+}
+
+static void
+resetLinRegServo(ClockServo* servo)
+{
+	driftEstimatorReset(&servo->linreg);
+}
+
+/*
+ * Add a sample of the free-running phase and fit a line through the last
+ * window of them. The offset moves with the clock's own frequency offset
+ * less the corrections applied, and the other way with the path delay, so
+ * the offset plus the path delay plus the integral of the corrections is
+ * what the clock would have done on its own: its slope is the frequency
+ * offset, whatever the corrections were and however far apart the samples.
+ */
+static void
+driftEstimatorAdd(DriftEstimator* e, const double phase, const double dt)
+{
+	double t0, x0, mt = 0, mx = 0, sxx = 0, sxy = 0, ss = 0, dx;
+	int i, n;
+
+	if(e->window < LINREG_MIN_SAMPLES || e->window > LINREG_MAX_WINDOW) {
+		e->window = LINREG_MAX_WINDOW;
+	}
+
+	if(e->count) {
+		e->now += dt;
+		e->correction += e->lastOutput * dt;
+	}
+
+	e->time[e->next] = e->now;
+	e->phase[e->next] = phase + e->correction;
+	e->next = (e->next + 1) % e->window;
+	if(e->count < e->window) {
+		e->count++;
+	}
+
+	n = e->count;
+	if(n < LINREG_MIN_SAMPLES) {
+		return;
+	}
+
+	/* relative to the last sample, which keeps the sums small */
+	t0 = e->now;
+	x0 = phase + e->correction;
+
+	for(i = 0; i < n; i++) {
+		mt += e->time[i] - t0;
+		mx += e->phase[i] - x0;
+	}
+	mt /= n;
+	mx /= n;
+
+	for(i = 0; i < n; i++) {
+		sxx += (e->time[i] - t0 - mt) * (e->time[i] - t0 - mt);
+		sxy += (e->time[i] - t0 - mt) * (e->phase[i] - x0 - mx);
+	}
+
+	if(sxx <= 0.0) {
+		return;
+	}
+
+	e->drift = sxy / sxx;
+	e->phaseFit = x0 + mx - e->drift * mt - e->correction;
+
+	for(i = 0; i < n; i++) {
+		dx = e->phase[i] - x0 - mx - e->drift * (e->time[i] - t0 - mt);
+		ss += dx * dx;
+	}
+
+	e->driftError = sqrt(ss / (n - 2) / sxx);
+	e->valid = TRUE;
+}
+
+/*
+ * PI controller whose integral, the frequency offset estimate, starts from
+ * a linear regression of the free-running phase and stays within a few
+ * standard errors of it. With a sample every few seconds or more the PI
+ * integral alone takes minutes to find the frequency; the regression has
+ * it, to within the noise, once it has a handful of samples.
+ */
+static double
+runLinRegServo(ClockServo* servo, const Integer32 offset, const Integer32 rawOffset,
+		const Integer32 delay, const double dt)
+{
+
+	DriftEstimator *e = &servo->linreg;
+	Boolean seed = !e->valid;
+	double bound, output;
+
+	/* someone else set the drift: the corrections applied so far are not known */
+	if(e->count && servo->observedDrift != e->lastDrift) {
+		DBG("linreg servo: drift changed outside the servo - starting over\n");
+		resetLinRegServo(servo);
+		seed = TRUE;
+	}
+
+	driftEstimatorAdd(e, rawOffset + delay, dt);
+
+	if(e->valid) {
+		CLAMP(e->drift, servo->maxOutput);
+		if(seed) {
+			DBG("linreg servo: drift seeded from %.03f to %.03f ppb\n",
+				servo->observedDrift, e->drift);
+			servo->observedDrift = e->drift;
+		}
+	}
+
+	runPIservo(servo, offset, rawOffset, delay, dt);
+
+	if(e->valid) {
+		bound = max(LINREG_BOUND * e->driftError, LINREG_MIN_BOUND);
+		servo->observedDrift = max(servo->observedDrift, e->drift - bound);
+		servo->observedDrift = min(servo->observedDrift, e->drift + bound);
+		CLAMP(servo->observedDrift, servo->maxOutput);
+		servoAtLimit(servo, servo->observedDrift >= servo->maxOutput ||
+				servo->observedDrift <= -servo->maxOutput);
+	}
+
+	/* kP is per second: with samples far apart, do not take out more than a part of the offset */
+	output = servo->observedDrift + min(servo->kP, LINREG_PHASE_GAIN / dt) * offset;
+
+	/* what adjFreq will apply */
+	e->lastOutput = output;
+	CLAMP(e->lastOutput, servo->maxOutput);
+	e->lastDrift = servo->observedDrift;
+
+	DBGV("linreg servo: drift estimate %.03f ppb, std err %.03f ppb, %d samples\n",
+		e->drift, e->driftError, e->count);
+
+	return output;
+
+}
+
+/*
+ * Fast initial acquisition: the same fit as the linreg servo, over the
+ * samples arriving during the acquisition burst, whatever servo is in
+ * use and whether or not it is running yet.
+ */
+void
+startAcquisition(ClockServo* servo, const int period)
+{
+	DriftEstimator *e = &servo->acquisition;
+
+	e->window = LINREG_MAX_WINDOW;
+	driftEstimatorReset(e);
+	/* restoreDrift() has applied it */
+	e->lastOutput = servo->observedDrift;
+	/* a window's worth over the whole period, not the last few seconds of it */
+	servo->sampleSpacing = (period + 0.0) / LINREG_MAX_WINDOW;
+	servo->phaseSlew = 0.0;
+}
+
+/* called before the servo runs: the correction in force since the last sample is in lastOutput */
+void
+acquisitionSample(ClockServo* servo, const Integer32 rawOffset, const Integer32 delay)
+{
+	DriftEstimator *e = &servo->acquisition;
+	TimeInternal now, delta;
+	double dt = 0.0;
+
+	getTimeMonotonic(&now);
+	if(e->count) {
+		subTime(&delta, &now, &servo->lastSample);
+		dt = delta.seconds + delta.nanoseconds / 1E9;
+	}
+	servo->lastSample = now;
+
+	/* too soon after the last sample kept: only the corrections count */
+	if(e->count && e->now + dt - e->time[(e->next + e->window - 1) % e->window] < servo->sampleSpacing) {
+		e->now += dt;
+		e->correction += e->lastOutput * dt;
+		return;
+	}
+
+	driftEstimatorAdd(e, rawOffset + delay, dt);
+}
+
+/*
+ * End of the burst: the servo carries on from the frequency offset fitted
+ * over it, unless its own drift is within a few standard errors of that,
+ * and the phase offset fitted at the last sample - not the last noisy
+ * measurement - is taken out: stepped if it is over the step threshold,
+ * slewed out otherwise. A servo left to take it out itself takes minutes.
+ * The slew starts from servo->output and ends with endPhaseSlew(), which
+ * the caller times for phaseSlew / phaseSlewRate seconds: the updates are
+ * too irregular to time it. Returns TRUE if the clock needs a step.
+ */
+Boolean
+endAcquisition(ClockServo* servo, const Integer32 delay)
+{
+	DriftEstimator *e = &servo->acquisition;
+	double offset = e->phaseFit - delay;
+
+	if(!e->valid) {
+		INFO("Fast acquisition: too few samples (%d) for a frequency estimate\n", e->count);
+		return FALSE;
+	}
+
+	CLAMP(e->drift, servo->maxOutput);
+
+	if(fabs(e->drift - servo->observedDrift) <= ACQUISITION_BOUND * e->driftError) {
+		INFO("Fast acquisition: servo drift %.03f ppb agrees with the estimate of %.03f ppb "
+			"(std err %.03f ppb, %d samples, offset %.0f ns)\n",
+			servo->observedDrift, e->drift, e->driftError, e->count, offset);
+	} else {
+		INFO("Fast acquisition: drift set from %.03f to %.03f ppb "
+			"(std err %.03f ppb, %d samples, offset %.0f ns)\n",
+			servo->observedDrift, e->drift, e->driftError, e->count, offset);
+		servo->observedDrift = e->drift;
+	}
+
+	if(fabs(offset) >= ACQUISITION_STEP) {
+		return TRUE;
+	}
+
+	if(offset == 0.0) {
+		return FALSE;
+	}
+
+	servo->phaseSlewRate = offset / ACQUISITION_SLEW_TIME;
+	CLAMP(servo->phaseSlewRate, servo->maxOutput / 2);
+	servo->phaseSlew = offset;
+	servo->output = servo->observedDrift + servo->phaseSlewRate;
+	getTimeMonotonic(&servo->slewStart);
+
+	return FALSE;
+}
+
+/* the slew is over: returns the servo output without it */
+double
+endPhaseSlew(ClockServo* servo)
+{
+	if(servo->phaseSlew != 0.0) {
+		servo->output -= servo->phaseSlewRate;
+		servo->phaseSlew = 0.0;
+		DBG("Fast acquisition: phase slewed out\n");
+	}
 
 	return -servo->output;
+}
 
+/*
+ * While the phase fitted by acquisition is slewed out: the servo runs on
+ * the offset less what is still to be slewed, with the slew on top.
+ */
+static double
+runPhaseSlew(ClockServo* servo, const Integer32 offset, const Integer32 rawOffset,
+		const Integer32 delay, const double dt)
+{
+	TimeInternal now, delta;
+	double left;
+
+	getTimeMonotonic(&now);
+	subTime(&delta, &now, &servo->slewStart);
+	left = servo->phaseSlew - servo->phaseSlewRate * (delta.seconds + delta.nanoseconds / 1E9);
+	if(left * servo->phaseSlew < 0.0) {
+		left = 0.0;
+	}
+
+	return servoTypes[servo->type].run(servo, offset - left, rawOffset - left, delay, dt) +
+		servo->phaseSlewRate;
 }
 
 #ifdef PTPD_STATISTICS
@@ -1204,6 +1837,106 @@ checkServoStable(PtpClock *ptpClock, const RunTimeOpts *rtOpts)
 
 }
 
+/*
+ * Change the PI bandwidth. The gain gets there a little every update, so
+ * the output never jumps, and the integral - the frequency estimate - is
+ * left alone rather than made up for a noisy offset.
+ */
+static void
+setServoGain(ClockServo* servo, double gain)
+{
+	if(gain != servo->gainTarget) {
+		DBG("servo gain: %.03f -> %.03f\n", servo->gainTarget, gain);
+		servo->gainTarget = gain;
+	}
+}
+
+/*
+ * Per offset update: move the gain towards its target, keep the raw offset
+ * sums for updateServoGain(), and watch for a step - offsets well outside
+ * the noise for a few updates.
+ */
+static void
+trackServoGain(ClockServo* servo, const Integer32 offset, const Integer32 rawOffset)
+{
+	if(!servo->adaptive) {
+		return;
+	}
+
+	if(servo->gain < servo->gainTarget) {
+		servo->gain = min(servo->gainTarget, servo->gain * GAIN_SLEW);
+	} else if(servo->gain > servo->gainTarget) {
+		servo->gain = max(servo->gainTarget, servo->gain / GAIN_SLEW);
+	}
+
+	servo->rawSum += rawOffset;
+	servo->rawPower += (rawOffset + 0.0) * rawOffset;
+	servo->rawSamples++;
+
+	if(servo->noise <= 0.0 || servo->gainTarget >= servo->gainMax ||
+	    abs(offset) < GAIN_STEP_SIGMA * servo->noise) {
+		servo->excursions = 0;
+		return;
+	}
+
+	if(++servo->excursions >= GAIN_STEP_SAMPLES) {
+		INFO("Clock servo: offset step to %d ns, raising gain\n", offset);
+		setServoGain(servo, servo->gainMax);
+		servo->excursions = 0;
+	}
+}
+
+/*
+ * PI gain scheduling, once per statistics period. The raw offsets are
+ * measurement noise plus what the servo leaves of the clock's wander.
+ * Averaged over a period, the noise mostly goes and the wander does not:
+ * if the mean moves from one period to the next by more than the noise
+ * alone would move it, the servo is too slow for the clock. If it moves
+ * by less, a lower bandwidth filters out more of the noise. Many outliers
+ * mean heavy PDV, and the bandwidth only goes down then. The offset and
+ * path delay std devs give the noise level steps are detected against.
+ */
+static void
+updateServoGain(PtpClock *ptpClock)
+{
+	ClockServo *servo = &ptpClock->servo;
+	uint32_t outliers = ptpClock->counters.delayMSOutliersFound + ptpClock->counters.delaySMOutliersFound;
+	double share = 0.0;
+	double mean, variance, wander;
+
+	if(ptpClock->offsetUpdates > 0) {
+		share = (outliers - servo->lastOutliers + 0.0) / ptpClock->offsetUpdates;
+	}
+	servo->lastOutliers = outliers;
+
+	if(!servo->adaptive || servo->rawSamples < GAIN_MIN_SAMPLES) {
+		return;
+	}
+
+	mean = servo->rawSum / servo->rawSamples;
+	variance = servo->rawPower / servo->rawSamples - mean * mean;
+	/* the two means differ by noise alone with twice the variance of one */
+	wander = (servo->lastRawMeanValid && variance > 0.0) ?
+	    (mean - servo->lastRawMean) * (mean - servo->lastRawMean) * servo->rawSamples / (2.0 * variance) :
+	    GAIN_WANDER_HIGH;
+
+	servo->lastRawMean = mean;
+	servo->lastRawMeanValid = TRUE;
+	servo->rawSum = 0.0;
+	servo->rawPower = 0.0;
+	servo->rawSamples = 0;
+	servo->noise = max(ptpClock->slaveStats.ofmStdDev, ptpClock->slaveStats.mpdStdDev) * 1E9;
+
+	DBG("servo gain: raw offset mean moved %.02f times the noise, noise %.0f ns, outliers %.03f per update\n",
+		sqrt(wander), servo->noise, share);
+
+	if(share > GAIN_OUTLIER_SHARE || wander < GAIN_WANDER_LOW) {
+		setServoGain(servo, max(servo->gainMin, servo->gainTarget / GAIN_LOWER));
+	} else if(wander > GAIN_WANDER_HIGH) {
+		setServoGain(servo, min(servo->gainMax, servo->gainTarget * GAIN_RAISE));
+	}
+}
+
 void
 updatePtpEngineStats (PtpClock* ptpClock, const RunTimeOpts* rtOpts)
 {
@@ -1231,6 +1964,10 @@ updatePtpEngineStats (PtpClock* ptpClock, const RunTimeOpts* rtOpts)
 	ptpClock->servo.driftMinFinal = ptpClock->servo.driftMin;
 	ptpClock->servo.driftMaxFinal = ptpClock->servo.driftMax;
 
+	if(ptpClock->clockControl.granted) {
+		updateServoGain(ptpClock);
+	}
+
 	resetDoublePermanentMean(&ptpClock->oFilterMS.acceptedStats);
 	resetDoublePermanentMean(&ptpClock->oFilterSM.acceptedStats);
 
@@ -235,7 +235,22 @@ enum {
     PTPBASE_PTPD_SPECIFIC_DATA_RAW_DELAYMS,
     PTPBASE_PTPD_SPECIFIC_DATA_RAW_DELAYMS_STRING,
     PTPBASE_PTPD_SPECIFIC_DATA_RAW_DELAYSM,
-    PTPBASE_PTPD_SPECIFIC_DATA_RAW_DELAYSM_STRING
+    PTPBASE_PTPD_SPECIFIC_DATA_RAW_DELAYSM_STRING,
+    /* ptpBasePtpdLatency */
+    PTPBASE_PTPD_LATENCY_STAGE_NAME,
+    PTPBASE_PTPD_LATENCY_SAMPLES,
+    PTPBASE_PTPD_LATENCY_P50,
+    PTPBASE_PTPD_LATENCY_P99,
+    PTPBASE_PTPD_LATENCY_P999,
+    PTPBASE_PTPD_LATENCY_MAX,
+    /* ptpBasePtpdHoldover */
+    PTPBASE_PTPD_HOLDOVER_STATE,
+    PTPBASE_PTPD_HOLDOVER_SAMPLES,
+    PTPBASE_PTPD_HOLDOVER_FREQUENCY_STRING,
+    PTPBASE_PTPD_HOLDOVER_AGING_STRING,
+    PTPBASE_PTPD_HOLDOVER_SECONDS,
+    PTPBASE_PTPD_HOLDOVER_ERROR_ESTIMATE,
+    PTPBASE_PTPD_HOLDOVER_ERROR_ESTIMATE_STRING
 };
 
 /* trap / notification definitions */
@@ -1383,6 +1398,106 @@ snmpPtpdSpecificDataTable(SNMP_SIGNATURE) {
 	return NULL;
 }
 
+/* latencies in ns, saturating at what a Gauge32 holds */
+static unsigned long
+snmpLatencyGauge(int64_t value)
+{
+	return value > UINT32_MAX ? UINT32_MAX : (unsigned long)value;
+}
+
+/**
+ * Handle ptpBasePtpdLatencyTable: one row per stage, empty unless
+ * global:latency_histograms is enabled
+ */
+static u_char*
+snmpPtpdLatencyTable(SNMP_SIGNATURE) {
+	oid index[4];
+	int stage;
+	const LatencyHistogram *histogram;
+	SNMP_LOCAL_VARIABLES;
+	SNMP_INDEXED_TABLE;
+
+	if (snmpPtpClock->latency.stages == NULL) return NULL;
+
+	index[0] = snmpPtpClock->defaultDS.domainNumber;
+	index[1] = SNMP_PTP_ORDINARY_CLOCK;
+	index[2] = SNMP_PTP_CLOCK_INSTANCE;
+	for (stage = 0; stage < LATENCY_STAGES; stage++) {
+		index[3] = stage + 1;
+		SNMP_ADD_INDEX(index, 4, &snmpPtpClock->latency.stages[stage]);
+	}
+
+	if ((histogram = SNMP_BEST_MATCH) == NULL) return NULL;
+
+	switch (vp->magic) {
+	    case PTPBASE_PTPD_LATENCY_STAGE_NAME:
+		strncpy(tmpStr, latencyStageName(histogram - snmpPtpClock->latency.stages), sizeof(tmpStr) - 1);
+		return SNMP_OCTETSTR(&tmpStr, strlen(tmpStr));
+	    case PTPBASE_PTPD_LATENCY_SAMPLES:
+		return SNMP_COUNTER64(histogram->count);
+	    case PTPBASE_PTPD_LATENCY_P50:
+		return SNMP_GAUGE(snmpLatencyGauge(latencyHistogramPercentile(histogram, 50)));
+	    case PTPBASE_PTPD_LATENCY_P99:
+		return SNMP_GAUGE(snmpLatencyGauge(latencyHistogramPercentile(histogram, 99)));
+	    case PTPBASE_PTPD_LATENCY_P999:
+		return SNMP_GAUGE(snmpLatencyGauge(latencyHistogramPercentile(histogram, 99.9)));
+	    case PTPBASE_PTPD_LATENCY_MAX:
+		return SNMP_GAUGE(snmpLatencyGauge(histogram->max));
+	}
+
+	return NULL;
+}
+
+/**
+ * Handle ptpBasePtpdHoldoverTable: the holdover model, and while in
+ * holdover, how long for and the time error it has likely let in
+ */
+static u_char*
+snmpPtpdHoldoverTable(SNMP_SIGNATURE) {
+	oid index[3];
+	const HoldoverModel *holdover;
+	SNMP_LOCAL_VARIABLES;
+	SNMP_INDEXED_TABLE;
+
+	memset(tmpStr, 0, sizeof(tmpStr));
+
+	/* We only have one valid index */
+	index[0] = snmpPtpClock->defaultDS.domainNumber;
+	index[1] = SNMP_PTP_ORDINARY_CLOCK;
+	index[2] = SNMP_PTP_CLOCK_INSTANCE;
+	SNMP_ADD_INDEX(index, 3, snmpPtpClock);
+
+	if (!SNMP_BEST_MATCH) return NULL;
+
+	holdover = &snmpPtpClock->holdover;
+
+	switch (vp->magic) {
+	    case PTPBASE_PTPD_HOLDOVER_STATE:
+		return SNMP_INTEGER(holdover->state + 1);
+	    case PTPBASE_PTPD_HOLDOVER_SAMPLES:
+		return SNMP_GAUGE(holdover->count);
+	    case PTPBASE_PTPD_HOLDOVER_FREQUENCY_STRING:
+		snprintf(tmpStr, 64, "%.03f", holdover->state == HOLDOVER_ACTIVE ?
+		    holdover->predicted : holdover->coeff[HOLDOVER_TERM_FREQUENCY]);
+		return SNMP_OCTETSTR(&tmpStr, strlen(tmpStr));
+	    case PTPBASE_PTPD_HOLDOVER_AGING_STRING:
+		snprintf(tmpStr, 64, "%.03f", holdover->coeff[HOLDOVER_TERM_AGING] * 3600.0);
+		return SNMP_OCTETSTR(&tmpStr, strlen(tmpStr));
+	    case PTPBASE_PTPD_HOLDOVER_SECONDS:
+		return SNMP_GAUGE(holdover->state == HOLDOVER_ACTIVE ?
+		    (unsigned long)(holdover->lastUpdate - holdover->entered) : 0);
+	    case PTPBASE_PTPD_HOLDOVER_ERROR_ESTIMATE:
+		return SNMP_GAUGE(holdover->state == HOLDOVER_ACTIVE ?
+		    snmpLatencyGauge((int64_t)holdover->errorEstimate) : 0);
+	    case PTPBASE_PTPD_HOLDOVER_ERROR_ESTIMATE_STRING:
+		snprintf(tmpStr, 64, "%.0f", holdover->state == HOLDOVER_ACTIVE ?
+		    holdover->errorEstimate : 0.0);
+		return SNMP_OCTETSTR(&tmpStr, strlen(tmpStr));
+	}
+
+	return NULL;
+}
+
 
 
 /**
@@ -1754,7 +1869,35 @@ static struct variable7 snmpVariables[] = {
 	{ PTPBASE_PTPD_SPECIFIC_DATA_RAW_DELAYSM, ASN_OCTET_STR, HANDLER_CAN_RONLY,
 	  snmpPtpdSpecificDataTable, 5, {1, 2, 22, 1, 6}},
 	{ PTPBASE_PTPD_SPECIFIC_DATA_RAW_DELAYSM_STRING, ASN_OCTET_STR, HANDLER_CAN_RONLY,
-	  snmpPtpdSpecificDataTable, 5, {1, 2, 22, 1, 7}}
+	  snmpPtpdSpecificDataTable, 5, {1, 2, 22, 1, 7}},
+	/* ptpBasePtpdLatency */
+	{ PTPBASE_PTPD_LATENCY_STAGE_NAME, ASN_OCTET_STR, HANDLER_CAN_RONLY,
+	  snmpPtpdLatencyTable, 5, {1, 2, 23, 1, 5}},
+	{ PTPBASE_PTPD_LATENCY_SAMPLES, ASN_COUNTER64, HANDLER_CAN_RONLY,
+	  snmpPtpdLatencyTable, 5, {1, 2, 23, 1, 6}},
+	{ PTPBASE_PTPD_LATENCY_P50, ASN_GAUGE, HANDLER_CAN_RONLY,
+	  snmpPtpdLatencyTable, 5, {1, 2, 23, 1, 7}},
+	{ PTPBASE_PTPD_LATENCY_P99, ASN_GAUGE, HANDLER_CAN_RONLY,
+	  snmpPtpdLatencyTable, 5, {1, 2, 23, 1, 8}},
+	{ PTPBASE_PTPD_LATENCY_P999, ASN_GAUGE, HANDLER_CAN_RONLY,
+	  snmpPtpdLatencyTable, 5, {1, 2, 23, 1, 9}},
+	{ PTPBASE_PTPD_LATENCY_MAX, ASN_GAUGE, HANDLER_CAN_RONLY,
+	  snmpPtpdLatencyTable, 5, {1, 2, 23, 1, 10}},
+	/* ptpBasePtpdHoldover */
+	{ PTPBASE_PTPD_HOLDOVER_STATE, ASN_INTEGER, HANDLER_CAN_RONLY,
+	  snmpPtpdHoldoverTable, 5, {1, 2, 24, 1, 4}},
+	{ PTPBASE_PTPD_HOLDOVER_SAMPLES, ASN_GAUGE, HANDLER_CAN_RONLY,
+	  snmpPtpdHoldoverTable, 5, {1, 2, 24, 1, 5}},
+	{ PTPBASE_PTPD_HOLDOVER_FREQUENCY_STRING, ASN_OCTET_STR, HANDLER_CAN_RONLY,
+	  snmpPtpdHoldoverTable, 5, {1, 2, 24, 1, 6}},
+	{ PTPBASE_PTPD_HOLDOVER_AGING_STRING, ASN_OCTET_STR, HANDLER_CAN_RONLY,
+	  snmpPtpdHoldoverTable, 5, {1, 2, 24, 1, 7}},
+	{ PTPBASE_PTPD_HOLDOVER_SECONDS, ASN_GAUGE, HANDLER_CAN_RONLY,
+	  snmpPtpdHoldoverTable, 5, {1, 2, 24, 1, 8}},
+	{ PTPBASE_PTPD_HOLDOVER_ERROR_ESTIMATE, ASN_GAUGE, HANDLER_CAN_RONLY,
+	  snmpPtpdHoldoverTable, 5, {1, 2, 24, 1, 9}},
+	{ PTPBASE_PTPD_HOLDOVER_ERROR_ESTIMATE_STRING, ASN_OCTET_STR, HANDLER_CAN_RONLY,
+	  snmpPtpdHoldoverTable, 5, {1, 2, 24, 1, 10}}
 };
 
 /**
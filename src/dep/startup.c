@@ -131,6 +131,13 @@ void
 do_signal_close(PtpClock * ptpClock)
 {
 
+#ifdef PTPD_PORT_THREADS
+	/* the port threads may be steering the clock */
+	if(ptpClock->ports != NULL && ptpClock->ports->threaded) {
+		stopPortThreads(ptpClock->ports);
+	}
+#endif /* PTPD_PORT_THREADS */
+
 	timingDomain.shutdown(&timingDomain);
 
 	NOTIFY("Shutdown on close signal\n");
@@ -142,6 +149,7 @@ applyConfig(dictionary *baseConfig, RunTimeOpts *rtOpts, PtpClock *ptpClock)
 {
 
 	Boolean reloadSuccessful = TRUE;
+	int i;
 
 
 	/* Load default config to fill in the blanks in the config file */
@@ -186,6 +194,15 @@ applyConfig(dictionary *baseConfig, RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		    rtOpts->restartSubsystems = -1;
 		    ERROR("Error: Cannot use %s interface as backup\n",tmpOpts.backupIfaceName);
 		}
+		/* the port interfaces only change with a restart, but their settings can */
+		if(ptpClock->ports != NULL) {
+		    for(i = 1; i < ptpClock->ports->count; i++) {
+			if(!testInterface(ptpClock->ports->port[i]->rtOpts->primaryIfaceName, &tmpOpts)) {
+			    reloadSuccessful = FALSE;
+			    ERROR("Error: Cannot use %s interface\n",ptpClock->ports->port[i]->rtOpts->primaryIfaceName);
+			}
+		    }
+		}
 	}
 #if (defined(linux) && defined(HAVE_SCHED_H)) || defined(HAVE_SYS_CPUSET_H) || defined(__QNXNTO__)
         /* Changing the CPU affinity mask */
@@ -259,6 +276,11 @@ do_signal_sighup(RunTimeOpts * rtOpts, PtpClock * ptpClock)
 
 	NOTIFY("SIGHUP received\n");
 
+#ifdef PTPD_ASYNC_LOG
+	/* the configuration and log files are about to change under the writer thread */
+	asyncLogStop();
+#endif /* PTPD_ASYNC_LOG */
+
 #ifdef RUNTIME_DEBUG
 	if(rtOpts->transport == UDP_IPV4 && rtOpts->ipMode != IPMODE_UNICAST) {
 		DBG("SIGHUP - running an ipv4 multicast based mode, re-sending IGMP joins\n");
@@ -283,6 +305,14 @@ do_signal_sighup(RunTimeOpts * rtOpts, PtpClock * ptpClock)
 		    dictionary_merge(rtOpts->cliConfig, tmpConfig, 1, 1, "from command line");
 		    applyConfig(tmpConfig, rtOpts, ptpClock);
 		    dictionary_del(&tmpConfig);
+		    if(ptpClock->ports != NULL) {
+#ifdef PTPD_PORT_THREADS
+			if(ptpClock->ports->threaded) {
+			    portThreadsReload(rtOpts, ptpClock->ports);
+			} else
+#endif /* PTPD_PORT_THREADS */
+			setBoundaryClockConfig(rtOpts, ptpClock->ports);
+		    }
 
 	    }
 
@@ -301,6 +331,11 @@ do_signal_sighup(RunTimeOpts * rtOpts, PtpClock * ptpClock)
 	if(rtOpts->statisticsLog.logEnabled)
 		ptpClock->resetStatisticsLog = TRUE;
 
+#ifdef PTPD_ASYNC_LOG
+	if(rtOpts->logAsync)
+		asyncLogStart(rtOpts);
+#endif /* PTPD_ASYNC_LOG */
+
 
 }
 
@@ -425,8 +460,8 @@ restartSubsystems(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 
 		ptpClock->timingService.timeout = rtOpts->idleTimeout;
 
-		    /* Update PI servo parameters */
-		    setupPIservo(&ptpClock->servo, rtOpts);
+		    /* Update servo parameters */
+		    setupServo(&ptpClock->servo, rtOpts);
 		    /* Config changes don't require subsystem restarts - acknowledge it */
 		    if(rtOpts->restartSubsystems == PTPD_RESTART_NONE) {
 				NOTIFY("Applying configuration\n");
@@ -438,6 +473,18 @@ restartSubsystems(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 }
 
 
+/* step the clock to the current offset from master, if @ptpClock is a slave */
+void
+do_signal_sigusr1(PtpClock *ptpClock)
+{
+	if(ptpClock->portDS.portState == PTP_SLAVE){
+		WARNING("SIGUSR1 received, stepping clock to current known OFM\n");
+		stepClock(ptpClock->rtOpts, ptpClock);
+	} else {
+		ERROR("SIGUSR1 received - will not step clock, not in PTP_SLAVE state\n");
+	}
+}
+
 /*
  * Synchronous signal processing:
  * This function should be called regularly from the main loop
@@ -460,13 +507,14 @@ checkSignals(RunTimeOpts * rtOpts, PtpClock * ptpClock)
 	}
 
 	if(sigusr1_received){
-	    if(ptpClock->portDS.portState == PTP_SLAVE){
-		    WARNING("SIGUSR1 received, stepping clock to current known OFM\n");
-                    stepClock(rtOpts, ptpClock);                                                                                                        
-//		    ptpClock->clockControl.stepRequired = TRUE;
-	    } else {
-		    ERROR("SIGUSR1 received - will not step clock, not in PTP_SLAVE state\n");
-	    }
+	    /* boundary clock: the port controlling the clock does the step */
+	    PtpClock *controller = (ptpClock->ports != NULL) ? ptpClock->ports->controller : ptpClock;
+#ifdef PTPD_PORT_THREADS
+	    if(controller->thread != NULL) {
+		    portThreadStep(controller);
+	    } else
+#endif /* PTPD_PORT_THREADS */
+	    do_signal_sigusr1(controller);
 	sigusr1_received = 0;
 	}
 
@@ -568,12 +616,90 @@ writeLockFile(RunTimeOpts * rtOpts)
 
 }
 
+/* Boundary clock: take port @port down, from the thread running it */
+void
+shutdownBoundaryClockPort(PtpClock *port)
+{
+
+	toState(PTP_DISABLED, port->rtOpts, port);
+	updateAlarms(port->alarms, ALRM_MAX);
+	netShutdown(&port->netPath);
+	timerShutdown(port->timers);
+
+}
+
+/* Boundary clock: stop and free ports 2 and up - their configuration is freed by the caller */
+static void
+shutdownBoundaryClockPorts(ClockPorts *ports)
+{
+
+	extern PTPD_THREAD_LOCAL PtpClock* G_ptpClock;
+	PtpClock *port;
+	int i;
+
+#ifdef PTPD_PORT_THREADS
+	if(ports->threaded) {
+		/* the threads take their ports down on their way out */
+		stopPortThreads(ports);
+	} else
+#endif /* PTPD_PORT_THREADS */
+	for(i = 1; i < ports->count; i++) {
+		G_ptpClock = ports->port[i];
+		shutdownBoundaryClockPort(ports->port[i]);
+	}
+
+	for(i = 1; i < ports->count; i++) {
+		port = ports->port[i];
+		free(port->foreign);
+		freeUnicastGrantTable(port);
+		latencyProbeFree(&port->latency);
+		if(port->msgTmpHeader.messageType == MANAGEMENT)
+			freeManagementTLV(&port->msgTmp.manage);
+		freeManagementTLV(&port->outgoingManageTmp);
+		if(port->msgTmpHeader.messageType == SIGNALING)
+			freeSignalingTLV(&port->msgTmp.signaling);
+		freeSignalingTLV(&port->outgoingSignalingTmp);
+#ifdef PTPD_STATISTICS
+		port->oFilterMS.shutdown(&port->oFilterMS);
+		port->oFilterSM.shutdown(&port->oFilterSM);
+		freeDoubleMovingStatFilter(&port->filterMS);
+		freeDoubleMovingStatFilter(&port->filterSM);
+#endif /* PTPD_STATISTICS */
+	}
+
+#ifdef PTPD_PORT_THREADS
+	freePortThreads(ports);
+#endif /* PTPD_PORT_THREADS */
+
+	for(i = 1; i < ports->count; i++) {
+		free(ports->port[i]);
+		ports->port[i] = NULL;
+	}
+
+	G_ptpClock = ports->port[0];
+
+}
+
 void
 ptpdShutdown(PtpClock * ptpClock)
 {
 
 	extern RunTimeOpts rtOpts;
-	
+	extern PTPD_THREAD_LOCAL PtpClock* G_ptpClock;
+	ClockPorts *ports = ptpClock->ports;
+	RunTimeOpts *portOpts[PTPD_MAX_PORTS];
+	int i, portCount = 0;
+
+	/* the timing service may hand us any port of a boundary clock: port 1 owns the rest */
+	if(ports != NULL) {
+		ptpClock = ports->port[0];
+		portCount = ports->count;
+		for(i = 1; i < portCount; i++) {
+			portOpts[i] = ports->port[i]->rtOpts;
+		}
+		shutdownBoundaryClockPorts(ports);
+	}
+
 	/*
          * go into DISABLED state so the FSM can call any PTP-specific shutdown actions,
 	 * such as canceling unicast transmission
@@ -582,7 +708,12 @@ ptpdShutdown(PtpClock * ptpClock)
 	/* process any outstanding events before exit */
 	updateAlarms(ptpClock->alarms, ALRM_MAX);
 	netShutdown(&ptpClock->netPath);
+#ifdef PTPD_PHC
+	phcShutdown();
+#endif /* PTPD_PHC */
 	free(ptpClock->foreign);
+	freeUnicastGrantTable(ptpClock);
+	latencyProbeFree(&ptpClock->latency);
 
 	/* free management and signaling messages, they can have dynamic memory allocated */
 	if(ptpClock->msgTmpHeader.messageType == MANAGEMENT)
@@ -621,7 +752,6 @@ ptpdShutdown(PtpClock * ptpClock)
 	free(ptpClock);
 	ptpClock = NULL;
 
-	extern PtpClock* G_ptpClock;
 	G_ptpClock = NULL;
 
 
@@ -642,8 +772,171 @@ ptpdShutdown(PtpClock * ptpClock)
 		unlink(rtOpts.statusLog.logPath);
 	}
 
+#ifdef PTPD_ASYNC_LOG
+	asyncLogStop();
+#endif /* PTPD_ASYNC_LOG */
 	stopLogging(&rtOpts);
 
+	/* queued log messages may have pointed at the port interface names until now */
+	for(i = 1; i < portCount; i++) {
+		free(portOpts[i]);
+	}
+	if(ports != NULL) {
+		free(ports);
+	}
+
+}
+
+/*
+ * Boundary clock: port @index (0-based) runs with a copy of the configuration,
+ * with its own interface and port number. Called at startup and after every
+ * reload, passing on the subsystem restarts the reload requires.
+ */
+void
+setBoundaryClockPortConfig(const RunTimeOpts *rtOpts, RunTimeOpts *portOpts, int index)
+{
+
+	Octet ifaceName[IFACE_NAME_LENGTH];
+
+	/* interfaces only change with a restart - keep the one the port was created with */
+	memcpy(ifaceName, portOpts->primaryIfaceName, IFACE_NAME_LENGTH);
+	memcpy(portOpts, rtOpts, sizeof(RunTimeOpts));
+	memcpy(portOpts->primaryIfaceName, ifaceName, IFACE_NAME_LENGTH);
+	portOpts->ifaceName = portOpts->primaryIfaceName;
+	portOpts->portNumber = rtOpts->portNumber + index;
+	portOpts->backupIfaceEnabled = FALSE;
+	/* port 1 owns the configuration, the status file and the NTP engine */
+	portOpts->candidateConfig = NULL;
+	portOpts->currentConfig = NULL;
+	portOpts->cliConfig = NULL;
+	portOpts->statusLog.logEnabled = FALSE;
+	portOpts->restartSubsystems &= ~(PTPD_RESTART_NTPENGINE | PTPD_RESTART_NTPCONFIG);
+	/* a port thread is bound by ptpengine:port_thread_cpus, not by the process affinity */
+	if(portOpts->portThreads) {
+		portOpts->restartSubsystems &= ~PTPD_CHANGE_CPUAFFINITY;
+	}
+
+}
+
+void
+setBoundaryClockConfig(const RunTimeOpts *rtOpts, ClockPorts *ports)
+{
+
+	int i;
+
+	for(i = 1; i < ports->count; i++) {
+		setBoundaryClockPortConfig(rtOpts, ports->port[i]->rtOpts, i);
+	}
+
+}
+
+/* Boundary clock: allocate and set up port @index (0-based) */
+static PtpClock*
+createBoundaryClockPort(const RunTimeOpts *rtOpts, int index)
+{
+
+	PtpClock *port;
+
+	if((port = (PtpClock*)calloc(1, sizeof(PtpClock))) == NULL ||
+	    (port->rtOpts = (RunTimeOpts*)calloc(1, sizeof(RunTimeOpts))) == NULL ||
+	    (port->foreign = (ForeignMasterRecord*)calloc(rtOpts->max_foreign_records,
+		sizeof(ForeignMasterRecord))) == NULL ||
+	    !allocUnicastGrantTable(port, rtOpts->unicastGrantTableSize)) {
+		PERROR("Error: Failed to allocate memory for boundary clock port %d", index + 1);
+		return NULL;
+	}
+
+	strncpy(port->rtOpts->primaryIfaceName, rtOpts->boundaryClockPortIfaces[index - 1], IFACE_NAME_LENGTH - 1);
+
+	port->msgIbuf = port->msgIbufStorage;
+	port->outgoingManageTmp.tlv = NULL;
+	port->resetStatisticsLog = TRUE;
+
+	/* a port thread sets up its timers in its own event loop */
+	if(!rtOpts->portThreads && !timerSetup(port->timers)) {
+		PERROR("failed to set up event timers for boundary clock port %d", index + 1);
+		return NULL;
+	}
+
+	initAlarms(port->alarms, ALRM_MAX, (void*)port);
+
+#ifdef PTPD_PCAP
+	port->netPath.pcapEventSock = -1;
+	port->netPath.pcapGeneralSock = -1;
+#endif /* PTPD_PCAP */
+
+	port->netPath.generalSock = -1;
+	port->netPath.eventSock = -1;
+
+	return port;
+
+}
+
+/*
+ * Boundary clock: add a port for each of ptpengine:boundary_clock_interfaces
+ * to port 1. All ports are run by protocol() and share one clock.
+ */
+static Boolean
+setupBoundaryClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+
+	ClockPorts *ports;
+	PtpClock *port;
+	int i;
+
+	if((ports = (ClockPorts*)calloc(1, sizeof(ClockPorts))) == NULL) {
+		PERROR("Error: Failed to allocate memory for boundary clock ports");
+		return FALSE;
+	}
+
+	ports->port[0] = ptpClock;
+	ports->count = 1;
+	ports->controller = ptpClock;
+	ptpClock->ports = ports;
+	ptpClock->controllingClock = TRUE;
+	ptpClock->readfds = &ports->readfds;
+
+	for(i = 1; i <= rtOpts->boundaryClockPorts; i++) {
+		if((port = createBoundaryClockPort(rtOpts, i)) == NULL) {
+			return FALSE;
+		}
+		port->ports = ports;
+		port->readfds = &ports->readfds;
+		ports->port[ports->count++] = port;
+	}
+
+	setBoundaryClockConfig(rtOpts, ports);
+
+#ifdef PTPD_PORT_THREADS
+	if(rtOpts->portThreads && !setupPortThreads(ports)) {
+		return FALSE;
+	}
+#endif /* PTPD_PORT_THREADS */
+
+	for(i = 1; i < ports->count; i++) {
+		port = ports->port[i];
+		configureAlarms(port->alarms, ALRM_MAX, (void*)port);
+		port->alarmDelay = port->rtOpts->alarmInitialDelay;
+		if(port->alarmDelay) {
+		    enableAlarms(port->alarms, ALRM_MAX, FALSE);
+		}
+#ifdef PTPD_STATISTICS
+		outlierFilterSetup(&port->oFilterMS);
+		outlierFilterSetup(&port->oFilterSM);
+		port->oFilterMS.init(&port->oFilterMS,&port->rtOpts->oFilterMSConfig, "delayMS");
+		port->oFilterSM.init(&port->oFilterSM,&port->rtOpts->oFilterSMConfig, "delaySM");
+		if(port->rtOpts->filterMSOpts.enabled) {
+			port->filterMS = createDoubleMovingStatFilter(&port->rtOpts->filterMSOpts,"delayMS");
+		}
+		if(port->rtOpts->filterSMOpts.enabled) {
+			port->filterSM = createDoubleMovingStatFilter(&port->rtOpts->filterSMOpts, "delaySM");
+		}
+#endif /* PTPD_STATISTICS */
+		INFO("Boundary clock port %d on %s\n", port->rtOpts->portNumber, port->rtOpts->ifaceName);
+	}
+
+	return TRUE;
+
 }
 
 void dump_command_line_parameters(int argc, char **argv)
@@ -725,12 +1018,15 @@ ptpdStartup(int argc, char **argv, Integer16 * ret, RunTimeOpts * rtOpts)
 	 * the exception is the lock file, as we get a new pid when we call daemon(),
 	 * so this is checked twice: once to read, second to read/write
 	 */
+#ifndef PTPD_SIM
+	/* ptpd2-sim touches no clock or socket, so it runs as any user */
 	if(geteuid() != 0)
 	{
 		printf("Error: "PTPD_PROGNAME" daemon can only be run as root\n");
 			*ret = 1;
 			goto fail;
 		}
+#endif /* PTPD_SIM */
 
 	/* Have we got a config file? */
 	if(strlen(rtOpts->configFile) > 0) {
@@ -779,6 +1075,13 @@ ptpdStartup(int argc, char **argv, Integer16 * ret, RunTimeOpts * rtOpts)
 	    *ret = 1;
 	    goto configcheck;
 	}
+	for(i = 0; i < rtOpts->boundaryClockPorts; i++) {
+	    if(!testInterface(rtOpts->boundaryClockPortIfaces[i], rtOpts)) {
+		ERROR("Error: Cannot use %s interface\n",rtOpts->boundaryClockPortIfaces[i]);
+		*ret = 1;
+		goto configcheck;
+	    }
+	}
 
 
 configcheck:
@@ -842,12 +1145,21 @@ configcheck:
 			    (int)(rtOpts->max_foreign_records *
 				  sizeof(ForeignMasterRecord)));
 		}
+
+		if (!allocUnicastGrantTable(ptpClock, rtOpts->unicastGrantTableSize)) {
+			PERROR("failed to allocate memory for unicast grant table");
+			*ret = 2;
+			free(ptpClock->foreign);
+			free(ptpClock);
+			goto fail;
+		}
 	}
 
 	if(rtOpts->statisticsLog.logEnabled)
 		ptpClock->resetStatisticsLog = TRUE;
 
 	/* Init to 0 net buffer */
+	ptpClock->msgIbuf = ptpClock->msgIbufStorage;
 	memset(ptpClock->msgIbuf, 0, PACKET_SIZE);
 	memset(ptpClock->msgObuf, 0, PACKET_SIZE);
 	
@@ -977,6 +1289,11 @@ configcheck:
 		ptpClock->netPath.generalSock = -1;
 		ptpClock->netPath.eventSock = -1;
 
+	if(rtOpts->boundaryClockPorts > 0 && !setupBoundaryClock(rtOpts, ptpClock)) {
+		*ret = 2;
+		goto fail;
+	}
+
 	*ret = 0;
 
 	return ptpClock;
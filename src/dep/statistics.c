@@ -43,30 +43,6 @@ static int cmpInt32 (const void *vA, const void *vB) {
 	return ((a < b) ? -1 : (a > b) ? 1 : 0);
 }
 
-static int cmpDouble (const void *vA, const void *vB) {
-
-	double a = *(double*)vA;
-	double b = *(double*)vB;
-
-	return ((a < b) ? -1 : (a > b) ? 1 : 0);
-}
-
-static int cmpAbsInt32 (const void *vA, const void *vB) {
-
-	int32_t a = abs(*(int32_t*)vA);
-	int32_t b = abs(*(int32_t*)vB);
-
-	return ((a < b) ? -1 : (a > b) ? 1 : 0);
-}
-
-static int cmpAbsDouble (const void *vA, const void *vB) {
-
-	double a = fabs(*(double*)vA);
-	double b = fabs(*(double*)vB);
-
-	return ((a < b) ? -1 : (a > b) ? 1 : 0);
-}
-
 static int32_t median3Int(int32_t *bucket, int count)
 {
 
@@ -102,7 +78,7 @@ static double median3Double(double *bucket, int count)
 	    case 2:
 		return (bucket[0] + bucket[1]) / 2.0;
 	    case 3:
-		qsort(sortedSamples, count, sizeof(double), cmpInt32);
+		qsort(sortedSamples, count, sizeof(double), cmpDouble);
 		return sortedSamples[1];
 	    default:
 		return 0;
@@ -566,179 +542,417 @@ feedDoubleMovingStdDev(DoubleMovingStdDev* container, double sample)
 
 }
 
-IntMovingStatFilter* createIntMovingStatFilter(StatFilterOptions *config, const char* id)
+/*
+ * Order statistic sliding window: the last n samples in a ring buffer, plus
+ * the structure needed by the filter type, updated incrementally:
+ *
+ * - median: the lower half of the window in a max-heap, the upper half in a
+ *   min-heap, both holding ring slots. The oldest sample is removed by
+ *   position, so each sample costs O(log n).
+ * - min, max, absmin, absmax: a monotonic deque of ring slots ordered by key
+ *   (value, negated value, absolute value, negated absolute value). The front
+ *   is the result. Each sample costs amortised O(1).
+ * - mean: running sum.
+ * - lucky: no structure - the rank of each new sample is counted, O(n),
+ *   and the sample passes if it is in the lowest percentile of the window.
+ *   While nothing passes, that share grows to the whole window over one
+ *   window's worth of samples, so a window that keeps rising (a clock still
+ *   being brought in) cannot hold the output back for good, while a run of
+ *   bad luck lets through the best of what is coming, not the next sample
+ *   whatever it is.
+ */
+
+static double
+orderStatKey(uint8_t filterType, double sample)
 {
 
-	IntMovingStatFilter* container;
+	switch(filterType) {
+	    case FILTER_MAX:
+		return -sample;
+	    case FILTER_ABSMIN:
+		return fabs(sample);
+	    case FILTER_ABSMAX:
+		return -fabs(sample);
+	    default:
+		return sample;
+	}
 
-	if(config->filterType > FILTER_MAXVALUE) {
-		return NULL;
+}
+
+/* slot a belongs above slot b in the given heap */
+static Boolean
+heapAbove(const OrderStatWindow *window, Boolean upper, int a, int b)
+{
+
+	if(upper) {
+		return window->samples[a] < window->samples[b];
 	}
+	return window->samples[a] > window->samples[b];
 
-	if ( !(container = calloc (1, sizeof(IntMovingStatFilter))) ) {
-		return NULL;
+}
+
+static void
+heapSet(OrderStatWindow *window, Boolean upper, int i, int slot)
+{
+
+	if(upper) {
+		window->upper[i] = slot;
+		window->heapPos[slot] = -(i + 1);
+	} else {
+		window->lower[i] = slot;
+		window->heapPos[slot] = i;
 	}
 
-	if((container->meanContainer = createIntMovingMean(config->windowSize))
-		== NULL) {
-		free(container);
-		return NULL;
+}
+
+static void
+heapSiftUp(OrderStatWindow *window, Boolean upper, int i)
+{
+
+	int *heap = upper ? window->upper : window->lower;
+	int slot = heap[i];
+	int parent;
+
+	while(i > 0) {
+		parent = (i - 1) / 2;
+		if(!heapAbove(window, upper, slot, heap[parent])) {
+			break;
+		}
+		heapSet(window, upper, i, heap[parent]);
+		i = parent;
 	}
 
-	container->filterType = config->filterType;
-	container->windowType = config->windowType;
+	heapSet(window, upper, i, slot);
 
-	if(config->windowSize < 2) container->windowType = WINDOW_SLIDING;
+}
 
-	strncpy(container->identifier, id, 10);
+static void
+heapSiftDown(OrderStatWindow *window, Boolean upper, int i)
+{
 
-	return container;
+	int *heap = upper ? window->upper : window->lower;
+	int count = upper ? window->upperCount : window->lowerCount;
+	int slot = heap[i];
+	int child;
+
+	while((child = 2 * i + 1) < count) {
+		if(child + 1 < count && heapAbove(window, upper, heap[child + 1], heap[child])) {
+			child++;
+		}
+		if(!heapAbove(window, upper, heap[child], slot)) {
+			break;
+		}
+		heapSet(window, upper, i, heap[child]);
+		i = child;
+	}
+
+	heapSet(window, upper, i, slot);
 
 }
 
-void
-freeIntMovingStatFilter(IntMovingStatFilter** container)
+static void
+heapPush(OrderStatWindow *window, Boolean upper, int slot)
 {
 
-	freeIntMovingMean(&((*container)->meanContainer));
-	free(*container);
-	*container = NULL;
+	int i = upper ? window->upperCount++ : window->lowerCount++;
+
+	heapSet(window, upper, i, slot);
+	heapSiftUp(window, upper, i);
 
 }
 
-void
-resetIntMovingStatFilter(IntMovingStatFilter* container)
+/* remove a slot from whichever heap holds it */
+static void
+heapRemove(OrderStatWindow *window, int slot)
 {
 
-	if(container == NULL)
-	    return;
-	resetIntMovingMean(container->meanContainer);
-	container->output = 0;
+	Boolean upper = (window->heapPos[slot] < 0);
+	int i = upper ? -(window->heapPos[slot] + 1) : window->heapPos[slot];
+	int *heap = upper ? window->upper : window->lower;
+	int last = upper ? --window->upperCount : --window->lowerCount;
+	int moved;
+
+	if(i == last) {
+		return;
+	}
+
+	/* the last entry fills the gap and moves up or down from there */
+	moved = heap[last];
+	heapSet(window, upper, i, moved);
+	heapSiftUp(window, upper, i);
+	i = upper ? -(window->heapPos[moved] + 1) : window->heapPos[moved];
+	heapSiftDown(window, upper, i);
 
 }
 
-Boolean
-feedIntMovingStatFilter(IntMovingStatFilter* container, int32_t sample)
+/* keep the lower heap equal in size to the upper heap, or one larger */
+static void
+heapBalance(OrderStatWindow *window)
 {
-	if(container == NULL)
-		return 0;
 
-	if(container->filterType == FILTER_NONE) {
+	int slot;
 
-	    container->output = sample;
-	    return TRUE;
+	while(window->lowerCount > window->upperCount + 1) {
+		slot = window->lower[0];
+		heapRemove(window, slot);
+		heapPush(window, TRUE, slot);
+	}
 
-	} else {
-	    /* cheat - the mean container is used as a general purpose sliding window */
-	    feedIntMovingMean(container->meanContainer, sample);
+	while(window->upperCount > window->lowerCount) {
+		slot = window->upper[0];
+		heapRemove(window, slot);
+		heapPush(window, FALSE, slot);
+	}
 
+}
+
+OrderStatWindow*
+createOrderStatWindow(int capacity, uint8_t filterType)
+{
+
+	OrderStatWindow* window;
+
+	if ( !(window = calloc (1, sizeof(OrderStatWindow))) ) {
+	    return NULL;
 	}
 
-	container->counter++;
-	container->counter = container->counter % container->meanContainer->capacity;
+	if(capacity < 1) {
+	    capacity = 1;
+	}
 
-	switch(container->filterType) {
+	window->capacity = (capacity > STATFILTER_MAX_SAMPLES) ?
+			STATFILTER_MAX_SAMPLES : capacity;
+	window->filterType = filterType;
 
-	    case FILTER_MEAN:
+	if ( !(window->samples = calloc (window->capacity, sizeof(double))) ) {
+	    goto failure;
+	}
 
-		container->output = container->meanContainer->mean;
+	switch(filterType) {
+	    case FILTER_MEDIAN:
+		if ( !(window->lower = calloc (window->capacity, sizeof(int))) ||
+		     !(window->upper = calloc (window->capacity, sizeof(int))) ||
+		     !(window->heapPos = calloc (window->capacity, sizeof(int))) ) {
+			goto failure;
+		}
+		break;
+	    case FILTER_MIN:
+	    case FILTER_MAX:
+	    case FILTER_ABSMIN:
+	    case FILTER_ABSMAX:
+		if ( !(window->deque = calloc (window->capacity, sizeof(int))) ) {
+			goto failure;
+		}
+		break;
+	    case FILTER_LUCKY:
+		if ( !(window->sorted = calloc (window->capacity, sizeof(double))) ) {
+			goto failure;
+		}
+		window->percentile = 100;
+		break;
+	    default:
 		break;
+	}
 
-	    case FILTER_MEDIAN:
-		{
-		    int count = container->meanContainer->count;
-		    int32_t sortedSamples[count];
+	return window;
+
+failure:
+	freeOrderStatWindow(&window);
+	return NULL;
+
+}
 
-		    Boolean odd = ((count %2 ) == 1);
-	
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
+void
+freeOrderStatWindow(OrderStatWindow** window)
+{
+
+	if((window == NULL) || (*window == NULL)) {
+	    return;
+	}
 
-		    qsort(sortedSamples, count, sizeof(sample), cmpInt32);
+	free((*window)->samples);
+	free((*window)->lower);
+	free((*window)->upper);
+	free((*window)->heapPos);
+	free((*window)->deque);
+	free((*window)->sorted);
+	free(*window);
+	*window = NULL;
 
-		    if(odd) {
+}
 
-			    container->output = sortedSamples[(count / 2)];
+void
+resetOrderStatWindow(OrderStatWindow* window)
+{
 
-		    } else {
+	if(window == NULL)
+	    return;
 
-			    container->output = (sortedSamples[(count / 2) -1] + sortedSamples[(count / 2)]) / 2;
+	window->sum = 0;
+	window->count = 0;
+	window->oldest = 0;
+	window->lowerCount = 0;
+	window->upperCount = 0;
+	window->dequeHead = 0;
+	window->dequeCount = 0;
+	window->sinceSelected = 0;
+	window->selected = FALSE;
 
-		    }
+}
+
+/* samples in the lowest percentile of the window, at least one */
+static int
+luckyCount(const OrderStatWindow* window)
+{
+
+	int n = (window->count * window->percentile + 99) / 100;
+
+	return n < 1 ? 1 : n;
+
+}
+
+/* FILTER_LUCKY: the mean of the samples in the lowest percentile of the window */
+double
+orderStatWindowLowestMean(OrderStatWindow* window)
+{
 
+	double sum = 0;
+	int i, n;
+
+	if(window == NULL || window->sorted == NULL || !window->count) {
+		return 0;
+	}
+
+	for(i = 0; i < window->count; i++) {
+		window->sorted[i] = window->samples[(window->oldest + i) % window->capacity];
+	}
+	qsort(window->sorted, window->count, sizeof(double), cmpDouble);
+
+	n = luckyCount(window);
+	for(i = 0; i < n; i++) {
+		sum += window->sorted[i];
+	}
+
+	return sum / n;
+
+}
+
+/* add a sample, dropping the oldest one if the window is full, and return the filter output */
+double
+feedOrderStatWindow(OrderStatWindow* window, double sample)
+{
+
+	int slot, back;
+	double key;
+
+	if(window == NULL) return sample;
+
+	if(window->count == window->capacity) {
+		/* drop the oldest sample - its slot is reused below */
+		slot = window->oldest;
+		window->sum -= window->samples[slot];
+		if(window->filterType == FILTER_MEDIAN) {
+			heapRemove(window, slot);
+			heapBalance(window);
+		} else if(window->deque != NULL && window->dequeCount &&
+		    window->deque[window->dequeHead] == slot) {
+			window->dequeHead = (window->dequeHead + 1) % window->capacity;
+			window->dequeCount--;
 		}
-		break;
+		window->oldest = (window->oldest + 1) % window->capacity;
+		window->count--;
+	} else {
+		slot = (window->oldest + window->count) % window->capacity;
+	}
 
-	    case FILTER_MIN:
-		{
-		    int count = container->meanContainer->count;
-		    int32_t sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpInt32);
-		    container->output = sortedSamples[0];
+	window->samples[slot] = sample;
+	window->sum += sample;
+	window->count++;
 
+	/* once per pass over the ring, recompute the sum to shed rounding errors */
+	if(window->filterType == FILTER_MEAN && window->count == window->capacity && window->oldest == 0) {
+		int i;
+		window->sum = 0;
+		for(i = 0; i < window->count; i++) {
+			window->sum += window->samples[i];
 		}
-		break;
+	}
 
-	    case FILTER_MAX:
-		{
-		    int count = container->meanContainer->count;
-		    int32_t sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpInt32);
-		    container->output = sortedSamples[count - 1];
+	switch(window->filterType) {
 
+	    case FILTER_MEDIAN:
+
+		if(window->lowerCount == 0 || sample <= window->samples[window->lower[0]]) {
+			heapPush(window, FALSE, slot);
+		} else {
+			heapPush(window, TRUE, slot);
 		}
-		break;
+		heapBalance(window);
+
+		if(window->count % 2) {
+			return window->samples[window->lower[0]];
+		}
+		return (window->samples[window->lower[0]] + window->samples[window->upper[0]]) / 2.0;
 
+	    case FILTER_MIN:
+	    case FILTER_MAX:
 	    case FILTER_ABSMIN:
-		{
-		    int count = container->meanContainer->count;
-		    int32_t sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpAbsInt32);
-		    container->output = sortedSamples[0];
+	    case FILTER_ABSMAX:
 
+		key = orderStatKey(window->filterType, sample);
+		/* samples that can no longer be the result leave from the back */
+		while(window->dequeCount) {
+			back = (window->dequeHead + window->dequeCount - 1) % window->capacity;
+			if(orderStatKey(window->filterType, window->samples[window->deque[back]]) < key) {
+				break;
+			}
+			window->dequeCount--;
 		}
-		break;
+		window->deque[(window->dequeHead + window->dequeCount++) % window->capacity] = slot;
 
-	    case FILTER_ABSMAX:
-		{
-		    int count = container->meanContainer->count;
-		    int32_t sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpAbsInt32);
-		    container->output = sortedSamples[count - 1];
+		return window->samples[window->deque[window->dequeHead]];
+
+	    case FILTER_MEAN:
 
+		return window->sum / window->count;
+
+	    case FILTER_LUCKY:
+
+		{
+			int i, n, rank = 0;
+			for(i = 0; i < window->count; i++) {
+				if(window->samples[(window->oldest + i) % window->capacity] < sample) {
+					rank++;
+				}
+			}
+			n = luckyCount(window);
+			n += (window->count - n) * window->sinceSelected / window->capacity;
+			window->selected = rank < n;
+			window->sinceSelected = window->selected ? 0 : window->sinceSelected + 1;
 		}
-		break;
-	    default:
-		container->output = sample;
-		return TRUE;
-	}
-		
 
-	DBGV("filter %s, Sample %d output %d\n", container->identifier, sample, container->output);
+		return sample;
 
-	if((container->windowType == WINDOW_INTERVAL) && (container->counter != 0)) {
-		return FALSE;
+	    default:
+		return sample;
 	}
-	return TRUE;
 
 }
 
-DoubleMovingStatFilter* createDoubleMovingStatFilter(StatFilterOptions *config, const char* id)
+IntMovingStatFilter* createIntMovingStatFilter(StatFilterOptions *config, const char* id)
 {
-	DoubleMovingStatFilter* container;
+
+	IntMovingStatFilter* container;
 
 	if(config->filterType > FILTER_MAXVALUE) {
 		return NULL;
 	}
 
-	if ( !(container = calloc (1, sizeof(DoubleMovingStatFilter))) ) {
+	if ( !(container = calloc (1, sizeof(IntMovingStatFilter))) ) {
 		return NULL;
 	}
 
-	if((container->meanContainer = createDoubleMovingMean(config->windowSize))
+	if((container->window = createOrderStatWindow(config->windowSize, config->filterType))
 		== NULL) {
 		free(container);
 		return NULL;
@@ -749,6 +963,10 @@ DoubleMovingStatFilter* createDoubleMovingStatFilter(StatFilterOptions *config,
 
 	if(config->windowSize < 2) container->windowType = WINDOW_SLIDING;
 
+	if(config->filterType == FILTER_LUCKY && config->percentile >= 1 && config->percentile <= 100) {
+		container->window->percentile = config->percentile;
+	}
+
 	strncpy(container->identifier, id, 10);
 
 	return container;
@@ -756,33 +974,29 @@ DoubleMovingStatFilter* createDoubleMovingStatFilter(StatFilterOptions *config,
 }
 
 void
-freeDoubleMovingStatFilter(DoubleMovingStatFilter** container)
+freeIntMovingStatFilter(IntMovingStatFilter** container)
 {
 
-	if((container==NULL) || (*container==NULL)) {
-	    return;
-	}
-	freeDoubleMovingMean(&((*container)->meanContainer));
+	freeOrderStatWindow(&((*container)->window));
 	free(*container);
 	*container = NULL;
 
 }
 
 void
-resetDoubleMovingStatFilter(DoubleMovingStatFilter* container)
+resetIntMovingStatFilter(IntMovingStatFilter* container)
 {
 
 	if(container == NULL)
 	    return;
-	resetDoubleMovingMean(container->meanContainer);
+	resetOrderStatWindow(container->window);
 	container->output = 0;
 
 }
 
 Boolean
-feedDoubleMovingStatFilter(DoubleMovingStatFilter* container, double sample)
+feedIntMovingStatFilter(IntMovingStatFilter* container, int32_t sample)
 {
-
 	if(container == NULL)
 		return 0;
 
@@ -791,98 +1005,134 @@ feedDoubleMovingStatFilter(DoubleMovingStatFilter* container, double sample)
 	    container->output = sample;
 	    return TRUE;
 
-	} else {
-	    /* cheat - the mean container is used as a general purpose sliding window */
-	    feedDoubleMovingMean(container->meanContainer, sample);
 	}
 
+	if(container->filterType >= FILTER_MAXVALUE) {
+	    container->output = sample;
+	    return TRUE;
+	}
+
+	/* int32 samples are exact in a double; the casts truncate like integer division */
+	container->output = (int32_t)feedOrderStatWindow(container->window, sample);
+
 	container->counter++;
-	container->counter = container->counter % container->meanContainer->capacity;
+	container->counter = container->counter % container->window->capacity;
 
-	switch(container->filterType) {
+	DBGV("filter %s, Sample %d output %d\n", container->identifier, sample, container->output);
 
-	    case FILTER_MEAN:
+	if((container->windowType == WINDOW_INTERVAL) && (container->counter != 0)) {
+		return FALSE;
+	}
 
-		container->output = container->meanContainer->mean;
-		break;
+	/* lucky: the mean of the lowest samples of each interval, or the lowest samples as they come */
+	if(container->filterType == FILTER_LUCKY) {
+		if(container->windowType == WINDOW_INTERVAL) {
+			container->output = (int32_t)orderStatWindowLowestMean(container->window);
+			return TRUE;
+		}
+		return container->window->selected;
+	}
 
-	    case FILTER_MEDIAN:
-		{
-		    int count = container->meanContainer->count;
-		    double sortedSamples[count];
+	return TRUE;
 
-		    Boolean odd = ((count %2 ) == 1);
-	
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
+}
 
-		    qsort(sortedSamples, count, sizeof(sample), cmpDouble);
+DoubleMovingStatFilter* createDoubleMovingStatFilter(StatFilterOptions *config, const char* id)
+{
+	DoubleMovingStatFilter* container;
 
-		    if(odd) {
+	if(config->filterType > FILTER_MAXVALUE) {
+		return NULL;
+	}
 
-			    container->output = sortedSamples[(count / 2)];
+	if ( !(container = calloc (1, sizeof(DoubleMovingStatFilter))) ) {
+		return NULL;
+	}
 
-		    } else {
+	if((container->window = createOrderStatWindow(config->windowSize, config->filterType))
+		== NULL) {
+		free(container);
+		return NULL;
+	}
 
-			    container->output = (sortedSamples[(count / 2) -1] + sortedSamples[(count / 2)]) / 2;
+	container->filterType = config->filterType;
+	container->windowType = config->windowType;
 
-		    }
+	if(config->windowSize < 2) container->windowType = WINDOW_SLIDING;
 
-		}
-		break;
+	if(config->filterType == FILTER_LUCKY && config->percentile >= 1 && config->percentile <= 100) {
+		container->window->percentile = config->percentile;
+	}
 
-	    case FILTER_MIN:
-		{
-		    int count = container->meanContainer->count;
-		    double sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpDouble);
-		    container->output = sortedSamples[0];
+	strncpy(container->identifier, id, 10);
 
-		}
-		break;
+	return container;
 
-	    case FILTER_MAX:
-		{
-		    int count = container->meanContainer->count;
-		    double sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpDouble);
-		    container->output = sortedSamples[count - 1];
+}
 
-		}
-		break;
+void
+freeDoubleMovingStatFilter(DoubleMovingStatFilter** container)
+{
 
-	    case FILTER_ABSMIN:
-		{
-		    int count = container->meanContainer->count;
-		    double sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpAbsDouble);
-		    container->output = sortedSamples[0];
+	if((container==NULL) || (*container==NULL)) {
+	    return;
+	}
+	freeOrderStatWindow(&((*container)->window));
+	free(*container);
+	*container = NULL;
 
-		}
-		break;
+}
 
-	    case FILTER_ABSMAX:
-		{
-		    int count = container->meanContainer->count;
-		    double sortedSamples[count];
-		    memcpy(sortedSamples, container->meanContainer->samples, count * sizeof(sample));
-		    qsort(sortedSamples, count, sizeof(sample), cmpAbsDouble);
-		    container->output = sortedSamples[count - 1];
+void
+resetDoubleMovingStatFilter(DoubleMovingStatFilter* container)
+{
 
-		}
-		break;
-	    default:
-		container->output = sample;
-		return TRUE;
+	if(container == NULL)
+	    return;
+	resetOrderStatWindow(container->window);
+	container->output = 0;
+
+}
+
+Boolean
+feedDoubleMovingStatFilter(DoubleMovingStatFilter* container, double sample)
+{
+
+	if(container == NULL)
+		return 0;
+
+	if(container->filterType == FILTER_NONE) {
+
+	    container->output = sample;
+	    return TRUE;
+
+	}
+
+	if(container->filterType >= FILTER_MAXVALUE) {
+	    container->output = sample;
+	    return TRUE;
 	}
 
+	container->output = feedOrderStatWindow(container->window, sample);
+
+	container->counter++;
+	container->counter = container->counter % container->window->capacity;
+
 	DBGV("Filter %s, Sample %.09f output %.09f\n", container->identifier, sample, container->output);
 
 	if((container->windowType == WINDOW_INTERVAL) && (container->counter != 0)) {
 		return FALSE;
 	}
+
+	/* lucky: the mean of the lowest samples of each interval, or the lowest samples as they come */
+	if(container->filterType == FILTER_LUCKY) {
+		if(container->windowType == WINDOW_INTERVAL) {
+			container->output = orderStatWindowLowestMean(container->window);
+			return TRUE;
+		}
+		return container->window->selected;
+	}
+
 	return TRUE;
 
 }
@@ -12,6 +12,8 @@
 #define STATISTICS_H_
 
 #define STATCONTAINER_MAX_SAMPLES 60
+/* largest window of the statistical filters (FILTER_xxx) */
+#define STATFILTER_MAX_SAMPLES 4096
 
 /* "Permanent" i.e. non-moving statistics containers - useful for long term measurement */
 
@@ -119,11 +121,38 @@ typedef struct {
 
 } DoubleMovingStdDev;
 
+/* Order statistic sliding window - last n samples, result updated per sample */
+
 typedef struct {
 
-	IntMovingMean* meanContainer;
+	double* samples;	/* ring buffer */
+	double sum;
+	int capacity;
+	int count;
+	int oldest;		/* ring slot of the oldest sample */
+	uint8_t filterType;
+	/* FILTER_MEDIAN: ring slots of the lower half (max-heap) and upper half (min-heap) */
+	int* lower;
+	int* upper;
+	int* heapPos;		/* per slot: index in lower, or -(index + 1) in upper */
+	int lowerCount;
+	int upperCount;
+	/* FILTER_MIN, MAX, ABSMIN, ABSMAX: monotonic deque of ring slots */
+	int* deque;
+	int dequeHead;
+	int dequeCount;
+	/* FILTER_LUCKY: samples in the lowest percentile of the window pass */
+	int percentile;
+	int sinceSelected;	/* samples since the last one passed */
+	Boolean selected;	/* the last sample passed */
+	double* sorted;		/* scratch for orderStatWindowLowestMean() */
+
+} OrderStatWindow;
+
+typedef struct {
+
+	OrderStatWindow* window;
 	int32_t output;
-	int32_t* sortedSamples;
 	char identifier[10];
 	int counter;
 	uint8_t filterType;
@@ -133,9 +162,8 @@ typedef struct {
 
 typedef struct {
 
-	DoubleMovingMean* meanContainer;
+	OrderStatWindow* window;
 	double output;
-	double* sortedSamples;
 	char identifier[10];
 	int counter;
 	uint8_t filterType;
@@ -149,6 +177,7 @@ typedef struct {
 	uint8_t	filterType;
 	int	windowSize;
 	uint8_t	windowType;
+	int	percentile;	/* FILTER_LUCKY */
 
 } StatFilterOptions;
 
@@ -172,6 +201,12 @@ void freeDoubleMovingStdDev(DoubleMovingStdDev** container);
 void resetDoubleMovingStdDev(DoubleMovingStdDev* container);
 double feedDoubleMovingStdDev(DoubleMovingStdDev* container, double sample);
 
+OrderStatWindow* createOrderStatWindow(int capacity, uint8_t filterType);
+void freeOrderStatWindow(OrderStatWindow** window);
+void resetOrderStatWindow(OrderStatWindow* window);
+double orderStatWindowLowestMean(OrderStatWindow* window);
+double feedOrderStatWindow(OrderStatWindow* window, double sample);
+
 IntMovingStatFilter* createIntMovingStatFilter(StatFilterOptions* config, const char* id);
 void freeIntMovingStatFilter(IntMovingStatFilter** container);
 void resetIntMovingStatFilter(IntMovingStatFilter* container);
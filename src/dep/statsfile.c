@@ -0,0 +1,290 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   statsfile.c
+ * @date   Tue Mar 22 20:15:37 2016
+ *
+ * @brief  Binary statistics file writer and CSV converter
+ *
+ * With global:statistics_file_format=binary, every statistics log entry
+ * is stored as a fixed size StatisticsRecord instead of a CSV line. The
+ * file is mapped into memory and grown STATSFILE_CHUNK at a time, with
+ * the space allocated up front, so logging an entry is a memcpy() and
+ * a page fault now and then. The header keeps the number of records
+ * written, so a file left behind by a crash is still readable; on a
+ * clean close the preallocated tail is cut off.
+ *
+ * statsFileConvert() (ptpd2 -X) prints a binary file as the CSV lines
+ * logStatistics() would have written.
+ */
+
+#include "../ptpd.h"
+
+#ifdef HAVE_SYS_MMAN_H
+
+/* allocate the file up to size and map it */
+static Boolean
+statsFileMap(LogFileHandler *handler, size_t size)
+{
+
+	int fd = fileno(handler->logFP);
+	Octet *map;
+
+	if(handler->map != NULL) {
+		munmap(handler->map, handler->mapSize);
+		handler->map = NULL;
+		handler->mapSize = 0;
+	}
+
+#ifdef HAVE_POSIX_FALLOCATE
+	/* allocate the blocks now, so running out of space can't fault a write to the mapping */
+	if(posix_fallocate(fd, 0, size) != 0)
+#endif /* HAVE_POSIX_FALLOCATE */
+	{
+		if(ftruncate(fd, size) == -1) {
+			PERROR("Could not extend %s file to %zu bytes", handler->logID, size);
+			return FALSE;
+		}
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED) {
+		PERROR("Could not map %s file", handler->logID);
+		return FALSE;
+	}
+
+	handler->map = map;
+	handler->mapSize = size;
+	return TRUE;
+
+}
+
+static size_t
+statsFileChunks(size_t size)
+{
+	return ((size + STATSFILE_CHUNK - 1) / STATSFILE_CHUNK) * STATSFILE_CHUNK;
+}
+
+static Boolean
+statsFileHeaderValid(const StatisticsFileHeader *header)
+{
+	return !memcmp(header->magic, STATSFILE_MAGIC, sizeof(header->magic)) &&
+		header->version == STATSFILE_VERSION &&
+		header->headerSize == sizeof(StatisticsFileHeader) &&
+		header->recordSize == sizeof(StatisticsRecord);
+}
+
+/*
+ * Map a binary statistics file just opened by restartLog(): continue
+ * after the records already in it, or start it with a header if empty
+ */
+Boolean
+statsFileOpen(LogFileHandler *handler)
+{
+
+	int fd = fileno(handler->logFP);
+	struct stat st;
+	StatisticsFileHeader header;
+	size_t used = sizeof(StatisticsFileHeader);
+
+	handler->map = NULL;
+	handler->mapSize = 0;
+
+	if(fstat(fd, &st) == -1) {
+		PERROR("Could not stat %s file", handler->logID);
+		return FALSE;
+	}
+
+	if(st.st_size > 0) {
+		if((st.st_size < sizeof(header)) ||
+		    (pread(fd, &header, sizeof(header), 0) != sizeof(header)) ||
+		    !statsFileHeaderValid(&header) || (header.flags != STATSFILE_FLAGS)) {
+			ERROR("%s file %s is not a binary statistics file written by this version of "PTPD_PROGNAME
+				" - not overwriting it (see global:statistics_file_truncate)\n",
+				handler->logID, handler->logPath);
+			return FALSE;
+		}
+		used = header.headerSize + header.records * header.recordSize;
+		if(used > st.st_size) {
+			WARNING("%s file %s is shorter than its record count - truncated?\n",
+				handler->logID, handler->logPath);
+			used = header.headerSize + ((st.st_size - header.headerSize) / header.recordSize) * header.recordSize;
+		}
+	}
+
+	if(!statsFileMap(handler, statsFileChunks(used + sizeof(StatisticsRecord)))) {
+		return FALSE;
+	}
+
+	if(st.st_size == 0) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, STATSFILE_MAGIC, sizeof(header.magic));
+		header.version = STATSFILE_VERSION;
+		header.headerSize = sizeof(StatisticsFileHeader);
+		header.recordSize = sizeof(StatisticsRecord);
+		header.flags = STATSFILE_FLAGS;
+		memcpy(handler->map, &header, sizeof(header));
+	} else {
+		/* the record count may have been clamped above */
+		((StatisticsFileHeader*)handler->map)->records = (used - sizeof(header)) / sizeof(StatisticsRecord);
+	}
+
+	handler->fileSize = used;
+	return TRUE;
+
+}
+
+/* Unmap a binary statistics file and cut off the preallocated space after the last record */
+void
+statsFileClose(LogFileHandler *handler)
+{
+
+	if(handler->map == NULL) {
+		return;
+	}
+
+	munmap(handler->map, handler->mapSize);
+	handler->map = NULL;
+	handler->mapSize = 0;
+
+	if(handler->logFP != NULL && ftruncate(fileno(handler->logFP), handler->fileSize) == -1) {
+		DBG("Could not trim %s file: %s\n", handler->logID, strerror(errno));
+	}
+
+}
+
+/* Append a record, growing the file by another chunk if needed */
+Boolean
+statsFileWrite(LogFileHandler *handler, const StatisticsRecord *record)
+{
+
+	if(handler->map == NULL) {
+		return FALSE;
+	}
+
+	if((handler->fileSize + sizeof(StatisticsRecord) > handler->mapSize) &&
+	    !statsFileMap(handler, handler->mapSize + STATSFILE_CHUNK)) {
+		return FALSE;
+	}
+
+	memcpy(handler->map + handler->fileSize, record, sizeof(StatisticsRecord));
+	handler->fileSize += sizeof(StatisticsRecord);
+	((StatisticsFileHeader*)handler->map)->records++;
+
+	return TRUE;
+
+}
+
+/* Print a binary statistics file as CSV. Returns the number of records converted, -1 on error */
+int
+statsFileConvert(const char *path, FILE *out)
+{
+
+	int fd;
+	struct stat st;
+	Octet *map;
+	StatisticsFileHeader header;
+	StatisticsRecord record;
+	char line[SCREEN_BUFSZ * 2];
+	uint64_t i, count;
+	int len;
+
+	if((fd = open(path, O_RDONLY)) == -1) {
+		fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if((fstat(fd, &st) == -1) || (st.st_size < sizeof(header))) {
+		fprintf(stderr, "%s is not a binary statistics file\n", path);
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		fprintf(stderr, "Could not map %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	memcpy(&header, map, sizeof(header));
+	if(!statsFileHeaderValid(&header)) {
+		fprintf(stderr, "%s is not a binary statistics file, or was written by a different version "
+				"or on a machine of different byte order\n", path);
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	count = (st.st_size - header.headerSize) / header.recordSize;
+	if(header.records < count) {
+		count = header.records;
+	}
+
+	for(i = 0; i < count; i++) {
+		memcpy(&record, map + header.headerSize + i * header.recordSize, sizeof(record));
+		if(i == 0) {
+			len = snprint_StatisticsHeader(line, sizeof(line), record.timestampFormat, header.flags);
+			fwrite(line, 1, len < sizeof(line) ? len : sizeof(line) - 1, out);
+		}
+		len = snprint_StatisticsRecord(line, sizeof(line), &record, header.flags);
+		fwrite(line, 1, len < sizeof(line) ? len : sizeof(line) - 1, out);
+	}
+
+	munmap(map, st.st_size);
+	return count;
+
+}
+
+#else
+
+Boolean
+statsFileOpen(LogFileHandler *handler)
+{
+	ERROR("Binary %s file not supported on this system (no mmap)\n", handler->logID);
+	return FALSE;
+}
+
+void
+statsFileClose(LogFileHandler *handler)
+{
+}
+
+Boolean
+statsFileWrite(LogFileHandler *handler, const StatisticsRecord *record)
+{
+	return FALSE;
+}
+
+int
+statsFileConvert(const char *path, FILE *out)
+{
+	fprintf(stderr, "Binary statistics files not supported on this system (no mmap)\n");
+	return -1;
+}
+
+#endif /* HAVE_SYS_MMAN_H */
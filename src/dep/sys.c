@@ -98,7 +98,7 @@ static Boolean tDataUpdated = FALSE;
 */
 char *dump_TimeInternal(const TimeInternal * p)
 {
-	static char buf[100];
+	static PTPD_THREAD_LOCAL char buf[100];
 
 	snprint_TimeInternal(buf, 100, p);
 	return buf;
@@ -111,7 +111,7 @@ char *dump_TimeInternal(const TimeInternal * p)
 */
 char *dump_TimeInternal2(const char *st1, const TimeInternal * p1, const char *st2, const TimeInternal * p2)
 {
-	static char buf[BUF_SIZE];
+	static PTPD_THREAD_LOCAL char buf[BUF_SIZE];
 	int n = 0;
 
 	/* display Timestamps */
@@ -158,7 +158,7 @@ snprint_TimeInternal(char *s, int max_len, const TimeInternal * p)
 /* debug aid: convert a time variable into a static char */
 char *time2st(const TimeInternal * p)
 {
-	static char buf[1000];
+	static PTPD_THREAD_LOCAL char buf[1000];
 
 	snprint_TimeInternal(buf, sizeof(buf), p);
 	return buf;
@@ -173,16 +173,17 @@ void DBG_time(const char *name, const TimeInternal  p)
 }
 
 
-char *
-translatePortState(PtpClock *ptpClock)
+/* short port state name used in log and statistics lines */
+static char *
+portStateTag(Enumeration8 portState, int resetCount)
 {
 	char *s;
-	switch(ptpClock->portDS.portState) {
+	switch(portState) {
 	    case PTP_INITIALIZING:  s = "init";  break;
 	    case PTP_FAULTY:        s = "flt";   break;
 	    case PTP_LISTENING:
 		    /* seperate init-reset from real resets */
-		    if(ptpClock->resetCount == 1){
+		    if(resetCount == 1){
 		    	s = "lstn_init";
 		    } else {
 		    	s = "lstn_reset";
@@ -199,6 +200,12 @@ translatePortState(PtpClock *ptpClock)
 	return s;
 }
 
+char *
+translatePortState(PtpClock *ptpClock)
+{
+	return portStateTag(ptpClock->portDS.portState, ptpClock->resetCount);
+}
+
 
 int
 snprint_ClockIdentity(char *s, int max_len, const ClockIdentity id)
@@ -252,9 +259,9 @@ snprint_ClockIdentity_mac(char *s, int max_len, const ClockIdentity id)
  */
 int ether_ntohost_cache(char *hostname, struct ether_addr *addr)
 {
-	static int valid = 0;
-	static struct ether_addr prev_addr;
-	static char buf[BUF_SIZE];
+	static PTPD_THREAD_LOCAL int valid = 0;
+	static PTPD_THREAD_LOCAL struct ether_addr prev_addr;
+	static PTPD_THREAD_LOCAL char buf[BUF_SIZE];
 
 #ifdef HAVE_STRUCT_ETHER_ADDR_OCTET
 	if (memcmp(addr->octet, &prev_addr,
@@ -333,25 +340,22 @@ snprint_PortIdentity(char *s, int max_len, const PortIdentity *id)
 	return len;
 }
 
-/* Write a formatted string to file pointer */
-int writeMessage(FILE* destination, uint32_t *lastHash, int priority, const char * format, va_list ap) {
-
+/* Write a message already formatted by logMessage() to file pointer, prefixed with its timestamp, interface and port state */
+static int
+writeMessage(FILE* destination, uint32_t *lastHash, int priority, const struct timeval *when,
+		const char *state, const char *iface, const char * message, int length)
+{
 
 	extern RunTimeOpts rtOpts;
 	extern Boolean startupInProgress;
 
-	int written;
 	char time_str[MAXTIMESTR];
-	struct timeval now;
+	struct tm tm;
+	time_t seconds;
 #ifndef RUNTIME_DEBUG
-	char buf[PATH_MAX +1];
 	uint32_t hash;
-	va_list ap1;
 #endif /* RUNTIME_DEBUG */
 
-	extern char *translatePortState(PtpClock *ptpClock);
-	extern PtpClock *G_ptpClock;
-
 	if(destination == NULL)
 		return -1;
 
@@ -363,19 +367,16 @@ int writeMessage(FILE* destination, uint32_t *lastHash, int priority, const char
 		}
 
 #ifndef RUNTIME_DEBUG
-	/* check if this message produces the same hash as last */
-	memset(buf, 0, sizeof(buf));
-	va_copy(ap1, ap);
-	vsnprintf(buf, PATH_MAX, format, ap1);
-	hash = fnvHash(buf, sizeof(buf), 0);
-	if(lastHash != NULL) {
-	    if(format[0] != '\n' && lastHash != NULL) {
-		    /* last message was the same - don't print the next one */
-		    if( (lastHash != 0) && (hash == *lastHash)) {
-		    return 0;
+	/* check if this message produces the same hash as last - only the bytes produced are hashed */
+	if(lastHash != NULL && message[0] != '\n') {
+		hash = fnvHash((void*)message, length, 0);
+		/* the same message from another boundary clock port is not a repeat */
+		hash ^= fnvHash((void*)iface, strlen(iface), 0);
+		/* last message was the same - don't print the next one */
+		if((*lastHash != 0) && (hash == *lastHash)) {
+			return 0;
 		}
-	    }
-	    *lastHash = hash;
+		*lastHash = hash;
 	}
 #endif /* RUNTIME_DEBUG */
 
@@ -387,11 +388,11 @@ int writeMessage(FILE* destination, uint32_t *lastHash, int priority, const char
 		 * it also can cause problems in nested debug statements (which are solved by turning the signal
 		 *  handling synchronous, and not calling this function inside asycnhronous signal processing)
 		 */
-		gettimeofday(&now, 0);
-		strftime(time_str, MAXTIMESTR, "%F %X", localtime((time_t*)&now.tv_sec));
-		fprintf(destination, "%s.%06d ", time_str, (int)now.tv_usec  );
-		fprintf(destination,PTPD_PROGNAME"[%d].%s (%-9s ",
-		(int)getpid(), startupInProgress ? "startup" : rtOpts.ifaceName,
+		seconds = when->tv_sec;
+		strftime(time_str, MAXTIMESTR, "%F %X", localtime_r(&seconds, &tm));
+		return fprintf(destination, "%s.%06d "PTPD_PROGNAME"[%d].%s (%-9s  (%s) %s",
+		time_str, (int)when->tv_usec,
+		(int)getpid(), iface,
 		priority == LOG_EMERG   ? "emergency)" :
 		priority == LOG_ALERT   ? "alert)" :
 		priority == LOG_CRIT    ? "critical)" :
@@ -402,17 +403,15 @@ int writeMessage(FILE* destination, uint32_t *lastHash, int priority, const char
 		priority == LOG_DEBUG   ? "debug1)" :
 		priority == LOG_DEBUG2  ? "debug2)" :
 		priority == LOG_DEBUGV  ? "debug3)" :
-		"unk)");
-
-
-		fprintf(destination, " (%s) ", G_ptpClock ?
-		       translatePortState(G_ptpClock) : "___");
+		"unk)",
+		state, message);
 	}
-	written = vfprintf(destination, format, ap);
-	return written;
+
+	return fwrite(message, 1, length, destination);
 
 }
 
+/* Re-read the log file size from the file system - otherwise it is tracked as we write */
 void
 updateLogSize(LogFileHandler* handler)
 {
@@ -420,6 +419,9 @@ updateLogSize(LogFileHandler* handler)
 	struct stat st;
 	if(handler->logFP == NULL)
 		return;
+	/* binary statistics files are preallocated: only the tracked size is meaningful */
+	if(handler->binary)
+		return;
 	if (fstat(fileno(handler->logFP), &st) != -1) {
 		handler->fileSize = st.st_size;
 	} else {
@@ -431,36 +433,34 @@ updateLogSize(LogFileHandler* handler)
 
 }
 
+/* Account for bytes written to a log file */
+static void
+logWritten(LogFileHandler* handler, int written)
+{
+
+	if(written > 0)
+		handler->fileSize += written;
+
+}
+
 
 /*
- * Prints a message, randing from critical to debug.
- * This either prints the message to syslog, or with timestamp+state to stderr
+ * Send a formatted message to the log file, syslog and / or stderr.
+ * Called by logMessage(), or by the writer thread with asynchronous logging.
  */
-void
-logMessage(int priority, const char * format, ...)
+static void
+dispatchMessage(int priority, const struct timeval *when, const char *state, const char *iface, const char * message, int length)
 {
 	extern RunTimeOpts rtOpts;
 	extern Boolean startupInProgress;
-	va_list ap , ap1;
-
-	va_copy(ap1, ap);
-	va_start(ap1, format);
-	va_start(ap, format);
-
-#ifdef RUNTIME_DEBUG
-	if ((priority >= LOG_DEBUG) && (priority > rtOpts.debug_level)) {
-		goto end;
-	}
-#endif
+	int written;
+	Boolean wroteLog = FALSE;
 
-	/* log level filter */
-	if(priority > rtOpts.logLevel) {
-	    goto end;
-	}
 	/* If we're using a log file and the message has been written OK, we're done*/
 	if(rtOpts.eventLog.logEnabled && rtOpts.eventLog.logFP != NULL) {
-	    if(writeMessage(rtOpts.eventLog.logFP, &rtOpts.eventLog.lastHash, priority, format, ap) > 0) {
-		maintainLogSize(&rtOpts.eventLog);
+	    if((written = writeMessage(rtOpts.eventLog.logFP, &rtOpts.eventLog.lastHash, priority, when, state, iface, message, length)) > 0) {
+		logWritten(&rtOpts.eventLog, written);
+		wroteLog = TRUE;
 		if(!startupInProgress)
 		    goto end;
 		else {
@@ -492,7 +492,7 @@ logMessage(int priority, const char * format, ...)
 			openlog(PTPD_PROGNAME, LOG_PID, LOG_DAEMON);
 			syslogOpened = TRUE;
 		}
-		vsyslog(priority, format, ap);
+		syslog(priority, "%s", message);
 		if (!startupInProgress) {
 			goto end;
 		}
@@ -504,14 +504,146 @@ logMessage(int priority, const char * format, ...)
 std_err:
 
 	/* Either all else failed or we're running in foreground - or we also log to stderr */
-	writeMessage(stderr, &rtOpts.eventLog.lastHash, priority, format, ap1);
+	writeMessage(stderr, &rtOpts.eventLog.lastHash, priority, when, state, iface, message, length);
 
 end:
-	va_end(ap1);
+	/* rotating may log messages itself, so only once this one is out everywhere */
+	if(wroteLog)
+		maintainLogSize(&rtOpts.eventLog);
+
+}
+
+/*
+ * Prints a message, randing from critical to debug.
+ * This either prints the message to syslog, or with timestamp+state to stderr
+ */
+void
+logMessage(int priority, const char * format, ...)
+{
+	extern RunTimeOpts rtOpts;
+	extern PTPD_THREAD_LOCAL PtpClock *G_ptpClock;
+	extern char *translatePortState(PtpClock *ptpClock);
+	extern Boolean startupInProgress;
+	va_list ap;
+	char *message = rtOpts.eventLog.lineBuf;
+	int size = sizeof(rtOpts.eventLog.lineBuf);
+	int length;
+	struct timeval now;
+	const char *state;
+	const char *iface;
+#ifdef PTPD_ASYNC_LOG
+	Boolean queued = FALSE;
+#endif /* PTPD_ASYNC_LOG */
+
+#ifdef RUNTIME_DEBUG
+	if ((priority >= LOG_DEBUG) && (priority > rtOpts.debug_level)) {
+		return;
+	}
+#endif
+
+	/* log level filter */
+	if(priority > rtOpts.logLevel) {
+	    return;
+	}
+
+#ifdef PTPD_ASYNC_LOG
+	/* format straight into a queue slot - the writer thread does the rest */
+	if(asyncLogActive()) {
+	    if((message = asyncLogReserve(ASYNCLOG_EVENT, priority, &size)) == NULL)
+		return;
+	    queued = TRUE;
+	}
+#endif /* PTPD_ASYNC_LOG */
+
+	/* format once - all destinations write the same bytes */
+	va_start(ap, format);
+	length = vsnprintf(message, size, format, ap);
 	va_end(ap);
-	return;
+
+	if(length < 0)
+	    length = 0;
+	if(length >= size)
+	    length = size - 1;
+
+#ifdef PTPD_SIM
+	/* stamped with simulated time, so that repeated runs log the same */
+	{
+	    TimeInternal simNow;
+	    getTime(&simNow);
+	    now.tv_sec = simNow.seconds;
+	    now.tv_usec = simNow.nanoseconds / 1000;
+	}
+#else
+	gettimeofday(&now, 0);
+#endif /* PTPD_SIM */
+	state = G_ptpClock ? translatePortState(G_ptpClock) : "___";
+	/* with boundary clock ports, tag messages with the port being run */
+	iface = startupInProgress ? "startup" :
+		(G_ptpClock && G_ptpClock->rtOpts) ? G_ptpClock->rtOpts->ifaceName : rtOpts.ifaceName;
+
+#ifdef PTPD_ASYNC_LOG
+	if(queued) {
+	    asyncLogCommit(length, &now, state, iface);
+	    return;
+	}
+#endif /* PTPD_ASYNC_LOG */
+
+	dispatchMessage(priority, &now, state, iface, message, length);
+
 }
 
+#ifdef PTPD_ASYNC_LOG
+/* Queue a pre-formatted statistics or sync record line for the writer thread */
+static void
+queueLogRecord(int target, const char *text, int length)
+{
+	char *buf;
+	int size;
+
+	if((buf = asyncLogReserve(target, LOG_NOTICE, &size)) == NULL)
+		return;
+	if(length >= size)
+		length = size - 1;
+	memcpy(buf, text, length);
+	buf[length] = '\0';
+	asyncLogCommit(length, NULL, NULL, NULL);
+}
+
+/*
+ * Write out a record taken off the asynchronous log queue - called by the
+ * writer thread. Returns TRUE if the target file was rotated or truncated.
+ */
+Boolean
+writeLogRecord(int target, int priority, const struct timeval *when, const char *state, const char *iface, const char *text, int length)
+{
+	extern RunTimeOpts rtOpts;
+	LogFileHandler *handler;
+
+	switch(target) {
+	    case ASYNCLOG_EVENT:
+		dispatchMessage(priority, when, state, iface, text, length);
+		return FALSE;
+	    case ASYNCLOG_STATISTICS:
+		handler = &rtOpts.statisticsLog;
+		if(!handler->logEnabled || handler->logFP == NULL) {
+			fwrite(text, 1, length, stdout);
+			return FALSE;
+		}
+		break;
+	    case ASYNCLOG_RECORD:
+		handler = &rtOpts.recordLog;
+		if(!handler->logEnabled || handler->logFP == NULL)
+			return FALSE;
+		break;
+	    default:
+		return FALSE;
+	}
+
+	logWritten(handler, fwrite(text, 1, length, handler->logFP));
+	return maintainLogSize(handler);
+}
+#endif /* PTPD_ASYNC_LOG */
+
 
 /* Restart a file log target based on its settings  */
 int
@@ -521,6 +653,8 @@ restartLog(LogFileHandler* handler, Boolean quiet)
         /* The FP is open - close it */
         if(handler->logFP != NULL) {
 		handler->lastHash=0;
+		if(handler->binary)
+			statsFileClose(handler);
                 fclose(handler->logFP);
 		/*
 		 * fclose doesn't do this at least on Linux - changes the underlying FD to -1,
@@ -551,6 +685,12 @@ restartLog(LogFileHandler* handler, Boolean quiet)
 		}
 		/* \n flushes output for us, no need for fflush() - if you want something different, set it later */
                 setlinebuf(handler->logFP);
+		/* from here on the size is tracked as we write */
+		updateLogSize(handler);
+		if(handler->binary && !statsFileOpen(handler)) {
+			fclose(handler->logFP);
+			handler->logFP = NULL;
+		}
 
 	}
         return (handler->logFP != NULL);
@@ -561,6 +701,8 @@ static int
 closeLog(LogFileHandler* handler)
 {
         if(handler->logFP != NULL) {
+		if(handler->binary)
+			statsFileClose(handler);
                 fclose(handler->logFP);
 		handler->logFP=NULL;
 		return 1;
@@ -579,11 +721,14 @@ maintainLogSize(LogFileHandler* handler)
 	if(handler->maxSize) {
 		if(handler->logFP == NULL)
 		    return FALSE;
-		updateLogSize(handler);
 #ifdef RUNTIME_DEBUG
 /* 2.3.1: do not print to stderr or log file */
 //		fprintf(stderr, "%s logsize: %d\n", handler->logID, handler->fileSize);
 #endif /* RUNTIME_DEBUG */
+		/* tracked size is over the limit - confirm, the file may have been truncated externally */
+		if(handler->fileSize > (handler->maxSize * 1024)) {
+			updateLogSize(handler);
+		}
 		if(handler->fileSize > (handler->maxSize * 1024)) {
 
 		    /* Rotate the log file */
@@ -622,15 +767,23 @@ maintainLogSize(LogFileHandler* handler)
 		    /* Just truncate - maxSize given but no maxFiles */
 		    } else {
 
+			if(handler->binary)
+				statsFileClose(handler);
 			if(!ftruncate(fileno(handler->logFP),0)) {
-			INFO("Truncating %s file - size above %dkB\n",
-				handler->logID, handler->maxSize);
+				handler->fileSize = 0;
+				INFO("Truncating %s file - size above %dkB\n",
+					handler->logID, handler->maxSize);
 			} else {
 #ifdef RUNTIME_DEBUG
 /* 2.3.1: do not print to stderr or log file */
 //				fprintf(stderr, "Could not truncate %s file\n", handler->logPath);
 #endif
 			}
+			/* start over with a new header */
+			if(handler->binary && !statsFileOpen(handler)) {
+				fclose(handler->logFP);
+				handler->logFP = NULL;
+			}
 			return TRUE;
 		    }
 		}
@@ -644,6 +797,12 @@ void
 restartLogging(RunTimeOpts* rtOpts)
 {
 
+	/* the statistics file has to be closed in the format it was opened with */
+	if(rtOpts->statisticsLog.binary != (rtOpts->statisticsFormat == STATSFILE_BINARY)) {
+		closeLog(&rtOpts->statisticsLog);
+		rtOpts->statisticsLog.binary = (rtOpts->statisticsFormat == STATSFILE_BINARY);
+	}
+
 	if(!restartLog(&rtOpts->statisticsLog, TRUE))
 		NOTIFY("Failed logging to %s file\n", rtOpts->statisticsLog.logID);
 
@@ -667,18 +826,192 @@ stopLogging(RunTimeOpts* rtOpts)
 	closeLog(&rtOpts->statusLog);
 }
 
+/* Statistics log column header line, matching snprint_StatisticsRecord() */
+int
+snprint_StatisticsHeader(char *s, int max_len, int timestampFormat, UInteger32 flags)
+{
+	return snprintf(s, max_len, "# %s, State, Clock ID, One Way Delay, "
+		       "Offset From Master, Slave to Master, "
+		       "Master to Slave, Observed Drift, Last packet Received, Sequence ID"
+			"%s, Drift Estimate, Drift Estimate Std Err"
+			"\n", (timestampFormat == TIMESTAMP_BOTH) ? "Timestamp, Unix timestamp" : "Timestamp",
+			(flags & STATSFILE_FLAG_STATISTICS) ?
+			", One Way Delay Mean, One Way Delay Std Dev, Offset From Master Mean, Offset From Master Std Dev, Observed Drift Mean, Observed Drift Std Dev, raw delayMS, raw delaySM" : "");
+}
+
+/* Format a statistics log entry as a CSV line */
+int
+snprint_StatisticsRecord(char *s, int max_len, const StatisticsRecord *record, UInteger32 flags)
+{
+	int len = 0;
+	time_t time_s = record->timestamp.seconds;
+	struct tm tm;
+	char time_str[MAXTIMESTR];
+	const char *state = portStateTag(record->portState, record->resetCount);
+
+	/* output date-time timestamp if configured */
+	if (record->timestampFormat == TIMESTAMP_DATETIME ||
+	    record->timestampFormat == TIMESTAMP_BOTH) {
+	    strftime(time_str, MAXTIMESTR, "%Y-%m-%d %X", localtime_r(&time_s, &tm));
+	    len += snprintf(s + len, max_len - len, "%s.%06d, %s, ",
+		       time_str, (int)record->timestamp.nanoseconds/1000, /* Timestamp */
+		       state); /* State */
+	}
+
+	/* output unix timestamp s.ns if configured */
+	if (record->timestampFormat == TIMESTAMP_UNIX ||
+	    record->timestampFormat == TIMESTAMP_BOTH) {
+	    len += snprintf(s + len, max_len - len, "%d.%06d, %s,",
+		       record->timestamp.seconds, record->timestamp.nanoseconds, /* Timestamp */
+		       state); /* State */
+	}
+
+	if (record->portState == PTP_SLAVE) {
+		len += snprint_PortIdentity(s + len, max_len - len,
+			 &record->parentPortIdentity); /* Clock ID */
+
+		/*
+		 * if grandmaster ID differs from parent port ID then
+		 * also print GM ID
+		 */
+		if (memcmp(record->grandmasterIdentity,
+			   record->parentPortIdentity.clockIdentity,
+			   CLOCK_IDENTITY_LENGTH)) {
+			len += snprint_ClockIdentity(s + len,
+						     max_len - len,
+						     record->grandmasterIdentity);
+		}
+
+		len += snprintf(s + len, max_len - len, ", ");
+
+		len += snprint_TimeInternal(s + len, max_len - len,
+					    &record->meanPathDelay);
+
+		len += snprintf(s + len, max_len - len, ", ");
+
+		len += snprint_TimeInternal(s + len, max_len - len,
+		    &record->offsetFromMaster);
+
+		/* print MS and SM with sign */
+		len += snprintf(s + len, max_len - len, ", ");
+
+		len += snprint_TimeInternal(s + len, max_len - len,
+						&record->delaySM);
+
+		len += snprintf(s + len, max_len - len, ", ");
+
+		len += snprint_TimeInternal(s + len, max_len - len,
+				&record->delayMS);
+
+		len += snprintf(s + len, max_len - len, ", %.09f, %c, %05d",
+			       record->observedDrift,
+			       record->lastMessage,
+			       record->sequenceId);
+
+		if(flags & STATSFILE_FLAG_STATISTICS) {
+
+		len += snprintf(s + len, max_len - len, ", %.09f, %.00f, %.09f, %.00f",
+			       record->mpdMean,
+			       record->mpdStdDev * 1E9,
+			       record->ofmMean,
+			       record->ofmStdDev * 1E9);
+
+		len += snprintf(s + len, max_len - len, ", %.0f, %.0f, ",
+			       record->driftMean,
+			       record->driftStdDev);
+
+		len += snprint_TimeInternal(s + len, max_len - len,
+							&record->rawDelayMS);
+
+		len += snprintf(s + len, max_len - len, ", ");
+
+		len += snprint_TimeInternal(s + len, max_len - len,
+							&record->rawDelaySM);
+
+		}
+
+		len += snprintf(s + len, max_len - len, ", %.03f, %.03f",
+			       record->driftEstimate,
+			       record->driftEstimateError);
+
+	} else {
+		if ((record->portState == PTP_MASTER) || (record->portState == PTP_PASSIVE)) {
+
+			len += snprint_PortIdentity(s + len, max_len - len,
+				 &record->parentPortIdentity);
+		}
+
+		/* show the current reset number on the log */
+		if (record->portState == PTP_LISTENING) {
+			len += snprintf(s + len,
+						     max_len - len,
+						     " %d ", record->resetCount);
+		}
+	}
+
+	/* add final \n in normal status lines */
+	len += snprintf(s + len, max_len - len, "\n");
+
+	return len;
+}
+
+/* Take a statistics log entry from the current state of the clock */
+static void
+getStatisticsRecord(const PtpClock *ptpClock, const RunTimeOpts *rtOpts, const TimeInternal *now, StatisticsRecord *record)
+{
+
+	memset(record, 0, sizeof(StatisticsRecord));
+
+	record->timestamp = *now;
+	record->timestampFormat = rtOpts->statisticsTimestamp;
+	record->portState = ptpClock->portDS.portState;
+	record->resetCount = ptpClock->resetCount;
+	record->parentPortIdentity = ptpClock->parentDS.parentPortIdentity;
+	memcpy(record->grandmasterIdentity, ptpClock->parentDS.grandmasterIdentity, CLOCK_IDENTITY_LENGTH);
+
+	if(rtOpts->delayMechanism == E2E) {
+		record->meanPathDelay = ptpClock->currentDS.meanPathDelay;
+		record->delaySM = ptpClock->delaySM;
+	} else {
+		record->meanPathDelay = ptpClock->portDS.peerMeanPathDelay;
+		record->delaySM = ptpClock->pdelaySM;
+	}
+	record->offsetFromMaster = ptpClock->currentDS.offsetFromMaster;
+	record->delayMS = ptpClock->delayMS;
+	record->observedDrift = ptpClock->servo.observedDrift;
+	record->lastMessage = ptpClock->char_last_msg;
+	record->sequenceId = ptpClock->msgTmpHeader.sequenceId;
+	if(ptpClock->servo.type == SERVO_LINREG && ptpClock->servo.linreg.valid) {
+		record->driftEstimate = ptpClock->servo.linreg.drift;
+		record->driftEstimateError = ptpClock->servo.linreg.driftError;
+	}
+
+#ifdef PTPD_STATISTICS
+	record->mpdMean = ptpClock->slaveStats.mpdMean;
+	record->mpdStdDev = ptpClock->slaveStats.mpdStdDev;
+	record->ofmMean = ptpClock->slaveStats.ofmMean;
+	record->ofmStdDev = ptpClock->slaveStats.ofmStdDev;
+	record->driftMean = ptpClock->servo.driftMean;
+	record->driftStdDev = ptpClock->servo.driftStdDev;
+	record->rawDelayMS = ptpClock->rawDelayMS;
+	record->rawDelaySM = ptpClock->rawDelaySM;
+#endif /* PTPD_STATISTICS */
+
+}
+
 void
 logStatistics(PtpClock * ptpClock)
 {
 	extern RunTimeOpts rtOpts;
-	static int errorMsg = 0;
-	static char sbuf[SCREEN_BUFSZ * 2];
+	static PTPD_THREAD_LOCAL int errorMsg = 0;
+	static PTPD_THREAD_LOCAL char sbuf[SCREEN_BUFSZ * 2];
 	int len = 0;
+	int written = 0;
 	TimeInternal now;
-	time_t time_s;
 	FILE* destination;
-	static TimeInternal prev_now_sync, prev_now_delay;
-	char time_str[MAXTIMESTR];
+	static PTPD_THREAD_LOCAL TimeInternal prev_now_sync, prev_now_delay;
+	StatisticsRecord record;
+	Boolean binary;
 
 	if (!rtOpts.logStatistics) {
 		return;
@@ -689,19 +1022,33 @@ logStatistics(PtpClock * ptpClock)
 	else
 	    destination = stdout;
 
+	/* binary records are a memory copy - they never go through the async log queue */
+	binary = (destination == rtOpts.statisticsLog.logFP) && rtOpts.statisticsLog.binary;
+
+#ifdef PTPD_ASYNC_LOG
+	/* the writer thread rotated the statistics file - start the new one with a header */
+	if(asyncLogActive() && asyncLogRotated(ASYNCLOG_STATISTICS))
+		ptpClock->resetStatisticsLog = TRUE;
+#endif /* PTPD_ASYNC_LOG */
+
 	if (ptpClock->resetStatisticsLog) {
 		ptpClock->resetStatisticsLog = FALSE;
-		fprintf(destination,"# %s, State, Clock ID, One Way Delay, "
-		       "Offset From Master, Slave to Master, "
-		       "Master to Slave, Observed Drift, Last packet Received, Sequence ID"
-#ifdef PTPD_STATISTICS
-			", One Way Delay Mean, One Way Delay Std Dev, Offset From Master Mean, Offset From Master Std Dev, Observed Drift Mean, Observed Drift Std Dev, raw delayMS, raw delaySM"
-#endif
-			"\n", (rtOpts.statisticsTimestamp == TIMESTAMP_BOTH) ? "Timestamp, Unix timestamp" : "Timestamp");
+		/* binary files carry their own header */
+		if(!binary) {
+		len = snprint_StatisticsHeader(sbuf, sizeof(sbuf), rtOpts.statisticsTimestamp, STATSFILE_FLAGS);
+#ifdef PTPD_ASYNC_LOG
+		if(asyncLogActive()) {
+			queueLogRecord(ASYNCLOG_STATISTICS, sbuf, len);
+		} else
+#endif /* PTPD_ASYNC_LOG */
+		{
+			written = fprintf(destination, "%s", sbuf);
+			if(destination == rtOpts.statisticsLog.logFP)
+				logWritten(&rtOpts.statisticsLog, written);
+		}
+		}
 	}
 
-	memset(sbuf, 0, sizeof(sbuf));
-
 	getTime(&now);
 
 	/*
@@ -709,7 +1056,7 @@ logStatistics(PtpClock * ptpClock)
 	 */
 
 	if ((ptpClock->portDS.portState == PTP_SLAVE) && (rtOpts.statisticsLogInterval)) {
-			
+
 		switch(ptpClock->char_last_msg) {
 			case 'S':
 			if((now.seconds - prev_now_sync.seconds) < rtOpts.statisticsLogInterval){
@@ -730,118 +1077,19 @@ logStatistics(PtpClock * ptpClock)
 		}
 	}
 
-	time_s = now.seconds;
-
-	/* output date-time timestamp if configured */
-	if (rtOpts.statisticsTimestamp == TIMESTAMP_DATETIME ||
-	    rtOpts.statisticsTimestamp == TIMESTAMP_BOTH) {
-	    strftime(time_str, MAXTIMESTR, "%Y-%m-%d %X", localtime(&time_s));
-	    len += snprintf(sbuf + len, sizeof(sbuf) - len, "%s.%06d, %s, ",
-		       time_str, (int)now.nanoseconds/1000, /* Timestamp */
-		       translatePortState(ptpClock)); /* State */
-	}
-
-	/* output unix timestamp s.ns if configured */
-	if (rtOpts.statisticsTimestamp == TIMESTAMP_UNIX ||
-	    rtOpts.statisticsTimestamp == TIMESTAMP_BOTH) {
-	    len += snprintf(sbuf + len, sizeof(sbuf) - len, "%d.%06d, %s,",
-		       now.seconds, now.nanoseconds, /* Timestamp */
-		       translatePortState(ptpClock)); /* State */
-	}
-
-	if (ptpClock->portDS.portState == PTP_SLAVE) {
-		len += snprint_PortIdentity(sbuf + len, sizeof(sbuf) - len,
-			 &ptpClock->parentDS.parentPortIdentity); /* Clock ID */
+	getStatisticsRecord(ptpClock, &rtOpts, &now, &record);
 
-		/*
-		 * if grandmaster ID differs from parent port ID then
-		 * also print GM ID
-		 */
-		if (memcmp(ptpClock->parentDS.grandmasterIdentity,
-			   ptpClock->parentDS.parentPortIdentity.clockIdentity,
-			   CLOCK_IDENTITY_LENGTH)) {
-			len += snprint_ClockIdentity(sbuf + len,
-						     sizeof(sbuf) - len,
-						     ptpClock->parentDS.grandmasterIdentity);
-		}
-
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", ");
-
-		if(rtOpts.delayMechanism == E2E) {
-			len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-						    &ptpClock->currentDS.meanPathDelay);
-		} else {
-			len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-						    &ptpClock->portDS.peerMeanPathDelay);
-		}
-
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", ");
-
-		len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-		    &ptpClock->currentDS.offsetFromMaster);
-
-		/* print MS and SM with sign */
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", ");
-			
-		if(rtOpts.delayMechanism == E2E) {
-			len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-							&(ptpClock->delaySM));
-		} else {
-			len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-							&(ptpClock->pdelaySM));
-		}
-
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", ");
-
-		len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-				&(ptpClock->delayMS));
-
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", %.09f, %c, %05d",
-			       ptpClock->servo.observedDrift,
-			       ptpClock->char_last_msg,
-			       ptpClock->msgTmpHeader.sequenceId);
-
-#ifdef PTPD_STATISTICS
-
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", %.09f, %.00f, %.09f, %.00f",
-			       ptpClock->slaveStats.mpdMean,
-			       ptpClock->slaveStats.mpdStdDev * 1E9,
-			       ptpClock->slaveStats.ofmMean,
-			       ptpClock->slaveStats.ofmStdDev * 1E9);
-
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", %.0f, %.0f, ",
-			       ptpClock->servo.driftMean,
-			       ptpClock->servo.driftStdDev);
-
-		len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-							&(ptpClock->rawDelayMS));
-
-		len += snprintf(sbuf + len, sizeof(sbuf) - len, ", ");
-
-		len += snprint_TimeInternal(sbuf + len, sizeof(sbuf) - len,
-							&(ptpClock->rawDelaySM));
-
-#endif /* PTPD_STATISTICS */
-
-	} else {
-		if ((ptpClock->portDS.portState == PTP_MASTER) || (ptpClock->portDS.portState == PTP_PASSIVE)) {
-
-			len += snprint_PortIdentity(sbuf + len, sizeof(sbuf) - len,
-				 &ptpClock->parentDS.parentPortIdentity);
-							
-			//len += snprintf(sbuf + len, sizeof(sbuf) - len, ")");
-		}
-
-		/* show the current reset number on the log */
-		if (ptpClock->portDS.portState == PTP_LISTENING) {
-			len += snprintf(sbuf + len,
-						     sizeof(sbuf) - len,
-						     " %d ", ptpClock->resetCount);
+	if(binary) {
+		if(statsFileWrite(&rtOpts.statisticsLog, &record)) {
+			maintainLogSize(&rtOpts.statisticsLog);
+		} else if(!errorMsg) {
+			ERROR("Error while writing statistics\n");
+			errorMsg = TRUE;
 		}
+		return;
 	}
-	
-	/* add final \n in normal status lines */
-	len += snprintf(sbuf + len, sizeof(sbuf) - len, "\n");
+
+	len = snprint_StatisticsRecord(sbuf, sizeof(sbuf), &record, STATSFILE_FLAGS);
 
 #if 0   /* NOTE: Do we want this? */
 	if (rtOpts.nonDaemon) {
@@ -850,9 +1098,16 @@ logStatistics(PtpClock * ptpClock)
 	}
 #endif
 
+#ifdef PTPD_ASYNC_LOG
+	if(asyncLogActive()) {
+		queueLogRecord(ASYNCLOG_STATISTICS, sbuf, len < sizeof(sbuf) ? len : sizeof(sbuf) - 1);
+		return;
+	}
+#endif /* PTPD_ASYNC_LOG */
+
 	/* fprintf may get interrupted by a signal - silently retry once */
-	if (fprintf(destination, "%s", sbuf) < len) {
-	    if (fprintf(destination, "%s", sbuf) < len) {
+	if ((written = fprintf(destination, "%s", sbuf)) < len) {
+	    if ((written = fprintf(destination, "%s", sbuf)) < len) {
 		if(!errorMsg) {
 		    PERROR("Error while writing statistics");
 		}
@@ -861,6 +1116,7 @@ logStatistics(PtpClock * ptpClock)
 	}
 
 	if(destination == rtOpts.statisticsLog.logFP) {
+		logWritten(&rtOpts.statisticsLog, written);
 		if (maintainLogSize(&rtOpts.statisticsLog))
 			ptpClock->resetStatisticsLog = TRUE;
 	}
@@ -947,7 +1203,7 @@ void
 displayStatus(PtpClock *ptpClock, const char *prefixMessage)
 {
 
-	static char sbuf[SCREEN_BUFSZ];
+	static PTPD_THREAD_LOCAL char sbuf[SCREEN_BUFSZ];
 	char strAddr[MAXHOSTNAMELEN];
 	int len = 0;
 
@@ -979,8 +1235,10 @@ void
 writeStatusFile(PtpClock *ptpClock,const RunTimeOpts *rtOpts, Boolean quiet)
 {
 
-	char outBuf[2048];
+	/* setbuf() takes a buffer of BUFSIZ */
+	char outBuf[BUFSIZ];
 	char tmpBuf[200];
+	int stage;
 
 	int n = getAlarmSummary(NULL, 0, ptpClock->alarms, ALRM_MAX);
 	char alarmBuf[n];
@@ -1040,6 +1298,16 @@ writeStatusFile(PtpClock *ptpClock,const RunTimeOpts *rtOpts, Boolean quiet)
 		fprintf(out, 		STATUSPREFIX"  %d\n","PTP domain", ptpClock->defaultDS.domainNumber);
 	}
 	fprintf(out, 		STATUSPREFIX"  %s\n","Port state", portState_getName(ptpClock->portDS.portState));
+	if(ptpClock->ports != NULL) {
+	    int i;
+	    char portName[20];
+	    for(i = 1; i < ptpClock->ports->count; i++) {
+		snprintf(portName, sizeof(portName), "Port %d state", i + 1);
+		fprintf(out, 		STATUSPREFIX"  %s (%s)\n", portName,
+		    portState_getName(ptpClock->ports->portState[i]),
+		    ptpClock->ports->port[i]->rtOpts->primaryIfaceName);
+	    }
+	}
 	if(strlen(alarmBuf) > 0) {
 	    fprintf(out, 		STATUSPREFIX"  %s\n","Alarms", alarmBuf);
 	}
@@ -1149,14 +1417,18 @@ writeStatusFile(PtpClock *ptpClock,const RunTimeOpts *rtOpts, Boolean quiet)
 	if(rtOpts->noAdjust) {
 	    fprintf(out, ", read-only");
 	}
-#ifdef PTPD_STATISTICS	
 	else {
+	    fprintf(out, ", %s servo", servoName(&ptpClock->servo));
+#ifdef PTPD_STATISTICS
 	    if (rtOpts->servoStabilityDetection) {
 		fprintf(out, ", %s",
 		    ptpClock->servo.isStable ? "stabilised" : "not stabilised");
 	    }
-	}
+	    if (ptpClock->servo.adaptive) {
+		fprintf(out, ", gain x%.02f", ptpClock->servo.gain);
+	    }
 #endif /* PTPD_STATISTICS */
+	}
 	fprintf(out,"\n");
 
 
@@ -1180,6 +1452,15 @@ else {
 }
 	    fprintf(out,"\n");
 
+	if(ptpClock->servo.type == SERVO_LINREG) {
+	    fprintf(out, 		STATUSPREFIX" ","Drift estimate");
+	    if(ptpClock->servo.linreg.valid)
+		fprintf(out, "% .03f ppm, std err % .03f ppm, ",
+		    ptpClock->servo.linreg.drift / 1000.0,
+		    ptpClock->servo.linreg.driftError / 1000.0);
+	    fprintf(out, "%d samples\n", ptpClock->servo.linreg.count);
+	}
+
 
 	}
 
@@ -1280,6 +1561,28 @@ else {
 				    timingDomain.controlCount,
 				    timingDomain.controlCount > 1 ? " (!)":"");
 
+	if(ptpClock->holdover.state != HOLDOVER_DISABLED) {
+	    const HoldoverModel *holdover = &ptpClock->holdover;
+	    fprintf(out, 		STATUSPREFIX"  %s","Holdover", holdoverStateName(holdover->state));
+	    switch(holdover->state) {
+		case HOLDOVER_LEARNING:
+		    fprintf(out, ", %d samples", holdover->count);
+		    break;
+		case HOLDOVER_READY:
+		    fprintf(out, ", %.03f ppm, aging %.03f ppb/h, residual %.03f ppb, %d samples",
+			holdover->coeff[HOLDOVER_TERM_FREQUENCY] / 1000.0,
+			holdover->coeff[HOLDOVER_TERM_AGING] * 3600.0,
+			holdover->residual, holdover->count);
+		    break;
+		case HOLDOVER_ACTIVE:
+		    fprintf(out, " %.0f s, %.03f ppm, est. error %.0f ns",
+			holdover->lastUpdate - holdover->entered,
+			holdover->predicted / 1000.0, holdover->errorEstimate);
+		    break;
+	    }
+	    fprintf(out, "\n");
+	}
+
 	fprintf(out, 		STATUSPREFIX"  ","Performance");
 	fprintf(out,"Message RX %d/s, TX %d/s", ptpClock->counters.messageReceiveRate,
 						  ptpClock->counters.messageSendRate);
@@ -1293,6 +1596,29 @@ else {
 
 	fprintf(out,"\n");
 
+	if(ptpClock->latency.stages != NULL) {
+	    for(stage = 0; stage < LATENCY_STAGES; stage++) {
+		const LatencyHistogram *histogram = &ptpClock->latency.stages[stage];
+		if(!histogram->count) {
+		    continue;
+		}
+		snprintf(tmpBuf, sizeof(tmpBuf), "Latency %s", latencyStageName(stage));
+		fprintf(out, 		STATUSPREFIX"  %llu, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", tmpBuf,
+		    (unsigned long long)histogram->count,
+		    latencyHistogramPercentile(histogram, 50) / 1000.0,
+		    latencyHistogramPercentile(histogram, 99) / 1000.0,
+		    latencyHistogramPercentile(histogram, 99.9) / 1000.0,
+		    histogram->max / 1000.0);
+	    }
+	}
+
+#ifdef PTPD_ASYNC_LOG
+	if(asyncLogActive()) {
+	fprintf(out, 		STATUSPREFIX"  %lu\n","Log msgs dropped",
+	    (unsigned long)asyncLogDropped());
+	}
+#endif /* PTPD_ASYNC_LOG */
+
 	if ( ptpClock->portDS.portState == PTP_SLAVE ||
 	    ptpClock->defaultDS.clockQuality.clockClass == 255 ) {
 
@@ -1369,7 +1695,7 @@ else {
 void
 displayPortIdentity(PortIdentity *port, const char *prefixMessage)
 {
-	static char sbuf[SCREEN_BUFSZ];
+	static PTPD_THREAD_LOCAL char sbuf[SCREEN_BUFSZ];
 	int len = 0;
 
 	memset(sbuf, ' ', sizeof(sbuf));
@@ -1384,10 +1710,22 @@ void
 recordSync(UInteger16 sequenceId, TimeInternal * time)
 {
 	extern RunTimeOpts rtOpts;
+#ifdef PTPD_ASYNC_LOG
+	char line[64];
+	int len;
+
+	if (asyncLogActive()) {
+		len = snprintf(line, sizeof(line), "%d %llu\n", sequenceId,
+		  ((time->seconds * 1000000000ULL) + time->nanoseconds));
+		queueLogRecord(ASYNCLOG_RECORD, line, len);
+		return;
+	}
+#endif /* PTPD_ASYNC_LOG */
 	if (rtOpts.recordLog.logEnabled && rtOpts.recordLog.logFP != NULL) {
-		fprintf(rtOpts.recordLog.logFP, "%d %llu\n", sequenceId,
+		logWritten(&rtOpts.recordLog,
+		  fprintf(rtOpts.recordLog.logFP, "%d %llu\n", sequenceId,
 		  ((time->seconds * 1000000000ULL) + time->nanoseconds)
-		);
+		));
 		maintainLogSize(&rtOpts.recordLog);
 	}
 }
@@ -1438,6 +1776,9 @@ static const struct sigevent* timerIntHandler(void* data, int id) {
 }
 #endif
 
+/* ptpd2-sim brings its own clock: see src/sim/simclock.c */
+#ifndef PTPD_SIM
+
  void getTime(TimeInternal *time)
  {
 #ifdef __QNXNTO__
@@ -1497,7 +1838,11 @@ static const struct sigevent* timerIntHandler(void* data, int id) {
 #if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0)
 
 	struct timespec tp;
+#ifdef PTPD_PHC
+	if (clock_gettime(phcClockId(), &tp) < 0) {
+#else
 	if (clock_gettime(CLOCK_REALTIME, &tp) < 0) {
+#endif /* PTPD_PHC */
 		PERROR("clock_gettime() failed, exiting.");
 		exit(0);
 	}
@@ -1562,10 +1907,17 @@ setTime(TimeInternal * time)
 
 #if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0)
 
+#ifdef PTPD_PHC
+	if (clock_settime(phcClockId(), &tp) < 0) {
+		PERROR("Could not set time of %s", phcName());
+		return;
+	}
+#else
 	if (clock_settime(CLOCK_REALTIME, &tp) < 0) {
 		PERROR("Could not set system time");
 		return;
 	}
+#endif /* PTPD_PHC */
 
 #else
 
@@ -1577,8 +1929,13 @@ setTime(TimeInternal * time)
 
 	char timeStr[MAXTIMESTR];
 	strftime(timeStr, MAXTIMESTR, "%x %X", localtime(&tmpTs.tv_sec));
+#ifdef PTPD_PHC
+	WARNING("Stepped the %s to: %s.%d\n",
+	       phcName(), timeStr, time->nanoseconds);
+#else
 	WARNING("Stepped the system clock to: %s.%d\n",
 	       timeStr, time->nanoseconds);
+#endif /* PTPD_PHC */
 
 }
 
@@ -1654,6 +2011,8 @@ cleanup:
 
 #endif /* HAVE_LINUX_RTC_H */
 
+#endif /* PTPD_SIM */
+
 /* returns a double beween 0.0 and 1.0 */
 double
 getRand(void)
@@ -1852,9 +2211,12 @@ end:
 }
 
 
-/* Whole block of adjtimex() functions starts here - only for systems with sys/timex.h */
+/*
+ * Whole block of adjtimex() functions starts here - only for systems with sys/timex.h.
+ * ptpd2-sim adjusts its simulated clock instead, see src/sim/simclock.c
+ */
 
-#ifdef HAVE_SYS_TIMEX_H
+#if defined(HAVE_SYS_TIMEX_H) && !defined(PTPD_SIM)
 
 /*
  * Apply a tick / frequency shift to the kernel clock
@@ -1885,6 +2247,13 @@ adjFreq(double adj)
 		adj = -rtOpts.servoMaxPpb;
 	}
 
+#ifdef PTPD_PHC
+	/* a PHC has no tick - it takes the whole adjustment as frequency */
+	if(phcActive()) {
+		return phcAdjFreq(adj);
+	}
+#endif /* PTPD_PHC */
+
 /* Y U NO HAVE TICK? */
 #ifdef HAVE_STRUCT_TIMEX_TICK
 
@@ -1952,6 +2321,12 @@ getAdjFreq(void)
 
 	DBGV("getAdjFreq called\n");
 
+#ifdef PTPD_PHC
+	if(phcActive()) {
+		return phcGetAdjFreq();
+	}
+#endif /* PTPD_PHC */
+
 	memset(&t, 0, sizeof(t));
 	t.modes = 0;
 	adjtimex(&t);
@@ -2161,7 +2536,7 @@ setTimexFlags(int flags, Boolean quiet)
 	}
 }
 
-#endif /* SYS_TIMEX_H */
+#endif /* SYS_TIMEX_H && !PTPD_SIM */
 
 #define DRIFTFORMAT "%.0f"
 
@@ -0,0 +1,232 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   timerwheel.c
+ * @date   Tue Feb 16 21:04:37 2016
+ *
+ * @brief  Hierarchical timing wheel
+ *
+ * Level 0 holds entries due within the next 64 ticks, one slot per tick.
+ * Each higher level covers 64 times the span of the one below. Whenever
+ * a lower level wraps, the matching slot of the level above is cascaded
+ * down, so every entry is moved at most TIMERWHEEL_LEVELS - 1 times.
+ */
+
+#include "../ptpd.h"
+
+static void timerWheelAdd(TimerWheel *wheel, TimerWheelEntry *entry);
+static void timerWheelUnlink(TimerWheelEntry *entry);
+static void timerWheelCascade(TimerWheel *wheel, int level, int slot);
+
+/* put entry on the list for its expiry tick */
+static void
+timerWheelAdd(TimerWheel *wheel, TimerWheelEntry *entry)
+{
+
+	uint32_t delta = entry->expires - wheel->now;
+	TimerWheelEntry *head;
+	int level;
+
+	for(level = 0; level < TIMERWHEEL_LEVELS - 1; level++) {
+		if(delta < (1U << (TIMERWHEEL_BITS * (level + 1)))) {
+			break;
+		}
+	}
+
+	head = &wheel->slots[level][(entry->expires >> (TIMERWHEEL_BITS * level)) & TIMERWHEEL_MASK];
+
+	entry->prev = head->prev;
+	entry->next = head;
+	head->prev->next = entry;
+	head->prev = entry;
+
+}
+
+static void
+timerWheelUnlink(TimerWheelEntry *entry)
+{
+
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->next = NULL;
+	entry->prev = NULL;
+
+}
+
+/* re-add all entries from a higher level slot: they land on lower levels */
+static void
+timerWheelCascade(TimerWheel *wheel, int level, int slot)
+{
+
+	TimerWheelEntry *head = &wheel->slots[level][slot];
+	TimerWheelEntry list;
+	TimerWheelEntry *entry;
+
+	if(head->next == head) {
+		return;
+	}
+
+	/* detach the whole slot first - entries may be re-added to it */
+	list.next = head->next;
+	list.prev = head->prev;
+	list.next->prev = &list;
+	list.prev->next = &list;
+	head->next = head->prev = head;
+
+	while(list.next != &list) {
+		entry = list.next;
+		timerWheelUnlink(entry);
+		timerWheelAdd(wheel, entry);
+	}
+
+}
+
+void
+timerWheelInit(TimerWheel *wheel)
+{
+
+	int i, j;
+
+	wheel->now = 0;
+	wheel->count = 0;
+
+	for(i = 0; i < TIMERWHEEL_LEVELS; i++) {
+		for(j = 0; j < TIMERWHEEL_SLOTS; j++) {
+			wheel->slots[i][j].next = &wheel->slots[i][j];
+			wheel->slots[i][j].prev = &wheel->slots[i][j];
+		}
+	}
+
+}
+
+/* unschedule everything, leaving the entries free to be scheduled again */
+void
+timerWheelClear(TimerWheel *wheel)
+{
+
+	int i, j;
+	TimerWheelEntry *head;
+
+	for(i = 0; i < TIMERWHEEL_LEVELS; i++) {
+		for(j = 0; j < TIMERWHEEL_SLOTS; j++) {
+			head = &wheel->slots[i][j];
+			while(head->next != head) {
+				timerWheelUnlink(head->next);
+			}
+		}
+	}
+
+	wheel->count = 0;
+
+}
+
+/* (re)schedule entry to be due in the given number of ticks (minimum 1) */
+void
+timerWheelSchedule(TimerWheel *wheel, TimerWheelEntry *entry, uint32_t ticks)
+{
+
+	if(timerWheelScheduled(entry)) {
+		timerWheelUnlink(entry);
+	} else {
+		wheel->count++;
+	}
+
+	if(ticks < 1) {
+		ticks = 1;
+	}
+
+	if(ticks > TIMERWHEEL_MAX_TICKS) {
+		ticks = TIMERWHEEL_MAX_TICKS;
+	}
+
+	entry->expires = wheel->now + ticks;
+	timerWheelAdd(wheel, entry);
+
+}
+
+void
+timerWheelCancel(TimerWheel *wheel, TimerWheelEntry *entry)
+{
+
+	if(!timerWheelScheduled(entry)) {
+		return;
+	}
+
+	timerWheelUnlink(entry);
+	wheel->count--;
+
+}
+
+/*
+ * Advance the wheel by one tick and run the callback for every entry
+ * now due. Entries are unscheduled before the callback runs, so the
+ * callback may schedule them again. Returns the number of entries run.
+ */
+int
+timerWheelAdvance(TimerWheel *wheel, TimerWheelCallback callback, void *userData)
+{
+
+	int level;
+	int run = 0;
+	TimerWheelEntry *head;
+	TimerWheelEntry list;
+	TimerWheelEntry *entry;
+
+	wheel->now++;
+
+	/* cascade from each level whose lower neighbour just wrapped */
+	for(level = 1; level < TIMERWHEEL_LEVELS; level++) {
+		if((wheel->now >> (TIMERWHEEL_BITS * (level - 1))) & TIMERWHEEL_MASK) {
+			break;
+		}
+		timerWheelCascade(wheel, level, (wheel->now >> (TIMERWHEEL_BITS * level)) & TIMERWHEEL_MASK);
+	}
+
+	head = &wheel->slots[0][wheel->now & TIMERWHEEL_MASK];
+
+	if(head->next == head) {
+		return 0;
+	}
+
+	list.next = head->next;
+	list.prev = head->prev;
+	list.next->prev = &list;
+	list.prev->next = &list;
+	head->next = head->prev = head;
+
+	while(list.next != &list) {
+		entry = list.next;
+		timerWheelUnlink(entry);
+		wheel->count--;
+		run++;
+		callback(entry, userData);
+	}
+
+	return run;
+
+}
@@ -0,0 +1,74 @@
+#ifndef PTPDTIMERWHEEL_H_
+#define PTPDTIMERWHEEL_H_
+
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file    timerwheel.h
+ * @date    Tue Feb 16 21:04:37 2016
+ * Hierarchical timing wheel: O(1) scheduling and cancellation of
+ * events counted in ticks, each tick only touching the events due.
+ */
+
+#include <stdint.h>
+
+/* 4 levels of 64 slots: 64, 4096, 262144 and 16777216 ticks */
+#define TIMERWHEEL_BITS		6
+#define TIMERWHEEL_SLOTS	(1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_MASK		(TIMERWHEEL_SLOTS - 1)
+#define TIMERWHEEL_LEVELS	4
+/* longest delay that can be scheduled - anything longer is clamped */
+#define TIMERWHEEL_MAX_TICKS	((1U << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS)) - 1)
+
+typedef struct TimerWheelEntry TimerWheelEntry;
+
+/* embedded in the object being scheduled */
+struct TimerWheelEntry {
+	TimerWheelEntry *next;		/* NULL when not scheduled */
+	TimerWheelEntry *prev;
+	uint32_t expires;		/* tick at which the entry is due */
+	void *owner;			/* object this entry belongs to */
+};
+
+typedef struct {
+	uint32_t now;			/* current tick */
+	int count;			/* number of entries scheduled */
+	TimerWheelEntry slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];	/* list heads */
+} TimerWheel;
+
+typedef void (*TimerWheelCallback)(TimerWheelEntry *entry, void *userData);
+
+void timerWheelInit(TimerWheel *wheel);
+void timerWheelClear(TimerWheel *wheel);
+void timerWheelSchedule(TimerWheel *wheel, TimerWheelEntry *entry, uint32_t ticks);
+void timerWheelCancel(TimerWheel *wheel, TimerWheelEntry *entry);
+int timerWheelAdvance(TimerWheel *wheel, TimerWheelCallback callback, void *userData);
+
+#define timerWheelScheduled(entry) ((entry)->next != NULL)
+
+#endif /*PTPDTIMERWHEEL_H_*/
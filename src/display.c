@@ -970,6 +970,8 @@ displayCounters(const PtpClock * ptpClock)
 		(unsigned long)ptpClock->counters.sequenceMismatchErrors);
 	INFO("         consecutiveSequenceErrors : %lu\n",
 		(unsigned long)ptpClock->counters.consecutiveSequenceErrors);
+	INFO("                  txTimestampsLost : %lu\n",
+		(unsigned long)ptpClock->counters.txTimestampsLost);
 	INFO("           delayMechanismMismatchErrors : %lu\n",
 		(unsigned long)ptpClock->counters.delayMechanismMismatchErrors);
 	INFO("           maxDelayDrops : %lu\n",
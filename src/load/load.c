@@ -0,0 +1,490 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   load.c
+ * @date   Mon Apr 25 14:02:37 2016
+ *
+ * @brief  main() of ptpd2-load: options, the event loop and the report
+ *
+ * One thread polls the sockets of all slaves and runs each slave when its
+ * next request or Delay_Req is due, from a heap of wakeup times. A slave
+ * only ever has its earliest wakeup in effect: heap entries for any other
+ * time are stale and skipped.
+ */
+
+#include "load.h"
+
+#include <getopt.h>
+#include <poll.h>
+#include <sys/resource.h>
+
+/* normally provided by ptpd.c */
+RunTimeOpts rtOpts;
+Boolean startupInProgress;
+PTPD_THREAD_LOCAL PtpClock *G_ptpClock = NULL;
+TimingDomain timingDomain;
+
+LoadConfig loadConfig;
+LoadStats loadStats;
+
+typedef struct {
+	int64_t time;
+	LoadSlave *slave;
+} LoadWakeup;
+
+static LoadWakeup *heap = NULL;
+static int heapCount = 0;
+static int heapSize = 0;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+int64_t
+loadNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * LOAD_NS + ts.tv_nsec;
+}
+
+static void
+heapSwap(int a, int b)
+{
+	LoadWakeup tmp = heap[a];
+
+	heap[a] = heap[b];
+	heap[b] = tmp;
+}
+
+/* only the earliest wakeup asked for is kept: runs at any other time are stale */
+void
+loadSchedule(LoadSlave *slave, int64_t time)
+{
+	LoadWakeup *grown;
+	int i, parent;
+
+	if(time >= slave->nextWakeup) {
+		return;
+	}
+
+	if(heapCount == heapSize) {
+		heapSize = heapSize ? heapSize * 2 : 1024;
+		if((grown = realloc(heap, heapSize * sizeof(LoadWakeup))) == NULL) {
+			PERROR("Could not grow the wakeup heap to %d entries", heapSize);
+			exit(1);
+		}
+		heap = grown;
+	}
+
+	slave->nextWakeup = time;
+
+	i = heapCount++;
+	heap[i].time = time;
+	heap[i].slave = slave;
+
+	for(; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if(heap[parent].time <= heap[i].time) {
+			break;
+		}
+		heapSwap(i, parent);
+	}
+}
+
+static LoadWakeup
+heapPop(void)
+{
+	LoadWakeup top = heap[0];
+	int i = 0, child;
+
+	heap[0] = heap[--heapCount];
+
+	for(;;) {
+		child = 2 * i + 1;
+		if(child >= heapCount) {
+			break;
+		}
+		if(child + 1 < heapCount && heap[child + 1].time < heap[child].time) {
+			child++;
+		}
+		if(heap[i].time <= heap[child].time) {
+			break;
+		}
+		heapSwap(i, child);
+		i = child;
+	}
+
+	return top;
+}
+
+static void
+printHistogram(const char *name, const LatencyHistogram *histogram)
+{
+	if(!histogram->count) {
+		printf("%-20s no samples\n", name);
+		return;
+	}
+
+	printf("%-20s %8llu samples, mean %9.1f us, p50 %9.1f, p90 %9.1f, p99 %9.1f, p99.9 %9.1f, max %9.1f us\n",
+	    name, (unsigned long long)histogram->count, (double)histogram->sum / histogram->count / 1000.0,
+	    latencyHistogramPercentile(histogram, 50) / 1000.0,
+	    latencyHistogramPercentile(histogram, 90) / 1000.0,
+	    latencyHistogramPercentile(histogram, 99) / 1000.0,
+	    latencyHistogramPercentile(histogram, 99.9) / 1000.0,
+	    histogram->max / 1000.0);
+}
+
+/* one line per report interval: what happened since the last one */
+static void
+printProgress(int64_t elapsed, const LoadStats *last)
+{
+	printf("%7.1f s: %5d/%d served, Sync %llu (lost %llu, late %llu), Delay_Resp %llu (late %llu, lost %llu), denied %llu, unanswered %llu\n",
+	    elapsed / 1E9, loadSlavesServed(), loadConfig.slaveCount,
+	    (unsigned long long)(loadStats.sync - last->sync),
+	    (unsigned long long)(loadStats.syncLost - last->syncLost),
+	    (unsigned long long)(loadStats.syncLate - last->syncLate),
+	    (unsigned long long)(loadStats.delayResp - last->delayResp),
+	    (unsigned long long)(loadStats.delayRespLate - last->delayRespLate),
+	    (unsigned long long)(loadStats.delayRespLost - last->delayRespLost),
+	    (unsigned long long)(loadStats.denials - last->denials),
+	    (unsigned long long)(loadStats.unanswered - last->unanswered));
+	fflush(stdout);
+}
+
+static void
+printReport(int64_t elapsed)
+{
+	printf("\n%d slaves for %.1f s against %s: Sync 2^%d s, Announce 2^%d s, Delay_Req 2^%d s, late after %.3f ms\n",
+	    loadConfig.slaveCount, elapsed / 1E9, inet_ntoa(*(struct in_addr*)&loadConfig.master),
+	    loadConfig.logSyncInterval, loadConfig.logAnnounceInterval, loadConfig.logDelayReqInterval,
+	    loadConfig.lateThreshold / 1E6);
+	printf("served:              %d of %d slaves holding all grants at the end\n",
+	    loadSlavesServed(), loadConfig.slaveCount);
+	printf("grants:              %llu requested, %llu granted, %llu denied, %llu unanswered, %llu expired\n",
+	    (unsigned long long)loadStats.requests, (unsigned long long)loadStats.grants,
+	    (unsigned long long)loadStats.denials, (unsigned long long)loadStats.unanswered,
+	    (unsigned long long)loadStats.expiries);
+	printf("received:            Announce %llu, Sync %llu, Follow_Up %llu, unmatched %llu\n",
+	    (unsigned long long)loadStats.announce, (unsigned long long)loadStats.sync,
+	    (unsigned long long)loadStats.followUp, (unsigned long long)loadStats.unknown);
+	printf("Sync:                %llu lost, %llu late\n",
+	    (unsigned long long)loadStats.syncLost, (unsigned long long)loadStats.syncLate);
+	printf("Delay_Req:           %llu sent, %llu answered, %llu late, %llu lost\n",
+	    (unsigned long long)loadStats.delayReq, (unsigned long long)loadStats.delayResp,
+	    (unsigned long long)loadStats.delayRespLate, (unsigned long long)loadStats.delayRespLost);
+	printHistogram("grant latency:", &loadStats.grantLatency);
+	printHistogram("Delay_Resp latency:", &loadStats.delayRespLatency);
+	printHistogram("Sync interval error:", &loadStats.syncJitter);
+}
+
+/* read everything waiting on a socket; arrival times from the kernel if it gives them */
+static void
+drainSocket(LoadSlave *slave, int sock)
+{
+	Octet buf[PACKET_SIZE];
+	union {
+		struct cmsghdr cm;
+		char control[256];
+	} cmsgUnion;
+	struct msghdr msg;
+	struct iovec vec;
+	struct cmsghdr *cmsg;
+	ssize_t length;
+	int64_t arrival;
+
+	for(;;) {
+		vec.iov_base = buf;
+		vec.iov_len = sizeof(buf);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &vec;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsgUnion.control;
+		msg.msg_controllen = sizeof(cmsgUnion.control);
+
+		if((length = recvmsg(sock, &msg, MSG_DONTWAIT)) <= 0) {
+			return;
+		}
+
+		arrival = 0;
+		for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if(cmsg->cmsg_level != SOL_SOCKET) {
+				continue;
+			}
+#if defined(SCM_TIMESTAMPNS)
+			if(cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+				struct timespec ts;
+				memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				arrival = (int64_t)ts.tv_sec * LOAD_NS + ts.tv_nsec;
+			}
+#elif defined(SCM_TIMESTAMP)
+			if(cmsg->cmsg_type == SCM_TIMESTAMP) {
+				struct timeval tv;
+				memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+				arrival = (int64_t)tv.tv_sec * LOAD_NS + tv.tv_usec * 1000LL;
+			}
+#endif
+		}
+
+		loadSlaveReceive(slave, buf, length, arrival ? arrival : loadNow());
+	}
+}
+
+static void
+stopHandler(int sig)
+{
+	stopRequested = 1;
+}
+
+/* two sockets per slave, and a few to spare */
+static Boolean
+raiseFileLimit(int needed)
+{
+	struct rlimit limit;
+
+	if(getrlimit(RLIMIT_NOFILE, &limit) < 0) {
+		PERROR("Could not get the open file limit");
+		return FALSE;
+	}
+
+	if(limit.rlim_cur >= (rlim_t)needed) {
+		return TRUE;
+	}
+
+	if(limit.rlim_max != RLIM_INFINITY && limit.rlim_max < (rlim_t)needed) {
+		ERROR("%d slaves need %d open files, the limit is %llu\n", loadConfig.slaveCount,
+		    needed, (unsigned long long)limit.rlim_max);
+		return FALSE;
+	}
+
+	limit.rlim_cur = needed;
+	if(setrlimit(RLIMIT_NOFILE, &limit) < 0) {
+		PERROR("Could not raise the open file limit to %d", needed);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+usage(const char *name)
+{
+	printf("usage: %s [options] master-address\n"
+	       "\n"
+	       "  -n count     number of slaves (default %d)\n"
+	       "  -a address   address of the first slave, the others follow it (default %s)\n"
+	       "  -i ifname    bind the slaves' sockets to this interface\n"
+	       "  -d domain    PTP domain (default %d)\n"
+	       "  -s log2      Sync interval requested (default %d)\n"
+	       "  -A log2      Announce interval requested (default %d)\n"
+	       "  -D log2      Delay_Req interval requested (default %d)\n"
+	       "  -g seconds   grant duration requested (default %d)\n"
+	       "  -r seconds   bring the slaves up evenly over this time (default %.0f)\n"
+	       "  -t seconds   run this long, 0: until interrupted (default %.0f)\n"
+	       "  -l ms        Delay_Resp and Sync later than this are counted late (default %.1f)\n"
+	       "  -p seconds   progress report interval, 0: none (default %.0f)\n"
+	       "\n"
+	       "Each slave binds its own address on ports 319 and 320: on loopback any\n"
+	       "127/8 address works, on a veth pair add the addresses to the interface,\n"
+	       "or route the range locally (ip route add local 10.1.0.0/16 dev veth1).\n",
+	       name, loadConfig.slaveCount, inet_ntoa(*(struct in_addr*)&loadConfig.firstAddress),
+	       loadConfig.domainNumber, loadConfig.logSyncInterval, loadConfig.logAnnounceInterval,
+	       loadConfig.logDelayReqInterval, loadConfig.grantDuration, loadConfig.ramp / 1E9,
+	       loadConfig.duration / 1E9, loadConfig.lateThreshold / 1E6, loadConfig.reportInterval / 1E9);
+}
+
+int
+main(int argc, char **argv)
+{
+	LoadSlave *slaves;
+	LoadWakeup wakeup;
+	LoadStats last;
+	struct pollfd *fds;
+	struct in_addr addr;
+	int64_t now, start, end, nextReport, next;
+	int c, i, ready, timeout;
+
+	memset(&loadConfig, 0, sizeof(loadConfig));
+	loadConfig.slaveCount = 100;
+	loadConfig.firstAddress = htonl(0x7F010001);	/* 127.1.0.1 */
+	loadConfig.logSyncInterval = 0;
+	loadConfig.logAnnounceInterval = 1;
+	loadConfig.logDelayReqInterval = 0;
+	loadConfig.grantDuration = 300;
+	loadConfig.duration = 60 * LOAD_NS;
+	loadConfig.ramp = 10 * LOAD_NS;
+	loadConfig.lateThreshold = 10000000;
+	loadConfig.reportInterval = 10 * LOAD_NS;
+
+	while((c = getopt(argc, argv, "n:a:i:d:s:A:D:g:r:t:l:p:h")) != -1) {
+		switch(c) {
+		case 'n':
+			loadConfig.slaveCount = atoi(optarg);
+			break;
+		case 'a':
+			if(!inet_aton(optarg, &addr)) {
+				usage(argv[0]);
+				return 1;
+			}
+			loadConfig.firstAddress = addr.s_addr;
+			break;
+		case 'i':
+			loadConfig.interface = optarg;
+			break;
+		case 'd':
+			loadConfig.domainNumber = atoi(optarg);
+			break;
+		case 's':
+			loadConfig.logSyncInterval = atoi(optarg);
+			break;
+		case 'A':
+			loadConfig.logAnnounceInterval = atoi(optarg);
+			break;
+		case 'D':
+			loadConfig.logDelayReqInterval = atoi(optarg);
+			break;
+		case 'g':
+			loadConfig.grantDuration = atoi(optarg);
+			break;
+		case 'r':
+			loadConfig.ramp = llround(strtod(optarg, NULL) * LOAD_NS);
+			break;
+		case 't':
+			loadConfig.duration = llround(strtod(optarg, NULL) * LOAD_NS);
+			break;
+		case 'l':
+			loadConfig.lateThreshold = llround(strtod(optarg, NULL) * 1E6);
+			break;
+		case 'p':
+			loadConfig.reportInterval = llround(strtod(optarg, NULL) * LOAD_NS);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return (c == 'h') ? 0 : 1;
+		}
+	}
+
+	if(optind != argc - 1 || !inet_aton(argv[optind], &addr) || loadConfig.slaveCount < 1 ||
+	    loadConfig.grantDuration < 1 || loadConfig.ramp < 0 || loadConfig.duration < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	loadConfig.master = addr.s_addr;
+
+	loadDefaultSettings(&rtOpts);
+	rtOpts.logLevel = LOG_INFO;
+	rtOpts.nonDaemon = TRUE;
+	/* log messages are tagged with it */
+	rtOpts.ifaceName = (Octet*)"load";
+
+	if(!raiseFileLimit(2 * loadConfig.slaveCount + 16)) {
+		return 1;
+	}
+
+	if((slaves = loadSlavesInit()) == NULL) {
+		return 1;
+	}
+
+	if((fds = calloc(2 * loadConfig.slaveCount, sizeof(struct pollfd))) == NULL) {
+		PERROR("Could not allocate %d poll descriptors", 2 * loadConfig.slaveCount);
+		return 1;
+	}
+
+	for(i = 0; i < loadConfig.slaveCount; i++) {
+		fds[2 * i].fd = slaves[i].eventSock;
+		fds[2 * i].events = POLLIN;
+		fds[2 * i + 1].fd = slaves[i].generalSock;
+		fds[2 * i + 1].events = POLLIN;
+	}
+
+	signal(SIGINT, stopHandler);
+	signal(SIGTERM, stopHandler);
+
+	start = loadNow();
+	end = loadConfig.duration ? start + loadConfig.duration : LOAD_NEVER;
+	nextReport = loadConfig.reportInterval ? start + loadConfig.reportInterval : LOAD_NEVER;
+	last = loadStats;
+
+	INFO("load: %d slaves from %s against %s\n", loadConfig.slaveCount,
+	    inet_ntoa(*(struct in_addr*)&loadConfig.firstAddress), argv[optind]);
+
+	while(!stopRequested) {
+		now = loadNow();
+
+		while(heapCount > 0 && heap[0].time <= now) {
+			wakeup = heapPop();
+			if(wakeup.time != wakeup.slave->nextWakeup) {
+				continue;
+			}
+			wakeup.slave->nextWakeup = LOAD_NEVER;
+			loadSlaveRun(wakeup.slave, now);
+		}
+
+		if(now >= nextReport) {
+			printProgress(now - start, &last);
+			last = loadStats;
+			nextReport += loadConfig.reportInterval;
+		}
+
+		if(now >= end) {
+			break;
+		}
+
+		next = end < nextReport ? end : nextReport;
+		if(heapCount > 0 && heap[0].time < next) {
+			next = heap[0].time;
+		}
+		/* round up: waking up early only spins */
+		timeout = (next - now + 999999) / 1000000;
+		if(next == LOAD_NEVER || timeout > 1000) {
+			timeout = 1000;
+		}
+
+		if((ready = poll(fds, 2 * loadConfig.slaveCount, timeout)) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			PERROR("poll() failed");
+			break;
+		}
+
+		for(i = 0; ready > 0 && i < 2 * loadConfig.slaveCount; i++) {
+			if(fds[i].revents & POLLIN) {
+				drainSocket(&slaves[i / 2], fds[i].fd);
+				ready--;
+			}
+		}
+	}
+
+	printReport(loadNow() - start);
+
+	free(fds);
+	free(heap);
+
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   load.h
+ * @date   Mon Apr 25 14:02:37 2016
+ *
+ * @brief  Unicast slave load generator definitions
+ *
+ * ptpd2-load impersonates many unicast negotiation slaves against a real
+ * master over a real network - loopback, or one end of a veth pair - to
+ * find out how many slaves the master can serve. Every slave has its own
+ * address and its own pair of sockets, negotiates Announce, Sync and
+ * Delay_Resp, renews its grants and sends Delay_Req; all messages are
+ * built and parsed by msg.c.
+ *
+ * Times are CLOCK_REALTIME nanoseconds: arrivals are timestamped by the
+ * kernel (SO_TIMESTAMPNS) where available, so the time the load generator
+ * itself takes to get round to a packet does not count against the master.
+ */
+
+#ifndef PTPD_LOAD_H_
+#define PTPD_LOAD_H_
+
+#include "../ptpd.h"
+
+#ifdef PTPD_SLAVE_ONLY
+#error "ptpd2-load needs the unicast negotiation code: configure without --enable-slave-only"
+#endif /* PTPD_SLAVE_ONLY */
+
+#define LOAD_NS			1000000000LL
+#define LOAD_NEVER		INT64_MAX
+
+/* the message types a slave negotiates */
+enum {
+	LOAD_GRANT_ANNOUNCE = 0,
+	LOAD_GRANT_SYNC,
+	LOAD_GRANT_DELAY_RESP,
+	LOAD_GRANT_TYPES
+};
+
+/* one negotiated grant, as the slave sees it */
+typedef struct {
+	Boolean granted;
+	Boolean requested;	/* a request is waiting for its answer */
+	int64_t requestSent;
+	int64_t expires;	/* when the grant runs out */
+	int64_t nextRequest;	/* when to request it (again) */
+} LoadGrant;
+
+typedef struct {
+	int number;
+	Integer32 address;	/* network byte order */
+	PortIdentity portIdentity;
+	int eventSock;
+	int generalSock;
+	UInteger16 signalingSequenceId;
+	UInteger16 delayReqSequenceId;
+	LoadGrant grants[LOAD_GRANT_TYPES];
+	/* Sync stream */
+	Boolean syncSeen;
+	UInteger16 lastSyncSequenceId;
+	int64_t lastSyncArrival;
+	/* the Delay_Req waiting for its Delay_Resp, if any */
+	Boolean delayReqOutstanding;
+	int64_t delayReqSent;
+	int64_t nextDelayReq;
+	int64_t nextWakeup;	/* scheduled wakeup, LOAD_NEVER if none */
+} LoadSlave;
+
+/* the command line */
+typedef struct {
+	int slaveCount;
+	Integer32 master;		/* network byte order */
+	Integer32 firstAddress;		/* of the first slave */
+	const char *interface;		/* bind the sockets to it, if set */
+	UInteger8 domainNumber;
+	Integer8 logSyncInterval;
+	Integer8 logAnnounceInterval;
+	Integer8 logDelayReqInterval;
+	UInteger32 grantDuration;
+	int64_t duration;
+	int64_t ramp;			/* slaves start evenly spread over it */
+	int64_t lateThreshold;		/* responses and Sync later than this are late */
+	int64_t reportInterval;
+} LoadConfig;
+
+/* what the slaves saw, summed over all of them */
+typedef struct {
+	uint64_t requests;
+	uint64_t grants;
+	uint64_t denials;
+	uint64_t unanswered;		/* requests with no answer before the retry */
+	uint64_t expiries;		/* grants which ran out before their renewal arrived */
+	uint64_t announce;
+	uint64_t sync;
+	uint64_t syncLate;		/* Sync further than the late threshold off its interval */
+	uint64_t syncLost;		/* gaps in the Sync sequence */
+	uint64_t followUp;
+	uint64_t delayReq;
+	uint64_t delayResp;
+	uint64_t delayRespLate;		/* answered, but after the late threshold */
+	uint64_t delayRespLost;		/* not answered before the next Delay_Req */
+	uint64_t unknown;		/* messages we could not match to a request */
+	LatencyHistogram grantLatency;		/* request to grant */
+	LatencyHistogram delayRespLatency;	/* Delay_Req to Delay_Resp */
+	LatencyHistogram syncJitter;		/* |Sync interval - granted interval| */
+} LoadStats;
+
+extern LoadConfig loadConfig;
+extern LoadStats loadStats;
+
+/* load.c */
+int64_t loadNow(void);
+void loadSchedule(LoadSlave *slave, int64_t time);
+
+/* loadslaves.c */
+LoadSlave* loadSlavesInit(void);
+void loadSlaveRun(LoadSlave *slave, int64_t now);
+void loadSlaveReceive(LoadSlave *slave, Octet *buf, int length, int64_t arrival);
+int loadSlavesServed(void);
+
+#endif /* PTPD_LOAD_H_ */
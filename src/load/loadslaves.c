@@ -0,0 +1,483 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   loadslaves.c
+ * @date   Mon Apr 25 14:02:37 2016
+ *
+ * @brief  The impersonated unicast slaves
+ *
+ * Each slave requests Announce, Sync and Delay_Resp, renews its grants
+ * with a quarter of them left, sends Delay_Req at the granted rate, and
+ * records how long the master takes to answer and what it fails to send.
+ * Messages are built and parsed by msg.c, through a scratch PtpClock set
+ * up as the slave sending.
+ */
+
+#include "load.h"
+
+#define LOAD_RETRY_INTERVAL	(5 * LOAD_NS)
+
+static PtpClock *scratch = NULL;
+static const LoadSlave *scratchOwner = NULL;
+
+static LoadSlave *slaves = NULL;
+
+static const Enumeration8 grantMessageTypes[LOAD_GRANT_TYPES] = {
+	ANNOUNCE, SYNC, DELAY_RESP
+};
+
+static int64_t
+logInterval(Integer8 log)
+{
+	return llround(pow(2, log) * LOAD_NS);
+}
+
+/* a clock identity made from an IPv4 address, EUI-64 style */
+static void
+addressIdentity(Integer32 address, PortIdentity *identity)
+{
+	uint32_t host = ntohl(address);
+
+	memset(identity, 0, sizeof(PortIdentity));
+	identity->clockIdentity[0] = 0x02;
+	identity->clockIdentity[1] = 0x00;
+	identity->clockIdentity[2] = (host >> 24) & 0xFF;
+	identity->clockIdentity[3] = 0xFF;
+	identity->clockIdentity[4] = 0xFE;
+	identity->clockIdentity[5] = (host >> 16) & 0xFF;
+	identity->clockIdentity[6] = (host >> 8) & 0xFF;
+	identity->clockIdentity[7] = host & 0xFF;
+	identity->portNumber = 1;
+}
+
+/* set the scratch clock up as a slave */
+static void
+becomeSlave(LoadSlave *slave)
+{
+	if(scratchOwner == slave) {
+		return;
+	}
+
+	scratchOwner = slave;
+
+	copyPortIdentity(&scratch->portDS.portIdentity, &slave->portIdentity);
+	scratch->portDS.transportSpecific = 0;
+	scratch->portDS.versionNumber = 2;
+	scratch->defaultDS.domainNumber = loadConfig.domainNumber;
+	scratch->defaultDS.twoStepFlag = TRUE;
+}
+
+/*
+ * A socket bound to the slave's own address. The master's sockets are
+ * bound to the wildcard address with SO_REUSEADDR, so on the same host
+ * ours can share the port: the more specific binding gets the slave's
+ * traffic.
+ */
+static int
+slaveSocket(const LoadSlave *slave, UInteger16 port)
+{
+	struct sockaddr_in addr;
+	int sock, on = 1;
+
+	if((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+		PERROR("Could not create socket for slave %d", slave->number);
+		return -1;
+	}
+
+	if(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+		PERROR("Could not set SO_REUSEADDR for slave %d", slave->number);
+		goto fail;
+	}
+
+#ifdef SO_BINDTODEVICE
+	if(loadConfig.interface != NULL &&
+	    setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, loadConfig.interface,
+		strlen(loadConfig.interface)) < 0) {
+		PERROR("Could not bind slave %d to %s", slave->number, loadConfig.interface);
+		goto fail;
+	}
+#endif /* SO_BINDTODEVICE */
+
+#if defined(SO_TIMESTAMPNS)
+	if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+		DBG("load: no SO_TIMESTAMPNS: arrival times taken on receipt\n");
+	}
+#elif defined(SO_TIMESTAMP)
+	if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) < 0) {
+		DBG("load: no SO_TIMESTAMP: arrival times taken on receipt\n");
+	}
+#endif
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = slave->address;
+	addr.sin_port = htons(port);
+
+	if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		PERROR("Could not bind slave %d to %s:%d - is the address configured?",
+		    slave->number, inet_ntoa(addr.sin_addr), port);
+		goto fail;
+	}
+
+	if(fcntl(sock, F_SETFL, O_NONBLOCK) < 0) {
+		PERROR("Could not make the sockets of slave %d non-blocking", slave->number);
+		goto fail;
+	}
+
+	return sock;
+
+fail:
+	close(sock);
+	return -1;
+}
+
+static void
+slaveSend(const LoadSlave *slave, Octet *buf, int length, Boolean event)
+{
+	struct sockaddr_in addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = loadConfig.master;
+	addr.sin_port = htons(event ? PTP_EVENT_PORT : PTP_GENERAL_PORT);
+
+	if(sendto(event ? slave->eventSock : slave->generalSock, buf, length, 0,
+	    (struct sockaddr*)&addr, sizeof(addr)) != length) {
+		DBG("load: slave %d: send failed: %s\n", slave->number, strerror(errno));
+	}
+}
+
+LoadSlave*
+loadSlavesInit(void)
+{
+	LoadSlave *slave;
+	int64_t start = loadNow();
+	int64_t first;
+	int i, j;
+
+	if((scratch = calloc(1, sizeof(PtpClock))) == NULL ||
+	    (slaves = calloc(loadConfig.slaveCount, sizeof(LoadSlave))) == NULL) {
+		PERROR("Could not allocate %d slaves", loadConfig.slaveCount);
+		return NULL;
+	}
+
+	for(i = 0; i < loadConfig.slaveCount; i++) {
+		slave = &slaves[i];
+		slave->number = i + 1;
+		slave->address = htonl(ntohl(loadConfig.firstAddress) + i);
+		addressIdentity(slave->address, &slave->portIdentity);
+		slave->nextWakeup = LOAD_NEVER;
+		slave->nextDelayReq = LOAD_NEVER;
+		if((slave->eventSock = slaveSocket(slave, PTP_EVENT_PORT)) < 0 ||
+		    (slave->generalSock = slaveSocket(slave, PTP_GENERAL_PORT)) < 0) {
+			return NULL;
+		}
+		/* slaves come up spread evenly over the ramp */
+		first = start + loadConfig.ramp * i / loadConfig.slaveCount;
+		for(j = 0; j < LOAD_GRANT_TYPES; j++) {
+			slave->grants[j].nextRequest = first;
+		}
+		loadSchedule(slave, first);
+	}
+
+	return slaves;
+}
+
+/* request one message type from the master */
+static void
+slaveRequest(LoadSlave *slave, int type, int64_t now)
+{
+	Octet buf[PACKET_SIZE];
+	MsgSignaling outgoing;
+	SignalingTLV tlv;
+	SMRequestUnicastTransmission request;
+	LoadGrant *grant = &slave->grants[type];
+
+	becomeSlave(slave);
+
+	memset(&outgoing, 0, sizeof(outgoing));
+	memset(&tlv, 0, sizeof(tlv));
+	memset(&request, 0, sizeof(request));
+
+	/* as prepareSMRequestUnicastTransmission() builds it */
+	outgoing.header.transportSpecific = scratch->portDS.transportSpecific;
+	outgoing.header.messageType = SIGNALING;
+	outgoing.header.versionPTP = scratch->portDS.versionNumber;
+	outgoing.header.domainNumber = scratch->defaultDS.domainNumber;
+	outgoing.header.flagField0 = PTP_UNICAST;
+	copyPortIdentity(&outgoing.header.sourcePortIdentity, &slave->portIdentity);
+	outgoing.header.sequenceId = slave->signalingSequenceId++;
+	outgoing.header.controlField = 0x5;
+	outgoing.header.logMessageInterval = 0x7F;
+	memset(&outgoing.targetPortIdentity, 0xFF, sizeof(PortIdentity));
+
+	request.messageType = grantMessageTypes[type];
+	switch(type) {
+	case LOAD_GRANT_ANNOUNCE:
+		request.logInterMessagePeriod = loadConfig.logAnnounceInterval;
+		break;
+	case LOAD_GRANT_SYNC:
+		request.logInterMessagePeriod = loadConfig.logSyncInterval;
+		break;
+	default:
+		request.logInterMessagePeriod = loadConfig.logDelayReqInterval;
+		break;
+	}
+	request.durationField = loadConfig.grantDuration;
+
+	tlv.tlvType = TLV_REQUEST_UNICAST_TRANSMISSION;
+	tlv.valueField = (Octet*)&request;
+	outgoing.tlv = &tlv;
+
+	msgPackSignalingTLV(buf, &outgoing, scratch);
+	outgoing.header.messageLength = SIGNALING_LENGTH + TL_LENGTH + outgoing.tlv->lengthField;
+	msgPackSignaling(buf, &outgoing, scratch);
+
+	if(grant->requested) {
+		loadStats.unanswered++;
+	}
+
+	grant->requested = TRUE;
+	grant->requestSent = loadNow();
+	slaveSend(slave, buf, outgoing.header.messageLength, FALSE);
+
+	loadStats.requests++;
+	/* no answer: ask again */
+	grant->nextRequest = now + LOAD_RETRY_INTERVAL;
+}
+
+static void
+slaveDelayReq(LoadSlave *slave)
+{
+	Octet buf[PACKET_SIZE];
+	Timestamp timestamp;
+	TimeInternal time;
+
+	becomeSlave(slave);
+
+	if(slave->delayReqOutstanding) {
+		loadStats.delayRespLost++;
+	}
+
+	getTime(&time);
+	fromInternalTime(&time, &timestamp);
+	scratch->sentDelayReqSequenceId = ++slave->delayReqSequenceId;
+	msgPackDelayReq(buf, &timestamp, scratch);
+	buf[6] |= PTP_UNICAST;
+
+	slave->delayReqOutstanding = TRUE;
+	slave->delayReqSent = loadNow();
+	slaveSend(slave, buf, DELAY_REQ_LENGTH, TRUE);
+
+	loadStats.delayReq++;
+}
+
+/* renew and re-request grants, expire them, and send Delay_Req when due */
+void
+loadSlaveRun(LoadSlave *slave, int64_t now)
+{
+	int64_t next = LOAD_NEVER;
+	LoadGrant *grant;
+	int i;
+
+	for(i = 0; i < LOAD_GRANT_TYPES; i++) {
+		grant = &slave->grants[i];
+		if(grant->granted && grant->expires <= now) {
+			DBG("load: slave %d: %s grant expired\n", slave->number,
+			    getMessageTypeName(grantMessageTypes[i]));
+			grant->granted = FALSE;
+			loadStats.expiries++;
+		}
+		if(grant->nextRequest <= now) {
+			slaveRequest(slave, i, now);
+		}
+		if(grant->nextRequest < next) {
+			next = grant->nextRequest;
+		}
+		if(grant->granted && grant->expires < next) {
+			next = grant->expires;
+		}
+	}
+
+	if(slave->grants[LOAD_GRANT_DELAY_RESP].granted) {
+		if(slave->nextDelayReq <= now) {
+			slaveDelayReq(slave);
+			slave->nextDelayReq += logInterval(loadConfig.logDelayReqInterval);
+			/* we fell behind: do not make up for it with a burst */
+			if(slave->nextDelayReq <= now) {
+				slave->nextDelayReq = now + logInterval(loadConfig.logDelayReqInterval);
+			}
+		}
+		if(slave->nextDelayReq < next) {
+			next = slave->nextDelayReq;
+		}
+	}
+
+	loadSchedule(slave, next);
+}
+
+static void
+slaveGrant(LoadSlave *slave, Octet *buf, MsgHeader *header, int64_t arrival)
+{
+	MsgSignaling signaling;
+	SMGrantUnicastTransmission *data;
+	LoadGrant *grant;
+	int tlvOffset = 0;
+	int i;
+
+	becomeSlave(slave);
+	memset(&signaling, 0, sizeof(signaling));
+
+	while(msgUnpackSignaling(buf, &signaling, header, scratch, tlvOffset)) {
+		if(signaling.tlv->tlvType == TLV_GRANT_UNICAST_TRANSMISSION) {
+			unpackSMGrantUnicastTransmission(buf + tlvOffset, &signaling, scratch);
+			data = (SMGrantUnicastTransmission*)signaling.tlv->valueField;
+			for(i = 0; i < LOAD_GRANT_TYPES; i++) {
+				if(grantMessageTypes[i] != data->messageType) {
+					continue;
+				}
+				grant = &slave->grants[i];
+				if(!grant->requested) {
+					loadStats.unknown++;
+					continue;
+				}
+				grant->requested = FALSE;
+				latencyHistogramAdd(&loadStats.grantLatency, arrival - grant->requestSent);
+				if(data->durationField > 0) {
+					grant->granted = TRUE;
+					grant->expires = arrival + (int64_t)data->durationField * LOAD_NS;
+					/* renew with a quarter of the grant left */
+					grant->nextRequest = arrival + (int64_t)data->durationField * LOAD_NS * 3 / 4;
+					loadStats.grants++;
+					if(i == LOAD_GRANT_DELAY_RESP && slave->nextDelayReq == LOAD_NEVER) {
+						slave->nextDelayReq = arrival;
+					}
+				} else {
+					DBG("load: slave %d: %s denied\n", slave->number,
+					    getMessageTypeName(grantMessageTypes[i]));
+					grant->granted = FALSE;
+					grant->nextRequest = arrival + LOAD_RETRY_INTERVAL;
+					loadStats.denials++;
+				}
+			}
+		}
+		tlvOffset += TL_LENGTH + signaling.tlv->lengthField;
+		freeSignalingTLV(&signaling);
+	}
+
+	loadSchedule(slave, slave->grants[LOAD_GRANT_DELAY_RESP].granted ? slave->nextDelayReq : LOAD_NEVER);
+	for(i = 0; i < LOAD_GRANT_TYPES; i++) {
+		loadSchedule(slave, slave->grants[i].nextRequest);
+	}
+}
+
+/* a message from the master reaches a slave */
+void
+loadSlaveReceive(LoadSlave *slave, Octet *buf, int length, int64_t arrival)
+{
+	MsgHeader header;
+	MsgDelayResp resp;
+	int64_t error, latency;
+	UInteger16 lost;
+
+	if(length < HEADER_LENGTH) {
+		return;
+	}
+
+	msgUnpackHeader(buf, &header);
+
+	if(header.domainNumber != loadConfig.domainNumber) {
+		return;
+	}
+
+	switch(header.messageType) {
+	case ANNOUNCE:
+		loadStats.announce++;
+		break;
+	case SYNC:
+		loadStats.sync++;
+		if(slave->syncSeen) {
+			lost = header.sequenceId - slave->lastSyncSequenceId - 1;
+			loadStats.syncLost += lost;
+			if(!lost) {
+				error = arrival - slave->lastSyncArrival - logInterval(loadConfig.logSyncInterval);
+				error = error < 0 ? -error : error;
+				latencyHistogramAdd(&loadStats.syncJitter, error);
+				if(error > loadConfig.lateThreshold) {
+					loadStats.syncLate++;
+				}
+			}
+		}
+		slave->syncSeen = TRUE;
+		slave->lastSyncSequenceId = header.sequenceId;
+		slave->lastSyncArrival = arrival;
+		break;
+	case FOLLOW_UP:
+		loadStats.followUp++;
+		break;
+	case DELAY_RESP:
+		if(length < DELAY_RESP_LENGTH) {
+			return;
+		}
+		msgUnpackDelayResp(buf, &resp);
+		if(!slave->delayReqOutstanding || header.sequenceId != slave->delayReqSequenceId ||
+		    memcmp(&resp.requestingPortIdentity, &slave->portIdentity, sizeof(PortIdentity))) {
+			loadStats.unknown++;
+			break;
+		}
+		slave->delayReqOutstanding = FALSE;
+		latency = arrival - slave->delayReqSent;
+		latencyHistogramAdd(&loadStats.delayRespLatency, latency);
+		loadStats.delayResp++;
+		if(latency > loadConfig.lateThreshold) {
+			loadStats.delayRespLate++;
+		}
+		break;
+	case SIGNALING:
+		slaveGrant(slave, buf, &header, arrival);
+		break;
+	default:
+		break;
+	}
+}
+
+/* the slaves holding all their grants */
+int
+loadSlavesServed(void)
+{
+	int i, j, served = 0;
+
+	for(i = 0; i < loadConfig.slaveCount; i++) {
+		for(j = 0; j < LOAD_GRANT_TYPES && slaves[i].grants[j].granted; j++);
+		if(j == LOAD_GRANT_TYPES) {
+			served++;
+		}
+	}
+
+	return served;
+}
@@ -76,18 +76,38 @@ static void issueAnnounceSingle(Integer32, UInteger16*, const RunTimeOpts*,PtpCl
 static void issueSync(const RunTimeOpts*,PtpClock*);
 static TimeInternal issueSyncSingle(Integer32, UInteger16*, const RunTimeOpts*,PtpClock*);
 static void issueFollowup(const TimeInternal*,const RunTimeOpts*,PtpClock*, Integer32, const UInteger16);
+static void issueSyncUnicast(Integer32, UInteger16*, TimeInternal*, Boolean, const RunTimeOpts*,PtpClock*);
 #endif /* PTPD_SLAVE_ONLY */
+#ifdef PTPD_SYNC_BATCHING
+static Boolean syncBatchingActive(const RunTimeOpts*,PtpClock*);
+static void queueSyncBatch(Integer32, UInteger16*, TimeInternal*, const RunTimeOpts*,PtpClock*);
+static void flushSyncBatch(const RunTimeOpts*,PtpClock*);
+static void expireSyncTxPending(PtpClock*);
+#endif /* PTPD_SYNC_BATCHING */
+#ifdef PTPD_TXTIMESTAMP_KEYED
+static Boolean asyncTxTimestampsActive(const RunTimeOpts*,PtpClock*);
+static void deferTxTimestamp(TxTimestampPending*,UInteger16,PtpClock*);
+static Boolean matchTxTimestamp(TxTimestampPending*,UInteger32,UInteger16,PtpClock*);
+static void processTxTimestamps(const RunTimeOpts*,PtpClock*);
+#endif /* PTPD_TXTIMESTAMP_KEYED */
 static void issuePdelayReq(const RunTimeOpts*,PtpClock*);
 static void issueDelayReq(const RunTimeOpts*,PtpClock*);
 static void issuePdelayResp(const TimeInternal*,MsgHeader*,Integer32,const RunTimeOpts*,PtpClock*);
 static void issueDelayResp(const TimeInternal*,MsgHeader*,Integer32,const RunTimeOpts*,PtpClock*);
 static void issuePdelayRespFollowUp(const TimeInternal*,MsgHeader*, Integer32, const RunTimeOpts*,PtpClock*, const UInteger16);
+static Integer8 delayReqInterval(const RunTimeOpts*,const PtpClock*);
+
+static void startFastAcquisition(const RunTimeOpts*,PtpClock*);
+static void stopFastAcquisition(const RunTimeOpts*,PtpClock*,Boolean);
 
 static void processMessage(RunTimeOpts* rtOpts, PtpClock* ptpClock, TimeInternal* timeStamp, ssize_t length);
+#ifdef PTPD_RECV_BATCHING
+static Boolean handleBatch(RunTimeOpts*,PtpClock*,Boolean);
+#endif /* PTPD_RECV_BATCHING */
 
 #ifndef PTPD_SLAVE_ONLY /* does not get compiled when building slave only */
 static void processSyncFromSelf(const TimeInternal * tint, const RunTimeOpts * rtOpts, PtpClock * ptpClock, Integer32 dst, const UInteger16 sequenceId);
-static void indexSync(TimeInternal *timeStamp, UInteger16 sequenceId, Integer32 transportAddress, SyncDestEntry *index);
+static void indexSync(TimeInternal *timeStamp, UInteger16 sequenceId, Integer32 transportAddress, SyncDestEntry *index, int indexSize);
 #endif /* PTPD_SLAVE_ONLY */
 
 static void processDelayReqFromSelf(const TimeInternal * tint, const RunTimeOpts * rtOpts, PtpClock * ptpClock);
@@ -97,7 +117,7 @@ static void processPdelayRespFromSelf(const TimeInternal * tint, const RunTimeOp
 /* this shouldn't really be in protocol.c, it will be moved later */
 static void timestampCorrection(const RunTimeOpts * rtOpts, PtpClock *ptpClock, TimeInternal *timeStamp);
 
-static Integer32 lookupSyncIndex(TimeInternal *timeStamp, UInteger16 sequenceId, SyncDestEntry *index);
+static Integer32 lookupSyncIndex(TimeInternal *timeStamp, UInteger16 sequenceId, SyncDestEntry *index, int indexSize);
 static Integer32 findSyncDestination(TimeInternal *timeStamp, const RunTimeOpts *rtOpts, PtpClock *ptpClock);
 
 
@@ -105,7 +125,7 @@ static Integer32 findSyncDestination(TimeInternal *timeStamp, const RunTimeOpts
 
 /* store transportAddress in an index table */
 static void
-indexSync(TimeInternal *timeStamp, UInteger16 sequenceId, Integer32 transportAddress, SyncDestEntry *index)
+indexSync(TimeInternal *timeStamp, UInteger16 sequenceId, Integer32 transportAddress, SyncDestEntry *index, int indexSize)
 {
 
     uint32_t hash = 0;
@@ -119,7 +139,7 @@ indexSync(TimeInternal *timeStamp, UInteger16 sequenceId, Integer32 transportAdd
 	return;
     }
 
-    hash = fnvHash(timeStamp, sizeof(TimeInternal), UNICAST_MAX_DESTINATIONS);
+    hash = fnvHash(timeStamp, sizeof(TimeInternal), indexSize);
 
     if(index[hash].transportAddress) {
 	DBG("indexSync: hash collision - clearing entry %s:%04x\n", inet_ntoa(tmpAddr), hash);
@@ -135,7 +155,7 @@ indexSync(TimeInternal *timeStamp, UInteger16 sequenceId, Integer32 transportAdd
 
 /* sync destination index lookup */
 static Integer32
-lookupSyncIndex(TimeInternal *timeStamp, UInteger16 sequenceId, SyncDestEntry *index)
+lookupSyncIndex(TimeInternal *timeStamp, UInteger16 sequenceId, SyncDestEntry *index, int indexSize)
 {
 
     uint32_t hash = 0;
@@ -145,7 +165,7 @@ lookupSyncIndex(TimeInternal *timeStamp, UInteger16 sequenceId, SyncDestEntry *i
 	return 0;
     }
 
-    hash = fnvHash(timeStamp, sizeof(TimeInternal), UNICAST_MAX_DESTINATIONS);
+    hash = fnvHash(timeStamp, sizeof(TimeInternal), indexSize);
 
     if(index[hash].transportAddress == 0) {
 	DBG("lookupSyncIndex: cache miss\n");
@@ -166,15 +186,16 @@ findSyncDestination(TimeInternal *timeStamp, const RunTimeOpts *rtOpts, PtpClock
 
     int i = 0;
 
-    for(i = 0; i < UNICAST_MAX_DESTINATIONS; i++) {
-
-	if(rtOpts->unicastNegotiation) {
+    if(rtOpts->unicastNegotiation) {
+	for(i = 0; i < ptpClock->unicastGrantTableSize; i++) {
 		if( (timeStamp->seconds == ptpClock->unicastGrants[i].lastSyncTimestamp.seconds) &&
 		    (timeStamp->nanoseconds == ptpClock->unicastGrants[i].lastSyncTimestamp.nanoseconds)) {
 			clearTime(&ptpClock->unicastGrants[i].lastSyncTimestamp);
 			return ptpClock->unicastGrants[i].transportAddress;
 		    }
-	} else {
+	}
+    } else {
+	for(i = 0; i < ptpClock->unicastDestinationCount; i++) {
 		if( (timeStamp->seconds == ptpClock->unicastDestinations[i].lastSyncTimestamp.seconds) &&
 		    (timeStamp->nanoseconds == ptpClock->unicastDestinations[i].lastSyncTimestamp.nanoseconds)) {
 			clearTime(&ptpClock->unicastDestinations[i].lastSyncTimestamp);
@@ -187,17 +208,23 @@ findSyncDestination(TimeInternal *timeStamp, const RunTimeOpts *rtOpts, PtpClock
 
 }
 
-void addForeign(Octet*,MsgHeader*,PtpClock*, UInteger8, UInteger32);
+void addForeign(MsgHeader*,const MsgAnnounce*,PtpClock*, UInteger8, UInteger32);
 
-/* loop forever. doState() has a switch for the actions and events to be
-   checked for 'port_state'. the actions and events may or may not change
-   'port_state' by calling toState(), but once they are done we loop around
-   again and perform the actions required for the new 'port_state'. */
-void
-protocol(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+/*
+ * A boundary clock port only touches the clock frequency once it has been
+ * handed control - a port that just became slave takes over the drift
+ */
+static Boolean
+controlsClock(const PtpClock *ptpClock)
 {
-	DBG("event POWERUP\n");
+	return ptpClock->ports == NULL || ptpClock->controllingClock;
+}
 
+/* bring a port up: into INITIALIZING, or DISABLED if configured so */
+static void
+powerUp(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	/* every port keeps the timer: the one controlling the clock runs the timing domain */
 	timerStart(&ptpClock->timers[TIMINGDOMAIN_UPDATE_TIMER],timingDomain.updateInterval);
 	timerStart(&ptpClock->timers[ALARM_UPDATE_TIMER],ALARM_UPDATE_INTERVAL);
 
@@ -228,9 +255,12 @@ protocol(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 
 	if(rtOpts->statusLog.logEnabled)
 		writeStatusFile(ptpClock, rtOpts, TRUE);
+}
 
-	for (;;)
-	{
+/* one pass of the main loop for a port: the state machine, then the port's timers */
+static void
+runPort(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
 		/* 20110701: this main loop was rewritten to be more clear */
 		if(ptpClock->disabled && ptpClock->portDS.portState != PTP_DISABLED) {
 			toState(PTP_DISABLED, rtOpts, ptpClock);
@@ -284,7 +314,28 @@ protocol(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		}
 
 		if (timerExpired(&ptpClock->timers[TIMINGDOMAIN_UPDATE_TIMER])) {
-		    timingDomain.update(&timingDomain);
+#ifdef PTPD_PORT_THREADS
+		    /* the timing domain stays on the main thread, port threads only report to it */
+		    if(ptpClock->ports != NULL && ptpClock->ports->threaded) {
+			if(ptpClock->thread == NULL) {
+			    portThreadsTimingDomainUpdate(ptpClock->ports);
+			} else if(controlsClock(ptpClock)) {
+			    portThreadReportClock(ptpClock);
+			}
+		    } else
+#endif /* PTPD_PORT_THREADS */
+		    if(controlsClock(ptpClock)) {
+			timingDomain.update(&timingDomain);
+		    }
+		}
+
+		if (timerExpired(&ptpClock->timers[HOLDOVER_TIMER])) {
+		    if(controlsClock(ptpClock) && ptpClock->holdover.state == HOLDOVER_ACTIVE) {
+			updateHoldover(rtOpts, ptpClock);
+		    } else {
+			timerStop(&ptpClock->timers[HOLDOVER_TIMER]);
+			stopHoldover(rtOpts, ptpClock, FALSE);
+		    }
 		}
 
 		if(ptpClock->defaultDS.slaveOnly) {
@@ -308,20 +359,289 @@ protocol(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 
 
 		if (timerExpired(&ptpClock->timers[UNICAST_GRANT_TIMER])) {
-			if(rtOpts->unicastDestinationsSet) {
-			    refreshUnicastGrants(ptpClock->unicastGrants,
-				ptpClock->unicastDestinationCount, rtOpts, ptpClock);
-			} else {
-			    refreshUnicastGrants(ptpClock->unicastGrants,
-				UNICAST_MAX_DESTINATIONS, rtOpts, ptpClock);
+			refreshUnicastGrants(rtOpts, ptpClock);
+		}
+}
+
+/* Boundary clock: make the state decision across all ports and apply it */
+static void
+boundaryClockStateDecision(ClockPorts *ports)
+{
+	extern PTPD_THREAD_LOCAL PtpClock *G_ptpClock;
+	PtpClock *current = G_ptpClock;
+	PtpClock *port;
+	ForeignMasterRecord *erbest[PTPD_MAX_PORTS];
+	UInteger8 states[PTPD_MAX_PORTS];
+	UInteger8 decisions[PTPD_MAX_PORTS];
+	UInteger8 state;
+	int i;
+
+	DBG2("event STATE_DECISION_EVENT (boundary clock)\n");
+
+	for(i = 0; i < ports->count; i++) {
+		port = ports->port[i];
+		port->record_update = FALSE;
+		erbest[i] = bmcPortBest(port);
+		states[i] = port->portDS.portState;
+	}
+
+	bmcBoundaryClockDecision(erbest, states, ports->count, ports->port[0], decisions);
+
+	for(i = 0; i < ports->count; i++) {
+		port = ports->port[i];
+		G_ptpClock = port;
+		state = bmcApplyDecision(port, decisions[i]);
+		if(state != port->portDS.portState)
+			toState(state, port->rtOpts, port);
+	}
+
+	G_ptpClock = current;
+}
+
+/* Boundary clock: from now on the servo of @next steers the clock */
+static void
+handOverClockControl(ClockPorts *ports, PtpClock *next)
+{
+	PtpClock *previous = ports->controller;
+	TimingService *service = timingDomain.services[0];
+
+	if(next == previous) {
+		return;
+	}
+
+	next->clockControl.granted = previous->clockControl.granted;
+	previous->clockControl.granted = FALSE;
+	previous->controllingClock = FALSE;
+	/* the clock keeps running at the frequency the previous port left it at */
+	next->servo.observedDrift = previous->servo.observedDrift;
+	next->controllingClock = TRUE;
+
+	service->controller = next;
+	service->config = next->rtOpts;
+	ports->controller = next;
+
+	INFO("Clock now controlled by port %d (%s)\n",
+		next->portDS.portIdentity.portNumber, next->rtOpts->ifaceName);
+}
+
+/* Boundary clock: the datasets of the slave port, which all ports share */
+void
+getClockDatasets(const PtpClock *ptpClock, ClockDatasets *datasets)
+{
+	memset(datasets, 0, sizeof(ClockDatasets));
+	datasets->parentDS = ptpClock->parentDS;
+	datasets->stepsRemoved = ptpClock->currentDS.stepsRemoved;
+	datasets->timePropertiesDS = ptpClock->timePropertiesDS;
+	datasets->utcOffset = ptpClock->clockStatus.utcOffset;
+	datasets->leapInsert = ptpClock->clockStatus.leapInsert;
+	datasets->leapDelete = ptpClock->clockStatus.leapDelete;
+}
+
+void
+setClockDatasets(PtpClock *ptpClock, const ClockDatasets *datasets)
+{
+	ptpClock->parentDS = datasets->parentDS;
+	ptpClock->currentDS.stepsRemoved = datasets->stepsRemoved;
+	ptpClock->timePropertiesDS = datasets->timePropertiesDS;
+	ptpClock->clockStatus.utcOffset = datasets->utcOffset;
+	ptpClock->clockStatus.leapInsert = datasets->leapInsert;
+	ptpClock->clockStatus.leapDelete = datasets->leapDelete;
+}
+
+/* Boundary clock: one parent, current and time properties dataset for the whole clock */
+static void
+shareClockDatasets(ClockPorts *ports, const PtpClock *source)
+{
+	ClockDatasets datasets;
+	int i;
+
+	getClockDatasets(source, &datasets);
+
+	for(i = 0; i < ports->count; i++) {
+		if(ports->port[i] != source) {
+			setClockDatasets(ports->port[i], &datasets);
+		}
+	}
+}
+
+#ifdef PTPD_PORT_THREADS
+/*
+ * Boundary clock main loop with port threads: the main thread runs port 1
+ * and, through portThreadsPoll(), the decisions taken for the whole clock.
+ */
+static void
+protocolPortThreads(RunTimeOpts *rtOpts, ClockPorts *ports)
+{
+	PtpClock *ptpClock = ports->port[0];
+	NetPath *netPath = &ptpClock->netPath;
+	TimeInternal noWait = { 0, 0 };
+	Boolean busy;
+
+	if(!startPortThreads(ports)) {
+		CRITICAL("Could not start boundary clock port threads\n");
+		return;
+	}
+
+	for (;;)
+	{
+		busy = ptpClock->message_activity ||
+		    ptpClock->portDS.portState == PTP_INITIALIZING ||
+		    ptpClock->portDS.portState == PTP_FAULTY;
+
+		if(netSelect(busy ? &noWait : NULL, &netPath, 1, &ports->readfds) < 0) {
+			PERROR("failed to poll sockets");
+			FD_ZERO(&ports->readfds);
+		}
+
+		runPort(rtOpts, ptpClock);
+
+		portThreadsPoll(ports);
+
+		/* Perform the heavy signal processing synchronously */
+		checkSignals(rtOpts, ptpClock);
+	}
+}
+
+/*
+ * Boundary clock port thread main loop, until the main thread stops it.
+ * The port only waits for its own sockets, timers and queue.
+ */
+void
+protocolPortThread(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	TimeInternal noWait = { 0, 0 };
+	Boolean busy;
+
+	DBG("event POWERUP\n");
+
+	powerUp(rtOpts, ptpClock);
+
+	for (;;)
+	{
+		busy = ptpClock->message_activity ||
+		    ptpClock->portDS.portState == PTP_INITIALIZING ||
+		    ptpClock->portDS.portState == PTP_FAULTY;
+
+		FD_ZERO(ptpClock->readfds);
+		if(eventLoopWait(busy ? &noWait : NULL, ptpClock->readfds) < 0) {
+			PERROR("failed to poll sockets");
+			FD_ZERO(ptpClock->readfds);
+		}
+
+		if(!portThreadReceive(ptpClock)) {
+			break;
+		}
+
+		runPort(rtOpts, ptpClock);
+
+		portThreadSend(ptpClock);
+	}
+}
+#endif /* PTPD_PORT_THREADS */
+
+/*
+ * Boundary clock main loop: the ports are run one after the other, after one
+ * wait for the sockets of all of them. G_ptpClock is the port being run.
+ * Signals, the timing domain and the NTP engine are handled through port 1.
+ */
+static void
+protocolBoundaryClock(RunTimeOpts *rtOpts, ClockPorts *ports)
+{
+	extern PTPD_THREAD_LOCAL PtpClock *G_ptpClock;
+	NetPath *netPaths[PTPD_MAX_PORTS];
+	TimeInternal noWait = { 0, 0 };
+	PtpClock *port, *slave, *upstream = NULL;
+	Boolean busy;
+	int i;
+
+#ifdef PTPD_PORT_THREADS
+	if(ports->threaded) {
+		protocolPortThreads(rtOpts, ports);
+		return;
+	}
+#endif /* PTPD_PORT_THREADS */
+
+	for(i = 1; i < ports->count; i++) {
+		G_ptpClock = ports->port[i];
+		powerUp(G_ptpClock->rtOpts, G_ptpClock);
+	}
+	G_ptpClock = ports->port[0];
+
+	for (;;)
+	{
+		busy = FALSE;
+		for(i = 0; i < ports->count; i++) {
+			port = ports->port[i];
+			netPaths[i] = &port->netPath;
+			/* a port with work to do must not wait for the others */
+			if(port->message_activity ||
+			    port->portDS.portState == PTP_INITIALIZING ||
+			    port->portDS.portState == PTP_FAULTY) {
+				busy = TRUE;
 			}
-			if(ptpClock->unicastPeerDestination.transportAddress) {
-			    refreshUnicastGrants(&ptpClock->peerGrants,
-				1, rtOpts, ptpClock);
+		}
 
+		if(netSelect(busy ? &noWait : NULL, netPaths, ports->count, &ports->readfds) < 0) {
+			PERROR("failed to poll sockets");
+			FD_ZERO(&ports->readfds);
+		}
+
+		for(i = 0; i < ports->count; i++) {
+			G_ptpClock = ports->port[i];
+			runPort(G_ptpClock->rtOpts, G_ptpClock);
+			ports->portState[i] = G_ptpClock->portDS.portState;
+		}
+		G_ptpClock = ports->port[0];
+
+		/* the clock follows the port synchronised to the best master */
+		slave = NULL;
+		for(i = 0; i < ports->count; i++) {
+			port = ports->port[i];
+			if(port->portDS.portState == PTP_SLAVE ||
+			    port->portDS.portState == PTP_UNCALIBRATED) {
+				slave = port;
 			}
 		}
 
+		if(slave != upstream) {
+			upstream = slave;
+			handOverClockControl(ports, slave ? slave : ports->port[0]);
+			/* the other ports were decided on the old best master */
+			for(i = 0; i < ports->count; i++) {
+				ports->port[i]->record_update = TRUE;
+			}
+		}
+
+		if(slave != NULL) {
+			shareClockDatasets(ports, slave);
+		}
+
+		/* Perform the heavy signal processing synchronously */
+		checkSignals(rtOpts, ports->port[0]);
+	}
+}
+
+/* loop forever. doState() has a switch for the actions and events to be
+   checked for 'port_state'. the actions and events may or may not change
+   'port_state' by calling toState(), but once they are done we loop around
+   again and perform the actions required for the new 'port_state'. */
+void
+protocol(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	DBG("event POWERUP\n");
+
+	powerUp(rtOpts, ptpClock);
+
+	/* returns only if the ports could not be started */
+	if(ptpClock->ports != NULL) {
+		protocolBoundaryClock(rtOpts, ptpClock->ports);
+		return;
+	}
+
+	for (;;)
+	{
+		runPort(rtOpts, ptpClock);
+
 		/* Perform the heavy signal processing synchronously */
 		checkSignals(rtOpts, ptpClock);
 	}
@@ -352,6 +672,95 @@ void setPortState(PtpClock *ptpClock, Enumeration8 state)
 
 }
 
+/*
+ * Fast initial acquisition: for a while after becoming slave, Sync and
+ * Delay_Req run at the acquisition rate - requested from the master with
+ * unicast negotiation, sent that fast by us otherwise - and when it is
+ * over, the servo gets the frequency fitted over the burst.
+ */
+static void
+startFastAcquisition(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+
+	if(rtOpts->acquisitionPeriod <= 0 || rtOpts->noAdjust) {
+		return;
+	}
+
+	ptpClock->acquiring = TRUE;
+	startAcquisition(&ptpClock->servo, rtOpts->acquisitionPeriod);
+	timerStart(&ptpClock->timers[ACQUISITION_TIMER], rtOpts->acquisitionPeriod);
+
+	if(rtOpts->unicastNegotiation && ptpClock->parentGrants != NULL) {
+		setUnicastAcquisition(ptpClock->parentGrants, TRUE, rtOpts, ptpClock);
+	}
+
+	INFO("Fast acquisition for %d seconds, message interval 2^%d s\n",
+		rtOpts->acquisitionPeriod, rtOpts->acquisitionLogInterval);
+
+}
+
+/* back to the configured rates; the servo only gets the estimate if the burst ran its course */
+static void
+stopFastAcquisition(const RunTimeOpts *rtOpts, PtpClock *ptpClock, Boolean complete)
+{
+
+	if(!ptpClock->acquiring) {
+		return;
+	}
+
+	ptpClock->acquiring = FALSE;
+	timerStop(&ptpClock->timers[ACQUISITION_TIMER]);
+
+	if(rtOpts->unicastNegotiation && ptpClock->parentGrants != NULL) {
+		setUnicastAcquisition(ptpClock->parentGrants, FALSE, rtOpts, ptpClock);
+	}
+
+	if(!complete) {
+		DBG("Fast acquisition abandoned\n");
+		return;
+	}
+
+	/* a step is up to checkOffset() if the clock must not be reset */
+	if(endAcquisition(&ptpClock->servo, ptpClock->currentDS.meanPathDelay.nanoseconds) &&
+	    !rtOpts->noResetClock) {
+		WARNING("Fast acquisition: offset above 1 second - will step the clock\n");
+		ptpClock->clockControl.stepRequired = TRUE;
+	}
+
+	/* the burst has given the path delay what the calibration delay waits for */
+	if(rtOpts->calibrationDelay && !ptpClock->isCalibrated) {
+		timerStop(&ptpClock->timers[CALIBRATION_DELAY_TIMER]);
+		ptpClock->isCalibrated = TRUE;
+		NOTICE("Offset computation calibrated by fast acquisition\n");
+	}
+
+	/* the fitted phase is slewed out from now, for as long as it takes */
+	if(ptpClock->servo.phaseSlew != 0.0) {
+		if(ptpClock->clockControl.granted) {
+			adjFreq_wrapper(rtOpts, ptpClock, -ptpClock->servo.output);
+			timerStart(&ptpClock->timers[PHASE_SLEW_TIMER],
+			    ptpClock->servo.phaseSlew / ptpClock->servo.phaseSlewRate);
+		} else {
+			endPhaseSlew(&ptpClock->servo);
+		}
+	}
+
+}
+
+/* the Delay_Req interval in use: faster while acquiring, unless the master grants it */
+static Integer8
+delayReqInterval(const RunTimeOpts *rtOpts, const PtpClock *ptpClock)
+{
+
+	if(ptpClock->acquiring && !rtOpts->unicastNegotiation &&
+	    rtOpts->acquisitionLogInterval < ptpClock->portDS.logMinDelayReqInterval) {
+		return rtOpts->acquisitionLogInterval;
+	}
+
+	return ptpClock->portDS.logMinDelayReqInterval;
+
+}
+
 /* perform actions required when leaving 'port_state' and entering 'state' */
 void
 toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
@@ -370,7 +779,7 @@ toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		timerStop(&ptpClock->timers[MASTER_NETREFRESH_TIMER]);
 
 		if(rtOpts->unicastNegotiation && rtOpts->ipMode==IPMODE_UNICAST) {
-		    cancelAllGrants(ptpClock->unicastGrants, UNICAST_MAX_DESTINATIONS,
+		    cancelAllGrants(ptpClock->unicastGrants, ptpClock->unicastGrantTableSize,
 				rtOpts, ptpClock);
 		    if(ptpClock->portDS.delayMechanism == P2P) {
 			    cancelAllGrants(&ptpClock->peerGrants, 1,
@@ -383,6 +792,13 @@ toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		timerStop(&ptpClock->timers[ANNOUNCE_RECEIPT_TIMER]);
 		timerStop(&ptpClock->timers[SYNC_RECEIPT_TIMER]);
 		timerStop(&ptpClock->timers[DELAY_RECEIPT_TIMER]);
+
+		stopFastAcquisition(rtOpts, ptpClock, FALSE);
+
+		/* no master to follow any more - the clock keeps to the frequency model */
+		if(state != PTP_SLAVE && controlsClock(ptpClock) && startHoldover(rtOpts, ptpClock)) {
+			timerStart(&ptpClock->timers[HOLDOVER_TIMER], HOLDOVER_UPDATE_INTERVAL);
+		}
 		
 		if(rtOpts->unicastNegotiation && rtOpts->ipMode==IPMODE_UNICAST && ptpClock->parentGrants != NULL) {
 			/* do not cancel, just start re-requesting so we can still send a cancel on exit */
@@ -391,6 +807,9 @@ toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 			if(ptpClock->portDS.delayMechanism == E2E) {
 			    ptpClock->parentGrants->grantData[DELAY_RESP_INDEXED].timeLeft = 0;
 			}
+			scheduleUnicastGrant(&ptpClock->parentGrants->grantData[ANNOUNCE_INDEXED], ptpClock);
+			scheduleUnicastGrant(&ptpClock->parentGrants->grantData[SYNC_INDEXED], ptpClock);
+			scheduleUnicastGrant(&ptpClock->parentGrants->grantData[DELAY_RESP_INDEXED], ptpClock);
 
 			ptpClock->parentGrants = NULL;
 
@@ -437,11 +856,13 @@ toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		break;
 	case PTP_INITIALIZING:
 		if(rtOpts->unicastNegotiation) {
+		    /* grant entries are about to be wiped - unlink them from the wheel first */
+		    timerWheelClear(&ptpClock->grantWheel);
 		    if(!ptpClock->defaultDS.slaveOnly) {
 
 			initUnicastGrantTable(ptpClock->unicastGrants,
 				ptpClock->portDS.delayMechanism,
-				UNICAST_MAX_DESTINATIONS, NULL,
+				ptpClock->unicastGrantTableSize, NULL,
 				rtOpts, ptpClock);
 
 			if(rtOpts->unicastDestinationsSet) {
@@ -450,12 +871,18 @@ toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 					ptpClock->unicastDestinationCount, ptpClock->unicastDestinations,
 					rtOpts, ptpClock);
 			}
+
+			initUnicastGrantIndex(&ptpClock->grantIndex, ptpClock->unicastGrants,
+					ptpClock->unicastGrantTableSize, rtOpts);
 			
 		    } else {
 			initUnicastGrantTable(ptpClock->unicastGrants,
 					ptpClock->portDS.delayMechanism,
 					ptpClock->unicastDestinationCount, ptpClock->unicastDestinations,
 					rtOpts, ptpClock);
+
+			initUnicastGrantIndex(&ptpClock->grantIndex, ptpClock->unicastGrants,
+					ptpClock->unicastDestinationCount, rtOpts);
 		    }
 		    if(ptpClock->unicastPeerDestination.transportAddress) {
 			initUnicastGrantTable(&ptpClock->peerGrants,
@@ -467,6 +894,17 @@ toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 			 * so functions can see this is a peer table
 			 */
 			ptpClock->peerGrants.isPeer = TRUE;
+
+			if(!ptpClock->defaultDS.slaveOnly) {
+			    armUnicastGrants(ptpClock->unicastGrants,
+				    ptpClock->unicastGrantTableSize, ptpClock);
+			} else {
+			    armUnicastGrants(ptpClock->unicastGrants,
+				    ptpClock->unicastDestinationCount, ptpClock);
+			}
+			if(ptpClock->unicastPeerDestination.transportAddress) {
+			    armUnicastGrants(&ptpClock->peerGrants, 1, ptpClock);
+			}
 		}
 		break;
 	default:
@@ -645,10 +1083,25 @@ toState(UInteger8 state, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		 * restore the observed drift value using the selected method,
 		 * reset on failure or when -F 0 (default) is used, don't inform user
 		 */
-		restoreDrift(ptpClock, rtOpts, TRUE);
+		if(controlsClock(ptpClock))
+			restoreDrift(ptpClock, rtOpts, TRUE);
+
+		/* the model has the better idea of the frequency now than the drift saved */
+		if(ptpClock->holdover.state == HOLDOVER_ACTIVE) {
+			timerStop(&ptpClock->timers[HOLDOVER_TIMER]);
+			stopHoldover(rtOpts, ptpClock, controlsClock(ptpClock));
+		}
+
+		/* after restoreDrift(): the burst is fitted from the drift it applied */
+		if(controlsClock(ptpClock))
+			startFastAcquisition(rtOpts, ptpClock);
 
 		ptpClock->waitingForFollow = FALSE;
 		ptpClock->waitingForDelayResp = FALSE;
+#ifdef PTPD_TXTIMESTAMP_KEYED
+		ptpClock->delayReqTxPending.pending = FALSE;
+		ptpClock->pdelayReqTxPending.pending = FALSE;
+#endif /* PTPD_TXTIMESTAMP_KEYED */
 
 		if(rtOpts->calibrationDelay) {
 			ptpClock->isCalibrated = FALSE;
@@ -761,14 +1214,25 @@ doInit(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		return FALSE;
 	}
 
+#ifdef PTPD_PHC
+	/* the clock we steer follows the interface's timestamping */
+	if (!phcInit(rtOpts, &ptpClock->netPath)) {
+		ERROR("Failed to initialize PTP hardware clock\n");
+		toState(PTP_FAULTY, rtOpts, ptpClock);
+		return FALSE;
+	}
+#endif /* PTPD_PHC */
+
 	strncpy(filterMask,FILTER_MASK,199);
 
 	/* initialize other stuff */
 	initData(rtOpts, ptpClock);
+	latencyProbeInit(&ptpClock->latency, rtOpts->latencyHistograms);
 	initClock(rtOpts, ptpClock);
-	setupPIservo(&ptpClock->servo, rtOpts);
-	/* restore observed drift and inform user */
-	if(ptpClock->defaultDS.clockQuality.clockClass > 127)
+	setupServo(&ptpClock->servo, rtOpts);
+	/* restore observed drift and inform user - unless holding over through a restart */
+	if(ptpClock->defaultDS.clockQuality.clockClass > 127 && controlsClock(ptpClock) &&
+	    ptpClock->holdover.state != HOLDOVER_ACTIVE)
 		restoreDrift(ptpClock, rtOpts, FALSE);
 	m1(rtOpts, ptpClock );
 	msgPackHeader(ptpClock->msgObuf, ptpClock);
@@ -806,6 +1270,17 @@ doState(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 		 */
 		if(ptpClock->record_update)
 		{
+			/* a boundary clock decides for all its ports at once */
+			if(ptpClock->ports != NULL) {
+#ifdef PTPD_PORT_THREADS
+				if(ptpClock->ports->threaded) {
+					portThreadsBmcUpdate(ptpClock);
+					break;
+				}
+#endif /* PTPD_PORT_THREADS */
+				boundaryClockStateDecision(ptpClock->ports);
+				break;
+			}
 			DBG2("event STATE_DECISION_EVENT\n");
 			ptpClock->record_update = FALSE;
 			state = bmc(ptpClock->foreign, rtOpts, ptpClock);
@@ -947,13 +1422,34 @@ doState(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 			}
 		}
 
+		if(ptpClock->portDS.portState==PTP_SLAVE && timerExpired(&ptpClock->timers[ACQUISITION_TIMER])) {
+			stopFastAcquisition(rtOpts, ptpClock, TRUE);
+		}
+
+		/* a servo reset has ended the slew already */
+		if(timerExpired(&ptpClock->timers[PHASE_SLEW_TIMER])) {
+			timerStop(&ptpClock->timers[PHASE_SLEW_TIMER]);
+			if(ptpClock->servo.phaseSlew != 0.0) {
+				double adj = endPhaseSlew(&ptpClock->servo);
+				if(ptpClock->clockControl.granted) {
+					adjFreq_wrapper(rtOpts, ptpClock, adj);
+				}
+			}
+		}
+
 		if (ptpClock->portDS.delayMechanism == E2E) {
 			if(timerExpired(&ptpClock->timers[DELAYREQ_INTERVAL_TIMER])) {
 				DBG("event DELAYREQ_INTERVAL_TIMEOUT_EXPIRES\n");
-				/* if unicast negotiation is enabled, only request if granted */
-				if(!rtOpts->unicastNegotiation ||
+				/*
+				 * if unicast negotiation is enabled, only request if granted;
+				 * while acquiring, only once per Sync: the path delay uses the last
+				 * Sync, out by the frequency offset - unknown yet - times its age
+				 */
+				if((!rtOpts->unicastNegotiation ||
 					(ptpClock->parentGrants &&
-					    ptpClock->parentGrants->grantData[DELAY_RESP_INDEXED].granted)) {
+					    ptpClock->parentGrants->grantData[DELAY_RESP_INDEXED].granted)) &&
+					(!ptpClock->acquiring || ptpClock->acquisitionSync)) {
+						ptpClock->acquisitionSync = FALSE;
 						issueDelayReq(rtOpts,ptpClock);
 				}
 			}
@@ -1135,10 +1631,11 @@ doState(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 			issueSync(rtOpts, ptpClock);
 		}
 		if(!ptpClock->warnedUnicastCapacity) {
-		    if(ptpClock->slaveCount >= UNICAST_MAX_DESTINATIONS ||
+		    if(ptpClock->slaveCount >= ptpClock->unicastGrantTableSize ||
 			ptpClock->unicastDestinationCount >= UNICAST_MAX_DESTINATIONS) {
 			    if(rtOpts->ipMode == IPMODE_UNICAST) {
-				WARNING("Maximum unicast slave capacity reached: %d\n",UNICAST_MAX_DESTINATIONS);
+				WARNING("Maximum unicast slave capacity reached: %d\n",
+				    rtOpts->unicastNegotiation ? ptpClock->unicastGrantTableSize : UNICAST_MAX_DESTINATIONS);
 				ptpClock->warnedUnicastCapacity = TRUE;
 			    }
 		    }
@@ -1393,10 +1890,12 @@ processMessage(RunTimeOpts* rtOpts, PtpClock* ptpClock, TimeInternal* timeStamp,
 	           length, isFromSelf, rtOpts, ptpClock);
 	break;
     case SYNC:
+	latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_PROCESS);
 	handleSync(&ptpClock->msgTmpHeader,
 	       length, timeStamp, isFromSelf, ptpClock->netPath.lastSourceAddr, ptpClock->netPath.lastDestAddr, rtOpts, ptpClock);
 	break;
     case FOLLOW_UP:
+	latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_PROCESS);
 	handleFollowUp(&ptpClock->msgTmpHeader,
 	           length, isFromSelf, rtOpts, ptpClock);
 	break;
@@ -1442,6 +1941,66 @@ processMessage(RunTimeOpts* rtOpts, PtpClock* ptpClock, TimeInternal* timeStamp,
 }
 
 
+#ifdef PTPD_RECV_BATCHING
+/*
+ * Read a batch of messages from the event or general socket with one
+ * recvmmsg() call and process them straight from the receive buffers.
+ * Returns FALSE if the port went faulty.
+ */
+static Boolean
+handleBatch(RunTimeOpts *rtOpts, PtpClock *ptpClock, Boolean event)
+{
+
+    TimeInternal timeStamp;
+    ssize_t length;
+    Octet *buf;
+    int64_t received;
+
+    received = latencyStart(&ptpClock->latency, LATENCY_RX);
+
+    if (netRecvBatch(&ptpClock->netPath, event, rtOpts->recvBatchSize) < 0) {
+	PERROR("failed to receive on the %s socket", event ? "event" : "general");
+	toState(PTP_FAULTY, rtOpts, ptpClock);
+	ptpClock->counters.messageRecvErrors++;
+	return FALSE;
+    }
+
+    latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_RECV);
+    clearTime(&timeStamp);
+
+    while (netNextBatchPacket(&ptpClock->netPath, event, &buf, &length, &timeStamp)) {
+
+	if (length == 0) {
+	    continue;
+	}
+
+	if (event && ptpClock->leapSecondInProgress) {
+	    DBG("Leap second in progress - will not process event message\n");
+	    continue;
+	}
+
+	/* every message counts from the read of the batch */
+	latencyResume(&ptpClock->latency, LATENCY_RX, received);
+	ptpClock->msgIbuf = buf;
+	processMessage(rtOpts, ptpClock, &timeStamp, length);
+	ptpClock->msgIbuf = ptpClock->msgIbufStorage;
+
+	/* the rest of the batch is dropped with the port */
+	if (ptpClock->portDS.portState == PTP_FAULTY) {
+	    return FALSE;
+	}
+
+	if (!event) {
+	    clearTime(&timeStamp);
+	}
+
+    }
+
+    return TRUE;
+
+}
+#endif /* PTPD_RECV_BATCHING */
+
 /* check and handle received messages */
 void
 handle(RunTimeOpts *rtOpts, PtpClock *ptpClock)
@@ -1451,10 +2010,14 @@ handle(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 
     TimeInternal timeStamp = { 0, 0 };
     fd_set readfds;
+    NetPath *netPath = &ptpClock->netPath;
 
     FD_ZERO(&readfds);
-    if (!ptpClock->message_activity) {
-	ret = netSelect(NULL, &ptpClock->netPath, &readfds);
+    if (ptpClock->ports != NULL) {
+	/* boundary clock: the port's loop has done the waiting */
+	readfds = *ptpClock->readfds;
+    } else if (!ptpClock->message_activity) {
+	ret = netSelect(NULL, &netPath, 1, &readfds);
 	if (ret < 0) {
 	    PERROR("failed to poll sockets");
 	    ptpClock->counters.messageRecvErrors++;
@@ -1472,8 +2035,10 @@ handle(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 #ifdef PTPD_PCAP
     if (rtOpts->pcap == TRUE) {
 	if (ptpClock->netPath.pcapEventSock >=0 && FD_ISSET(ptpClock->netPath.pcapEventSock, &readfds)) {
+	    latencyStart(&ptpClock->latency, LATENCY_RX);
 	    length = netRecvEvent(ptpClock->msgIbuf, &timeStamp,
 		          &ptpClock->netPath,0);
+	    latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_RECV);
 	    if (length == 0){ /* timeout, return for now */
 		return;
 		}
@@ -1494,7 +2059,9 @@ handle(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 	    }
 	}
 	if (ptpClock->netPath.pcapGeneralSock >=0 && FD_ISSET(ptpClock->netPath.pcapGeneralSock, &readfds)) {
+	    latencyStart(&ptpClock->latency, LATENCY_RX);
 	    length = netRecvGeneral(ptpClock->msgIbuf, &ptpClock->netPath);
+	    latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_RECV);
 	    if (length == 0) /* timeout, return for now */
 		return;
 	    if (length < 0) {
@@ -1507,9 +2074,35 @@ handle(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 	}
     } else {
 #endif
+#ifdef PTPD_RECV_BATCHING
+	if (rtOpts->recvBatchSize > 1) {
+	    if (FD_ISSET(ptpClock->netPath.eventSock, &readfds)) {
+#ifdef PTPD_TXTIMESTAMP_KEYED
+		if (ptpClock->netPath.txTimestampKeyed) {
+		    processTxTimestamps(rtOpts, ptpClock);
+		}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+		if (!handleBatch(rtOpts, ptpClock, TRUE)) {
+		    return;
+		}
+	    }
+	    if (FD_ISSET(ptpClock->netPath.generalSock, &readfds)) {
+		handleBatch(rtOpts, ptpClock, FALSE);
+	    }
+	    return;
+	}
+#endif /* PTPD_RECV_BATCHING */
 	if (FD_ISSET(ptpClock->netPath.eventSock, &readfds)) {
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	    /* TX timestamps collected asynchronously wake us up too */
+	    if (ptpClock->netPath.txTimestampKeyed) {
+		processTxTimestamps(rtOpts, ptpClock);
+	    }
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+	    latencyStart(&ptpClock->latency, LATENCY_RX);
 	    length = netRecvEvent(ptpClock->msgIbuf, &timeStamp,
 		          &ptpClock->netPath, 0);
+	    latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_RECV);
 	    if (length < 0) {
 		PERROR("failed to receive on the event socket");
 		toState(PTP_FAULTY, rtOpts, ptpClock);
@@ -1518,13 +2111,19 @@ handle(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 	    }
 	    if(ptpClock->leapSecondInProgress) {
 		DBG("Leap second in progress - will not process event message\n");
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	    } else if (length == 0 && ptpClock->netPath.txTimestampKeyed) {
+		/* there were only TX timestamps on the socket */
+#endif /* PTPD_TXTIMESTAMP_KEYED */
 	    } else {
 		processMessage(rtOpts, ptpClock, &timeStamp, length);
 	    }
 	}
 
 	if (FD_ISSET(ptpClock->netPath.generalSock, &readfds)) {
+	    latencyStart(&ptpClock->latency, LATENCY_RX);
 	    length = netRecvGeneral(ptpClock->msgIbuf, &ptpClock->netPath);
+	    latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_RECV);
 	    if (length < 0) {
 		PERROR("failed to receive on the general socket");
 		toState(PTP_FAULTY, rtOpts, ptpClock);
@@ -1566,7 +2165,7 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 	if(rtOpts->unicastNegotiation && rtOpts->ipMode == IPMODE_UNICAST) {
 
 		nodeTable = findUnicastGrants(&header->sourcePortIdentity, 0,
-							ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS,
+							ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize,
 							FALSE);
 		if(nodeTable == NULL || !(nodeTable->grantData[ANNOUNCE_INDEXED].granted)) {
 			if(!rtOpts->unicastAcceptAny) {
@@ -1580,6 +2179,9 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 		}
 	}
 
+	/* decoded once here: s1() and addForeign() take it from msgTmp */
+	msgUnpackAnnounce(ptpClock->msgIbuf, &ptpClock->msgTmp.announce);
+
 	switch (ptpClock->portDS.portState) {
 	case PTP_INITIALIZING:
 	case PTP_FAULTY:
@@ -1608,9 +2210,6 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 
 		switch (isFromCurrentParent(ptpClock, header)) {
 		case TRUE:
-	   		msgUnpackAnnounce(ptpClock->msgIbuf,
-					  &ptpClock->msgTmp.announce);
-
 			/* update datasets (file bmc.c) */
 	   		s1(header,&ptpClock->msgTmp.announce,ptpClock, rtOpts);
 
@@ -1682,8 +2281,6 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 			break;
 
 		case FALSE:
-			/* addForeign takes care of AnnounceUnpacking */
-
 			/* the actual decision to change masters is
 			 * only done in doState() / record_update ==
 			 * TRUE / bmc()
@@ -1694,7 +2291,7 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 			 * the slave will  sit idle if current parent
 			 * is not announcing, but another GM is
 			 */
-			addForeign(ptpClock->msgIbuf,header,ptpClock,localPreference,ptpClock->netPath.lastSourceAddr);
+			addForeign(header,&ptpClock->msgTmp.announce,ptpClock,localPreference,ptpClock->netPath.lastSourceAddr);
 			break;
 
 		default:
@@ -1729,9 +2326,6 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 		ptpClock->record_update = TRUE;
 
 		if (isFromCurrentParent(ptpClock, header)) {
-			msgUnpackAnnounce(ptpClock->msgIbuf,
-					  &ptpClock->msgTmp.announce);
-
 			/* TODO: not in spec
 			 * datasets should not be updated by another master
 			 * this is the reason why we are PASSIVE and not SLAVE
@@ -1749,13 +2343,12 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 			   (pow(2,ptpClock->portDS.logAnnounceInterval)));
 
 		} else {
-			/*addForeign takes care of AnnounceUnpacking*/
 			/* the actual decision to change masters is only done in  doState() / record_update == TRUE / bmc() */
 			/* the original code always called: addforeign(new master) + timerstart(announce) */
 
 			DBG("___ Announce: received Announce from another master, will add to the list, as it might be better\n\n");
 			DBGV("this is to be decided immediatly by bmc())\n\n");
-			addForeign(ptpClock->msgIbuf,header,ptpClock,localPreference,ptpClock->netPath.lastSourceAddr);
+			addForeign(header,&ptpClock->msgTmp.announce,ptpClock,localPreference,ptpClock->netPath.lastSourceAddr);
 		}
 		break;
 
@@ -1773,7 +2366,7 @@ handleAnnounce(MsgHeader *header, ssize_t length,
 		}
 		ptpClock->counters.announceMessagesReceived++;
 		DBGV("Announce message from another foreign master\n");
-		addForeign(ptpClock->msgIbuf,header,ptpClock, localPreference,ptpClock->netPath.lastSourceAddr);
+		addForeign(header,&ptpClock->msgTmp.announce,ptpClock, localPreference,ptpClock->netPath.lastSourceAddr);
 		ptpClock->record_update = TRUE;    /* run BMC() as soon as possible */
 		break;
 
@@ -1809,7 +2402,7 @@ handleSync(const MsgHeader *header, ssize_t length,
 	if(!isFromSelf && rtOpts->unicastNegotiation && rtOpts->ipMode == IPMODE_UNICAST) {
 	    UnicastGrantTable *nodeTable = NULL;
 	    nodeTable = findUnicastGrants(&header->sourcePortIdentity, 0,
-			ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS,
+			ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize,
 			FALSE);
 	    if(nodeTable != NULL) {
 		nodeTable->grantData[SYNC_INDEXED].receiving = header->sequenceId;
@@ -1848,7 +2441,7 @@ handleSync(const MsgHeader *header, ssize_t length,
 
 				if (ptpClock->portDS.delayMechanism == E2E)
 					timerStart(&ptpClock->timers[DELAYREQ_INTERVAL_TIMER],
-						   pow(2,ptpClock->portDS.logMinDelayReqInterval));
+						   pow(2,delayReqInterval(rtOpts, ptpClock)));
 				else if (ptpClock->portDS.delayMechanism == P2P)
 					timerStart(&ptpClock->timers[PDELAYREQ_INTERVAL_TIMER],
 						   pow(2,ptpClock->portDS.logMinPdelayReqInterval));
@@ -1887,6 +2480,7 @@ handleSync(const MsgHeader *header, ssize_t length,
 			
 
 			recordSync(header->sequenceId, tint);
+			ptpClock->acquisitionSync = TRUE;
 
 			if ((header->flagField0 & PTP_TWO_STEP) == PTP_TWO_STEP) {
 				DBG2("HandleSync: waiting for follow-up \n");
@@ -1934,15 +2528,18 @@ handleSync(const MsgHeader *header, ssize_t length,
 				ptpClock->waitingForFollow = FALSE;
 				toInternalTime(&OriginTimestamp,
 					       &ptpClock->msgTmp.sync.originTimestamp);
+				latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_HANDLE);
 				updateOffset(&OriginTimestamp,
 					     &ptpClock->sync_receive_time,
 					     &ptpClock->ofm_filt,rtOpts,
 					     ptpClock,&correctionField);
+				latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_OFFSET);
 				checkOffset(rtOpts,ptpClock);
 				if (ptpClock->clockControl.updateOK) {
 					ptpClock->acceptedUpdates++;
 					updateClock(rtOpts,ptpClock);
 				}
+				latencyEnd(&ptpClock->latency, LATENCY_RX, LATENCY_RX_TOTAL);
 				ptpClock->offsetUpdates++;
 				
 				ptpClock->defaultDS.twoStepFlag=FALSE;
@@ -1971,7 +2568,7 @@ handleSync(const MsgHeader *header, ssize_t length,
 				msgUnpackSync(ptpClock->msgIbuf,
 					      &ptpClock->msgTmp.sync);
 				toInternalTime(&OriginTimestamp, &ptpClock->msgTmp.sync.originTimestamp);
-			    dst = lookupSyncIndex(&OriginTimestamp, header->sequenceId, ptpClock->syncDestIndex);
+			    dst = lookupSyncIndex(&OriginTimestamp, header->sequenceId, ptpClock->syncDestIndex, ptpClock->syncDestIndexSize);
 
 #ifdef RUNTIME_DEBUG
 			    {
@@ -2077,15 +2674,18 @@ handleFollowUp(const MsgHeader *header, ssize_t length,
 					send_time = preciseOriginTimestamp (received inside followup)
 					recv_time = sync_receive_time (received as CMSG in handleEvent)
 					*/
+					latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_HANDLE);
 					updateOffset(&preciseOriginTimestamp,
 						     &ptpClock->sync_receive_time,&ptpClock->ofm_filt,
 						     rtOpts,ptpClock,
 						     &correctionField);
+					latencyMark(&ptpClock->latency, LATENCY_RX, LATENCY_RX_OFFSET);
 					checkOffset(rtOpts,ptpClock);
 					if (ptpClock->clockControl.updateOK) {
 						ptpClock->acceptedUpdates++;
 						updateClock(rtOpts,ptpClock);
 					}
+					latencyEnd(&ptpClock->latency, LATENCY_RX, LATENCY_RX_TOTAL);
 					ptpClock->offsetUpdates++;
 
 					break;
@@ -2138,7 +2738,7 @@ handleDelayReq(const MsgHeader *header, ssize_t length,
 
 		if(!isFromSelf && rtOpts->unicastNegotiation && rtOpts->ipMode == IPMODE_UNICAST) {
 		    nodeTable = findUnicastGrants(&header->sourcePortIdentity, 0,
-				ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS,
+				ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize,
 				FALSE);
 		    if(nodeTable == NULL || !(nodeTable->grantData[DELAY_RESP_INDEXED].granted)) {
 			DBG("Ignoring Delay Request from slave: unicast transmission not granted\n");
@@ -2209,8 +2809,7 @@ handleDelayReq(const MsgHeader *header, ssize_t length,
 			break;
 
 		case PTP_MASTER:
-			msgUnpackHeader(ptpClock->msgIbuf,
-					&ptpClock->delayReqHeader);
+			ptpClock->delayReqHeader = *header;
 			ptpClock->counters.delayReqMessagesReceived++;
 
 			issueDelayResp(tint,&ptpClock->delayReqHeader, sourceAddress,
@@ -2268,7 +2867,7 @@ handleDelayResp(const MsgHeader *header, ssize_t length,
 		if(rtOpts->unicastNegotiation && rtOpts->ipMode == IPMODE_UNICAST) {
 		    UnicastGrantTable *nodeTable = NULL;
 		    nodeTable = findUnicastGrants(&header->sourcePortIdentity, 0,
-				ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS,
+				ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize,
 				FALSE);
 		    if(nodeTable != NULL) {
 			nodeTable->grantData[DELAY_RESP_INDEXED].receiving = header->sequenceId;
@@ -2311,6 +2910,13 @@ handleDelayResp(const MsgHeader *header, ssize_t length,
 				    (ptpClock->portDS.announceReceiptTimeout) * (pow(2,ptpClock->portDS.logAnnounceInterval)),
 					MISSED_MESSAGES_MAX * (pow(2,ptpClock->portDS.logMinDelayReqInterval))));
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+				/* the TX timestamp of our DelayReq may not have been collected yet */
+				if (ptpClock->delayReqTxPending.pending) {
+					processTxTimestamps(rtOpts, ptpClock);
+				}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 				if (!ptpClock->waitingForDelayResp) {
 					DBG("Ignored DelayResp sequence %d - wasn't waiting for one\n",
 						header->sequenceId);
@@ -2436,7 +3042,7 @@ handlePdelayReq(MsgHeader *header, ssize_t length,
 
 		if(!isFromSelf && rtOpts->unicastNegotiation && rtOpts->ipMode == IPMODE_UNICAST) {
 		    nodeTable = findUnicastGrants(&header->sourcePortIdentity, 0,
-				ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS,
+				ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize,
 				FALSE);
 		    if(nodeTable == NULL || !(nodeTable->grantData[PDELAY_RESP_INDEXED].granted)) {
 			DBG("Ignoring Peer Delay Request from peer: unicast transmission not granted\n");
@@ -2475,8 +3081,7 @@ handlePdelayReq(MsgHeader *header, ssize_t length,
 				break;
 			} else {
 				ptpClock->counters.pdelayReqMessagesReceived++;
-				msgUnpackHeader(ptpClock->msgIbuf,
-						&ptpClock->PdelayReqHeader);
+				ptpClock->PdelayReqHeader = *header;
 				issuePdelayResp(tint, header, sourceAddress, rtOpts,
 						ptpClock);	
 				break;
@@ -2570,6 +3175,18 @@ handlePdelayResp(const MsgHeader *header, TimeInternal *tint,
 				    ptpClock->counters.sequenceMismatchErrors++;
 				    break;
 			}
+#ifdef PTPD_TXTIMESTAMP_KEYED
+			/* the TX timestamp of our PdelayReq may not have been collected yet */
+			if (ptpClock->pdelayReqTxPending.pending) {
+				processTxTimestamps(rtOpts, ptpClock);
+				if (ptpClock->pdelayReqTxPending.pending) {
+					DBG("PdelayResp: no TX timestamp for PdelayReq %d yet - discarded\n",
+					    header->sequenceId);
+					ptpClock->counters.discardedMessages++;
+					break;
+				}
+			}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
 			if ((!memcmp(ptpClock->portDS.portIdentity.clockIdentity,ptpClock->msgTmp.presp.requestingPortIdentity.clockIdentity,CLOCK_IDENTITY_LENGTH))
 				 && ( ptpClock->portDS.portIdentity.portNumber == ptpClock->msgTmp.presp.requestingPortIdentity.portNumber))	{
 				ptpClock->counters.pdelayRespMessagesReceived++;
@@ -2860,6 +3477,12 @@ issueAnnounce(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 	UnicastGrantData *grant = NULL;
 	Boolean okToSend = TRUE;
 
+	/*
+	 * the datasets change in many places (BMC, leap seconds, management) -
+	 * repack once per round, every destination then gets a patched copy
+	 */
+	msgPackAnnounceTemplate(ptpClock);
+
 	/* send Announce to Ethernet or multicast */
 	if(rtOpts->transport == IEEE_802_3 || (rtOpts->ipMode != IPMODE_UNICAST)) {
 		issueAnnounceSingle(dst, &ptpClock->sentAnnounceSequenceId, rtOpts, ptpClock);
@@ -2867,7 +3490,8 @@ issueAnnounce(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 	} else {
 	    /* send to granted only */
 	    if(rtOpts->unicastNegotiation) {
-		for(i = 0; i < UNICAST_MAX_DESTINATIONS; i++) {
+		ptpClock->slaveCount = 0;
+		for(i = 0; i < ptpClock->unicastGrantTableSize; i++) {
 		    grant = &(ptpClock->unicastGrants[i].grantData[ANNOUNCE_INDEXED]);
 		    okToSend = TRUE;
 		    if(grant->logInterval > ptpClock->portDS.logAnnounceInterval ) {
@@ -2878,6 +3502,7 @@ issueAnnounce(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 			grant->intervalCounter++;
 		    }
 		    if(grant->granted) {
+			ptpClock->slaveCount++;
 			if(okToSend) {
 			    issueAnnounceSingle(ptpClock->unicastGrants[i].transportAddress,
 			    &grant->sentSeqId,rtOpts, ptpClock);
@@ -2929,6 +3554,10 @@ issueSync(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 	int i = 0;
 	UnicastGrantData *grant = NULL;
 	Boolean okToSend = TRUE;
+	Boolean batching = FALSE;
+
+	/* repack once per round, every destination then gets a patched copy */
+	msgPackSyncTemplate(ptpClock);
 
 	/* send Sync to Ethernet or multicast */
 	if(rtOpts->transport == IEEE_802_3 || (rtOpts->ipMode != IPMODE_UNICAST)) {
@@ -2936,14 +3565,21 @@ issueSync(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 
 	/* send Sync to unicast destination(s) */
 	} else {
-	    for(i = 0; i < UNICAST_MAX_DESTINATIONS; i++) {
-		ptpClock->syncDestIndex[i].transportAddress = 0;
+	    memset(ptpClock->syncDestIndex, 0, ptpClock->syncDestIndexSize * sizeof(SyncDestEntry));
+	    for(i = 0; i < ptpClock->unicastGrantTableSize; i++) {
 		clearTime(&ptpClock->unicastGrants[i].lastSyncTimestamp);
+	    }
+	    for(i = 0; i < ptpClock->unicastDestinationCount; i++) {
 		clearTime(&ptpClock->unicastDestinations[i].lastSyncTimestamp);
 	    }
+#ifdef PTPD_SYNC_BATCHING
+	    if((batching = syncBatchingActive(rtOpts, ptpClock))) {
+		expireSyncTxPending(ptpClock);
+	    }
+#endif /* PTPD_SYNC_BATCHING */
 	    /* send to granted only */
 	    if(rtOpts->unicastNegotiation) {
-		for(i = 0; i < UNICAST_MAX_DESTINATIONS; i++) {
+		for(i = 0; i < ptpClock->unicastGrantTableSize; i++) {
 		    grant = &(ptpClock->unicastGrants[i].grantData[SYNC_INDEXED]);
 		    okToSend = TRUE;
 		    /* handle different intervals */
@@ -2958,25 +3594,188 @@ issueSync(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 
 		    if(grant->granted) {
 			if(okToSend) {
-			    ptpClock->unicastGrants[i].lastSyncTimestamp =
-				issueSyncSingle(ptpClock->unicastGrants[i].transportAddress,
-				&grant->sentSeqId,rtOpts, ptpClock);
+			    issueSyncUnicast(ptpClock->unicastGrants[i].transportAddress,
+				&grant->sentSeqId, &ptpClock->unicastGrants[i].lastSyncTimestamp,
+				batching, rtOpts, ptpClock);
 			}
 		    }
 		}
 	    /* send to fixed unicast destinations */
 	    } else {
 		for(i = 0; i < ptpClock->unicastDestinationCount; i++) {
-			ptpClock->unicastDestinations[i].lastSyncTimestamp =
-			    issueSyncSingle(ptpClock->unicastDestinations[i].transportAddress,
+			issueSyncUnicast(ptpClock->unicastDestinations[i].transportAddress,
 			    &(ptpClock->unicastGrants[i].grantData[SYNC_INDEXED].sentSeqId),
-						rtOpts, ptpClock);
+			    &ptpClock->unicastDestinations[i].lastSyncTimestamp,
+			    batching, rtOpts, ptpClock);
 		    }
 		}
+#ifdef PTPD_SYNC_BATCHING
+	    /* send whatever is left in the batch */
+	    if(batching) {
+		flushSyncBatch(rtOpts, ptpClock);
+	    }
+#endif /* PTPD_SYNC_BATCHING */
+	}
+
+}
+
+/* send Sync to a single unicast destination, or queue it for the next batch */
+static void
+issueSyncUnicast(Integer32 dst, UInteger16 *sequenceId, TimeInternal *lastSyncTimestamp,
+		Boolean batching, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+#ifdef PTPD_SYNC_BATCHING
+	if(batching) {
+		queueSyncBatch(dst, sequenceId, lastSyncTimestamp, rtOpts, ptpClock);
+		return;
+	}
+#endif /* PTPD_SYNC_BATCHING */
+	*lastSyncTimestamp = issueSyncSingle(dst, sequenceId, rtOpts, ptpClock);
+}
+
+#ifdef PTPD_SYNC_BATCHING
+/* can Syncs be sent in a batch, with keyed TX timestamps collected later? */
+static Boolean
+syncBatchingActive(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+
+	if(!rtOpts->unicastSyncBatching || !ptpClock->netPath.txTimestampKeyed ||
+	    ptpClock->netPath.txTimestampFailure) {
+		return FALSE;
+	}
+
+#ifdef PTPD_PCAP
+	if(ptpClock->netPath.pcapEvent != NULL) {
+		return FALSE;
+	}
+#endif /* PTPD_PCAP */
+
+	/* issueSyncSingle() knows how to deal with this - see LEAPNOTE01# */
+	if(ptpClock->leapSecondInProgress) {
+		return FALSE;
 	}
 
+	return TRUE;
+
 }
 
+/* pack a Sync for the current batch, sending the batch when full */
+static void
+queueSyncBatch(Integer32 dst, UInteger16 *sequenceId, TimeInternal *lastSyncTimestamp,
+		const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	SyncBatch *batch = &ptpClock->syncBatch;
+	Timestamp originTimestamp;
+	TimeInternal internalTime;
+
+	latencyStart(&ptpClock->latency, LATENCY_TX);
+	getTime(&internalTime);
+
+	if (respectUtcOffset(rtOpts, ptpClock) == TRUE) {
+		internalTime.seconds += ptpClock->timePropertiesDS.currentUtcOffset;
+	}
+
+	fromInternalTime(&internalTime,&originTimestamp);
+
+	msgPackSync(batch->buf[batch->count], *sequenceId, &originTimestamp, ptpClock);
+	latencyMark(&ptpClock->latency, LATENCY_TX, LATENCY_TX_PACK);
+	latencyAbandon(&ptpClock->latency, LATENCY_TX);
+	batch->destinations[batch->count] = dst;
+	batch->sequenceIds[batch->count] = sequenceId;
+	batch->count++;
+
+	*lastSyncTimestamp = internalTime;
+
+	if(batch->count == SYNC_BATCH_MAX) {
+		flushSyncBatch(rtOpts, ptpClock);
+	}
+}
+
+/* send the current batch and register the Syncs sent as waiting for TX timestamps */
+static void
+flushSyncBatch(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	SyncBatch *batch = &ptpClock->syncBatch;
+	SyncTxPending *entry;
+	UInteger32 firstKey = 0;
+	int64_t sendTime;
+	int i, sent;
+
+	if(!batch->count) {
+		return;
+	}
+
+	latencyStart(&ptpClock->latency, LATENCY_TX);
+	sent = netSendEventBatch(&batch->buf[0][0], SYNC_LENGTH, batch->count,
+				batch->destinations, &ptpClock->netPath, &firstKey);
+	/* one sample per batch: the timestamps are waited for from here */
+	latencyMark(&ptpClock->latency, LATENCY_TX, LATENCY_TX_SEND);
+	sendTime = latencyLastMark(&ptpClock->latency, LATENCY_TX);
+	latencyAbandon(&ptpClock->latency, LATENCY_TX);
+
+	for(i = 0; i < sent; i++) {
+
+		entry = &ptpClock->syncTxPending[(firstKey + i) & (SYNC_TX_PENDING_MAX - 1)];
+
+		/* table wrapped before this one got its timestamp */
+		if(entry->pending) {
+			ptpClock->counters.txTimestampsLost++;
+			ptpClock->syncTxPendingCount--;
+		}
+
+		entry->pending = TRUE;
+		entry->key = firstKey + i;
+		entry->transportAddress = batch->destinations[i];
+		entry->sequenceId = *batch->sequenceIds[i];
+		entry->sent = sendTime;
+		ptpClock->syncTxPendingCount++;
+
+		ptpClock->lastSyncDst = batch->destinations[i];
+		(*batch->sequenceIds[i])++;
+		ptpClock->counters.syncMessagesSent++;
+
+	}
+
+	DBGV("Sync batch: %d of %d messages sent\n", sent < 0 ? 0 : sent, batch->count);
+
+	if(sent < batch->count) {
+		toState(PTP_FAULTY,rtOpts,ptpClock);
+		ptpClock->counters.messageSendErrors++;
+		DBGV("Sync message batch can't be sent -> FAULTY state \n");
+	}
+
+	batch->count = 0;
+}
+
+/*
+ * Syncs from the previous round still without a TX timestamp
+ * will not get one any more - no point sending a late FollowUp
+ */
+static void
+expireSyncTxPending(PtpClock *ptpClock)
+{
+	int i;
+
+	if(!ptpClock->syncTxPendingCount) {
+		return;
+	}
+
+	for(i = 0; i < SYNC_TX_PENDING_MAX; i++) {
+		if(ptpClock->syncTxPending[i].pending) {
+			DBG("No TX timestamp for Sync %d to %s (key %u)\n",
+			    ptpClock->syncTxPending[i].sequenceId,
+			    inet_ntoa(*(struct in_addr*)&ptpClock->syncTxPending[i].transportAddress),
+			    ptpClock->syncTxPending[i].key);
+			ptpClock->syncTxPending[i].pending = FALSE;
+			ptpClock->counters.txTimestampsLost++;
+		}
+	}
+
+	ptpClock->syncTxPendingCount = 0;
+}
+
+#endif /* PTPD_SYNC_BATCHING */
+
 /*Pack and send a single Sync message, return the embedded timestamp*/
 static TimeInternal
 issueSyncSingle(Integer32 dst, UInteger16 *sequenceId, const RunTimeOpts *rtOpts,PtpClock *ptpClock)
@@ -2984,6 +3783,7 @@ issueSyncSingle(Integer32 dst, UInteger16 *sequenceId, const RunTimeOpts *rtOpts
 	Timestamp originTimestamp;
 	TimeInternal internalTime, now;
 
+	latencyStart(&ptpClock->latency, LATENCY_TX);
 	getTime(&internalTime);
 
 	if (respectUtcOffset(rtOpts, ptpClock) == TRUE) {
@@ -3005,6 +3805,7 @@ issueSyncSingle(Integer32 dst, UInteger16 *sequenceId, const RunTimeOpts *rtOpts
 
 	if(ptpClock->leapSecondInProgress) {
 		DBG("Leap second in progress - will not send SYNC\n");
+		latencyAbandon(&ptpClock->latency, LATENCY_TX);
 		clearTime(&internalTime);
 		return internalTime;
 	}
@@ -3014,7 +3815,9 @@ issueSyncSingle(Integer32 dst, UInteger16 *sequenceId, const RunTimeOpts *rtOpts
 	now = internalTime;
 
 	msgPackSync(ptpClock->msgObuf,*sequenceId,&originTimestamp,ptpClock);
+	latencyMark(&ptpClock->latency, LATENCY_TX, LATENCY_TX_PACK);
 
+	/* netSendEvent() marks the end of the send and of the wait for the TX timestamp */
 	if (!netSendEvent(ptpClock->msgObuf,SYNC_LENGTH,&ptpClock->netPath,
 		rtOpts, dst, &internalTime)) {
 		toState(PTP_FAULTY,rtOpts,ptpClock);
@@ -3037,6 +3840,8 @@ issueSyncSingle(Integer32 dst, UInteger16 *sequenceId, const RunTimeOpts *rtOpts
 				    internalTime.seconds += ptpClock->timePropertiesDS.currentUtcOffset;
 			    }
 			    processSyncFromSelf(&internalTime, rtOpts, ptpClock, dst, *sequenceId);
+			    latencyMark(&ptpClock->latency, LATENCY_TX, LATENCY_TX_FOLLOWUP);
+			    latencyEnd(&ptpClock->latency, LATENCY_TX, LATENCY_TX_TOTAL);
 			}
 		}
 #endif
@@ -3058,13 +3863,16 @@ issueSyncSingle(Integer32 dst, UInteger16 *sequenceId, const RunTimeOpts *rtOpts
 		}
 
 		/* index the Sync destination */
-		indexSync(&internalTime, *sequenceId, dst, ptpClock->syncDestIndex);
+		indexSync(&internalTime, *sequenceId, dst, ptpClock->syncDestIndex, ptpClock->syncDestIndexSize);
 
 		(*sequenceId)++;
 		ptpClock->counters.syncMessagesSent++;
 
 	}
 
+    /* no Follow_Up went out from here */
+    latencyAbandon(&ptpClock->latency, LATENCY_TX);
+
     return internalTime;
 }
 
@@ -3098,6 +3906,7 @@ issueDelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 {
 	Timestamp originTimestamp;
 	TimeInternal internalTime;
+	Boolean deferred = FALSE;
 #if 0 /* PCAP ONLY */
 	MsgHeader ourDelayReq;
 #endif
@@ -3131,8 +3940,13 @@ issueDelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 		}
         }
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	/* do not wait for the TX timestamp: the event loop collects it */
+	deferred = asyncTxTimestampsActive(rtOpts, ptpClock);
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 	if (!netSendEvent(ptpClock->msgObuf,DELAY_REQ_LENGTH,
-			  &ptpClock->netPath, rtOpts, dst, &internalTime)) {
+			  &ptpClock->netPath, rtOpts, dst, deferred ? NULL : &internalTime)) {
 		toState(PTP_FAULTY,rtOpts,ptpClock);
 		ptpClock->counters.messageSendErrors++;
 		DBGV("delayReq message can't be sent -> FAULTY state \n");
@@ -3141,10 +3955,21 @@ issueDelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 		
 #ifdef SO_TIMESTAMPING
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+		if(deferred) {
+			ptpClock->waitingForDelayResp = FALSE;
+			deferTxTimestamp(&ptpClock->delayReqTxPending,
+			    ptpClock->sentDelayReqSequenceId, ptpClock);
+		}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 #ifdef PTPD_PCAP
-		if((ptpClock->netPath.pcapEvent == NULL) && !ptpClock->netPath.txTimestampFailure) {
+		if(!deferred && (ptpClock->netPath.pcapEvent == NULL) && !ptpClock->netPath.txTimestampFailure &&
+		    /* a lost hardware TX timestamp comes back cleared */
+		    (internalTime.seconds || internalTime.nanoseconds)) {
 #else
-		if(!ptpClock->netPath.txTimestampFailure) {
+		if(!deferred && !ptpClock->netPath.txTimestampFailure &&
+		    (internalTime.seconds || internalTime.nanoseconds)) {
 #endif /* PTPD_PCAP */
 			if (respectUtcOffset(rtOpts, ptpClock) == TRUE) {
 				internalTime.seconds += ptpClock->timePropertiesDS.currentUtcOffset;
@@ -3174,7 +3999,7 @@ issueDelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 		 */
 
 		timerStart(&ptpClock->timers[DELAYREQ_INTERVAL_TIMER],
-		   pow(2,ptpClock->portDS.logMinDelayReqInterval) * getRand() * 2.0);
+		   pow(2,delayReqInterval(rtOpts, ptpClock)) * getRand() * 2.0);
 #if 0 /* PCAP ONLY */
 		msgUnpackHeader(ptpClock->msgObuf, &ourDelayReq);
 		handleDelayReq(&ourDelayReq, DELAY_REQ_LENGTH, &internalTime,
@@ -3190,6 +4015,7 @@ issuePdelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 	Integer32 dst = 0;
 	Timestamp originTimestamp;
 	TimeInternal internalTime;
+	Boolean deferred = FALSE;
 
 	/* see LEAPNOTE01# in this file */
 	if(ptpClock->leapSecondInProgress) {
@@ -3208,8 +4034,14 @@ issuePdelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 	}
 	
 	msgPackPdelayReq(ptpClock->msgObuf,&originTimestamp,ptpClock);
+
+#ifdef PTPD_TXTIMESTAMP_KEYED
+	/* do not wait for the TX timestamp: the event loop collects it */
+	deferred = asyncTxTimestampsActive(rtOpts, ptpClock);
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 	if (!netSendPeerEvent(ptpClock->msgObuf,PDELAY_REQ_LENGTH,
-			      &ptpClock->netPath, rtOpts, dst, &internalTime)) {
+			      &ptpClock->netPath, rtOpts, dst, deferred ? NULL : &internalTime)) {
 		toState(PTP_FAULTY,rtOpts,ptpClock);
 		ptpClock->counters.messageSendErrors++;
 		DBGV("PdelayReq message can't be sent -> FAULTY state \n");
@@ -3218,10 +4050,20 @@ issuePdelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 		
 #ifdef SO_TIMESTAMPING
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+		if(deferred) {
+			deferTxTimestamp(&ptpClock->pdelayReqTxPending,
+			    ptpClock->sentPdelayReqSequenceId, ptpClock);
+		}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 #ifdef PTPD_PCAP
-		if((ptpClock->netPath.pcapEvent == NULL) && !ptpClock->netPath.txTimestampFailure) {
+		if(!deferred && (ptpClock->netPath.pcapEvent == NULL) && !ptpClock->netPath.txTimestampFailure &&
+		    /* a lost hardware TX timestamp comes back cleared */
+		    (internalTime.seconds || internalTime.nanoseconds)) {
 #else
-		if(!ptpClock->netPath.txTimestampFailure) {
+		if(!deferred && !ptpClock->netPath.txTimestampFailure &&
+		    (internalTime.seconds || internalTime.nanoseconds)) {
 #endif /* PTPD_PCAP */
 			if (respectUtcOffset(rtOpts, ptpClock) == TRUE) {
 				internalTime.seconds += ptpClock->timePropertiesDS.currentUtcOffset;
@@ -3235,6 +4077,129 @@ issuePdelayReq(const RunTimeOpts *rtOpts,PtpClock *ptpClock)
 	}
 }
 
+#ifdef PTPD_TXTIMESTAMP_KEYED
+/* can we send Delay_Req / Pdelay_Req without waiting for the TX timestamp? */
+static Boolean
+asyncTxTimestampsActive(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+
+	if(!rtOpts->asyncTxTimestamps || !ptpClock->netPath.txTimestampKeyed ||
+	    ptpClock->netPath.txTimestampFailure) {
+		return FALSE;
+	}
+
+#ifdef PTPD_PCAP
+	if(ptpClock->netPath.pcapEvent != NULL) {
+		return FALSE;
+	}
+#endif /* PTPD_PCAP */
+
+	return TRUE;
+
+}
+
+/*
+ * Remember the delay request just sent, so processTxTimestamps() can match
+ * its TX timestamp. A previous request still waiting never got its timestamp:
+ * that one measurement is lost, SO_TIMESTAMPING stays in use.
+ */
+static void
+deferTxTimestamp(TxTimestampPending *entry, UInteger16 sequenceId, PtpClock *ptpClock)
+{
+
+	if(entry->pending) {
+		DBG("deferTxTimestamp: TX timestamp for sequence %d never arrived\n", entry->sequenceId);
+		ptpClock->counters.txTimestampsLost++;
+		/* warn once per run of losses, the next timestamp to arrive ends it */
+		if(++ptpClock->txTimestampsMissed == TXTIMESTAMP_MAX_LOST) {
+			WARNING("%d consecutive TX timestamps lost - delay measurements are being dropped\n",
+			    ptpClock->txTimestampsMissed);
+		}
+	}
+
+	entry->pending = TRUE;
+	entry->key = netLastTxTimestampKey(&ptpClock->netPath);
+	entry->sequenceId = sequenceId;
+
+}
+
+/* match a collected TX timestamp with a delay request waiting for it */
+static Boolean
+matchTxTimestamp(TxTimestampPending *entry, UInteger32 key, UInteger16 sentSequenceId, PtpClock *ptpClock)
+{
+
+	if(!entry->pending || entry->key != key) {
+		return FALSE;
+	}
+
+	entry->pending = FALSE;
+
+	/* a newer request has been sent since */
+	if((UInteger16)(entry->sequenceId + 1) != sentSequenceId) {
+		DBG("matchTxTimestamp: late TX timestamp for sequence %d discarded\n", entry->sequenceId);
+		return FALSE;
+	}
+
+	ptpClock->txTimestampsMissed = 0;
+	return TRUE;
+
+}
+
+/*
+ * Collect all TX timestamps waiting in the error queue and hand each one
+ * to the message it belongs to: our delay requests, or batched Syncs.
+ */
+static void
+processTxTimestamps(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+	TimeInternal timestamp;
+	UInteger32 key;
+#ifdef PTPD_SYNC_BATCHING
+	SyncTxPending *entry;
+#endif /* PTPD_SYNC_BATCHING */
+
+	while(netRecvTxTimestamp(&ptpClock->netPath, &timestamp, &key) > 0) {
+
+		if (respectUtcOffset(rtOpts, ptpClock) == TRUE) {
+			timestamp.seconds += ptpClock->timePropertiesDS.currentUtcOffset;
+		}
+
+		if(matchTxTimestamp(&ptpClock->delayReqTxPending, key,
+		    ptpClock->sentDelayReqSequenceId, ptpClock)) {
+			processDelayReqFromSelf(&timestamp, rtOpts, ptpClock);
+			continue;
+		}
+
+		if(matchTxTimestamp(&ptpClock->pdelayReqTxPending, key,
+		    ptpClock->sentPdelayReqSequenceId, ptpClock)) {
+			processPdelayReqFromSelf(&timestamp, rtOpts, ptpClock);
+			continue;
+		}
+
+#ifdef PTPD_SYNC_BATCHING
+		entry = &ptpClock->syncTxPending[key & (SYNC_TX_PENDING_MAX - 1)];
+
+		if(entry->pending && entry->key == key) {
+			entry->pending = FALSE;
+			ptpClock->syncTxPendingCount--;
+			/* batched Syncs count from the end of the send */
+			if(entry->sent) {
+				latencyStartAt(&ptpClock->latency, LATENCY_TX, entry->sent);
+				latencyMark(&ptpClock->latency, LATENCY_TX, LATENCY_TX_TIMESTAMP);
+			}
+			processSyncFromSelf(&timestamp, rtOpts, ptpClock, entry->transportAddress, entry->sequenceId);
+			latencyMark(&ptpClock->latency, LATENCY_TX, LATENCY_TX_FOLLOWUP);
+			latencyEnd(&ptpClock->latency, LATENCY_TX, LATENCY_TX_TOTAL);
+			continue;
+		}
+#endif /* PTPD_SYNC_BATCHING */
+
+		DBG("processTxTimestamps: no message waiting for TX timestamp key %u\n", key);
+
+	}
+}
+#endif /* PTPD_TXTIMESTAMP_KEYED */
+
 /*Pack and send on event multicast ip adress a PdelayResp message*/
 static void
 issuePdelayResp(const TimeInternal *tint,MsgHeader *header, Integer32 sourceAddress, const RunTimeOpts *rtOpts,
@@ -3273,9 +4238,12 @@ issuePdelayResp(const TimeInternal *tint,MsgHeader *header, Integer32 sourceAddr
 #ifdef SO_TIMESTAMPING
 
 #ifdef PTPD_PCAP
-		if((ptpClock->netPath.pcapEvent == NULL) && !ptpClock->netPath.txTimestampFailure) {
+		if((ptpClock->netPath.pcapEvent == NULL) && !ptpClock->netPath.txTimestampFailure &&
+		    /* a lost hardware TX timestamp comes back cleared */
+		    (internalTime.seconds || internalTime.nanoseconds)) {
 #else
-		if(!ptpClock->netPath.txTimestampFailure) {
+		if(!ptpClock->netPath.txTimestampFailure &&
+		    (internalTime.seconds || internalTime.nanoseconds)) {
 #endif /* PTPD_PCAP */
 			if (respectUtcOffset(rtOpts, ptpClock) == TRUE) {
 				internalTime.seconds += ptpClock->timePropertiesDS.currentUtcOffset;
@@ -3342,7 +4310,7 @@ issuePdelayRespFollowUp(const TimeInternal *tint, MsgHeader *header, Integer32 d
 }
 
 void
-addForeign(Octet *buf,MsgHeader *header,PtpClock *ptpClock, UInteger8 localPreference, UInteger32 sourceAddr)
+addForeign(MsgHeader *header, const MsgAnnounce *announce, PtpClock *ptpClock, UInteger8 localPreference, UInteger32 sourceAddr)
 {
 	int i,j;
 	Boolean found = FALSE;
@@ -3363,8 +4331,8 @@ addForeign(Octet *buf,MsgHeader *header,PtpClock *ptpClock, UInteger8 localPrefe
 			ptpClock->foreign[j].foreignMasterAnnounceMessages++;
 			found = TRUE;
 			DBGV("addForeign : AnnounceMessage incremented \n");
-			msgUnpackHeader(buf,&ptpClock->foreign[j].header);
-			msgUnpackAnnounce(buf,&ptpClock->foreign[j].announce);
+			ptpClock->foreign[j].header = *header;
+			ptpClock->foreign[j].announce = *announce;
 			ptpClock->foreign[j].disqualified = FALSE;
 			ptpClock->foreign[j].localPreference = localPreference;
 			break;
@@ -3401,8 +4369,8 @@ addForeign(Octet *buf,MsgHeader *header,PtpClock *ptpClock, UInteger8 localPrefe
 		 * header and announce field of each Foreign Master are
 		 * usefull to run Best Master Clock Algorithm
 		 */
-		msgUnpackHeader(buf,&ptpClock->foreign[j].header);
-		msgUnpackAnnounce(buf,&ptpClock->foreign[j].announce);
+		ptpClock->foreign[j].header = *header;
+		ptpClock->foreign[j].announce = *announce;
 		DBGV("New foreign Master added \n");
 		
 		ptpClock->foreign_record_i =
@@ -3418,10 +4386,10 @@ updateDatasets(PtpClock* ptpClock, const RunTimeOpts* rtOpts)
 
 	if(rtOpts->unicastNegotiation) {
 	    	updateUnicastGrantTable(ptpClock->unicastGrants,
-			    ptpClock->unicastDestinationCount, rtOpts);
+			    ptpClock->unicastDestinationCount, rtOpts, ptpClock);
 		if(rtOpts->unicastPeerDestinationSet) {
 	    	    updateUnicastGrantTable(&ptpClock->peerGrants,
-			    1, rtOpts);
+			    1, rtOpts, ptpClock);
 
 		}
 	}
@@ -3440,7 +4408,7 @@ updateDatasets(PtpClock* ptpClock, const RunTimeOpts* rtOpts)
 			    ptpClock->portDS.transportSpecific = TSP_DEFAULT;
 			}
 
-			ptpClock->defaultDS.numberPorts = NUMBER_PORTS;
+			ptpClock->defaultDS.numberPorts = ptpClock->ports ? ptpClock->ports->count : NUMBER_PORTS;
 			ptpClock->portDS.portIdentity.portNumber = rtOpts->portNumber;
 
 			ptpClock->portDS.delayMechanism = rtOpts->delayMechanism;
@@ -3487,7 +4455,7 @@ updateDatasets(PtpClock* ptpClock, const RunTimeOpts* rtOpts)
 					ptpClock->portDS.logMinDelayReqInterval = rtOpts->logMinDelayReqInterval;
 				}
 		case PTP_PASSIVE:
-			ptpClock->defaultDS.numberPorts = NUMBER_PORTS;
+			ptpClock->defaultDS.numberPorts = ptpClock->ports ? ptpClock->ports->count : NUMBER_PORTS;
 			ptpClock->portDS.portIdentity.portNumber = rtOpts->portNumber;
 
 			if(rtOpts->dot1AS) {
@@ -3514,6 +4482,8 @@ updateDatasets(PtpClock* ptpClock, const RunTimeOpts* rtOpts)
 		    break;
 	}
 
+	msgPackTemplates(ptpClock);
+
 }
 
 void
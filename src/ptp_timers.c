@@ -123,7 +123,10 @@ Boolean timerSetup(IntervalTimer *itimers)
   "MASTER_NETREFRESH",
   "CALIBRATION_DELAY",
   "CLOCK_UPDATE",
-  "TIMINGDOMAIN_UPDATE"
+  "TIMINGDOMAIN_UPDATE",
+  "ACQUISITION",
+  "HOLDOVER",
+  "PHASE_SLEW"
     };
 
     int i = 0;
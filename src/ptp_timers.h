@@ -31,12 +31,12 @@
  */
 
 
-#ifdef PTPD_PTIMERS
+#if defined(PTPD_PTIMERS) || defined(PTPD_EPOLL)
 #define LOG_MIN_INTERVAL -7
 #else
 /* 62.5ms tick for interval timers = 16/sec max */
 #define LOG_MIN_INTERVAL -4
-#endif /* PTPD_PTIMERS */
+#endif /* PTPD_PTIMERS || PTPD_EPOLL */
 
 /* safeguard: a week */
 #define PTPTIMER_MAX_INTERVAL 604800
@@ -81,6 +81,9 @@ enum {
   CALIBRATION_DELAY_TIMER,
   CLOCK_UPDATE_TIMER,
   TIMINGDOMAIN_UPDATE_TIMER,
+  ACQUISITION_TIMER,
+  HOLDOVER_TIMER,
+  PHASE_SLEW_TIMER,	/* end of the slew of the phase fitted by fast acquisition */
   PTP_MAX_TIMER
 };
 
@@ -70,7 +70,7 @@ Boolean startupInProgress;
  * if ptpd is extended to handle multiple ports (eg, to instantiate a Boundary Clock),
  * then DBG()/message() needs a per-port pointer argument
  */
-PtpClock *G_ptpClock = NULL;
+PTPD_THREAD_LOCAL PtpClock *G_ptpClock = NULL;
 
 TimingDomain timingDomain;
 
@@ -126,6 +126,12 @@ main(int argc, char **argv)
 	/* global variable for message(), please see comment on top of this file */
 	G_ptpClock = ptpClock;
 
+#ifdef PTPD_ASYNC_LOG
+	/* from here on, log output can be handed over to the writer thread */
+	if(rtOpts.logAsync)
+		asyncLogStart(&rtOpts);
+#endif /* PTPD_ASYNC_LOG */
+
 	/* do the protocol engine */
 	protocol(&rtOpts, ptpClock);
 	/* forever loop.. */
@@ -22,6 +22,15 @@
 # include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+/*
+ * ptpd2-sim replaces the network, the event timers and the clock with
+ * simulated ones (src/sim): none of the kernel facilities are used
+ */
+#ifdef PTPD_SIM
+#undef PTPD_EPOLL
+#undef PTPD_PTIMERS
+#endif /* PTPD_SIM */
+
 
 #ifdef linux
 #	ifndef _GNU_SOURCE
@@ -133,6 +142,22 @@
 #include <sys/cpuset.h>
 #endif /* HAVE_SYS_CPUSET_H */
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#ifdef HAVE_SEMAPHORE_H
+#include <semaphore.h>
+#endif /* HAVE_SEMAPHORE_H */
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif /* HAVE_SYS_EVENTFD_H */
+
 #include "constants.h"
 #include "limits.h"
 
@@ -176,6 +201,8 @@
 #include "dep/daemonconfig.h"
 
 #include "dep/alarms.h"
+#include "dep/timerwheel.h"
+#include "dep/latency.h"
 
 
 
@@ -277,6 +304,9 @@ void div2Time(TimeInternal *);
  */
 
 UInteger8 bmc(ForeignMasterRecord*, const RunTimeOpts*,PtpClock*);
+ForeignMasterRecord* bmcPortBest(PtpClock*);
+void bmcBoundaryClockDecision(ForeignMasterRecord**, const UInteger8*, int, PtpClock*, UInteger8*);
+UInteger8 bmcApplyDecision(PtpClock*, UInteger8);
 
 /* compare two portIdentTitties */
 int cmpPortIdentity(const PortIdentity *a, const PortIdentity *b);
@@ -315,6 +345,11 @@ void initData(RunTimeOpts*,PtpClock*);
 void protocol(RunTimeOpts*,PtpClock*);
 void updateDatasets(PtpClock* ptpClock, const RunTimeOpts* rtOpts);
 void setPortState(PtpClock *ptpClock, Enumeration8 state);
+void getClockDatasets(const PtpClock *ptpClock, ClockDatasets *datasets);
+void setClockDatasets(PtpClock *ptpClock, const ClockDatasets *datasets);
+#ifdef PTPD_PORT_THREADS
+void protocolPortThread(RunTimeOpts *rtOpts, PtpClock *ptpClock);
+#endif /* PTPD_PORT_THREADS */
 
 Boolean acceptPortIdentity(PortIdentity thisPort, PortIdentity targetPort);
 
@@ -341,14 +376,20 @@ void handleManagement(MsgHeader *header,
  */
 UnicastGrantTable* findUnicastGrants(const PortIdentity* portIdentity, Integer32 TransportAddress, UnicastGrantTable *grantTable, UnicastGrantIndex *index, int nodeCount, Boolean update);
 void 	initUnicastGrantTable(UnicastGrantTable *grantTable, Enumeration8 delayMechanism, int nodeCount, UnicastDestination *destinations, const RunTimeOpts *rtOpts, PtpClock *ptpClock);
+void 	initUnicastGrantIndex(UnicastGrantIndex *index, UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts);
+Boolean allocUnicastGrantTable(PtpClock *ptpClock, int nodeCount);
+void 	freeUnicastGrantTable(PtpClock *ptpClock);
 
 void 	cancelUnicastTransmission(UnicastGrantData*, const RunTimeOpts*, PtpClock*);
 void 	cancelAllGrants(UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts, PtpClock *ptpClock);
 
 void 	handleSignaling(MsgHeader*, Boolean, Integer32, const RunTimeOpts*,PtpClock*);
 
-void 	refreshUnicastGrants(UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts, PtpClock *ptpClock);
-void 	updateUnicastGrantTable(UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts);
+void 	refreshUnicastGrants(const RunTimeOpts *rtOpts, PtpClock *ptpClock);
+void 	scheduleUnicastGrant(UnicastGrantData *grant, PtpClock *ptpClock);
+void 	armUnicastGrants(UnicastGrantTable *grantTable, int nodeCount, PtpClock *ptpClock);
+void 	updateUnicastGrantTable(UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts, PtpClock *ptpClock);
+void 	setUnicastAcquisition(UnicastGrantTable *nodeTable, Boolean fast, const RunTimeOpts *rtOpts, PtpClock *ptpClock);
 
 
 /* quick shortcut to defining a temporary char array for the purpose of snprintf to it */
@@ -472,6 +513,7 @@ int is_Time_close(const TimeInternal *x, const TimeInternal *b, int nanos);
 int isTimeInternalNegative(const TimeInternal * p);
 double timeInternalToDouble(const TimeInternal * p);
 TimeInternal doubleToTimeInternal(const double d);
+int cmpDouble(const void *vA, const void *vB);
 
 uint32_t fnvHash(void *input, size_t len, int modulo);
 
@@ -43,14 +43,28 @@
 #define GRANT_KEEPALIVE_INTERVAL 5
 /* maximum number of missed messages of given type before we re-request */
 #define GRANT_MAX_MISSED 10
-
-static void updateUnicastIndex(UnicastGrantTable *table, UnicastGrantIndex *index);
-static UnicastGrantTable* lookupUnicastIndex(PortIdentity *portIdentity, Integer32 transportAddress, UnicastGrantIndex *index);
+/* grants are considered expired this many refreshes before their time runs out */
+#define GRANT_EXPIRY_MARGIN 5
+
+static const void* unicastIndexKey(UnicastGrantTable *table, int keyType, size_t *len);
+static Boolean unicastKeyIndexable(UnicastGrantTable *table, int keyType);
+static UnicastGrantTable** unicastIndexSlots(UnicastGrantIndex *index, int keyType);
+static uint32_t unicastIndexHash(const void *key, size_t len, UnicastGrantIndex *index);
+static UnicastGrantTable* lookupUnicastIndex(const void *key, int keyType, UnicastGrantIndex *index);
+static void insertUnicastIndex(UnicastGrantTable *table, int keyType, UnicastGrantIndex *index);
+static void removeUnicastIndex(UnicastGrantTable *table, int keyType, UnicastGrantIndex *index);
+static void updateUnicastKeys(UnicastGrantTable *table, const PortIdentity *portIdentity, Integer32 transportAddress, UnicastGrantIndex *index);
+static Boolean unicastGrantsFree(UnicastGrantTable *table);
+static void releaseUnicastGrants(UnicastGrantTable *table, UnicastGrantIndex *index);
+static UnicastGrantTable* getFreeUnicastGrants(UnicastGrantIndex *index);
+static Boolean unicastGrantRetry(UnicastGrantData *grant, PtpClock *ptpClock);
+static void updateUnicastNode(UnicastGrantTable *nodeTable, PtpClock *ptpClock);
+static void processUnicastGrant(TimerWheelEntry *entry, void *userData);
 static int msgIndex(Enumeration8 messageType);
 static Enumeration8 msgXedni(int messageIndex);
 static void initOutgoingMsgSignaling(PortIdentity* targetPortIdentity, MsgSignaling* outgoing, PtpClock *ptpClock);
 static void handleSMRequestUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoing, Integer32 sourceAddress, const RunTimeOpts *rtOpts, PtpClock *ptpClock);
-static void handleSMGrantUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress, UnicastGrantTable *grantTable, int nodeCount, PtpClock *ptpClock);
+static void handleSMGrantUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress, UnicastGrantTable *grantTable, UnicastGrantIndex *index, int nodeCount, PtpClock *ptpClock);
 static Boolean handleSMCancelUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoing, Integer32 sourceAddress, PtpClock* ptpClock);
 static void handleSMAcknowledgeCancelUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress, PtpClock* ptpClock);
 static Boolean prepareSMRequestUnicastTransmission(MsgSignaling* outgoing, UnicastGrantData *grant, PtpClock* ptpClock);
@@ -103,55 +117,303 @@ msgXedni(int messageIndex)
 
 }
 
-/* update index table */
+/* grant table index keys */
+#define UNICAST_KEY_PORTID	0
+#define UNICAST_KEY_ADDRESS	1
+
+/* return pointer to the given key of a grant table entry, and its length */
+static const void*
+unicastIndexKey(UnicastGrantTable *table, int keyType, size_t *len)
+{
+
+    if(keyType == UNICAST_KEY_ADDRESS) {
+	*len = sizeof(Integer32);
+	return &table->transportAddress;
+    }
+
+    *len = sizeof(PortIdentity);
+    return &table->portIdentity;
+
+}
+
+/* unset keys (zero address, empty or all-ones port identity) are not indexed */
+static Boolean
+unicastKeyIndexable(UnicastGrantTable *table, int keyType)
+{
+
+    if(keyType == UNICAST_KEY_ADDRESS) {
+	return (table->transportAddress != 0);
+    }
+
+    return (!portIdentityEmpty(&table->portIdentity) && !portIdentityAllOnes(&table->portIdentity));
+
+}
+
+static UnicastGrantTable**
+unicastIndexSlots(UnicastGrantIndex *index, int keyType)
+{
+    return (keyType == UNICAST_KEY_ADDRESS) ? index->byAddress : index->byPortIdentity;
+}
+
+/* home slot for the given key - index size is a power of 2 */
+static uint32_t
+unicastIndexHash(const void *key, size_t len, UnicastGrantIndex *index)
+{
+    return fnvHash((void*)key, len, 0) & (index->size - 1);
+}
+
+/* return matching entry from index table: linear probing until an empty slot */
+static UnicastGrantTable*
+lookupUnicastIndex(const void *key, int keyType, UnicastGrantIndex *index)
+{
+
+    UnicastGrantTable **slots = unicastIndexSlots(index, keyType);
+    uint32_t mask = index->size - 1;
+    uint32_t i;
+    size_t len = (keyType == UNICAST_KEY_ADDRESS) ? sizeof(Integer32) : sizeof(PortIdentity);
+    size_t slotLen;
+
+    for(i = unicastIndexHash(key, len, index); slots[i] != NULL; i = (i + 1) & mask) {
+	if(!memcmp(unicastIndexKey(slots[i], keyType, &slotLen), key, len)) {
+	    return slots[i];
+	}
+    }
+
+    return NULL;
+
+}
+
+/* add entry to index table under its current key */
 static void
-updateUnicastIndex(UnicastGrantTable *table, UnicastGrantIndex *index)
+insertUnicastIndex(UnicastGrantTable *table, int keyType, UnicastGrantIndex *index)
+{
+
+    UnicastGrantTable **slots = unicastIndexSlots(index, keyType);
+    uint32_t mask = index->size - 1;
+    uint32_t i;
+    size_t len;
+    const void *key;
+
+    if(!unicastKeyIndexable(table, keyType)) {
+	return;
+    }
+
+    key = unicastIndexKey(table, keyType, &len);
+
+    for(i = unicastIndexHash(key, len, index); slots[i] != NULL; i = (i + 1) & mask) {
+	if(slots[i] == table) {
+	    return;
+	}
+	/* another entry holds the same key: the most recently updated one wins */
+	if(!memcmp(unicastIndexKey(slots[i], keyType, &len), key, len)) {
+	    slots[i] = table;
+	    return;
+	}
+    }
+
+    slots[i] = table;
+
+}
+
+/* remove entry from index table - must be called before its key changes */
+static void
+removeUnicastIndex(UnicastGrantTable *table, int keyType, UnicastGrantIndex *index)
+{
+
+    UnicastGrantTable **slots = unicastIndexSlots(index, keyType);
+    uint32_t mask = index->size - 1;
+    uint32_t i, j, home;
+    size_t len;
+    const void *key;
+
+    if(!unicastKeyIndexable(table, keyType)) {
+	return;
+    }
+
+    key = unicastIndexKey(table, keyType, &len);
+
+    for(i = unicastIndexHash(key, len, index); slots[i] != table; i = (i + 1) & mask) {
+	if(slots[i] == NULL) {
+	    return;
+	}
+    }
+
+    /* backward shift deletion: move back entries which would become unreachable */
+    for(j = i;;) {
+	slots[i] = NULL;
+	do {
+	    j = (j + 1) & mask;
+	    if(slots[j] == NULL) {
+		return;
+	    }
+	    key = unicastIndexKey(slots[j], keyType, &len);
+	    home = unicastIndexHash(key, len, index);
+	} while ((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j)));
+	slots[i] = slots[j];
+	i = j;
+    }
+
+}
+
+/* set port identity and address of a grant table entry, keeping the index up to date */
+static void
+updateUnicastKeys(UnicastGrantTable *table, const PortIdentity *portIdentity, Integer32 transportAddress, UnicastGrantIndex *index)
 {
-    uint32_t hash = fnvHash(&table->portIdentity, sizeof(PortIdentity), UNICAST_MAX_DESTINATIONS);
 
     /* peer table normally has one entry: if we got here, we might pollute the main index */
-    if(!table->isPeer && index != NULL) {
-	index->data[hash] = table;
+    if(table->isPeer || index == NULL) {
+	table->portIdentity = *portIdentity;
+	table->transportAddress = transportAddress;
+	return;
     }
 
+    removeUnicastIndex(table, UNICAST_KEY_PORTID, index);
+    removeUnicastIndex(table, UNICAST_KEY_ADDRESS, index);
+
+    table->portIdentity = *portIdentity;
+    table->transportAddress = transportAddress;
+
+    insertUnicastIndex(table, UNICAST_KEY_PORTID, index);
+    insertUnicastIndex(table, UNICAST_KEY_ADDRESS, index);
+
 }
 
-/* return matching entry from index table */
-static UnicastGrantTable*
-lookupUnicastIndex(PortIdentity *portIdentity, Integer32 transportAddress, UnicastGrantIndex *index)
+/* entry can be re-used: never used or no grants left */
+static Boolean
+unicastGrantsFree(UnicastGrantTable *table)
+{
+    return (portIdentityEmpty(&table->portIdentity) || (table->timeLeft == 0));
+}
+
+/* put entry on the free entry stack */
+static void
+releaseUnicastGrants(UnicastGrantTable *table, UnicastGrantIndex *index)
 {
 
-    uint32_t hash = fnvHash((void*)portIdentity, sizeof(PortIdentity), UNICAST_MAX_DESTINATIONS);
+    if(index == NULL || table->isPeer || table->freeListed) {
+	return;
+    }
+
+    index->freeNodes[index->freeCount++] = table;
+    table->freeListed = TRUE;
+
+}
+
+/* return first free entry: entries which got re-used since they were put on the stack are dropped */
+static UnicastGrantTable*
+getFreeUnicastGrants(UnicastGrantIndex *index)
+{
 
-    UnicastGrantTable* table;
+    UnicastGrantTable *table;
 
-    if(index == NULL) {
-	return NULL;
+    while(index->freeCount > 0) {
+	table = index->freeNodes[index->freeCount - 1];
+	if(unicastGrantsFree(table)) {
+	    return table;
+	}
+	table->freeListed = FALSE;
+	index->freeCount--;
     }
 
-    table  = index->data[hash];
+    return NULL;
+
+}
+
+/* allocate unicast grant table with its index tables and Sync destination index */
+Boolean
+allocUnicastGrantTable(PtpClock *ptpClock, int nodeCount)
+{
 
-    if(table == NULL) {
-	DBG("lookupUnicastIndex: empty hit\n");
-	return NULL;
+    int size = 1;
+
+    /* keep the load factor at or below 0.5 so probe sequences stay short */
+    while(size < 2 * nodeCount) {
+	size <<= 1;
     }
 
-    if(!cmpPortIdentity(portIdentity, &table->portIdentity)) {
-	DBG("lookupUnicastIndex: cache hit\n");
-	return table;
-    } else {
-	/* hash collision */
-	DBG("lookupUnicastIndex: hash collision\n");
-	return NULL;
+    ptpClock->unicastGrants = (UnicastGrantTable*)calloc(nodeCount, sizeof(UnicastGrantTable));
+    ptpClock->grantIndex.byPortIdentity = (UnicastGrantTable**)calloc(size, sizeof(UnicastGrantTable*));
+    ptpClock->grantIndex.byAddress = (UnicastGrantTable**)calloc(size, sizeof(UnicastGrantTable*));
+    ptpClock->grantIndex.freeNodes = (UnicastGrantTable**)calloc(nodeCount, sizeof(UnicastGrantTable*));
+    ptpClock->syncDestIndex = (SyncDestEntry*)calloc(size, sizeof(SyncDestEntry));
+
+    if(ptpClock->unicastGrants == NULL || ptpClock->grantIndex.byPortIdentity == NULL ||
+	ptpClock->grantIndex.byAddress == NULL || ptpClock->grantIndex.freeNodes == NULL ||
+	ptpClock->syncDestIndex == NULL) {
+	freeUnicastGrantTable(ptpClock);
+	return FALSE;
     }
 
+    ptpClock->unicastGrantTableSize = nodeCount;
+    ptpClock->grantIndex.size = size;
+    ptpClock->grantIndex.nodeCount = 0;
+    ptpClock->grantIndex.freeCount = 0;
+    ptpClock->syncDestIndexSize = size;
+
+    timerWheelInit(&ptpClock->grantWheel);
+
+    DBG("allocated %d bytes for unicast grant table (%d entries, %d index slots)\n",
+	(int)(nodeCount * (sizeof(UnicastGrantTable) + sizeof(UnicastGrantTable*)) +
+	size * (2 * sizeof(UnicastGrantTable*) + sizeof(SyncDestEntry))), nodeCount, size);
+
+    return TRUE;
+
+}
+
+void
+freeUnicastGrantTable(PtpClock *ptpClock)
+{
+
+    free(ptpClock->unicastGrants);
+    free(ptpClock->grantIndex.byPortIdentity);
+    free(ptpClock->grantIndex.byAddress);
+    free(ptpClock->grantIndex.freeNodes);
+    free(ptpClock->syncDestIndex);
+
+    ptpClock->unicastGrants = NULL;
+    ptpClock->grantIndex.byPortIdentity = NULL;
+    ptpClock->grantIndex.byAddress = NULL;
+    ptpClock->grantIndex.freeNodes = NULL;
+    ptpClock->syncDestIndex = NULL;
+    ptpClock->unicastGrantTableSize = 0;
+    ptpClock->grantIndex.size = 0;
+    ptpClock->grantIndex.nodeCount = 0;
+    ptpClock->grantIndex.freeCount = 0;
+    ptpClock->syncDestIndexSize = 0;
+
 }
 
+/* (re)build the index over the first nodeCount entries of an initialised grant table */
+void
+initUnicastGrantIndex(UnicastGrantIndex *index, UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts)
+{
+
+    int j;
+
+    memset(index->byPortIdentity, 0, index->size * sizeof(UnicastGrantTable*));
+    memset(index->byAddress, 0, index->size * sizeof(UnicastGrantTable*));
+
+    index->portMask = rtOpts->unicastPortMask;
+    index->nodeCount = nodeCount;
+    index->freeCount = 0;
+
+    /* walk backwards so that the first entry ends up on top of the free stack */
+    for(j = nodeCount - 1; j >= 0; j--) {
+	grantTable[j].freeListed = FALSE;
+	insertUnicastIndex(&grantTable[j], UNICAST_KEY_PORTID, index);
+	insertUnicastIndex(&grantTable[j], UNICAST_KEY_ADDRESS, index);
+	if(unicastGrantsFree(&grantTable[j])) {
+	    releaseUnicastGrants(&grantTable[j], index);
+	}
+    }
+
+}
 
 /* find which grant table entry the given port belongs to:
    - if not found, return first free entry, store portID and/or address
    - if found, find the entry it belongs to
-   - look up the index table, only iterate on miss
+   - with an index, look up port identity, then transport address, then the free entry stack
+   - without an index (peer table), iterate
    - if update is FALSE, only a search is performed
 */
 UnicastGrantTable*
@@ -168,27 +430,29 @@ findUnicastGrants
 
 	PortIdentity tmpIdentity = *portIdentity;
 
-	/* look up the index table*/
 	if(index != NULL) {
+
 	    tmpIdentity.portNumber |= index->portMask;
-	    found = lookupUnicastIndex(&tmpIdentity, transportAddress, index);
-	}
-	
-	if(found != NULL) {
-	    DBG("findUnicastGrants: cache hit\n");
+
+	    if((found = lookupUnicastIndex(&tmpIdentity, UNICAST_KEY_PORTID, index)) != NULL) {
+		DBG("findUnicastGrants: port identity hit\n");
 		/* do not overwrite address if zero given
 		 * (used by slave to preserve configured master addresses)
 		 */
-		if(update && transportAddress) {
-		    found->transportAddress = transportAddress;
-		}
 		if(update) {
-		    found->portIdentity = tmpIdentity;
+		    updateUnicastKeys(found, &tmpIdentity,
+			transportAddress ? transportAddress : found->transportAddress, index);
 		}
-
+	    /* no port identity match but we have a transport address match */
+	    } else if(transportAddress &&
+		(found = lookupUnicastIndex(&transportAddress, UNICAST_KEY_ADDRESS, index)) != NULL) {
+		DBG("findUnicastGrants: transport address hit\n");
 		if(update) {
-		    updateUnicastIndex(found, index);
+		    updateUnicastKeys(found, &tmpIdentity, found->transportAddress, index);
 		}
+	    } else {
+		firstFree = getFreeUnicastGrants(index);
+	    }
 
 	} else for(i=0; i < nodeCount; i++) {
 
@@ -196,8 +460,7 @@ findUnicastGrants
 
 	    /* first free entry */
 	    if(firstFree == NULL) {
-		    if(portIdentityEmpty(&nodeTable->portIdentity) ||
-			(nodeTable->timeLeft == 0)) {
+		    if(unicastGrantsFree(nodeTable)) {
 			    firstFree = nodeTable;
 		    }
 	    }
@@ -210,19 +473,9 @@ findUnicastGrants
 		/* do not overwrite address if zero given
 		 * (used by slave to preserve configured master addresses)
 		 */
-
-		if(update && transportAddress) {
-		    found->transportAddress = transportAddress;
-		}
-
-		if(update) {
-		    found->portIdentity = tmpIdentity;
-		}
-
-		DBG("findUnicastGrants: cache miss - %d iterations %d\n", i);
-
 		if(update) {
-		    updateUnicastIndex(found, index);
+		    updateUnicastKeys(found, &tmpIdentity,
+			transportAddress ? transportAddress : found->transportAddress, NULL);
 		}
 
 		break;
@@ -235,8 +488,7 @@ findUnicastGrants
 
 		found = nodeTable;
 		if(update) {
-			found->portIdentity = tmpIdentity;
-			updateUnicastIndex(found, index);
+			updateUnicastKeys(found, &tmpIdentity, found->transportAddress, NULL);
 		}
 		break;
 	    }
@@ -249,9 +501,7 @@ findUnicastGrants
 
     /* will return NULL if there are no free slots, otherwise the first free slot */
     if(update && firstFree != NULL) {
-	firstFree->portIdentity = tmpIdentity;
-	firstFree->transportAddress = transportAddress;
-	updateUnicastIndex(firstFree, index);
+	updateUnicastKeys(firstFree, &tmpIdentity, transportAddress, index);
 	/* new set of grants - reset sequence numbers */
 	for(i=0; i < PTP_MAX_MESSAGE_INDEXED; i++) {
 	    firstFree->grantData[i].sentSeqId = 0;
@@ -321,6 +571,8 @@ handleSMRequestUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoin
 	initOutgoingMsgSignaling(&incoming->header.sourcePortIdentity, outgoing, ptpClock);
 	XMALLOC(outgoing->tlv->valueField, sizeof(SMGrantUnicastTransmission));
 	grantData = (SMGrantUnicastTransmission*)outgoing->tlv->valueField;
+	/* a request we cannot even look up (table full) must still go out as a denial */
+	memset(grantData, 0, sizeof(SMGrantUnicastTransmission));
 
         outgoing->header.flagField0 |= PTP_UNICAST;
 	outgoing->tlv->tlvType = TLV_GRANT_UNICAST_TRANSMISSION;
@@ -331,10 +583,10 @@ handleSMRequestUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoin
 			getMessageTypeName(messageType), portId, inet_ntoa(tmpAddr), requestData->durationField,
 			requestData->logInterMessagePeriod);
 
-	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS, TRUE);
+	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize, TRUE);
 
 	if(nodeTable == NULL) {
-		if(ptpClock->slaveCount >= UNICAST_MAX_DESTINATIONS) {
+		if(ptpClock->slaveCount >= ptpClock->unicastGrantTableSize) {
 			DBG("REQUEST_UNICAST_TRANSMISSION (%s): did not find node in slave table : %s (%s) - table full\n", getMessageTypeName(messageType),
 			inet_ntoa(tmpAddr),portId);
 		} else {
@@ -417,12 +669,6 @@ handleSMRequestUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoin
 	    myGrant->cancelCount = 0;
 	    myGrant->logInterval = grantData->logInterMessagePeriod;
 
-	    /* this could be the very first grant for this node - update node's timeLeft so it's not seen as free anymore */
-	    if(nodeTable->timeLeft <= 0) {
-		/* + 10 seconds for a grace period */
-		nodeTable->timeLeft = myGrant->timeLeft + 10;
-	    }
-
 	    /* If we've granted once, we're likely to grant again */
 	    grantData->renewal_invited = 1;
 
@@ -433,6 +679,9 @@ handleSMRequestUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoin
 		ptpClock->counters.unicastGrantsDenied++;
 	}
 
+	/* this could be the very first grant for this node - the node's timeLeft is updated so it's not seen as free anymore */
+	scheduleUnicastGrant(myGrant, ptpClock);
+
 	/* Testing only */
 	/* grantData->logInterMessagePeriod = requestData->logInterMessagePeriod; */
 	/* grantData->durationField = requestData->durationField; */
@@ -445,7 +694,7 @@ finaliseResponse:
 
 /**\brief Handle incoming GRANT_UNICAST_TRANSMISSION signaling message type*/
 static void
-handleSMGrantUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress, UnicastGrantTable *grantTable, int nodeCount, PtpClock *ptpClock)
+handleSMGrantUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress, UnicastGrantTable *grantTable, UnicastGrantIndex *index, int nodeCount, PtpClock *ptpClock)
 {
 
 	char portId[PATH_MAX];
@@ -463,7 +712,7 @@ handleSMGrantUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress
 	DBGV("Received GRANT_UNICAST_TRANSMISSION message for message %s from %s(%s)\n",
 			getMessageTypeName(messageType), portId, inet_ntoa(tmpAddr));
 
-	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, grantTable, &ptpClock->grantIndex, nodeCount, TRUE);
+	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, grantTable, index, nodeCount, TRUE);
 
 	if(nodeTable == NULL) {
 		DBG("GRANT_UNICAST_TRANSMISSION: did not find node in master table: %s\n", portId);
@@ -508,6 +757,8 @@ handleSMGrantUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress
 		/* this is so that we request again */
 		myGrant->requested = FALSE;
 
+		scheduleUnicastGrant(myGrant, ptpClock);
+
 		return;
 	}
 
@@ -524,6 +775,8 @@ handleSMGrantUnicastTransmission(MsgSignaling* incoming, Integer32 sourceAddress
 	myGrant->canceled = FALSE;
 	myGrant->cancelCount = 0;
 
+	scheduleUnicastGrant(myGrant, ptpClock);
+
 }
 
 /**\brief Handle incoming CANCEL_UNICAST_TRANSMISSION signaling message type*/
@@ -558,7 +811,7 @@ handleSMCancelUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoing
 
 	ptpClock->counters.unicastGrantsCancelReceived++;
 
-	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS, FALSE);
+	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize, FALSE);
 
 	if(nodeTable == NULL) {
 		DBG("CANCEL_UNICAST_TRANSMISSION: did not find node in slave table: %s\n", portId);
@@ -601,6 +854,8 @@ handleSMCancelUnicastTransmission(MsgSignaling* incoming, MsgSignaling* outgoing
 	myGrant->timeLeft = 0;
 	myGrant->duration = 0;
 
+	scheduleUnicastGrant(myGrant, ptpClock);
+
 	DBG("Accepted CANCEL_UNICAST_TRANSMISSION message for message %s from %s(%s)\n",
 			getMessageTypeName(messageType), portId, inet_ntoa(tmpAddr));
 
@@ -632,7 +887,7 @@ handleSMAcknowledgeCancelUnicastTransmission(MsgSignaling* incoming, Integer32 s
 	DBGV("Received ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION message for message %s from %s(%s)\n",
 			getMessageTypeName(messageType), portId, inet_ntoa(tmpAddr));
 
-	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, ptpClock->unicastGrants, &ptpClock->grantIndex, UNICAST_MAX_DESTINATIONS, FALSE);
+	nodeTable = findUnicastGrants(&incoming->header.sourcePortIdentity, sourceAddress, ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastGrantTableSize, FALSE);
 
 	if(nodeTable == NULL) {
 		DBG("ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION: did not find node in slave table: %s\n", portId);
@@ -664,6 +919,8 @@ handleSMAcknowledgeCancelUnicastTransmission(MsgSignaling* incoming, Integer32 s
 	myGrant->canceled = FALSE;
 	myGrant->cancelCount = 0;
 
+	scheduleUnicastGrant(myGrant, ptpClock);
+
 	ptpClock->counters.unicastGrantsCancelAckReceived++;
 
 	DBG("Accepted ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION message for message %s from %s(%s)\n",
@@ -768,13 +1025,8 @@ initUnicastGrantTable(UnicastGrantTable *grantTable, Enumeration8 delayMechanism
     UnicastGrantData *grantData;
     UnicastGrantTable *nodeTable;
 
-    /* initialise the index table */
-    for(i=0; i < UNICAST_MAX_DESTINATIONS; i++) {
-	ptpClock->grantIndex.data[i] = NULL;
-	ptpClock->syncDestIndex[i].transportAddress = 0;
-    }
-
-    ptpClock->grantIndex.portMask = rtOpts->unicastPortMask;
+    /* the index is rebuilt with initUnicastGrantIndex() once the table is ready */
+    memset(ptpClock->syncDestIndex, 0, ptpClock->syncDestIndexSize * sizeof(SyncDestEntry));
 
     for(j=0; j<nodeCount; j++) {   
 
@@ -856,7 +1108,7 @@ initUnicastGrantTable(UnicastGrantTable *grantTable, Enumeration8 delayMechanism
  * so that messages are re-requested
  */
 void
-updateUnicastGrantTable(UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts)
+updateUnicastGrantTable(UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
 {
 
     int i,j;
@@ -914,7 +1166,7 @@ updateUnicastGrantTable(UnicastGrantTable *grantTable, int nodeCount, const RunT
 		    break;
 	    }
 
-
+	    scheduleUnicastGrant(grantData, ptpClock);
 
 	}
 
@@ -923,6 +1175,61 @@ updateUnicastGrantTable(UnicastGrantTable *grantTable, int nodeCount, const RunT
 
 }
 
+/*
+ * Fast initial acquisition: ask the node for Sync and Delay_Resp at the
+ * acquisition rate, or at the configured rates again once it is over.
+ * Grants already requested are requested again straight away; if the node
+ * denies the rate, slower ones are asked for as usual.
+ */
+void
+setUnicastAcquisition(UnicastGrantTable *nodeTable, Boolean fast, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+
+    int i;
+    Integer8 logInterval;
+    UnicastGrantData *grantData;
+
+    for(i=0; i < PTP_MAX_MESSAGE_INDEXED; i++) {
+
+	grantData = &nodeTable->grantData[i];
+
+	if(!grantData->requestable) {
+	    continue;
+	}
+
+	switch(grantData->messageType) {
+	    case SYNC:
+		logInterval = rtOpts->logSyncInterval;
+		break;
+	    case DELAY_RESP:
+		logInterval = rtOpts->logMinDelayReqInterval;
+		break;
+	    default:
+		continue;
+	}
+
+	if(fast && rtOpts->acquisitionLogInterval < logInterval) {
+	    logInterval = rtOpts->acquisitionLogInterval;
+	}
+
+	if(grantData->logMinInterval == logInterval) {
+	    continue;
+	}
+
+	DBG("unicast acquisition: requesting %s at interval %d\n",
+		getMessageTypeName(grantData->messageType), logInterval);
+
+	grantData->logMinInterval = logInterval;
+	grantData->logInterval = logInterval;
+
+	if(grantData->requested) {
+	    requestUnicastTransmission(grantData, rtOpts->unicastGrantDuration, rtOpts, ptpClock);
+	}
+
+    }
+
+}
+
 static void
 requestUnicastTransmission(UnicastGrantData *grant, UInteger32 duration, const RunTimeOpts* rtOpts, PtpClock* ptpClock)
 {
@@ -952,6 +1259,8 @@ requestUnicastTransmission(UnicastGrantData *grant, UInteger32 duration, const R
 			grant->expired = FALSE;
 	}
 
+	scheduleUnicastGrant(grant, ptpClock);
+
 	/* cleanup msgTmp signalingTLV */
 	freeSignalingTLV(&ptpClock->msgTmp.signaling);
 	/* cleanup outgoing signalingTLV */
@@ -972,6 +1281,8 @@ cancelUnicastTransmission(UnicastGrantData* grant, const const RunTimeOpts* rtOp
 			ptpClock->counters.unicastGrantsCancelSent++;
 	}
 
+	scheduleUnicastGrant(grant, ptpClock);
+
 	/* cleanup msgTmp signalingTLV */
 	freeSignalingTLV(&ptpClock->msgTmp.signaling);
 	/* cleanup outgoing signalingTLV */
@@ -1162,9 +1473,9 @@ handleSignaling(MsgHeader *header,
         		    goto end;
 		}
 		unpackSMGrantUnicastTransmission(ptpClock->msgIbuf + tlvOffset, &ptpClock->msgTmp.signaling, ptpClock);
-		handleSMGrantUnicastTransmission(&ptpClock->msgTmp.signaling, sourceAddress, ptpClock->unicastGrants, ptpClock->unicastDestinationCount, ptpClock);
+		handleSMGrantUnicastTransmission(&ptpClock->msgTmp.signaling, sourceAddress, ptpClock->unicastGrants, &ptpClock->grantIndex, ptpClock->unicastDestinationCount, ptpClock);
 		if(ptpClock->portDS.delayMechanism == P2P) {
-		    handleSMGrantUnicastTransmission(&ptpClock->msgTmp.signaling, sourceAddress, &ptpClock->peerGrants, 1, ptpClock);
+		    handleSMGrantUnicastTransmission(&ptpClock->msgTmp.signaling, sourceAddress, &ptpClock->peerGrants, NULL, 1, ptpClock);
 		}
 		break;
 
@@ -1195,136 +1506,223 @@ handleSignaling(MsgHeader *header,
 
 }
 
-void
-refreshUnicastGrants(UnicastGrantTable *grantTable, int nodeCount, const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+/* check if a grant needs to be (re-)requested on every refresh until it is granted */
+static Boolean
+unicastGrantRetry(UnicastGrantData *grant, PtpClock *ptpClock)
 {
 
-    static int everyN = 0;
-    int i,j;
+    UnicastGrantTable *nodeTable = grant->parent;
 
-    UnicastGrantData *grantData = NULL;
-    UnicastGrantTable *nodeTable = NULL;
-    Boolean actionRequired;
-    int maxTime = 0;
+    if(ptpClock->defaultDS.slaveOnly && grant->requested && !grant->granted) {
+	return TRUE;
+    }
 
-    /* modulo N counter: used for requesting announce while other master is selected */
-    everyN++;
-    everyN %= GRANT_KEEPALIVE_INTERVAL;
+    if(nodeTable->isPeer && grant->messageType == PDELAY_RESP && !grant->granted) {
+	return TRUE;
+    }
 
-     /* only notSlave or slaveOnly - nothing inbetween */
-     if(ptpClock->defaultDS.clockQuality.clockClass > 127 && ptpClock->defaultDS.clockQuality.clockClass < 255)  {
-	return;
-     }
+    if(!nodeTable->isPeer && ptpClock->defaultDS.slaveOnly &&
+	grant->messageType == ANNOUNCE && !grant->requested) {
+	return TRUE;
+    }
 
+    return FALSE;
 
-    ptpClock->slaveCount = 0;
+}
 
-	for(j=0; j<nodeCount; j++) {
+/*
+ * Recompute node's timeLeft from its live grants and release the node
+ * once no grant remains. Called whenever any of its grants is rescheduled.
+ */
+static void
+updateUnicastNode(UnicastGrantTable *nodeTable, PtpClock *ptpClock)
+{
 
-	    nodeTable = &grantTable[j];
-	    maxTime = 0;
+    int i;
+    Integer32 left;
+    Integer32 maxTime = 0;
+    UnicastGrantData *grantData;
+    PortIdentity freeIdentity;
+    /* the peer table is not indexed */
+    UnicastGrantIndex *index = (nodeTable == &ptpClock->peerGrants) ? NULL : &ptpClock->grantIndex;
 
-	    for(i=0; i < PTP_MAX_MESSAGE_INDEXED; i++) {
-		grantData = &nodeTable->grantData[i];
-		if(grantData->granted && !grantData->expired) {
-		    maxTime = grantData->timeLeft;
-		    break;
-		}
+    for(i=0; i < PTP_MAX_MESSAGE_INDEXED; i++) {
+	grantData = &nodeTable->grantData[i];
+	if(grantData->granted && !grantData->expired) {
+	    left = (Integer32)(grantData->expiryTick - ptpClock->grantWheel.now) + GRANT_EXPIRY_MARGIN;
+	    if(left < 1) {
+		left = 1;
 	    }
+	    if(left > maxTime) {
+		maxTime = left;
+	    }
+	}
+    }
 
-	    for(i=0; i < PTP_MAX_MESSAGE_INDEXED; i++) {
+    nodeTable->timeLeft = maxTime;
+
+    /* Wild West version:  Murdering Murphy! You done killed my paw! */
+    /* Reggae version:     Matic in dem way, chopper in dem hand, hey, some a dem have M16 'pon dem shoulder */
+    /* Factual version:    Make sure the node is re-usable: reset PortIdentity to all-ones again */
+    if(nodeTable->timeLeft == 0) {
+	if(!portIdentityAllOnes(&nodeTable->portIdentity)) {
+	    memset(&freeIdentity, 0xFF, sizeof(PortIdentity));
+	    updateUnicastKeys(nodeTable, &freeIdentity, nodeTable->transportAddress, index);
+	    DBG("Unicast node for %s now free and reusable\n",
+		inet_ntoa(*(struct in_addr *)&nodeTable->transportAddress));
+	}
+	releaseUnicastGrants(nodeTable, index);
+    }
 
-		grantData = &nodeTable->grantData[i];
+}
 
-		if(!grantData->requestable) {
-		    continue;
-		}
+/*
+ * (Re-)arm the grant's timer wheel entry for the next refresh tick at which
+ * the grant needs attention: expiry, a pending retry or cancel timeout, or
+ * the next keepalive check on the slave side. Grants needing none of these
+ * are left off the wheel until a signaling message changes their state.
+ */
+void
+scheduleUnicastGrant(UnicastGrantData *grant, PtpClock *ptpClock)
+{
 
-		actionRequired = FALSE;
-	
-		if(grantData->granted) {
-		    /* re-request 5 seconds before expiry for continuous service.
-		     * masters set this to +10 sec so will keep +5 sec extra
-		     */
-		    if(grantData->timeLeft <= 5) {
-			DBG("grant for message %s expired\n", getMessageTypeName(grantData->messageType));
-			grantData->expired = TRUE;
-		    } else {
-			if(grantData->timeLeft > maxTime) {
-			    maxTime = grantData->timeLeft;
-			}
-			grantData->timeLeft--;
-		    }
+    UnicastGrantTable *nodeTable = grant->parent;
+    TimerWheel *wheel = &ptpClock->grantWheel;
+    UInteger32 ticks = 0;
+    UInteger32 keepalive;
 
+    grant->wheelEntry.owner = grant;
 
-		}
+    if(grant->granted && !grant->expired) {
+	/* re-request 5 seconds before expiry for continuous service.
+	 * masters set this to +10 sec so will keep +5 sec extra
+	 */
+	ticks = (grant->timeLeft > GRANT_EXPIRY_MARGIN) ? grant->timeLeft - GRANT_EXPIRY_MARGIN : 1;
+	grant->expiryTick = wheel->now + ticks;
+	/* slave side: check the grant is still being honoured */
+	if(ptpClock->defaultDS.slaveOnly || nodeTable->isPeer) {
+	    keepalive = (GRANT_KEEPALIVE_INTERVAL - 1 - wheel->now % GRANT_KEEPALIVE_INTERVAL) % GRANT_KEEPALIVE_INTERVAL;
+	    if(keepalive == 0) {
+		keepalive = GRANT_KEEPALIVE_INTERVAL;
+	    }
+	    if(keepalive < ticks) {
+		ticks = keepalive;
+	    }
+	}
+    } else if(grant->expired || (grant->canceled && grant->cancelCount >= GRANT_CANCEL_ACK_TIMEOUT) ||
+		unicastGrantRetry(grant, ptpClock)) {
+	ticks = 1;
+    }
 
-		if(grantData->canceled && grantData->cancelCount >= GRANT_CANCEL_ACK_TIMEOUT) {
-		    grantData->cancelCount = 0;
-		    grantData->canceled = FALSE;
-		    grantData->granted = FALSE;
-		    grantData->requested = FALSE;
-		    grantData->sentSeqId = 0;
-		    grantData->timeLeft = 0;
-		    grantData->duration = 0;
-		}
+    if(!grant->requestable || ticks == 0) {
+	timerWheelCancel(wheel, &grant->wheelEntry);
+    } else {
+	timerWheelSchedule(wheel, &grant->wheelEntry, ticks);
+    }
 
-		if(grantData->expired || (ptpClock->defaultDS.slaveOnly && grantData->requested && !grantData->granted)) {
-		    actionRequired = TRUE;
-		}
+    updateUnicastNode(nodeTable, ptpClock);
 
-		if(nodeTable->isPeer && grantData->messageType==PDELAY_RESP && !grantData->granted) {
-		    actionRequired = TRUE;
-		}
+}
 
-		if(!nodeTable->isPeer && ptpClock->defaultDS.slaveOnly) {
-		    if(grantData->messageType == ANNOUNCE && !grantData->requested) {
-			actionRequired = TRUE;
-		    }
-		}
+/* put all grants of a freshly initialised grant table on the timer wheel */
+void
+armUnicastGrants(UnicastGrantTable *grantTable, int nodeCount, PtpClock *ptpClock)
+{
 
-		if((ptpClock->defaultDS.slaveOnly || nodeTable->isPeer) && (everyN == (GRANT_KEEPALIVE_INTERVAL -1))){
-			if(grantData->receiving == 0 && grantData->granted ) {
-			    /* if we mixed n consecutive messages (checked every m seconds), re-request */
- 			    if( (everyN * UNICAST_GRANT_REFRESH_INTERVAL) > (GRANT_MAX_MISSED * grantData->logInterval)) {
-			    DBG("foreign master: no %s being received - will request again\n",
-				    getMessageTypeName(grantData->messageType));
-				actionRequired = TRUE;
-			    }
-			}
-			    grantData->receiving = 0;
-		}
+    int i,j;
 
-		/* if we're slave, we request; if we're master, we cancel */
-		if(actionRequired) {
-		    if (ptpClock->defaultDS.slaveOnly || nodeTable->isPeer) {
-			requestUnicastTransmission(grantData, rtOpts->unicastGrantDuration, rtOpts, ptpClock);
-		    } else {
-			cancelUnicastTransmission(grantData, rtOpts, ptpClock);
-		    }
-		}
+    for(j=0; j<nodeCount; j++) {
+	for(i=0; i < PTP_MAX_MESSAGE_INDEXED; i++) {
+	    scheduleUnicastGrant(&grantTable[j].grantData[i], ptpClock);
+	}
+    }
 
-		if(grantData->messageType == ANNOUNCE && ptpClock->portDS.portState == PTP_MASTER
-		    && grantData->granted) {
-			ptpClock->slaveCount++;
-		}
+}
 
-	    }
+/* timer wheel callback: service a single grant whose refresh tick is due */
+static void
+processUnicastGrant(TimerWheelEntry *entry, void *userData)
+{
 
-	    nodeTable->timeLeft = maxTime;
-	    /* Wild West version:  Murdering Murphy! You done killed my paw! */
-	    /* Reggae version:     Matic in dem way, chopper in dem hand, hey, some a dem have M16 'pon dem shoulder */
-	    /* Factual version:    Make sure the node is re-usable: reset PortIdentity to all-ones again */
-	    if(nodeTable->timeLeft == 0) {
-		nodeTable->portIdentity.portNumber = 0xFFFF;
-		memset(&nodeTable->portIdentity.clockIdentity, 0xFF, CLOCK_IDENTITY_LENGTH);
-		DBG("Unicast node %d now free and reusable\n", j);
+    PtpClock *ptpClock = (PtpClock*)userData;
+    const RunTimeOpts *rtOpts = ptpClock->rtOpts;
+    UnicastGrantData *grantData = (UnicastGrantData*)entry->owner;
+    UnicastGrantTable *nodeTable = grantData->parent;
+    UInteger32 now = ptpClock->grantWheel.now;
+    Boolean actionRequired = FALSE;
+
+    if(grantData->granted && !grantData->expired) {
+	if((Integer32)(now - grantData->expiryTick) >= 0) {
+	    DBG("grant for message %s expired\n", getMessageTypeName(grantData->messageType));
+	    grantData->expired = TRUE;
+	} else {
+	    grantData->timeLeft = grantData->expiryTick - now + GRANT_EXPIRY_MARGIN;
+	}
+    }
+
+    if(grantData->canceled && grantData->cancelCount >= GRANT_CANCEL_ACK_TIMEOUT) {
+	grantData->cancelCount = 0;
+	grantData->canceled = FALSE;
+	grantData->granted = FALSE;
+	grantData->requested = FALSE;
+	grantData->sentSeqId = 0;
+	grantData->timeLeft = 0;
+	grantData->duration = 0;
+    }
+
+    if(grantData->expired || unicastGrantRetry(grantData, ptpClock)) {
+	actionRequired = TRUE;
+    }
+
+    if((ptpClock->defaultDS.slaveOnly || nodeTable->isPeer) &&
+	((now % GRANT_KEEPALIVE_INTERVAL) == (GRANT_KEEPALIVE_INTERVAL - 1))) {
+	if(grantData->receiving == 0 && grantData->granted ) {
+	    /* if we mixed n consecutive messages (checked every m seconds), re-request */
+	    if( ((GRANT_KEEPALIVE_INTERVAL - 1) * UNICAST_GRANT_REFRESH_INTERVAL) > (GRANT_MAX_MISSED * grantData->logInterval)) {
+		DBG("foreign master: no %s being received - will request again\n",
+		    getMessageTypeName(grantData->messageType));
+		actionRequired = TRUE;
 	    }
 	}
+	grantData->receiving = 0;
+    }
 
-	if(nodeCount == 1 && nodeTable && nodeTable->isPeer) {
-		return;
+    /* if we're slave, we request; if we're master, we cancel */
+    if(actionRequired) {
+	if (ptpClock->defaultDS.slaveOnly || nodeTable->isPeer) {
+	    requestUnicastTransmission(grantData, rtOpts->unicastGrantDuration, rtOpts, ptpClock);
+	} else {
+	    cancelUnicastTransmission(grantData, rtOpts, ptpClock);
+	}
+    }
+
+    scheduleUnicastGrant(grantData, ptpClock);
+
+}
+
+/*
+ * Advance the grant timer wheel by one refresh tick: only grants with
+ * something due on this tick are visited, instead of sweeping every node.
+ */
+void
+refreshUnicastGrants(const RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+
+    UnicastGrantData *grantData = NULL;
+    UnicastGrantTable *nodeTable = NULL;
+
+     /* only notSlave or slaveOnly - nothing inbetween */
+     if(ptpClock->defaultDS.clockQuality.clockClass > 127 && ptpClock->defaultDS.clockQuality.clockClass < 255)  {
+	return;
+     }
+
+	/* slaves are counted while issuing Announce */
+	if(ptpClock->portDS.portState != PTP_MASTER) {
+	    ptpClock->slaveCount = 0;
 	}
+
+	timerWheelAdvance(&ptpClock->grantWheel, processUnicastGrant, ptpClock);
+
 	/* we have some old requests to cancel, we changed the GM - keep the Announce coming though */
 	if(ptpClock->previousGrants != NULL) {
 	    cancelUnicastTransmission(&(ptpClock->previousGrants->grantData[SYNC_INDEXED]), rtOpts, ptpClock);
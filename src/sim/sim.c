@@ -0,0 +1,677 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   sim.c
+ * @date   Tue Apr 12 09:20:15 2016
+ *
+ * @brief  ptpd2-sim: the protocol engine in a simulated world
+ *
+ * Usage: ptpd2-sim scenario.conf [ptpd2 options]
+ *
+ * The scenario is a ptpd2 configuration file - the engine is configured
+ * from it as usual - with the simulation set up in extra sections:
+ *
+ *   [sim]          the engine's clock and network, the run, the checks;
+ *                  sim:phc gives the interface a PTP hardware clock
+ *   [sim.master1]  a grandmaster, up to [sim.master16]
+ *   [sim.slaves]   unicast negotiation slaves
+ *
+ * A scenario can build on another one: sim:base names it, relative to
+ * the scenario, and only what differs from it needs setting.
+ *
+ * Times of day and durations are in seconds, offsets and delays in
+ * nanoseconds, frequency errors in ppb; see test/sim-*.conf. The engine
+ * starts the way ptpd2 does and runs until the scenario's duration is
+ * up, then a summary is printed. The exit status is 1 when one of the
+ * scenario's expect_ checks failed.
+ */
+
+#include "sim.h"
+
+/* what a ptpd2 binary provides in ptpd.c */
+RunTimeOpts rtOpts;
+Boolean startupInProgress;
+PTPD_THREAD_LOCAL PtpClock *G_ptpClock = NULL;
+TimingDomain timingDomain;
+
+SimConfig simConfig;
+
+#define SIM_MAX_ARGS	64
+
+/* the engine's clock as seen by the samples */
+static struct {
+	Boolean locked;
+	int64_t lockTime;	/* start of the first stretch within the threshold long enough */
+	Boolean inside;		/* within the threshold since lockTime */
+	SimStat offset;		/* since lock, ns */
+	double maxOffset;	/* largest absolute offset since lock, ns */
+	int64_t lastOffset;
+	uint64_t samples;
+} clockStats;
+
+static FILE *outputFile = NULL;
+
+/* does the scenario name the engine's interface */
+static Boolean hasInterface = FALSE;
+
+/* the scenario merged with its base, which the engine is configured from */
+static char engineConfig[PATH_MAX];
+
+/* state and parent, for the timeline */
+static Enumeration8 lastState = PTP_INITIALIZING;
+static PortIdentity lastParent;
+
+static struct timespec wallStart;
+
+Boolean
+simConfigKey(const char *key)
+{
+	return !strncmp(key, "sim", 3) && (key[3] == ':' || key[3] == '.');
+}
+
+void
+simStatAdd(SimStat *stat, double value)
+{
+	if(!stat->count || value < stat->min) {
+		stat->min = value;
+	}
+	if(!stat->count || value > stat->max) {
+		stat->max = value;
+	}
+	stat->count++;
+	stat->sum += value;
+	stat->sumSquares += value * value;
+}
+
+double
+simStatMean(const SimStat *stat)
+{
+	return stat->count ? stat->sum / stat->count : 0;
+}
+
+double
+simStatStdDev(const SimStat *stat)
+{
+	double mean = simStatMean(stat);
+	double variance;
+
+	if(stat->count < 2) {
+		return 0;
+	}
+
+	variance = stat->sumSquares / stat->count - mean * mean;
+	return variance > 0 ? sqrt(variance) : 0;
+}
+
+/* seconds since the start of the run */
+static double
+elapsed(int64_t time)
+{
+	return (time - simConfig.startTime) / 1E9;
+}
+
+static int64_t
+secondsToNs(double seconds)
+{
+	return llround(seconds * SIM_NS);
+}
+
+static Boolean
+parseAddress(dictionary *dict, const char *key, const char *def, Integer32 *address)
+{
+	const char *value = iniparser_getstring(dict, key, (char*)def);
+	struct in_addr netAddr;
+
+	if(!inet_aton(value, &netAddr)) {
+		ERROR("sim: %s: invalid IPv4 address %s\n", key, value);
+		return FALSE;
+	}
+
+	*address = netAddr.s_addr;
+	return TRUE;
+}
+
+static double
+getDouble(dictionary *dict, const char *section, const char *name, double def)
+{
+	char key[PATH_MAX];
+
+	snprintf(key, sizeof(key), "%s:%s", section, name);
+	return iniparser_getdouble(dict, key, def);
+}
+
+static int
+getInt(dictionary *dict, const char *section, const char *name, int def)
+{
+	char key[PATH_MAX];
+
+	snprintf(key, sizeof(key), "%s:%s", section, name);
+	return iniparser_getint(dict, key, def);
+}
+
+static const char*
+getString(dictionary *dict, const char *name)
+{
+	char key[PATH_MAX];
+	const char *value;
+
+	snprintf(key, sizeof(key), "sim:%s", name);
+	value = iniparser_getstring(dict, key, "");
+	return strlen(value) ? strdup(value) : NULL;
+}
+
+/* a section is there if any key is in it: [section] or section:key */
+static Boolean
+hasSection(dictionary *dict, const char *section)
+{
+	size_t length = strlen(section);
+	int i;
+
+	for(i = 0; i < dict->size; i++) {
+		if(dict->key[i] != NULL && !strncmp(dict->key[i], section, length) &&
+		    (dict->key[i][length] == ':' || dict->key[i][length] == '\0')) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Load a scenario. With a base, its settings are laid over the base's and
+ * the result is written out for the engine to load, into engineConfig.
+ */
+static dictionary*
+loadScenario(const char *fileName)
+{
+	dictionary *dict, *merged;
+	const char *base, *slash;
+	char path[PATH_MAX], section[PATH_MAX];
+	char *colon;
+	FILE *out;
+	int fd, i;
+
+	if((dict = iniparser_load(fileName)) == NULL) {
+		ERROR("sim: could not load scenario %s\n", fileName);
+		return NULL;
+	}
+
+	base = iniparser_getstring(dict, "sim:base", "");
+	if(!strlen(base)) {
+		return dict;
+	}
+
+	slash = strrchr(fileName, '/');
+	if(base[0] == '/' || slash == NULL) {
+		snprintf(path, sizeof(path), "%s", base);
+	} else {
+		snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - fileName), fileName, base);
+	}
+
+	if((merged = iniparser_load(path)) == NULL) {
+		ERROR("sim: could not load base scenario %s\n", path);
+		iniparser_freedict(&dict);
+		return NULL;
+	}
+
+	for(i = 0; i < dict->size; i++) {
+		if(dict->key[i] != NULL && strcmp(dict->key[i], "sim:base")) {
+			iniparser_set(merged, dict->key[i], dict->val[i]);
+		}
+	}
+	iniparser_freedict(&dict);
+
+	/* keys set outside a [section] are only written out under one */
+	for(i = 0; i < merged->size; i++) {
+		if(merged->key[i] != NULL && (colon = strchr(merged->key[i], ':')) != NULL) {
+			snprintf(section, sizeof(section), "%.*s", (int)(colon - merged->key[i]), merged->key[i]);
+			if(!iniparser_find_entry(merged, section)) {
+				iniparser_set(merged, section, NULL);
+			}
+		}
+	}
+
+	snprintf(engineConfig, sizeof(engineConfig), "/tmp/ptpd2-sim.XXXXXX");
+	if((fd = mkstemp(engineConfig)) < 0 || (out = fdopen(fd, "w")) == NULL) {
+		PERROR("sim: could not write the configuration for %s", fileName);
+		if(fd >= 0) {
+			close(fd);
+			unlink(engineConfig);
+		}
+		engineConfig[0] = '\0';
+		iniparser_freedict(&merged);
+		return NULL;
+	}
+	iniparser_dump_ini(merged, out);
+	fclose(out);
+
+	return merged;
+}
+
+/* the simulation settings in a scenario file */
+static Boolean
+parseScenario(const char *fileName)
+{
+	dictionary *dict;
+	SimMaster *master;
+	char section[32], key[PATH_MAX], def[32];
+	int64_t traceStart;
+	int domain, i;
+
+	if((dict = loadScenario(fileName)) == NULL) {
+		return FALSE;
+	}
+
+	memset(&simConfig, 0, sizeof(simConfig));
+	domain = iniparser_getint(dict, "ptpengine:domain", DFLT_DOMAIN_NUMBER);
+	hasInterface = strlen(iniparser_getstring(dict, "ptpengine:interface", "")) > 0;
+
+	simConfig.trace = getString(dict, "trace");
+	simConfig.duration = secondsToNs(getDouble(dict, "sim", "duration", 600));
+	simConfig.seed = getInt(dict, "sim", "seed", 1);
+	/*
+	 * 2016-01-01 00:00:00.25 UTC, or the time of the first packet in the trace.
+	 * Timers run on whole intervals from the start, and a two-step master
+	 * takes a TX timestamp with zero nanoseconds as missing: keep them off
+	 * the second boundary.
+	 */
+	simConfig.startTime = secondsToNs(getDouble(dict, "sim", "start_time", 1451606400.25));
+	if(simConfig.trace != NULL) {
+		if(!simTraceOpen(simConfig.trace, &traceStart)) {
+			goto fail;
+		}
+		if(!iniparser_find_entry(dict, "sim:start_time")) {
+			simConfig.startTime = traceStart;
+		}
+	}
+	simConfig.initialOffset = llround(getDouble(dict, "sim", "initial_offset", 0));
+	simConfig.oscillatorPpb = getDouble(dict, "sim", "oscillator_error", 0);
+	simConfig.wanderPpb = getDouble(dict, "sim", "wander", 0);
+	simConfig.agingPpb = getDouble(dict, "sim", "aging", 0);
+	simConfig.phc = iniparser_getboolean(dict, "sim:phc", FALSE);
+	simConfig.phcInitialOffset = llround(getDouble(dict, "sim", "phc_initial_offset", 0));
+	simConfig.phcOscillatorPpb = getDouble(dict, "sim", "phc_oscillator_error", 0);
+	simConfig.phcMaxAdj = getInt(dict, "sim", "phc_max_adjustment", 500000);
+	simConfig.delay = llround(getDouble(dict, "sim", "delay", 100000));
+	simConfig.jitter = llround(getDouble(dict, "sim", "jitter", 0));
+	simConfig.asymmetry = llround(getDouble(dict, "sim", "asymmetry", 0));
+	simConfig.loss = getDouble(dict, "sim", "loss", 0);
+	simConfig.timestampNoise = llround(getDouble(dict, "sim", "timestamp_noise", 0));
+	simConfig.sampleInterval = secondsToNs(getDouble(dict, "sim", "sample_interval", 1));
+	simConfig.lockThreshold = llround(getDouble(dict, "sim", "lock_threshold", 1000));
+	simConfig.lockHold = secondsToNs(getDouble(dict, "sim", "lock_hold", 10));
+	simConfig.capture = getString(dict, "capture");
+	simConfig.output = getString(dict, "output");
+	simConfig.expectLock = getDouble(dict, "sim", "expect_lock", -1);
+	simConfig.expectMaxOffset = getDouble(dict, "sim", "expect_max_offset", -1);
+	simConfig.expectState = getString(dict, "expect_state");
+
+	if(!parseAddress(dict, "sim:address", "10.0.0.1", &simConfig.address)) {
+		goto fail;
+	}
+
+	if(simConfig.duration <= 0 || simConfig.sampleInterval <= 0 ||
+	    simConfig.loss < 0 || simConfig.loss >= 1) {
+		ERROR("sim: duration and sample_interval must be positive, loss in [0, 1)\n");
+		goto fail;
+	}
+
+	for(i = 1; i <= SIM_MAX_MASTERS; i++) {
+		snprintf(section, sizeof(section), "sim.master%d", i);
+		if(!hasSection(dict, section)) {
+			continue;
+		}
+		master = &simConfig.masters[simConfig.masterCount++];
+		master->number = i;
+		snprintf(key, sizeof(key), "%s:address", section);
+		snprintf(def, sizeof(def), "10.0.1.%d", i);
+		if(!parseAddress(dict, key, def, &master->address)) {
+			goto fail;
+		}
+		master->start = simConfig.startTime + secondsToNs(getDouble(dict, section, "start", 0));
+		master->stop = getDouble(dict, section, "stop", -1) < 0 ? SIM_NEVER :
+		    simConfig.startTime + secondsToNs(getDouble(dict, section, "stop", 0));
+		master->offset = llround(getDouble(dict, section, "offset", 0));
+		master->delay = llround(getDouble(dict, section, "delay", simConfig.delay));
+		master->domainNumber = getInt(dict, section, "domain", domain);
+		master->priority1 = getInt(dict, section, "priority1", 128);
+		master->priority2 = getInt(dict, section, "priority2", 128);
+		master->clockClass = getInt(dict, section, "clock_class", 6);
+		master->clockAccuracy = getInt(dict, section, "clock_accuracy", 0x21);
+		master->utcOffset = getInt(dict, section, "utc_offset", 36);
+		master->logSyncInterval = getInt(dict, section, "log_sync_interval", 0);
+		master->logAnnounceInterval = getInt(dict, section, "log_announce_interval", 1);
+	}
+
+	simConfig.slaveCount = getInt(dict, "sim.slaves", "count", 0);
+	simConfig.slavesStart = simConfig.startTime + secondsToNs(getDouble(dict, "sim.slaves", "start", 0));
+	simConfig.slavesRamp = secondsToNs(getDouble(dict, "sim.slaves", "ramp", 0));
+	simConfig.slaveLogSyncInterval = getInt(dict, "sim.slaves", "log_sync_interval", 0);
+	simConfig.slaveLogAnnounceInterval = getInt(dict, "sim.slaves", "log_announce_interval", 1);
+	simConfig.slaveLogDelayReqInterval = getInt(dict, "sim.slaves", "log_delayreq_interval", 0);
+	simConfig.slaveGrantDuration = getInt(dict, "sim.slaves", "grant_duration", 300);
+	simConfig.slaveDomainNumber = getInt(dict, "sim.slaves", "domain", domain);
+
+	if(simConfig.slaveCount < 0 || simConfig.slaveCount > 65534) {
+		ERROR("sim: sim.slaves:count must be between 0 and 65534\n");
+		goto fail;
+	}
+
+	iniparser_freedict(&dict);
+	return TRUE;
+
+fail:
+	iniparser_freedict(&dict);
+	return FALSE;
+}
+
+/* the engine's clock against true time, every sample_interval */
+void
+simSample(void)
+{
+	int64_t now = simNow();
+	int64_t offset = simLocalTime(now) - now;
+	Enumeration8 state = G_ptpClock->portDS.portState;
+
+	clockStats.samples++;
+	clockStats.lastOffset = offset;
+
+	/* locked once the offset has stayed within the threshold for lock_hold */
+	if(!clockStats.locked) {
+		if(state != PTP_SLAVE || llabs(offset) > simConfig.lockThreshold) {
+			clockStats.inside = FALSE;
+		} else if(!clockStats.inside) {
+			clockStats.inside = TRUE;
+			clockStats.lockTime = now;
+		}
+		if(clockStats.inside && now - clockStats.lockTime >= simConfig.lockHold) {
+			clockStats.locked = TRUE;
+			INFO("sim: %.3f s: locked since %.3f s, offset %lld ns\n", elapsed(now),
+			    elapsed(clockStats.lockTime), (long long)offset);
+		}
+	}
+
+	if(clockStats.locked) {
+		simStatAdd(&clockStats.offset, offset);
+		if(fabs((double)offset) > clockStats.maxOffset) {
+			clockStats.maxOffset = fabs((double)offset);
+		}
+	}
+
+	if(outputFile != NULL) {
+		fprintf(outputFile, "%.3f,%lld,%.3f,%s\n", elapsed(now), (long long)offset,
+		    simClockFrequency(), portState_getName(state));
+	}
+
+	/* random walk of the oscillator */
+	if(simConfig.wanderPpb > 0) {
+		simClockWander(simConfig.wanderPpb * sqrt(simConfig.sampleInterval / 1E9) * simRandomGaussian());
+	}
+
+	/* oscillator aging */
+	if(simConfig.agingPpb != 0) {
+		simClockWander(simConfig.agingPpb * simConfig.sampleInterval / 1E9 / 3600.0);
+	}
+
+	simSchedule(now + simConfig.sampleInterval, SIM_EVENT_SAMPLE, NULL);
+}
+
+/* log port state and parent changes */
+void
+simWatch(void)
+{
+	PtpClock *ptpClock = G_ptpClock;
+	char parent[PATH_MAX];
+
+	if(ptpClock == NULL) {
+		return;
+	}
+
+	if(ptpClock->portDS.portState == lastState &&
+	    !memcmp(&ptpClock->parentDS.parentPortIdentity, &lastParent, sizeof(PortIdentity))) {
+		return;
+	}
+
+	lastState = ptpClock->portDS.portState;
+	lastParent = ptpClock->parentDS.parentPortIdentity;
+
+	snprint_PortIdentity(parent, sizeof(parent), &lastParent);
+	INFO("sim: %.3f s: %s, parent %s\n", elapsed(simNow()), portState_getName(lastState), parent);
+}
+
+/* the end of the run: the summary, and the verdict */
+void
+simFinish(void)
+{
+	struct timespec wallEnd;
+	const char *finalState = portState_getName(G_ptpClock->portDS.portState);
+	double wall, run = simConfig.duration / 1E9;
+	int64_t systemOffset = 0;
+	double systemAdjustment = 0;
+	uint64_t systemSteps = 0;
+	int failed = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+	wall = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1E9;
+
+	simTraceClose();
+	simCaptureClose();
+	if(outputFile != NULL) {
+		fclose(outputFile);
+	}
+
+	printf("\nsimulated %.0f s, seed %llu\n", run, (unsigned long long)simConfig.seed);
+	printf("final state:    %s\n", finalState);
+	printf("final offset:   %lld ns, frequency %.3f ppb\n", (long long)clockStats.lastOffset,
+	    simClockFrequency());
+	if(clockStats.locked) {
+		printf("locked after:   %.3f s (|offset| <= %lld ns)\n", elapsed(clockStats.lockTime),
+		    (long long)simConfig.lockThreshold);
+		printf("since lock:     mean %.1f ns, std dev %.1f ns, max |offset| %.0f ns\n",
+		    simStatMean(&clockStats.offset), simStatStdDev(&clockStats.offset),
+		    clockStats.maxOffset);
+	} else {
+		printf("locked after:   never (|offset| <= %lld ns)\n", (long long)simConfig.lockThreshold);
+	}
+	printf("clock steps:    %llu\n", (unsigned long long)simClockSteps());
+	if(simClockHardware()) {
+		simSystemClock(&systemOffset, &systemAdjustment, &systemSteps);
+		printf("system clock:   offset %lld ns, adjusted by %.3f ppb, %llu steps\n",
+		    (long long)systemOffset, systemAdjustment, (unsigned long long)systemSteps);
+	}
+	printf("packets:        %llu\n", (unsigned long long)simNetPacketCount());
+	simPeersReport(stdout);
+	printf("wall clock:     %.3f s, %.0fx real time\n", wall, wall > 0 ? run / wall : 0);
+
+	if(simConfig.expectLock >= 0 &&
+	    (!clockStats.locked || elapsed(clockStats.lockTime) > simConfig.expectLock)) {
+		printf("FAIL: no lock within %.3f s\n", simConfig.expectLock);
+		failed++;
+	}
+
+	if(simConfig.expectMaxOffset >= 0 &&
+	    (!clockStats.locked || clockStats.maxOffset > simConfig.expectMaxOffset)) {
+		printf("FAIL: max |offset| since lock above %.0f ns\n", simConfig.expectMaxOffset);
+		failed++;
+	}
+
+	/* with hardware timestamps the PHC is steered, and only the PHC */
+	if(simClockHardware() && (systemAdjustment != 0 || systemSteps > 0)) {
+		printf("FAIL: the system clock was steered\n");
+		failed++;
+	}
+
+	/* PTP_SLAVE or just SLAVE */
+	if(simConfig.expectState != NULL &&
+	    strcasecmp(simConfig.expectState, finalState) && strcasecmp(simConfig.expectState, finalState + 4)) {
+		printf("FAIL: final state is not %s\n", simConfig.expectState);
+		failed++;
+	}
+
+	fflush(stdout);
+	exit(failed ? 1 : 0);
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage: %s scenario.conf [ptpd2 options]\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+	PtpClock *ptpClock;
+	Integer16 ret;
+	TimingService *ts;
+	char *args[SIM_MAX_ARGS];
+	int64_t traceTime;
+	SimPacket *packet;
+	int count = 0, i;
+
+	if(argc < 2 || argv[1][0] == '-') {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if(!parseScenario(argv[1])) {
+		if(strlen(engineConfig)) {
+			unlink(engineConfig);
+		}
+		return 2;
+	}
+
+	simClockInit(simConfig.startTime, simConfig.initialOffset, simConfig.oscillatorPpb);
+	simRandomInit(simConfig.seed);
+	srand(simConfig.seed);
+
+	/* the engine starts as ptpd2 -C -L -c scenario.conf, in the foreground and without a lock */
+	args[count++] = argv[0];
+	args[count++] = "-C";
+	args[count++] = "-L";
+	args[count++] = "-c";
+	args[count++] = strlen(engineConfig) ? engineConfig : argv[1];
+	if(!hasInterface) {
+		args[count++] = "-i";
+		args[count++] = "sim0";
+	}
+	for(i = 2; i < argc && count < SIM_MAX_ARGS - 1; i++) {
+		args[count++] = argv[i];
+	}
+	args[count] = NULL;
+
+	startupInProgress = TRUE;
+
+	memset(&timingDomain, 0, sizeof(timingDomain));
+	timingDomainSetup(&timingDomain);
+
+	timingDomain.electionLeft = 10;
+
+	ptpClock = ptpdStartup(count, args, &ret, &rtOpts);
+
+	/* the engine has its configuration now */
+	if(strlen(engineConfig)) {
+		unlink(engineConfig);
+	}
+
+	if (ptpClock == NULL) {
+		if (ret != 0 && !rtOpts.checkConfigOnly)
+			ERROR(USER_DESCRIPTION" startup failed\n");
+		return ret;
+	}
+
+	if(rtOpts.boundaryClockPorts > 0 || rtOpts.pcap || rtOpts.transport == IEEE_802_3) {
+		ERROR("sim: boundary clock, pcap and 802.3 transport are not simulated\n");
+		return 2;
+	}
+
+	/* the engine's own randomness, re-seeded after startup consumed some */
+	srand(simConfig.seed);
+
+	if(!simNetInit() || !simPeersInit()) {
+		return 2;
+	}
+
+	if(simConfig.capture != NULL && !simCaptureOpen(simConfig.capture)) {
+		return 2;
+	}
+
+	if(simConfig.output != NULL) {
+		if((outputFile = fopen(simConfig.output, "w")) == NULL) {
+			PERROR("Could not open %s", simConfig.output);
+			return 2;
+		}
+		fprintf(outputFile, "time,offset,frequency,state\n");
+	}
+
+	if(simConfig.trace != NULL && (packet = simTraceNext(&traceTime)) != NULL) {
+		simSchedule(traceTime, SIM_EVENT_TRACE, packet);
+	}
+
+	simSchedule(simConfig.startTime + simConfig.sampleInterval, SIM_EVENT_SAMPLE, NULL);
+
+	timingDomain.electionDelay = rtOpts.electionDelay;
+
+	/* configure PTP TimeService */
+
+	timingDomain.services[0] = &ptpClock->timingService;
+	ts = timingDomain.services[0];
+	strncpy(ts->id, "PTP0", TIMINGSERVICE_MAX_DESC);
+	ts->dataSet.priority1 = rtOpts.preferNTP;
+	ts->dataSet.type = TIMINGSERVICE_PTP;
+	ts->config = &rtOpts;
+	ts->controller = ptpClock;
+	ts->timeout = rtOpts.idleTimeout;
+	ts->updateInterval = 1;
+	ts->holdTime = rtOpts.ntpOptions.failoverTimeout;
+	timingDomain.serviceCount = 1;
+
+	if (rtOpts.ntpOptions.enableEngine) {
+		WARNING("sim: the NTP engine is not simulated - ignored\n");
+	}
+	timingDomain.services[1] = NULL;
+
+	timingDomain.init(&timingDomain);
+	timingDomain.updateInterval = 1;
+
+	startupInProgress = FALSE;
+
+	G_ptpClock = ptpClock;
+
+	/*
+	 * No asynchronous logging: the writer thread runs in real time, and
+	 * log lines are stamped with simulated time anyway.
+	 */
+
+	clock_gettime(CLOCK_MONOTONIC, &wallStart);
+
+	/* the run ends in netSelect(), through simFinish() */
+	protocol(&rtOpts, ptpClock);
+
+	return 1;
+}
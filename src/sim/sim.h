@@ -0,0 +1,259 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   sim.h
+ * @date   Tue Apr 12 09:20:15 2016
+ *
+ * @brief  Offline simulation harness definitions
+ *
+ * ptpd2-sim runs the unmodified protocol engine against a simulated
+ * network, simulated event timers and a simulated system clock, all
+ * driven by one virtual time line: nothing waits for real time, so a
+ * session runs as fast as the engine can process it, and the same
+ * scenario and seed always give the same run.
+ *
+ * Time is kept in signed 64-bit nanoseconds. "True" time is the time of
+ * the simulation; every node keeps its own clock relative to it.
+ */
+
+#ifndef PTPD_SIM_H_
+#define PTPD_SIM_H_
+
+#include "../ptpd.h"
+
+#ifdef PTPD_SLAVE_ONLY
+#error "ptpd2-sim needs the master code: configure without --enable-slave-only"
+#endif /* PTPD_SLAVE_ONLY */
+
+#define SIM_NS			1000000000LL
+#define SIM_NEVER		INT64_MAX
+
+/* descriptors handed to the engine - only ever used with FD_SET / FD_ISSET */
+#define SIM_EVENT_FD		100
+#define SIM_GENERAL_FD		101
+/* the interface's PTP hardware clock, with sim:phc */
+#define SIM_PHC_FD		102
+#define SIM_PHC_DEVICE		"/dev/ptp0"
+
+#define SIM_MAX_MASTERS		16
+
+/* running statistics of one quantity */
+typedef struct {
+	uint64_t count;
+	double sum;
+	double sumSquares;
+	double min;
+	double max;
+} SimStat;
+
+/* a packet on the simulated network */
+typedef struct SimPacket SimPacket;
+struct SimPacket {
+	Octet data[PACKET_SIZE];
+	int length;
+	Boolean event;		/* sent to the event port */
+	Integer32 src;		/* addresses in network byte order */
+	Integer32 dst;
+	Integer32 to;		/* the node receiving this copy */
+	TimeInternal rxTimestamp;	/* taken by the receiver on arrival */
+	SimPacket *next;	/* engine receive queues */
+};
+
+/* a simulated grandmaster: [sim.masterN] */
+typedef struct {
+	int number;
+	Integer32 address;
+	PortIdentity portIdentity;
+	int64_t start;
+	int64_t stop;
+	int64_t offset;		/* of its clock from true time, excluding the UTC offset */
+	int64_t delay;		/* one-way path delay to the engine */
+	UInteger8 domainNumber;
+	UInteger8 priority1;
+	UInteger8 priority2;
+	UInteger8 clockClass;
+	Enumeration8 clockAccuracy;
+	Integer16 utcOffset;
+	Integer8 logSyncInterval;
+	Integer8 logAnnounceInterval;
+	UInteger16 syncSequenceId;
+	UInteger16 announceSequenceId;
+	int64_t nextSync;
+	int64_t nextAnnounce;
+	Boolean active;
+	/* counters for the summary */
+	uint64_t syncSent;
+	uint64_t delayRespSent;
+	uint64_t pdelayRespSent;
+} SimMaster;
+
+/* the message types a slave negotiates with the engine */
+enum {
+	SIM_GRANT_ANNOUNCE = 0,
+	SIM_GRANT_SYNC,
+	SIM_GRANT_DELAY_RESP,
+	SIM_GRANT_TYPES
+};
+
+/* one negotiated grant, as the slave sees it */
+typedef struct {
+	Boolean granted;
+	int64_t expires;	/* when the grant runs out */
+	int64_t nextRequest;	/* when to request it (again) */
+} SimGrant;
+
+/* a simulated unicast negotiation slave: [sim.slaves] */
+typedef struct {
+	int number;
+	Integer32 address;
+	PortIdentity portIdentity;
+	UInteger16 signalingSequenceId;
+	UInteger16 delayReqSequenceId;
+	SimGrant grants[SIM_GRANT_TYPES];
+	/* Sync stream */
+	Boolean syncSeen;
+	UInteger16 lastSyncSequenceId;
+	int64_t lastSyncArrival;
+	/* the Delay_Req waiting for its Delay_Resp, if any */
+	Boolean delayReqOutstanding;
+	int64_t delayReqSent;
+	int64_t nextDelayReq;
+	int64_t nextWakeup;	/* scheduled wakeup, SIM_NEVER if none */
+} SimSlave;
+
+/* everything the scenario file sets up */
+typedef struct {
+	/* [sim] */
+	int64_t duration;
+	uint64_t seed;
+	int64_t startTime;	/* true time at the start, since the epoch */
+	Integer32 address;	/* of the engine */
+	int64_t initialOffset;	/* of the engine's clock from true time */
+	double oscillatorPpb;	/* frequency error of the engine's oscillator */
+	double wanderPpb;	/* random walk of the frequency error, per sqrt(s) */
+	double agingPpb;	/* linear drift of the frequency error, per hour */
+	Boolean phc;		/* the interface has a PTP hardware clock */
+	int64_t phcInitialOffset;	/* of the PHC from true time */
+	double phcOscillatorPpb;	/* frequency error of the PHC's oscillator */
+	Integer32 phcMaxAdj;	/* largest frequency adjustment it accepts, ppb */
+	int64_t delay;		/* one-way network delay */
+	int64_t jitter;		/* mean of the exponential queueing delay added to it */
+	int64_t asymmetry;	/* extra delay towards the engine */
+	double loss;		/* packet loss probability */
+	int64_t timestampNoise;	/* standard deviation of timestamping noise */
+	int64_t sampleInterval;
+	int64_t lockThreshold;
+	int64_t lockHold;	/* how long the offset must stay within the threshold */
+	const char *trace;	/* pcap file replayed to the engine */
+	const char *capture;	/* pcap file the engine's traffic is written to */
+	const char *output;	/* CSV file with the engine's clock samples */
+	/* regression checks, disabled when negative */
+	double expectLock;
+	double expectMaxOffset;
+	const char *expectState;
+	/* [sim.masterN] */
+	SimMaster masters[SIM_MAX_MASTERS];
+	int masterCount;
+	/* [sim.slaves] */
+	int slaveCount;
+	int64_t slavesStart;
+	int64_t slavesRamp;
+	Integer8 slaveLogSyncInterval;
+	Integer8 slaveLogAnnounceInterval;
+	Integer8 slaveLogDelayReqInterval;
+	UInteger32 slaveGrantDuration;
+	UInteger8 slaveDomainNumber;
+} SimConfig;
+
+extern SimConfig simConfig;
+
+/* sim.c */
+void simFinish(void);
+void simSample(void);
+void simWatch(void);
+Boolean simConfigKey(const char *key);
+void simStatAdd(SimStat *stat, double value);
+double simStatMean(const SimStat *stat);
+double simStatStdDev(const SimStat *stat);
+
+/* simclock.c: the engine's clocks and the random numbers */
+void simClockInit(int64_t startTime, int64_t initialOffset, double oscillatorPpb);
+void simClockHardwareTimestamps(Boolean hardware);
+Boolean simClockHardware(void);
+int64_t simNow(void);
+void simAdvance(int64_t time);
+int64_t simLocalTime(int64_t trueTime);
+double simClockFrequency(void);
+void simClockWander(double ppb);
+uint64_t simClockSteps(void);
+void simSystemClock(int64_t *offset, double *adjustment, uint64_t *steps);
+void simRandomInit(uint64_t seed);
+double simRandom(void);
+double simRandomGaussian(void);
+double simRandomExponential(double mean);
+void simNsToInternal(int64_t ns, TimeInternal *time);
+void simNsToTimestamp(int64_t ns, Timestamp *timestamp);
+int64_t simTimestampToNs(const Timestamp *timestamp);
+
+/* simtimer.c: the event timers */
+Boolean simTimersExpire(int64_t now);
+int64_t simTimersNextDeadline(void);
+
+/* simnet.c: the network and the event queue */
+Boolean simNetInit(void);
+void simSchedule(int64_t time, int kind, void *data);
+void simSend(const Octet *buf, int length, Boolean event, Integer32 src, Integer32 dst);
+Integer32 simMulticastAddress(Boolean peer);
+uint64_t simNetPacketCount(void);
+
+enum {
+	SIM_EVENT_DELIVERY = 0,	/* a packet arrives at its destination */
+	SIM_EVENT_MASTER,	/* a master's Sync or Announce is due */
+	SIM_EVENT_SLAVE,	/* a slave wakes up */
+	SIM_EVENT_TRACE,	/* the next packet from the trace is due */
+	SIM_EVENT_SAMPLE	/* the engine's clock is sampled */
+};
+
+/* simpeers.c: simulated masters and slaves */
+Boolean simPeersInit(void);
+void simMasterRun(SimMaster *master);
+void simSlaveRun(SimSlave *slave);
+void simPeerReceive(SimPacket *packet, int64_t now);
+int64_t simPeerDelay(Integer32 address);
+int simPeersMulticastTargets(Integer32 *targets, int max);
+void simPeersReport(FILE *out);
+
+/* simtrace.c: pcap trace replay and capture */
+Boolean simTraceOpen(const char *fileName, int64_t *firstPacket);
+SimPacket *simTraceNext(int64_t *time);
+void simTraceClose(void);
+Boolean simCaptureOpen(const char *fileName);
+void simCapture(const SimPacket *packet, int64_t time);
+void simCaptureClose(void);
+
+#endif /* PTPD_SIM_H_ */
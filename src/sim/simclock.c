@@ -0,0 +1,422 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   simclock.c
+ * @date   Tue Apr 12 09:20:15 2016
+ *
+ * @brief  Simulated clocks, and the random numbers of the simulation
+ *
+ * Provides the clock functions sys.c provides in a normal build: getTime(),
+ * setTime(), adjFreq() and friends, plus the adjtimex() flag helpers,
+ * which keep their state here. The engine's clock runs at the frequency
+ * error of its oscillator plus the adjustment the servo applies, like a
+ * kernel clock disciplined through adjtimex().
+ *
+ * With sim:phc, the interface also has a PTP hardware clock: the device
+ * functions of phc.c are provided here, so the PHC driver opens and
+ * steers it as it would a /dev/ptpN. It timestamps the engine's event
+ * messages when the engine uses hardware timestamps.
+ */
+
+#include "sim.h"
+
+/* a clock: localBase at trueBase, running at 1 + frequency ppb since */
+typedef struct {
+	int64_t localBase;
+	int64_t trueBase;
+	double oscillator;	/* ppb */
+	double adjustment;	/* ppb, set through adjFreq() */
+	uint64_t steps;
+} SimClock;
+
+/* true time: the time line of the whole simulation */
+static int64_t trueNow = 0;
+
+static SimClock systemClock;
+static SimClock hardwareClock;
+
+/* the clock which timestamps the engine's packets */
+static SimClock *timestampClock = &systemClock;
+
+#ifdef HAVE_SYS_TIMEX_H
+static int timexFlags = STA_UNSYNC;
+#if defined(MOD_TAI) &&  NTP_API == 4
+static int kernelUtcOffset = 0;
+#endif /* MOD_TAI */
+#endif /* HAVE_SYS_TIMEX_H */
+
+static uint64_t randomState = 1;
+
+static void
+clockInit(SimClock *clock, int64_t initialOffset, double oscillatorPpb)
+{
+	memset(clock, 0, sizeof(SimClock));
+	clock->trueBase = trueNow;
+	clock->localBase = trueNow + initialOffset;
+	clock->oscillator = oscillatorPpb;
+}
+
+/* the system clock, and the PHC if there is one */
+void
+simClockInit(int64_t startTime, int64_t initialOffset, double oscillatorPpb)
+{
+	trueNow = startTime;
+	clockInit(&systemClock, initialOffset, oscillatorPpb);
+	clockInit(&hardwareClock, simConfig.phcInitialOffset, simConfig.phcOscillatorPpb);
+	timestampClock = &systemClock;
+}
+
+/* set up by netInit(): are the engine's packets timestamped by the PHC */
+void
+simClockHardwareTimestamps(Boolean hardware)
+{
+	timestampClock = hardware ? &hardwareClock : &systemClock;
+}
+
+Boolean
+simClockHardware(void)
+{
+	return timestampClock == &hardwareClock;
+}
+
+int64_t
+simNow(void)
+{
+	return trueNow;
+}
+
+/* time only moves forward */
+void
+simAdvance(int64_t time)
+{
+	if(time > trueNow) {
+		trueNow = time;
+	}
+}
+
+static int64_t
+clockTime(const SimClock *clock, int64_t trueTime)
+{
+	int64_t elapsed = trueTime - clock->trueBase;
+
+	return clock->localBase + elapsed +
+	    (int64_t)llround(elapsed * (clock->oscillator + clock->adjustment) / 1E9);
+}
+
+/* restart the clock's time line from now, before its frequency changes */
+static void
+rebase(SimClock *clock)
+{
+	clock->localBase = clockTime(clock, trueNow);
+	clock->trueBase = trueNow;
+}
+
+/* the clock the engine reads and steers: the PHC while the driver has it open */
+static SimClock*
+engineClock(void)
+{
+	return phcActive() ? &hardwareClock : &systemClock;
+}
+
+/* the time of the engine's clock - the one timestamping its packets */
+int64_t
+simLocalTime(int64_t trueTime)
+{
+	return clockTime(timestampClock, trueTime);
+}
+
+/* the frequency error of the engine's clock: oscillator plus adjustment, ppb */
+double
+simClockFrequency(void)
+{
+	return timestampClock->oscillator + timestampClock->adjustment;
+}
+
+/* oscillator wander: shift the frequency error */
+void
+simClockWander(double ppb)
+{
+	rebase(timestampClock);
+	timestampClock->oscillator += ppb;
+}
+
+uint64_t
+simClockSteps(void)
+{
+	return timestampClock->steps;
+}
+
+/* the system clock, while the PHC timestamps: it should not have been touched */
+void
+simSystemClock(int64_t *offset, double *adjustment, uint64_t *steps)
+{
+	*offset = clockTime(&systemClock, trueNow) - trueNow;
+	*adjustment = systemClock.adjustment;
+	*steps = systemClock.steps;
+}
+
+void
+simNsToInternal(int64_t ns, TimeInternal *time)
+{
+	int64_t seconds = ns / SIM_NS;
+	int64_t nanoseconds = ns % SIM_NS;
+
+	if(nanoseconds < 0) {
+		seconds--;
+		nanoseconds += SIM_NS;
+	}
+
+	time->seconds = seconds;
+	time->nanoseconds = nanoseconds;
+}
+
+void
+simNsToTimestamp(int64_t ns, Timestamp *timestamp)
+{
+	TimeInternal time;
+
+	simNsToInternal(ns, &time);
+	memset(timestamp, 0, sizeof(Timestamp));
+	fromInternalTime(&time, timestamp);
+}
+
+int64_t
+simTimestampToNs(const Timestamp *timestamp)
+{
+	return (((int64_t)timestamp->secondsField.msb << 32) + timestamp->secondsField.lsb) * SIM_NS +
+	    timestamp->nanosecondsField;
+}
+
+/* xorshift64*: fast, and the same sequence for the same seed everywhere */
+void
+simRandomInit(uint64_t seed)
+{
+	randomState = seed ? seed : 1;
+}
+
+static uint64_t
+randomNext(void)
+{
+	randomState ^= randomState >> 12;
+	randomState ^= randomState << 25;
+	randomState ^= randomState >> 27;
+	return randomState * 2685821657736338717ULL;
+}
+
+/* uniform in [0, 1) */
+double
+simRandom(void)
+{
+	return (randomNext() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* standard normal, Box-Muller */
+double
+simRandomGaussian(void)
+{
+	double u = 1.0 - simRandom();
+	double v = simRandom();
+
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+double
+simRandomExponential(double mean)
+{
+	if(mean <= 0) {
+		return 0;
+	}
+
+	return -mean * log(1.0 - simRandom());
+}
+
+/* the clock functions of sys.c */
+
+void
+getTime(TimeInternal *time)
+{
+	simNsToInternal(clockTime(engineClock(), trueNow), time);
+}
+
+/* monotonic: the simulation's own time line */
+void
+getTimeMonotonic(TimeInternal *time)
+{
+	simNsToInternal(trueNow, time);
+}
+
+void
+setTime(TimeInternal *time)
+{
+	char timeStr[MAXTIMESTR];
+	time_t seconds = time->seconds;
+	SimClock *clock = engineClock();
+
+	clock->localBase = (int64_t)time->seconds * SIM_NS + time->nanoseconds;
+	clock->trueBase = trueNow;
+	clock->steps++;
+
+	strftime(timeStr, MAXTIMESTR, "%x %X", localtime(&seconds));
+	WARNING("Stepped the %s to: %s.%d\n",
+	       phcName(), timeStr, time->nanoseconds);
+}
+
+#ifdef HAVE_LINUX_RTC_H
+void
+setRtc(TimeInternal *timeToSet)
+{
+	DBG("setRtc: no RTC in the simulation\n");
+}
+#endif /* HAVE_LINUX_RTC_H */
+
+Boolean
+adjFreq(double adj)
+{
+	extern RunTimeOpts rtOpts;
+
+	/* Clamp to max PPM */
+	if (adj > rtOpts.servoMaxPpb){
+		adj = rtOpts.servoMaxPpb;
+	} else if (adj < -rtOpts.servoMaxPpb){
+		adj = -rtOpts.servoMaxPpb;
+	}
+
+	/* as sys.c: a PHC takes the whole adjustment, through the driver */
+	if(phcActive()) {
+		return phcAdjFreq(adj);
+	}
+
+	rebase(&systemClock);
+	/* at the resolution of timex.freq: 2^-16 ppm */
+	systemClock.adjustment = round(adj * ((1 << 16) / 1000.0)) / ((1 << 16) / 1000.0);
+
+	DBG2("adjFreq: simulated clock adjusted by %.03f ppb\n", systemClock.adjustment);
+
+	return TRUE;
+}
+
+double
+getAdjFreq(void)
+{
+	if(phcActive()) {
+		return phcGetAdjFreq();
+	}
+
+	return systemClock.adjustment;
+}
+
+/*
+ * The device functions of phc.c: the interface's PHC, if the scenario
+ * gives it one. It has no file descriptor or clock ID of its own.
+ */
+
+int
+phcDeviceOpen(const char *path)
+{
+	if(!simConfig.phc || strcmp(path, SIM_PHC_DEVICE)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return SIM_PHC_FD;
+}
+
+int
+phcDeviceCaps(int fd, Integer32 *maxAdj)
+{
+	*maxAdj = simConfig.phcMaxAdj;
+	return 0;
+}
+
+void
+phcDeviceClose(int fd)
+{
+}
+
+int
+phcDeviceAdjtime(clockid_t clock, struct timex *t)
+{
+	/* scaled ppm: ppm with a 16-bit fractional part */
+	if(t->modes & ADJ_FREQUENCY) {
+		rebase(&hardwareClock);
+		hardwareClock.adjustment = t->freq / ((1 << 16) / 1000.0);
+		DBG2("phcDeviceAdjtime: simulated PHC adjusted by %.03f ppb\n", hardwareClock.adjustment);
+	}
+
+	t->freq = (long) round(hardwareClock.adjustment * ((1 << 16) / 1000.0));
+
+	return 0;
+}
+
+#ifdef HAVE_SYS_TIMEX_H
+/* the kernel clock status, as far as the engine can see it */
+
+void
+informClockSource(PtpClock* ptpClock)
+{
+}
+
+void
+setTimexFlags(int flags, Boolean quiet)
+{
+	timexFlags |= flags;
+}
+
+void
+unsetTimexFlags(int flags, Boolean quiet)
+{
+	timexFlags &= ~flags;
+}
+
+int
+getTimexFlags(void)
+{
+	return timexFlags;
+}
+
+Boolean
+checkTimexFlags(int flags)
+{
+	return ((timexFlags & flags) == flags);
+}
+
+#if defined(MOD_TAI) &&  NTP_API == 4
+void
+setKernelUtcOffset(int utc_offset)
+{
+	kernelUtcOffset = utc_offset;
+}
+
+Boolean
+getKernelUtcOffset(int *utc_offset)
+{
+	*utc_offset = kernelUtcOffset;
+	return TRUE;
+}
+#endif /* MOD_TAI */
+#endif /* HAVE_SYS_TIMEX_H */
@@ -0,0 +1,615 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   simnet.c
+ * @date   Tue Apr 12 09:20:15 2016
+ *
+ * @brief  Simulated network transport and the simulation's event queue
+ *
+ * Provides the functions net.c provides in a normal build. The engine's
+ * packets go onto a simulated network which delivers them to the
+ * simulated masters and slaves after the configured delay, and theirs
+ * - or those replayed from a trace - queue up in front of the engine's
+ * two "sockets". TX timestamps are taken on send, like SO_TIMESTAMPING
+ * does, so the engine never falls back to looping its packets back. With
+ * ptpengine:hardware_timestamping, the interface's PHC takes them.
+ *
+ * netSelect() is where simulated time passes: whenever the engine waits,
+ * time jumps to the next thing that happens - a packet arriving, a timer
+ * expiring, or a simulated node doing something - until the engine has
+ * something to do.
+ */
+
+#include "sim.h"
+
+/* something scheduled to happen at some time: a binary heap, ordered by time then by scheduling order */
+typedef struct {
+	int64_t time;
+	uint64_t sequence;
+	int kind;
+	void *data;
+} SimEvent;
+
+static SimEvent *events = NULL;
+static int eventCount = 0;
+static int eventCapacity = 0;
+static uint64_t eventSequence = 0;
+
+/* packets waiting for the engine to read them */
+static SimPacket *eventQueue = NULL;
+static SimPacket *eventQueueTail = NULL;
+static SimPacket *generalQueue = NULL;
+static SimPacket *generalQueueTail = NULL;
+
+static Integer32 multicastAddr;
+static Integer32 peerMulticastAddr;
+
+static uint64_t packetCount = 0;
+
+static Boolean
+eventBefore(const SimEvent *a, const SimEvent *b)
+{
+	return a->time < b->time || (a->time == b->time && a->sequence < b->sequence);
+}
+
+void
+simSchedule(int64_t time, int kind, void *data)
+{
+	SimEvent *grown, tmp;
+	int i, parent;
+
+	if(eventCount == eventCapacity) {
+		eventCapacity = eventCapacity ? eventCapacity * 2 : 1024;
+		if((grown = realloc(events, eventCapacity * sizeof(SimEvent))) == NULL) {
+			PERROR("Could not grow the simulation event queue");
+			exit(1);
+		}
+		events = grown;
+	}
+
+	i = eventCount++;
+	events[i].time = time;
+	events[i].sequence = eventSequence++;
+	events[i].kind = kind;
+	events[i].data = data;
+
+	while(i > 0) {
+		parent = (i - 1) / 2;
+		if(!eventBefore(&events[i], &events[parent])) {
+			break;
+		}
+		tmp = events[i];
+		events[i] = events[parent];
+		events[parent] = tmp;
+		i = parent;
+	}
+}
+
+static SimEvent
+popEvent(void)
+{
+	SimEvent top = events[0], tmp;
+	int i = 0, child;
+
+	events[0] = events[--eventCount];
+
+	for(;;) {
+		child = 2 * i + 1;
+		if(child >= eventCount) {
+			break;
+		}
+		if(child + 1 < eventCount && eventBefore(&events[child + 1], &events[child])) {
+			child++;
+		}
+		if(!eventBefore(&events[child], &events[i])) {
+			break;
+		}
+		tmp = events[i];
+		events[i] = events[child];
+		events[child] = tmp;
+		i = child;
+	}
+
+	return top;
+}
+
+static Boolean
+isMulticast(Integer32 address)
+{
+	return IN_MULTICAST(ntohl(address));
+}
+
+Integer32
+simMulticastAddress(Boolean peer)
+{
+	return peer ? peerMulticastAddr : multicastAddr;
+}
+
+uint64_t
+simNetPacketCount(void)
+{
+	return packetCount;
+}
+
+Boolean
+simNetInit(void)
+{
+	struct in_addr netAddr;
+
+	inet_aton(DEFAULT_PTP_DOMAIN_ADDRESS, &netAddr);
+	multicastAddr = netAddr.s_addr;
+	inet_aton(PEER_PTP_DOMAIN_ADDRESS, &netAddr);
+	peerMulticastAddr = netAddr.s_addr;
+
+	return TRUE;
+}
+
+/* a timestamp taken by the engine's clock, with the configured noise */
+static void
+engineTimestamp(int64_t trueTime, TimeInternal *time)
+{
+	int64_t local = simLocalTime(trueTime);
+
+	if(simConfig.timestampNoise > 0) {
+		local += llround(simRandomGaussian() * simConfig.timestampNoise);
+	}
+
+	simNsToInternal(local, time);
+}
+
+/* put one copy of a packet on its way to one node */
+static void
+transmit(const Octet *buf, int length, Boolean event, Integer32 src, Integer32 dst, Integer32 to)
+{
+	SimPacket *packet;
+	int64_t delay;
+
+	if(simConfig.loss > 0 && simRandom() < simConfig.loss) {
+		DBGV("sim: packet to %08x lost\n", ntohl(to));
+		return;
+	}
+
+	if(to == simConfig.address) {
+		delay = simPeerDelay(src) + simConfig.asymmetry;
+	} else {
+		delay = simPeerDelay(to);
+	}
+
+	delay += llround(simRandomExponential(simConfig.jitter));
+
+	if((packet = calloc(1, sizeof(SimPacket))) == NULL) {
+		PERROR("Could not allocate simulated packet");
+		exit(1);
+	}
+
+	memcpy(packet->data, buf, length);
+	packet->length = length;
+	packet->event = event;
+	packet->src = src;
+	packet->dst = dst;
+	packet->to = to;
+
+	simSchedule(simNow() + delay, SIM_EVENT_DELIVERY, packet);
+}
+
+/* send a packet: the engine's multicast reaches every master, everything else one node */
+void
+simSend(const Octet *buf, int length, Boolean event, Integer32 src, Integer32 dst)
+{
+	Integer32 targets[SIM_MAX_MASTERS];
+	SimPacket captured;
+	int i, count;
+
+	packetCount++;
+
+	captured.length = length;
+	captured.event = event;
+	captured.src = src;
+	captured.dst = dst;
+	memcpy(captured.data, buf, length);
+	simCapture(&captured, simNow());
+
+	if(src != simConfig.address) {
+		transmit(buf, length, event, src, dst, simConfig.address);
+	} else if(isMulticast(dst)) {
+		count = simPeersMulticastTargets(targets, SIM_MAX_MASTERS);
+		for(i = 0; i < count; i++) {
+			transmit(buf, length, event, src, dst, targets[i]);
+		}
+	} else {
+		transmit(buf, length, event, src, dst, dst);
+	}
+}
+
+static void
+engineReceive(SimPacket *packet, int64_t now)
+{
+	if(packet->event) {
+		engineTimestamp(now, &packet->rxTimestamp);
+		if(eventQueueTail != NULL) {
+			eventQueueTail->next = packet;
+		} else {
+			eventQueue = packet;
+		}
+		eventQueueTail = packet;
+	} else {
+		if(generalQueueTail != NULL) {
+			generalQueueTail->next = packet;
+		} else {
+			generalQueue = packet;
+		}
+		generalQueueTail = packet;
+	}
+}
+
+static void
+runEvent(SimEvent *event, int64_t now)
+{
+	SimPacket *packet, *next;
+	int64_t time;
+
+	switch(event->kind) {
+	case SIM_EVENT_DELIVERY:
+		packet = (SimPacket*)event->data;
+		if(packet->to == simConfig.address) {
+			engineReceive(packet, now);
+		} else {
+			simPeerReceive(packet, now);
+			free(packet);
+		}
+		break;
+	case SIM_EVENT_MASTER:
+		simMasterRun((SimMaster*)event->data);
+		break;
+	case SIM_EVENT_SLAVE:
+		simSlaveRun((SimSlave*)event->data);
+		break;
+	case SIM_EVENT_TRACE:
+		packet = (SimPacket*)event->data;
+		packetCount++;
+		simCapture(packet, now);
+		engineReceive(packet, now);
+		/* one trace packet in the queue at a time */
+		if((next = simTraceNext(&time)) != NULL) {
+			simSchedule(time, SIM_EVENT_TRACE, next);
+		}
+		break;
+	case SIM_EVENT_SAMPLE:
+		simSample();
+		break;
+	}
+}
+
+static SimPacket*
+dequeue(SimPacket **queue, SimPacket **tail)
+{
+	SimPacket *packet = *queue;
+
+	if(packet != NULL) {
+		*queue = packet->next;
+		if(*queue == NULL) {
+			*tail = NULL;
+		}
+	}
+
+	return packet;
+}
+
+/* the net.c API */
+
+Boolean
+testInterface(char * ifaceName, const RunTimeOpts* rtOpts)
+{
+	return TRUE;
+}
+
+Boolean
+hostLookup(const char* hostname, Integer32* addr)
+{
+	struct in_addr netAddr;
+
+	/* no name service in the simulation */
+	if (!inet_aton(hostname, &netAddr)) {
+		ERROR("failed to encode unicast address: %s\n", hostname);
+		return FALSE;
+	}
+
+	*addr = netAddr.s_addr;
+	return TRUE;
+}
+
+Boolean
+netInit(NetPath * netPath, RunTimeOpts * rtOpts, PtpClock * ptpClock)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in*)&netPath->interfaceInfo.afAddress;
+	uint32_t address = ntohl(simConfig.address);
+
+	DBG("netInit\n");
+
+	netPath->headerOffset = PACKET_BEGIN_UDP;
+	netPath->eventSock = SIM_EVENT_FD;
+	netPath->generalSock = SIM_GENERAL_FD;
+
+	/* a locally administered MAC address made from the IP address */
+	memset(&netPath->interfaceInfo, 0, sizeof(InterfaceInfo));
+	netPath->interfaceInfo.addressFamily = AF_INET;
+	netPath->interfaceInfo.hasHwAddress = TRUE;
+	netPath->interfaceInfo.hasAfAddress = TRUE;
+	netPath->interfaceInfo.hwAddress[0] = 0x02;
+	netPath->interfaceInfo.hwAddress[1] = 0x00;
+	netPath->interfaceInfo.hwAddress[2] = (address >> 24) & 0xFF;
+	netPath->interfaceInfo.hwAddress[3] = (address >> 16) & 0xFF;
+	netPath->interfaceInfo.hwAddress[4] = (address >> 8) & 0xFF;
+	netPath->interfaceInfo.hwAddress[5] = address & 0xFF;
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = simConfig.address;
+
+	memcpy(netPath->interfaceID, netPath->interfaceInfo.hwAddress, sizeof(netPath->interfaceID));
+	netPath->interfaceAddr = sin->sin_addr;
+	netPath->multicastAddr = multicastAddr;
+	netPath->peerMulticastAddr = peerMulticastAddr;
+	netPath->txTimestampFailure = FALSE;
+
+#ifdef PTPD_PHC
+	/* as net.c finds it with ETHTOOL_GET_TS_INFO: the PHC is /dev/ptp0 */
+	netPath->hwTimestamping = FALSE;
+	netPath->phcIndex = -1;
+
+	if(rtOpts->hwTimestamping) {
+		if(!simConfig.phc) {
+			ERROR("Interface %s does not support hardware timestamping\n",
+			    rtOpts->ifaceName);
+			return FALSE;
+		}
+		netPath->hwTimestamping = TRUE;
+		netPath->phcIndex = 0;
+		INFO("Hardware timestamping enabled on %s, PTP hardware clock index %d\n",
+		    rtOpts->ifaceName, netPath->phcIndex);
+	}
+
+	simClockHardwareTimestamps(netPath->hwTimestamping);
+#endif /* PTPD_PHC */
+
+	if(rtOpts->unicastDestinationsSet) {
+		WARNING("ptpengine:unicast_destinations is not simulated - ignored\n");
+	}
+
+	if(rtOpts->delayMechanism==P2P && rtOpts->ipMode==IPMODE_UNICAST) {
+		ptpClock->unicastPeerDestination.transportAddress = 0;
+		if(!rtOpts->unicastPeerDestinationSet) {
+			ERROR("No P2P unicast destination specified\n");
+			return FALSE;
+		}
+		if(!hostLookup(rtOpts->unicastPeerDestination,
+		    &ptpClock->unicastPeerDestination.transportAddress)) {
+			ERROR("Could not parse P2P unicast destination %s:\n",
+			    rtOpts->unicastPeerDestination);
+			return FALSE;
+		}
+	}
+
+	/* Compile ACLs */
+	if(rtOpts->timingAclEnabled) {
+		freeIpv4AccessList(&netPath->timingAcl);
+		netPath->timingAcl=createIpv4AccessList(rtOpts->timingAclPermitText,
+			rtOpts->timingAclDenyText, rtOpts->timingAclOrder);
+	}
+	if(rtOpts->managementAclEnabled) {
+		freeIpv4AccessList(&netPath->managementAcl);
+		netPath->managementAcl=createIpv4AccessList(rtOpts->managementAclPermitText,
+			rtOpts->managementAclDenyText, rtOpts->managementAclOrder);
+	}
+
+	return TRUE;
+}
+
+Boolean
+netShutdown(NetPath * netPath)
+{
+	netPath->eventSock = -1;
+	netPath->generalSock = -1;
+
+	freeIpv4AccessList(&netPath->timingAcl);
+	freeIpv4AccessList(&netPath->managementAcl);
+
+	return TRUE;
+}
+
+Boolean
+netRefreshIGMP(NetPath * netPath, const RunTimeOpts * rtOpts, PtpClock * ptpClock)
+{
+	return TRUE;
+}
+
+/*
+ * Wait for the engine's sockets: let simulated time pass until a packet
+ * is waiting, a timer expires or the timeout runs out. The run ends here.
+ */
+int
+netSelect(TimeInternal * timeout, NetPath **netPaths, int count, fd_set *readfds)
+{
+	int64_t limit = SIM_NEVER;
+	int64_t end = simConfig.startTime + simConfig.duration;
+	int64_t next, deadline;
+	SimEvent event;
+	int ready;
+
+	FD_ZERO(readfds);
+
+	if (timeout) {
+		if(isTimeInternalNegative(timeout)) {
+			ERROR("Negative timeout attempted for select()\n");
+			return -1;
+		}
+		limit = simNow() + (int64_t)timeout->seconds * SIM_NS + timeout->nanoseconds;
+	}
+
+	for(;;) {
+		simWatch();
+
+		if(eventQueue != NULL || generalQueue != NULL) {
+			ready = 0;
+			if(eventQueue != NULL) {
+				FD_SET(SIM_EVENT_FD, readfds);
+				ready++;
+			}
+			if(generalQueue != NULL) {
+				FD_SET(SIM_GENERAL_FD, readfds);
+				ready++;
+			}
+			return ready;
+		}
+
+		if(simTimersExpire(simNow()) || simNow() >= limit) {
+			return 0;
+		}
+
+		if(simNow() >= end) {
+			simFinish();
+		}
+
+		next = end;
+		if(limit < next) {
+			next = limit;
+		}
+		if((deadline = simTimersNextDeadline()) < next) {
+			next = deadline;
+		}
+		if(eventCount > 0 && events[0].time < next) {
+			next = events[0].time;
+		}
+
+		simAdvance(next);
+
+		while(eventCount > 0 && events[0].time <= simNow()) {
+			event = popEvent();
+			runEvent(&event, simNow());
+		}
+	}
+}
+
+ssize_t
+netRecvEvent(Octet * buf, TimeInternal * time, NetPath * netPath, int flags)
+{
+	SimPacket *packet = dequeue(&eventQueue, &eventQueueTail);
+	ssize_t length;
+
+	if(packet == NULL) {
+		return 0;
+	}
+
+	memcpy(buf, packet->data, packet->length);
+	length = packet->length;
+	*time = packet->rxTimestamp;
+
+	netPath->lastSourceAddr = packet->src;
+	netPath->lastDestAddr = packet->dst;
+	if(netPath->lastSourceAddr != netPath->interfaceAddr.s_addr) {
+		netPath->receivedPackets++;
+	}
+	netPath->receivedPacketsTotal++;
+
+	free(packet);
+
+	return length;
+}
+
+ssize_t
+netRecvGeneral(Octet * buf, NetPath * netPath)
+{
+	SimPacket *packet = dequeue(&generalQueue, &generalQueueTail);
+	ssize_t length;
+
+	if(packet == NULL) {
+		return 0;
+	}
+
+	memcpy(buf, packet->data, packet->length);
+	length = packet->length;
+
+	netPath->lastSourceAddr = packet->src;
+	if(netPath->lastSourceAddr != netPath->interfaceAddr.s_addr) {
+		netPath->receivedPackets++;
+	}
+	netPath->receivedPacketsTotal++;
+
+	free(packet);
+
+	return length;
+}
+
+/* send from the engine, to a unicast destination or the given multicast group */
+static ssize_t
+engineSend(Octet * buf, UInteger16 length, NetPath * netPath, Boolean event,
+	   Integer32 destinationAddress, Integer32 group, TimeInternal * tim)
+{
+	if (destinationAddress) {
+		/* as in net.c: unicast is flagged in the message itself */
+		*(char *)(buf + 6) |= PTP_UNICAST;
+	} else {
+		destinationAddress = group;
+	}
+
+	/* the TX timestamp is taken as the packet leaves */
+	if (tim != NULL) {
+		engineTimestamp(simNow(), tim);
+	}
+
+	simSend(buf, length, event, netPath->interfaceAddr.s_addr, destinationAddress);
+
+	netPath->sentPackets++;
+	netPath->sentPacketsTotal++;
+
+	return length;
+}
+
+ssize_t
+netSendEvent(Octet * buf, UInteger16 length, NetPath * netPath,
+	     const RunTimeOpts *rtOpts, Integer32 destinationAddress, TimeInternal * tim)
+{
+	return engineSend(buf, length, netPath, TRUE, destinationAddress, netPath->multicastAddr, tim);
+}
+
+ssize_t
+netSendGeneral(Octet * buf, UInteger16 length, NetPath * netPath,
+	       const RunTimeOpts *rtOpts, Integer32 destinationAddress)
+{
+	return engineSend(buf, length, netPath, FALSE, destinationAddress, netPath->multicastAddr, NULL);
+}
+
+ssize_t
+netSendPeerGeneral(Octet * buf, UInteger16 length, NetPath * netPath, const RunTimeOpts *rtOpts, Integer32 dst)
+{
+	return engineSend(buf, length, netPath, FALSE, dst, netPath->peerMulticastAddr, NULL);
+}
+
+ssize_t
+netSendPeerEvent(Octet * buf, UInteger16 length, NetPath * netPath, const RunTimeOpts *rtOpts, Integer32 dst, TimeInternal * tim)
+{
+	return engineSend(buf, length, netPath, TRUE, dst, netPath->peerMulticastAddr, tim);
+}
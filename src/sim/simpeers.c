@@ -0,0 +1,646 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   simpeers.c
+ * @date   Tue Apr 12 09:20:15 2016
+ *
+ * @brief  The simulated nodes the engine talks to
+ *
+ * Grandmasters send multicast Announce and two-step Sync, and answer
+ * Delay_Req and Pdelay_Req, from a perfect clock offset from true time.
+ * Unicast slaves negotiate Announce, Sync and Delay_Resp with the engine,
+ * renew their grants and send Delay_Req, and keep statistics on what the
+ * engine sends them. All messages are built and parsed by msg.c, through
+ * a scratch PtpClock set up as the node sending.
+ */
+
+#include "sim.h"
+
+#define SIM_RETRY_INTERVAL	(5 * SIM_NS)
+
+static PtpClock *scratch = NULL;
+static const void *scratchOwner = NULL;
+
+static SimSlave *slaves = NULL;
+
+/* what the slaves saw, summed over all of them */
+static struct {
+	uint64_t requests;
+	uint64_t grants;
+	uint64_t denials;
+	uint64_t expiries;
+	uint64_t announce;
+	uint64_t sync;
+	uint64_t followUp;
+	uint64_t syncLost;
+	uint64_t delayReq;
+	uint64_t delayResp;
+	uint64_t delayRespLate;
+	SimStat syncInterval;	/* deviation from the granted interval, ns */
+	SimStat delayRespLatency;	/* Delay_Req to Delay_Resp, ns */
+} slaveStats;
+
+static const Enumeration8 grantMessageTypes[SIM_GRANT_TYPES] = {
+	ANNOUNCE, SYNC, DELAY_RESP
+};
+
+static int64_t
+logInterval(Integer8 log)
+{
+	return llround(pow(2, log) * SIM_NS);
+}
+
+/* a clock identity made from an IPv4 address, EUI-64 style */
+static void
+addressIdentity(Integer32 address, PortIdentity *identity)
+{
+	uint32_t host = ntohl(address);
+
+	memset(identity, 0, sizeof(PortIdentity));
+	identity->clockIdentity[0] = 0x02;
+	identity->clockIdentity[1] = 0x00;
+	identity->clockIdentity[2] = (host >> 24) & 0xFF;
+	identity->clockIdentity[3] = 0xFF;
+	identity->clockIdentity[4] = 0xFE;
+	identity->clockIdentity[5] = (host >> 16) & 0xFF;
+	identity->clockIdentity[6] = (host >> 8) & 0xFF;
+	identity->clockIdentity[7] = host & 0xFF;
+	identity->portNumber = 1;
+}
+
+static SimMaster*
+findMaster(Integer32 address)
+{
+	int i;
+
+	for(i = 0; i < simConfig.masterCount; i++) {
+		if(simConfig.masters[i].address == address) {
+			return &simConfig.masters[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* slaves live at 10.1.0.1 onwards */
+static SimSlave*
+findSlave(Integer32 address)
+{
+	int64_t index = (int64_t)ntohl(address) - 0x0A010001;
+
+	if(index < 0 || index >= simConfig.slaveCount) {
+		return NULL;
+	}
+
+	return &slaves[index];
+}
+
+/* the time on a master's clock: PTP timescale, so UTC plus the UTC offset */
+static int64_t
+masterTime(const SimMaster *master, int64_t now)
+{
+	return now + (int64_t)master->utcOffset * SIM_NS + master->offset;
+}
+
+/* set the scratch clock up as a master */
+static void
+becomeMaster(SimMaster *master)
+{
+	if(scratchOwner == master) {
+		return;
+	}
+
+	scratchOwner = master;
+
+	copyPortIdentity(&scratch->portDS.portIdentity, &master->portIdentity);
+	scratch->portDS.transportSpecific = 0;
+	scratch->portDS.versionNumber = 2;
+	scratch->portDS.logSyncInterval = master->logSyncInterval;
+	scratch->portDS.logAnnounceInterval = master->logAnnounceInterval;
+	scratch->portDS.logMinDelayReqInterval = 0;
+	scratch->defaultDS.domainNumber = master->domainNumber;
+	scratch->defaultDS.twoStepFlag = TRUE;
+	scratch->defaultDS.clockQuality.clockClass = master->clockClass;
+	scratch->defaultDS.clockQuality.clockAccuracy = master->clockAccuracy;
+	scratch->defaultDS.clockQuality.offsetScaledLogVariance = 0x4E5D;
+	scratch->parentDS.grandmasterPriority1 = master->priority1;
+	scratch->parentDS.grandmasterPriority2 = master->priority2;
+	copyClockIdentity(scratch->parentDS.grandmasterIdentity, master->portIdentity.clockIdentity);
+	scratch->currentDS.stepsRemoved = 0;
+	scratch->timePropertiesDS.currentUtcOffset = master->utcOffset;
+	scratch->timePropertiesDS.currentUtcOffsetValid = TRUE;
+	scratch->timePropertiesDS.ptpTimescale = TRUE;
+	scratch->timePropertiesDS.timeTraceable = TRUE;
+	scratch->timePropertiesDS.frequencyTraceable = TRUE;
+	scratch->timePropertiesDS.leap59 = FALSE;
+	scratch->timePropertiesDS.leap61 = FALSE;
+	scratch->timePropertiesDS.timeSource = GPS;
+
+	msgPackTemplates(scratch);
+}
+
+/* set the scratch clock up as a slave */
+static void
+becomeSlave(SimSlave *slave)
+{
+	if(scratchOwner == slave) {
+		return;
+	}
+
+	scratchOwner = slave;
+
+	copyPortIdentity(&scratch->portDS.portIdentity, &slave->portIdentity);
+	scratch->portDS.transportSpecific = 0;
+	scratch->portDS.versionNumber = 2;
+	scratch->defaultDS.domainNumber = simConfig.slaveDomainNumber;
+	scratch->defaultDS.twoStepFlag = TRUE;
+}
+
+static void
+scheduleMaster(SimMaster *master, int64_t time)
+{
+	if(time < master->stop) {
+		simSchedule(time, SIM_EVENT_MASTER, master);
+	}
+}
+
+/* only the earliest wakeup asked for is kept: runs at any other time are stale */
+static void
+scheduleSlave(SimSlave *slave, int64_t time)
+{
+	if(time < slave->nextWakeup) {
+		slave->nextWakeup = time;
+		simSchedule(time, SIM_EVENT_SLAVE, slave);
+	}
+}
+
+Boolean
+simPeersInit(void)
+{
+	SimMaster *master;
+	SimSlave *slave;
+	int64_t start;
+	int i, j;
+
+	if((scratch = calloc(1, sizeof(PtpClock))) == NULL) {
+		PERROR("Could not allocate simulated peer clock");
+		return FALSE;
+	}
+
+	for(i = 0; i < simConfig.masterCount; i++) {
+		master = &simConfig.masters[i];
+		addressIdentity(master->address, &master->portIdentity);
+		master->active = FALSE;
+		scheduleMaster(master, master->start);
+	}
+
+	if(simConfig.slaveCount > 0) {
+		if((slaves = calloc(simConfig.slaveCount, sizeof(SimSlave))) == NULL) {
+			PERROR("Could not allocate %d simulated slaves", simConfig.slaveCount);
+			return FALSE;
+		}
+	}
+
+	for(i = 0; i < simConfig.slaveCount; i++) {
+		slave = &slaves[i];
+		slave->number = i + 1;
+		slave->address = htonl(0x0A010001 + i);
+		addressIdentity(slave->address, &slave->portIdentity);
+		slave->nextWakeup = SIM_NEVER;
+		slave->nextDelayReq = SIM_NEVER;
+		/* slaves come up spread evenly over the ramp */
+		start = simConfig.slavesStart + simConfig.slavesRamp * i / simConfig.slaveCount;
+		for(j = 0; j < SIM_GRANT_TYPES; j++) {
+			slave->grants[j].nextRequest = start;
+		}
+		scheduleSlave(slave, start);
+	}
+
+	return TRUE;
+}
+
+int64_t
+simPeerDelay(Integer32 address)
+{
+	SimMaster *master = findMaster(address);
+
+	return master != NULL ? master->delay : simConfig.delay;
+}
+
+/* the masters a multicast from the engine reaches */
+int
+simPeersMulticastTargets(Integer32 *targets, int max)
+{
+	int i, count = 0;
+
+	for(i = 0; i < simConfig.masterCount && count < max; i++) {
+		if(simConfig.masters[i].active) {
+			targets[count++] = simConfig.masters[i].address;
+		}
+	}
+
+	return count;
+}
+
+/* Sync and Announce when due; masters only run between start and stop */
+void
+simMasterRun(SimMaster *master)
+{
+	Octet buf[PACKET_SIZE];
+	Timestamp timestamp;
+	int64_t now = simNow();
+	int64_t next;
+
+	if(now >= master->stop) {
+		if(master->active) {
+			DBG("sim: master %d stopped\n", master->number);
+		}
+		master->active = FALSE;
+		return;
+	}
+
+	if(!master->active) {
+		DBG("sim: master %d started\n", master->number);
+		master->active = TRUE;
+		master->nextAnnounce = now;
+		master->nextSync = now;
+	}
+
+	becomeMaster(master);
+
+	if(now >= master->nextAnnounce) {
+		simNsToTimestamp(masterTime(master, now), &timestamp);
+		msgPackAnnounce(buf, master->announceSequenceId++, &timestamp, scratch);
+		simSend(buf, ANNOUNCE_LENGTH, FALSE, master->address, simMulticastAddress(FALSE));
+		master->nextAnnounce += logInterval(master->logAnnounceInterval);
+	}
+
+	if(now >= master->nextSync) {
+		/* two-step: the precise origin timestamp follows */
+		simNsToTimestamp(masterTime(master, now), &timestamp);
+		msgPackSync(buf, master->syncSequenceId, &timestamp, scratch);
+		simSend(buf, SYNC_LENGTH, TRUE, master->address, simMulticastAddress(FALSE));
+		msgPackFollowUp(buf, &timestamp, scratch, master->syncSequenceId);
+		simSend(buf, FOLLOW_UP_LENGTH, FALSE, master->address, simMulticastAddress(FALSE));
+		master->syncSequenceId++;
+		master->syncSent++;
+		master->nextSync += logInterval(master->logSyncInterval);
+	}
+
+	next = master->nextSync < master->nextAnnounce ? master->nextSync : master->nextAnnounce;
+	/* wake up at stop time to go quiet */
+	scheduleMaster(master, next);
+	if(next >= master->stop) {
+		simSchedule(master->stop, SIM_EVENT_MASTER, master);
+	}
+}
+
+static void
+masterReceive(SimMaster *master, SimPacket *packet, const MsgHeader *header, int64_t now)
+{
+	Octet buf[PACKET_SIZE];
+	Timestamp timestamp;
+	MsgHeader request = *header;
+	Integer32 dst;
+
+	if(!master->active || header->domainNumber != master->domainNumber) {
+		return;
+	}
+
+	becomeMaster(master);
+	simNsToTimestamp(masterTime(master, now), &timestamp);
+
+	switch(header->messageType) {
+	case DELAY_REQ:
+		/* answer unicast requests with unicast */
+		dst = (header->flagField0 & PTP_UNICAST) ? packet->src : simMulticastAddress(FALSE);
+		msgPackDelayResp(buf, &request, &timestamp, scratch);
+		if(header->flagField0 & PTP_UNICAST) {
+			buf[6] |= PTP_UNICAST;
+		}
+		simSend(buf, DELAY_RESP_LENGTH, FALSE, master->address, dst);
+		master->delayRespSent++;
+		break;
+	case PDELAY_REQ:
+		dst = (header->flagField0 & PTP_UNICAST) ? packet->src : simMulticastAddress(TRUE);
+		/* turnaround is instant: t2 == t3 */
+		msgPackPdelayResp(buf, &request, &timestamp, scratch);
+		simSend(buf, PDELAY_RESP_LENGTH, TRUE, master->address, dst);
+		msgPackPdelayRespFollowUp(buf, &request, &timestamp, scratch, header->sequenceId);
+		simSend(buf, PDELAY_RESP_FOLLOW_UP_LENGTH, FALSE, master->address, dst);
+		master->pdelayRespSent++;
+		break;
+	default:
+		break;
+	}
+}
+
+/* request one message type from the engine */
+static void
+slaveRequest(SimSlave *slave, int type, int64_t now)
+{
+	Octet buf[PACKET_SIZE];
+	MsgSignaling outgoing;
+	SignalingTLV tlv;
+	SMRequestUnicastTransmission request;
+
+	becomeSlave(slave);
+
+	memset(&outgoing, 0, sizeof(outgoing));
+	memset(&tlv, 0, sizeof(tlv));
+	memset(&request, 0, sizeof(request));
+
+	/* as prepareSMRequestUnicastTransmission() builds it */
+	outgoing.header.transportSpecific = scratch->portDS.transportSpecific;
+	outgoing.header.messageType = SIGNALING;
+	outgoing.header.versionPTP = scratch->portDS.versionNumber;
+	outgoing.header.domainNumber = scratch->defaultDS.domainNumber;
+	outgoing.header.flagField0 = PTP_UNICAST;
+	copyPortIdentity(&outgoing.header.sourcePortIdentity, &slave->portIdentity);
+	outgoing.header.sequenceId = slave->signalingSequenceId++;
+	outgoing.header.controlField = 0x5;
+	outgoing.header.logMessageInterval = 0x7F;
+	memset(&outgoing.targetPortIdentity, 0xFF, sizeof(PortIdentity));
+
+	request.messageType = grantMessageTypes[type];
+	switch(type) {
+	case SIM_GRANT_ANNOUNCE:
+		request.logInterMessagePeriod = simConfig.slaveLogAnnounceInterval;
+		break;
+	case SIM_GRANT_SYNC:
+		request.logInterMessagePeriod = simConfig.slaveLogSyncInterval;
+		break;
+	default:
+		request.logInterMessagePeriod = simConfig.slaveLogDelayReqInterval;
+		break;
+	}
+	request.durationField = simConfig.slaveGrantDuration;
+
+	tlv.tlvType = TLV_REQUEST_UNICAST_TRANSMISSION;
+	tlv.valueField = (Octet*)&request;
+	outgoing.tlv = &tlv;
+
+	msgPackSignalingTLV(buf, &outgoing, scratch);
+	outgoing.header.messageLength = SIGNALING_LENGTH + TL_LENGTH + outgoing.tlv->lengthField;
+	msgPackSignaling(buf, &outgoing, scratch);
+
+	simSend(buf, outgoing.header.messageLength, FALSE, slave->address, simConfig.address);
+
+	slaveStats.requests++;
+	/* no answer: ask again */
+	slave->grants[type].nextRequest = now + SIM_RETRY_INTERVAL;
+}
+
+static void
+slaveDelayReq(SimSlave *slave, int64_t now)
+{
+	Octet buf[PACKET_SIZE];
+	Timestamp timestamp;
+
+	becomeSlave(slave);
+
+	if(slave->delayReqOutstanding) {
+		slaveStats.delayRespLate++;
+	}
+
+	simNsToTimestamp(now, &timestamp);
+	scratch->sentDelayReqSequenceId = ++slave->delayReqSequenceId;
+	msgPackDelayReq(buf, &timestamp, scratch);
+	buf[6] |= PTP_UNICAST;
+	simSend(buf, DELAY_REQ_LENGTH, TRUE, slave->address, simConfig.address);
+
+	slave->delayReqOutstanding = TRUE;
+	slave->delayReqSent = now;
+	slaveStats.delayReq++;
+}
+
+/* renew and re-request grants, expire them, and send Delay_Req when due */
+void
+simSlaveRun(SimSlave *slave)
+{
+	int64_t now = simNow();
+	int64_t next = SIM_NEVER;
+	SimGrant *grant;
+	int i;
+
+	if(now != slave->nextWakeup) {
+		return;
+	}
+	slave->nextWakeup = SIM_NEVER;
+
+	for(i = 0; i < SIM_GRANT_TYPES; i++) {
+		grant = &slave->grants[i];
+		if(grant->granted && grant->expires <= now) {
+			DBG("sim: slave %d: %s grant expired\n", slave->number, getMessageTypeName(grantMessageTypes[i]));
+			grant->granted = FALSE;
+			slaveStats.expiries++;
+		}
+		if(grant->nextRequest <= now) {
+			slaveRequest(slave, i, now);
+		}
+		if(grant->nextRequest < next) {
+			next = grant->nextRequest;
+		}
+		if(grant->granted && grant->expires < next) {
+			next = grant->expires;
+		}
+	}
+
+	if(slave->grants[SIM_GRANT_DELAY_RESP].granted) {
+		if(slave->nextDelayReq <= now) {
+			slaveDelayReq(slave, now);
+			slave->nextDelayReq = now + logInterval(simConfig.slaveLogDelayReqInterval);
+		}
+		if(slave->nextDelayReq < next) {
+			next = slave->nextDelayReq;
+		}
+	}
+
+	scheduleSlave(slave, next);
+}
+
+static void
+slaveGrant(SimSlave *slave, SimPacket *packet, const MsgHeader *header, int64_t now)
+{
+	MsgSignaling signaling;
+	SMGrantUnicastTransmission *data;
+	SimGrant *grant;
+	int tlvOffset = 0;
+	int i;
+
+	becomeSlave(slave);
+	memset(&signaling, 0, sizeof(signaling));
+
+	while(msgUnpackSignaling(packet->data, &signaling, (MsgHeader*)header, scratch, tlvOffset)) {
+		if(signaling.tlv->tlvType == TLV_GRANT_UNICAST_TRANSMISSION) {
+			unpackSMGrantUnicastTransmission(packet->data + tlvOffset, &signaling, scratch);
+			data = (SMGrantUnicastTransmission*)signaling.tlv->valueField;
+			for(i = 0; i < SIM_GRANT_TYPES; i++) {
+				if(grantMessageTypes[i] != data->messageType) {
+					continue;
+				}
+				grant = &slave->grants[i];
+				if(data->durationField > 0) {
+					grant->granted = TRUE;
+					grant->expires = now + (int64_t)data->durationField * SIM_NS;
+					/* renew with a quarter of the grant left */
+					grant->nextRequest = now + (int64_t)data->durationField * SIM_NS * 3 / 4;
+					slaveStats.grants++;
+					if(i == SIM_GRANT_DELAY_RESP && slave->nextDelayReq == SIM_NEVER) {
+						slave->nextDelayReq = now;
+					}
+				} else {
+					DBG("sim: slave %d: %s denied\n", slave->number, getMessageTypeName(grantMessageTypes[i]));
+					grant->granted = FALSE;
+					grant->nextRequest = now + SIM_RETRY_INTERVAL;
+					slaveStats.denials++;
+				}
+			}
+		}
+		tlvOffset += TL_LENGTH + signaling.tlv->lengthField;
+		freeSignalingTLV(&signaling);
+	}
+
+	if(slave->nextDelayReq < now) {
+		slave->nextDelayReq = now;
+	}
+	scheduleSlave(slave, slave->grants[SIM_GRANT_DELAY_RESP].granted ? slave->nextDelayReq : SIM_NEVER);
+	for(i = 0; i < SIM_GRANT_TYPES; i++) {
+		scheduleSlave(slave, slave->grants[i].nextRequest);
+	}
+}
+
+static void
+slaveReceive(SimSlave *slave, SimPacket *packet, const MsgHeader *header, int64_t now)
+{
+	MsgDelayResp resp;
+	int64_t expected;
+	UInteger16 lost;
+
+	switch(header->messageType) {
+	case ANNOUNCE:
+		slaveStats.announce++;
+		break;
+	case SYNC:
+		slaveStats.sync++;
+		if(slave->syncSeen) {
+			lost = header->sequenceId - slave->lastSyncSequenceId - 1;
+			slaveStats.syncLost += lost;
+			if(!lost) {
+				expected = logInterval(simConfig.slaveLogSyncInterval);
+				simStatAdd(&slaveStats.syncInterval, now - slave->lastSyncArrival - expected);
+			}
+		}
+		slave->syncSeen = TRUE;
+		slave->lastSyncSequenceId = header->sequenceId;
+		slave->lastSyncArrival = now;
+		break;
+	case FOLLOW_UP:
+		slaveStats.followUp++;
+		break;
+	case DELAY_RESP:
+		msgUnpackDelayResp(packet->data, &resp);
+		if(!slave->delayReqOutstanding || header->sequenceId != slave->delayReqSequenceId ||
+		    memcmp(&resp.requestingPortIdentity, &slave->portIdentity, sizeof(PortIdentity))) {
+			break;
+		}
+		slave->delayReqOutstanding = FALSE;
+		slaveStats.delayResp++;
+		simStatAdd(&slaveStats.delayRespLatency, now - slave->delayReqSent);
+		break;
+	case SIGNALING:
+		slaveGrant(slave, packet, header, now);
+		break;
+	default:
+		break;
+	}
+}
+
+/* a packet from the engine reaches a simulated node */
+void
+simPeerReceive(SimPacket *packet, int64_t now)
+{
+	MsgHeader header;
+	SimMaster *master;
+	SimSlave *slave;
+
+	if(packet->length < HEADER_LENGTH) {
+		return;
+	}
+
+	msgUnpackHeader(packet->data, &header);
+
+	if((master = findMaster(packet->to)) != NULL) {
+		masterReceive(master, packet, &header, now);
+	} else if((slave = findSlave(packet->to)) != NULL) {
+		slaveReceive(slave, packet, &header, now);
+	}
+}
+
+void
+simPeersReport(FILE *out)
+{
+	SimMaster *master;
+	int i, j, served = 0;
+
+	for(i = 0; i < simConfig.masterCount; i++) {
+		master = &simConfig.masters[i];
+		fprintf(out, "master %-2d %-15s Sync %llu, Delay_Resp %llu, Pdelay_Resp %llu\n",
+		    master->number, inet_ntoa(*(struct in_addr*)&master->address),
+		    (unsigned long long)master->syncSent, (unsigned long long)master->delayRespSent,
+		    (unsigned long long)master->pdelayRespSent);
+	}
+
+	if(!simConfig.slaveCount) {
+		return;
+	}
+
+	for(i = 0; i < simConfig.slaveCount; i++) {
+		for(j = 0; j < SIM_GRANT_TYPES && slaves[i].grants[j].granted; j++);
+		if(j == SIM_GRANT_TYPES) {
+			served++;
+		}
+	}
+
+	fprintf(out, "slaves:   %d of %d holding all grants at the end\n", served, simConfig.slaveCount);
+	fprintf(out, "  grants: %llu requested, %llu granted, %llu denied, %llu expired\n",
+	    (unsigned long long)slaveStats.requests, (unsigned long long)slaveStats.grants,
+	    (unsigned long long)slaveStats.denials, (unsigned long long)slaveStats.expiries);
+	fprintf(out, "  received: Announce %llu, Sync %llu, Follow_Up %llu, Sync lost %llu\n",
+	    (unsigned long long)slaveStats.announce, (unsigned long long)slaveStats.sync,
+	    (unsigned long long)slaveStats.followUp, (unsigned long long)slaveStats.syncLost);
+	fprintf(out, "  Sync interval error: mean %.0f ns, std dev %.0f ns, min %.0f ns, max %.0f ns\n",
+	    simStatMean(&slaveStats.syncInterval), simStatStdDev(&slaveStats.syncInterval),
+	    slaveStats.syncInterval.min, slaveStats.syncInterval.max);
+	fprintf(out, "  Delay_Req %llu, Delay_Resp %llu, unanswered %llu\n",
+	    (unsigned long long)slaveStats.delayReq, (unsigned long long)slaveStats.delayResp,
+	    (unsigned long long)slaveStats.delayRespLate);
+	fprintf(out, "  Delay_Resp latency: mean %.0f ns, std dev %.0f ns, max %.0f ns\n",
+	    simStatMean(&slaveStats.delayRespLatency), simStatStdDev(&slaveStats.delayRespLatency),
+	    slaveStats.delayRespLatency.max);
+}
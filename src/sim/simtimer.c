@@ -0,0 +1,203 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   simtimer.c
+ * @date   Tue Apr 12 09:20:15 2016
+ *
+ * @brief  EventTimer implementation running on simulated time
+ *
+ * Timers are periodic like their timerfd counterparts: an expired timer
+ * is re-armed one interval later and its expiry latched until
+ * isExpired() is called. Expiries are only ever found by netSelect(),
+ * which never lets time pass a running timer's deadline.
+ */
+
+#include "sim.h"
+
+static void eventTimerStart_sim(EventTimer *timer, double interval);
+static void eventTimerStop_sim(EventTimer *timer);
+static void eventTimerReset_sim(EventTimer *timer);
+static void eventTimerShutdown_sim(EventTimer *timer);
+static Boolean eventTimerIsRunning_sim(EventTimer *timer);
+static Boolean eventTimerIsExpired_sim(EventTimer *timer);
+
+/* all timers set up, in the order they were set up - iterated on every wakeup */
+static EventTimer **timers = NULL;
+static int timerCount = 0;
+static int timerCapacity = 0;
+
+void
+setupEventTimer(EventTimer *timer)
+{
+	EventTimer **grown;
+
+	if(timer == NULL) {
+	    return;
+	}
+
+	memset(timer, 0, sizeof(EventTimer));
+
+	timer->start = eventTimerStart_sim;
+	timer->stop = eventTimerStop_sim;
+	timer->reset = eventTimerReset_sim;
+	timer->shutdown = eventTimerShutdown_sim;
+	timer->isExpired = eventTimerIsExpired_sim;
+	timer->isRunning = eventTimerIsRunning_sim;
+
+	if(timerCount == timerCapacity) {
+	    timerCapacity = timerCapacity ? timerCapacity * 2 : 32;
+	    if((grown = realloc(timers, timerCapacity * sizeof(EventTimer*))) == NULL) {
+		PERROR("Could not register simulated timer");
+		exit(1);
+	    }
+	    timers = grown;
+	}
+
+	timers[timerCount++] = timer;
+}
+
+static void
+eventTimerStart_sim(EventTimer *timer, double interval)
+{
+	timer->simInterval = interval * 1E9;
+
+	if(timer->simInterval < EVENTTIMER_MIN_INTERVAL_US * 1000) {
+	    timer->simInterval = EVENTTIMER_MIN_INTERVAL_US * 1000;
+	}
+
+	timer->simDeadline = simNow() + timer->simInterval;
+	timer->expired = FALSE;
+	timer->running = TRUE;
+
+	DBG2("timerStart:     Set timer %s to %f\n", timer->id, interval);
+}
+
+static void
+eventTimerStop_sim(EventTimer *timer)
+{
+	timer->running = FALSE;
+	DBG2("timerStop: stopped timer %s\n", timer->id);
+}
+
+static void
+eventTimerReset_sim(EventTimer *timer)
+{
+}
+
+static void
+eventTimerShutdown_sim(EventTimer *timer)
+{
+	int i;
+
+	for(i = 0; i < timerCount; i++) {
+	    if(timers[i] == timer) {
+		memmove(&timers[i], &timers[i + 1], (timerCount - i - 1) * sizeof(EventTimer*));
+		timerCount--;
+		return;
+	    }
+	}
+}
+
+static Boolean
+eventTimerIsRunning_sim(EventTimer *timer)
+{
+	DBG2("timerIsRunning:   Timer %s %s running\n", timer->id,
+		timer->running ? "is" : "is not");
+
+	return timer->running;
+}
+
+static Boolean
+eventTimerIsExpired_sim(EventTimer *timer)
+{
+	Boolean ret = timer->expired;
+
+	DBG2("timerIsExpired:   Timer %s %s expired\n", timer->id,
+		timer->expired ? "is" : "is not");
+
+	if(ret) {
+	    timer->expired = FALSE;
+	}
+
+	return ret;
+}
+
+/*
+ * Latch the expiry of every running timer whose deadline has come,
+ * and re-arm it. Returns TRUE if any expired.
+ */
+Boolean
+simTimersExpire(int64_t now)
+{
+	Boolean fired = FALSE;
+	EventTimer *timer;
+	int i;
+
+	for(i = 0; i < timerCount; i++) {
+	    timer = timers[i];
+	    if(!timer->running || timer->simDeadline > now) {
+		continue;
+	    }
+	    /* overruns collapse into one expiry, as with timerfd */
+	    while(timer->simDeadline <= now) {
+		timer->simDeadline += timer->simInterval;
+	    }
+	    timer->expired = TRUE;
+	    fired = TRUE;
+	    DBGV("Timer %s expired\n", timer->id);
+	}
+
+	return fired;
+}
+
+/* the earliest deadline of all running timers, SIM_NEVER if none runs */
+int64_t
+simTimersNextDeadline(void)
+{
+	int64_t next = SIM_NEVER;
+	int i;
+
+	for(i = 0; i < timerCount; i++) {
+	    if(timers[i]->running && timers[i]->simDeadline < next) {
+		next = timers[i]->simDeadline;
+	    }
+	}
+
+	return next;
+}
+
+void
+startEventTimers(void)
+{
+	DBG("initTimer\n");
+}
+
+void
+shutdownEventTimers(void)
+{
+}
@@ -0,0 +1,376 @@
+/*-
+ * Copyright (c) 2016      PTPd developers
+ *
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file   simtrace.c
+ * @date   Tue Apr 12 09:20:15 2016
+ *
+ * @brief  pcap trace replay and capture for the simulation
+ *
+ * Replay reads a classic pcap file (not pcapng), microsecond or nanosecond
+ * resolution, either byte order, captured on Ethernet (VLAN tags allowed),
+ * Linux cooked or raw IP links, and feeds the engine every IPv4 UDP packet
+ * to or from port 319 or 320. A packet arrives at the engine at its
+ * capture time, so a trace taken on the host the engine stands in for
+ * replays with the delays it was recorded with. Packets sent from the
+ * engine's own address are that host's own traffic, and are skipped.
+ *
+ * Capture writes every packet on the simulated network as raw IPv4 with
+ * nanosecond timestamps in true time, for reading with any pcap tool.
+ */
+
+#include "sim.h"
+
+#define PCAP_MAGIC_USEC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define PCAP_HEADER_LENGTH	24
+#define PCAP_RECORD_LENGTH	16
+
+#define LINKTYPE_ETHERNET	1
+#define LINKTYPE_RAW_BSD	12
+#define LINKTYPE_RAW_OPENBSD	14
+#define LINKTYPE_RAW		101
+#define LINKTYPE_LINUX_SLL	113
+#define LINKTYPE_IPV4		228
+
+#define SIM_TRACE_SNAPLEN	65535
+
+static FILE *traceFile = NULL;
+static Boolean traceSwapped;
+static Boolean traceNanoseconds;
+static UInteger32 traceLinkType;
+static int64_t traceFirst = -1;
+static uint64_t traceSkipped = 0;
+
+static FILE *captureFile = NULL;
+
+/* one record at a time */
+static unsigned char traceData[SIM_TRACE_SNAPLEN];
+
+/* byte-swap helpers: pcap headers are in the byte order of the host that wrote them */
+static UInteger32
+swap32(UInteger32 word)
+{
+	return ((word & 0xFF) << 24) | ((word & 0xFF00) << 8) |
+	    ((word >> 8) & 0xFF00) | ((word >> 24) & 0xFF);
+}
+
+static UInteger32
+readWord(const unsigned char *buf)
+{
+	UInteger32 word;
+
+	memcpy(&word, buf, sizeof(word));
+	return traceSwapped ? swap32(word) : word;
+}
+
+/* read one record: its capture time in ns, and its data */
+static Boolean
+readRecord(int64_t *time, unsigned char *data, UInteger32 *length)
+{
+	unsigned char record[PCAP_RECORD_LENGTH];
+	UInteger32 captured;
+
+	if(fread(record, PCAP_RECORD_LENGTH, 1, traceFile) != 1) {
+		return FALSE;
+	}
+
+	*time = (int64_t)readWord(record) * SIM_NS +
+	    (int64_t)readWord(record + 4) * (traceNanoseconds ? 1 : 1000);
+	captured = readWord(record + 8);
+
+	if(captured > SIM_TRACE_SNAPLEN) {
+		ERROR("sim: corrupt trace record of %u bytes\n", captured);
+		return FALSE;
+	}
+
+	if(fread(data, captured, 1, traceFile) != 1) {
+		return FALSE;
+	}
+
+	*length = captured;
+	return TRUE;
+}
+
+/* find the IPv4 header in a link layer frame, -1 if there is none */
+static int
+ipOffset(const unsigned char *data, UInteger32 length)
+{
+	int offset;
+	UInteger16 type;
+
+	switch(traceLinkType) {
+	case LINKTYPE_ETHERNET:
+		offset = 12;
+		if(length < offset + 2) {
+			return -1;
+		}
+		type = (data[offset] << 8) | data[offset + 1];
+		/* skip VLAN tags */
+		while((type == 0x8100 || type == 0x88A8) && length >= offset + 6) {
+			offset += 4;
+			type = (data[offset] << 8) | data[offset + 1];
+		}
+		return type == 0x0800 ? offset + 2 : -1;
+	case LINKTYPE_LINUX_SLL:
+		if(length < 16) {
+			return -1;
+		}
+		return ((data[14] << 8) | data[15]) == 0x0800 ? 16 : -1;
+	case LINKTYPE_RAW:
+	case LINKTYPE_RAW_BSD:
+	case LINKTYPE_RAW_OPENBSD:
+	case LINKTYPE_IPV4:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/* turn a frame into a packet for the engine, NULL if it is not PTP for it */
+static SimPacket*
+tracePacket(const unsigned char *data, UInteger32 length)
+{
+	const unsigned char *ip, *udp;
+	SimPacket *packet;
+	UInteger16 port, udpLength;
+	Integer32 src, dst;
+	int offset, headerLength;
+
+	if((offset = ipOffset(data, length)) < 0 || length < offset + 20) {
+		return NULL;
+	}
+
+	ip = data + offset;
+	headerLength = (ip[0] & 0x0F) * 4;
+
+	/* IPv4, UDP, not a fragment */
+	if((ip[0] >> 4) != 4 || ip[9] != 17 || ((ip[6] & 0x3F) | ip[7]) ||
+	    length < offset + headerLength + 8) {
+		return NULL;
+	}
+
+	memcpy(&src, ip + 12, 4);
+	memcpy(&dst, ip + 16, 4);
+
+	udp = ip + headerLength;
+	port = (udp[2] << 8) | udp[3];
+	udpLength = (udp[4] << 8) | udp[5];
+
+	if((port != PTP_EVENT_PORT && port != PTP_GENERAL_PORT) || src == simConfig.address ||
+	    udpLength < 8 + HEADER_LENGTH || udpLength - 8 > PACKET_SIZE ||
+	    length < offset + headerLength + udpLength) {
+		return NULL;
+	}
+
+	if((packet = calloc(1, sizeof(SimPacket))) == NULL) {
+		PERROR("Could not allocate replayed packet");
+		exit(1);
+	}
+
+	packet->length = udpLength - 8;
+	memcpy(packet->data, udp + 8, packet->length);
+	packet->event = (port == PTP_EVENT_PORT);
+	packet->src = src;
+	packet->dst = dst;
+	packet->to = simConfig.address;
+
+	return packet;
+}
+
+Boolean
+simTraceOpen(const char *fileName, int64_t *firstPacket)
+{
+	unsigned char header[PCAP_HEADER_LENGTH];
+	UInteger32 magic, length;
+	long start;
+
+	if((traceFile = fopen(fileName, "r")) == NULL) {
+		PERROR("Could not open trace file %s", fileName);
+		return FALSE;
+	}
+
+	if(fread(header, PCAP_HEADER_LENGTH, 1, traceFile) != 1) {
+		ERROR("sim: %s is too short for a pcap file\n", fileName);
+		goto fail;
+	}
+
+	memcpy(&magic, header, sizeof(magic));
+	traceSwapped = (magic == swap32(PCAP_MAGIC_USEC) || magic == swap32(PCAP_MAGIC_NSEC));
+	magic = readWord(header);
+
+	if(magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+		ERROR("sim: %s is not a pcap file (pcapng is not supported)\n", fileName);
+		goto fail;
+	}
+
+	traceNanoseconds = (magic == PCAP_MAGIC_NSEC);
+	traceLinkType = readWord(header + 20) & 0x0FFFFFFF;
+
+	if(traceLinkType != LINKTYPE_ETHERNET && traceLinkType != LINKTYPE_LINUX_SLL &&
+	    traceLinkType != LINKTYPE_RAW && traceLinkType != LINKTYPE_RAW_BSD &&
+	    traceLinkType != LINKTYPE_RAW_OPENBSD && traceLinkType != LINKTYPE_IPV4) {
+		ERROR("sim: unsupported link type %u in %s\n", traceLinkType, fileName);
+		goto fail;
+	}
+
+	/* the first record's time, then back to it */
+	start = ftell(traceFile);
+	if(!readRecord(&traceFirst, traceData, &length)) {
+		ERROR("sim: no packets in %s\n", fileName);
+		goto fail;
+	}
+	fseek(traceFile, start, SEEK_SET);
+
+	*firstPacket = traceFirst;
+	INFO("sim: replaying %s\n", fileName);
+	return TRUE;
+
+fail:
+	fclose(traceFile);
+	traceFile = NULL;
+	return FALSE;
+}
+
+/* the next packet for the engine and its simulated arrival time, NULL at the end */
+SimPacket*
+simTraceNext(int64_t *time)
+{
+	SimPacket *packet;
+	UInteger32 length;
+	int64_t captured;
+
+	if(traceFile == NULL) {
+		return NULL;
+	}
+
+	while(readRecord(&captured, traceData, &length)) {
+		if((packet = tracePacket(traceData, length)) != NULL) {
+			*time = captured - traceFirst + simConfig.startTime;
+			return packet;
+		}
+		traceSkipped++;
+	}
+
+	INFO("sim: end of trace, %llu records skipped\n", (unsigned long long)traceSkipped);
+	simTraceClose();
+	return NULL;
+}
+
+void
+simTraceClose(void)
+{
+	if(traceFile != NULL) {
+		fclose(traceFile);
+		traceFile = NULL;
+	}
+}
+
+Boolean
+simCaptureOpen(const char *fileName)
+{
+	UInteger32 header[6];
+
+	if((captureFile = fopen(fileName, "w")) == NULL) {
+		PERROR("Could not open capture file %s", fileName);
+		return FALSE;
+	}
+
+	header[0] = PCAP_MAGIC_NSEC;
+	header[1] = 2 | (4 << 16);	/* version 2.4, in host order like the rest */
+	header[2] = 0;
+	header[3] = 0;
+	header[4] = SIM_TRACE_SNAPLEN;
+	header[5] = LINKTYPE_RAW;
+
+	fwrite(header, sizeof(header), 1, captureFile);
+	return TRUE;
+}
+
+/* IPv4 header checksum */
+static UInteger16
+ipChecksum(const unsigned char *header)
+{
+	UInteger32 sum = 0;
+	int i;
+
+	for(i = 0; i < 20; i += 2) {
+		sum += (header[i] << 8) | header[i + 1];
+	}
+	while(sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+
+	return ~sum & 0xFFFF;
+}
+
+void
+simCapture(const SimPacket *packet, int64_t time)
+{
+	unsigned char frame[28 + PACKET_SIZE];
+	UInteger32 record[4];
+	UInteger16 port = packet->event ? PTP_EVENT_PORT : PTP_GENERAL_PORT;
+	UInteger16 total = 28 + packet->length;
+	UInteger16 checksum;
+
+	if(captureFile == NULL) {
+		return;
+	}
+
+	memset(frame, 0, 28);
+	frame[0] = 0x45;
+	frame[2] = total >> 8;
+	frame[3] = total & 0xFF;
+	frame[8] = 64;
+	frame[9] = 17;
+	memcpy(frame + 12, &packet->src, 4);
+	memcpy(frame + 16, &packet->dst, 4);
+	checksum = ipChecksum(frame);
+	frame[10] = checksum >> 8;
+	frame[11] = checksum & 0xFF;
+	frame[20] = frame[22] = port >> 8;
+	frame[21] = frame[23] = port & 0xFF;
+	frame[24] = (total - 20) >> 8;
+	frame[25] = (total - 20) & 0xFF;
+	memcpy(frame + 28, packet->data, packet->length);
+
+	record[0] = time / SIM_NS;
+	record[1] = time % SIM_NS;
+	record[2] = record[3] = total;
+
+	fwrite(record, sizeof(record), 1, captureFile);
+	fwrite(frame, total, 1, captureFile);
+}
+
+void
+simCaptureClose(void)
+{
+	if(captureFile != NULL) {
+		fclose(captureFile);
+		captureFile = NULL;
+	}
+}